@@ -14,22 +14,40 @@
  * limitations under the License.
  *
 */
+#include <algorithm>
 #include <functional>
+#include <boost/algorithm/string/replace.hpp>
+
+#include "gazebo/physics/physics.hh"
+#include "gazebo/transport/Node.hh"
+#include "NpsBeamScanKernel.hh"
 #include "NpsBeamSensor.hh"
 #include "NpsBeamPlugin.hh"
+#include "NpsBeamPluginPrivate.hh"
 
 using namespace gazebo;
 GZ_REGISTER_SENSOR_PLUGIN(NpsBeamPlugin)
 
 /////////////////////////////////////////////////
 NpsBeamPlugin::NpsBeamPlugin()
-: SensorPlugin(), width(0), height(0)
+: SensorPlugin(), width(0), height(0),
+  dataPtr(new NpsBeamPluginPrivate)
 {
 }
 
+/////////////////////////////////////////////////
+NpsBeamPlugin::~NpsBeamPlugin()
+{
+  this->newLaserFrameConnection.reset();
+
+  this->dataPtr->queue.Stop();
+  if (this->dataPtr->worker.joinable())
+    this->dataPtr->worker.join();
+}
+
 /////////////////////////////////////////////////
 void NpsBeamPlugin::Load(sensors::SensorPtr _sensor,
-                              sdf::ElementPtr /*_sdf*/)
+                              sdf::ElementPtr _sdf)
 {
   this->parentSensor =
     std::dynamic_pointer_cast<sensors::NpsBeamSensor>(_sensor);
@@ -40,8 +58,64 @@ void NpsBeamPlugin::Load(sensors::SensorPtr _sensor,
     return;
   }
 
-  this->width = this->parentSensor->RangeCount();
-  this->height = this->parentSensor->VerticalRangeCount();
+  // Raw frames hold one cell per ray
+  this->width = this->parentSensor->RayCount();
+  this->height = this->parentSensor->VerticalRayCount();
+
+  this->dataPtr->world = physics::get_world(this->parentSensor->WorldName());
+  this->dataPtr->parentEntity =
+    this->dataPtr->world->EntityByName(this->parentSensor->ParentName());
+
+  this->dataPtr->node = transport::NodePtr(new transport::Node());
+  this->dataPtr->node->Init(this->parentSensor->WorldName());
+
+  if (_sdf && _sdf->HasElement("stage"))
+  {
+    for (sdf::ElementPtr stageElem = _sdf->GetElement("stage"); stageElem;
+        stageElem = stageElem->GetNextElement("stage"))
+    {
+      const std::string type =
+        NpsBeamStageParam<std::string>(stageElem, "type", std::string());
+      std::unique_ptr<NpsBeamStage> stage = NpsBeamStage::Create(type);
+      if (!stage)
+      {
+        gzerr << "Unknown NpsBeamPlugin stage type[" << type << "]\n";
+        continue;
+      }
+      stage->SetName(
+          NpsBeamStageParam<std::string>(stageElem, "name", type));
+      if (!stage->Load(stageElem, *this->parentSensor, this->dataPtr->node))
+      {
+        gzerr << "Unable to load NpsBeamPlugin stage[" << stage->Name()
+              << "]\n";
+        continue;
+      }
+      this->dataPtr->chain.Add(std::move(stage));
+    }
+  }
+
+  const unsigned int depth = std::max(1u,
+      NpsBeamStageParam<unsigned int>(_sdf, "queue_depth", 2));
+  const std::string dropPolicy =
+    NpsBeamStageParam<std::string>(_sdf, "drop_policy", "oldest");
+  if (dropPolicy != "oldest" && dropPolicy != "newest")
+  {
+    gzwarn << "Unknown NpsBeamPlugin drop_policy[" << dropPolicy
+           << "], using oldest\n";
+  }
+  this->dataPtr->queue.Configure(depth, dropPolicy != "newest",
+      this->width, this->height);
+
+  this->dataPtr->statsRate =
+    NpsBeamStageParam<double>(_sdf, "stats_rate", 1.0);
+  if (this->dataPtr->statsRate > 0)
+  {
+    this->dataPtr->statsPub =
+      this->dataPtr->node->Advertise<msgs::Param_V>(this->StatsTopic(), 10);
+  }
+  this->dataPtr->windowStart = NpsBeamPluginPrivate::Clock::now();
+
+  this->dataPtr->worker = std::thread(&NpsBeamPlugin::Run, this);
 
   this->newLaserFrameConnection = this->parentSensor->ConnectNewLaserFrame(
       std::bind(&NpsBeamPlugin::OnNewLaserFrame, this,
@@ -52,8 +126,126 @@ void NpsBeamPlugin::Load(sensors::SensorPtr _sensor,
 }
 
 /////////////////////////////////////////////////
-void NpsBeamPlugin::OnNewLaserFrame(const float * /*_image*/,
-    unsigned int /*_width*/, unsigned int /*_height*/,
-    unsigned int /*_depth*/, const std::string &/*_format*/)
+std::string NpsBeamPlugin::StatsTopic() const
 {
+  std::string topicName = "~/";
+  topicName += this->parentSensor->ParentName() + "/" +
+    this->parentSensor->Name() + "/stages";
+  boost::replace_all(topicName, "::", "/");
+
+  return topicName;
+}
+
+/////////////////////////////////////////////////
+void NpsBeamPlugin::OnNewLaserFrame(const float *_image,
+    unsigned int _width, unsigned int _height,
+    unsigned int _depth, const std::string &/*_format*/)
+{
+  if (this->dataPtr->chain.Size() == 0 || _depth < 2)
+    return;
+
+  sensors::NpsBeamFrame *frame = this->dataPtr->queue.Acquire();
+  if (!frame)
+    return;
+
+  this->width = _width;
+  this->height = _height;
+
+  const ignition::math::Pose3d pose = this->parentSensor->Pose() +
+    (this->dataPtr->parentEntity ?
+     this->dataPtr->parentEntity->WorldPose() : ignition::math::Pose3d());
+  // The time of the scan the sensor publishes for this frame, not the
+  // world time, which may be past it for a readback or a replay
+  const common::Time stamp = this->parentSensor->FrameTime();
+
+  frame->Resize(_width, _height);
+  frame->sec = stamp.sec;
+  frame->nsec = stamp.nsec;
+  frame->pose[0] = pose.Pos().X();
+  frame->pose[1] = pose.Pos().Y();
+  frame->pose[2] = pose.Pos().Z();
+  frame->pose[3] = pose.Rot().W();
+  frame->pose[4] = pose.Rot().X();
+  frame->pose[5] = pose.Rot().Y();
+  frame->pose[6] = pose.Rot().Z();
+  frame->angleMin = this->parentSensor->AngleMin().Radian();
+  frame->angleMax = this->parentSensor->AngleMax().Radian();
+  frame->angleStep = _width > 1 ?
+    (frame->angleMax - frame->angleMin) / (_width - 1) : 0.0;
+  frame->verticalAngleMin = this->parentSensor->VerticalAngleMin().Radian();
+  frame->verticalAngleMax = this->parentSensor->VerticalAngleMax().Radian();
+  frame->verticalAngleStep = _height > 1 ?
+    (frame->verticalAngleMax - frame->verticalAngleMin) / (_height - 1) :
+    0.0;
+  frame->rangeMin = this->parentSensor->RangeMin();
+  frame->rangeMax = this->parentSensor->RangeMax();
+  sensors::DeinterleaveBeamFrame(_image,
+      static_cast<size_t>(_width) * _height, _depth, frame->ranges.data(),
+      frame->intensities.data());
+
+  this->dataPtr->queue.Push(frame);
+}
+
+/////////////////////////////////////////////////
+void NpsBeamPlugin::Run()
+{
+  while (sensors::NpsBeamFrame *frame = this->dataPtr->queue.Pop())
+  {
+    this->dataPtr->chain.Process(*frame);
+    this->PublishStats();
+    this->dataPtr->queue.Release(frame);
+  }
+}
+
+/////////////////////////////////////////////////
+void NpsBeamPlugin::PublishStats()
+{
+  if (!this->dataPtr->statsPub)
+    return;
+
+  const NpsBeamPluginPrivate::Clock::time_point now =
+    NpsBeamPluginPrivate::Clock::now();
+  const double seconds =
+    std::chrono::duration<double>(now - this->dataPtr->windowStart).count();
+  if (seconds < 1.0 / this->dataPtr->statsRate)
+    return;
+
+  auto addValue = [](msgs::Param *_parent, const std::string &_name,
+      const double _value)
+  {
+    msgs::Param *param = _parent->add_children();
+    param->set_name(_name);
+    param->mutable_value()->set_type(msgs::Any::DOUBLE);
+    param->mutable_value()->set_double_value(_value);
+  };
+
+  msgs::Param_V &msg = this->dataPtr->statsMsg;
+  msg.Clear();
+
+  msgs::Param *window = msg.add_param();
+  window->set_name("window");
+  addValue(window, "seconds", seconds);
+  uint64_t queued;
+  uint64_t dropped;
+  this->dataPtr->queue.TakeCounts(queued, dropped);
+  addValue(window, "queued", queued);
+  addValue(window, "dropped", dropped);
+  addValue(window, "queue_depth", this->dataPtr->queue.Depth());
+
+  const NpsBeamStageChain &chain = this->dataPtr->chain;
+  for (size_t i = 0; i < chain.Size(); ++i)
+  {
+    const NpsBeamStageChain::StageStats &stats = chain.Stats(i);
+    msgs::Param *param = msg.add_param();
+    param->set_name(chain.Stage(i).Name());
+    addValue(param, "count", stats.count);
+    addValue(param, "mean_us",
+        stats.count ? stats.totalNs / 1e3 / stats.count : 0.0);
+    addValue(param, "max_us", stats.maxNs / 1e3);
+  }
+  this->dataPtr->chain.ResetStats();
+
+  this->dataPtr->windowStart = now;
+  if (this->dataPtr->statsPub->HasConnections())
+    this->dataPtr->statsPub->Publish(msg);
 }
@@ -18,6 +18,7 @@
 #ifndef _NPS_BEAM_PLUGIN_HH_
 #define _NPS_BEAM_PLUGIN_HH_
 
+#include <memory>
 #include <string>
 
 #include "gazebo/common/Plugin.hh"
@@ -46,21 +47,50 @@ namespace gazebo
     // and for sensor noise type, maybe for now try GPU_RAY_NOISE
   }
 
+  class NpsBeamPluginPrivate;
+
+  /// \brief Runs a chain of processing stages over the raw frames of an
+  /// nps_beam sensor.
+  ///
+  /// Stages are declared as <stage type="..."> elements of the plugin,
+  /// see NpsBeamStage::Create, and run in order on a worker thread. The
+  /// render callback only copies the frame into one of a fixed set of
+  /// pooled buffers and queues it; when the queue is full the oldest
+  /// queued frame, or the new one, is dropped so a slow stage never
+  /// stalls rendering.
   class GAZEBO_VISIBLE NpsBeamPlugin : public SensorPlugin
   {
     public: NpsBeamPlugin();
 
+    /// \brief Destructor, stops the worker.
+    public: virtual ~NpsBeamPlugin();
+
     public: void Load(sensors::SensorPtr _sensor, sdf::ElementPtr _sdf);
 
     public: virtual void OnNewLaserFrame(const float *_image,
                 unsigned int _width, unsigned int _height,
                 unsigned int _depth, const std::string &_format);
 
+    /// \brief Get the topic of the stage timings.
+    /// \return Stage timings topic name.
+    public: std::string StatsTopic() const;
+
+    /// \brief Worker loop running the stages over queued frames.
+    private: void Run();
+
+    /// \brief Publish the stage timings if the window elapsed.
+    private: void PublishStats();
+
+    /// \brief Size of the last raw frame, in rays.
     protected: unsigned int width, height/*, depth*/;
 
     protected: sensors::NpsBeamSensorPtr parentSensor;
 
     private: event::ConnectionPtr newLaserFrameConnection;
+
+    /// \internal
+    /// \brief Private data pointer
+    private: std::unique_ptr<NpsBeamPluginPrivate> dataPtr;
   };
 }
 #endif
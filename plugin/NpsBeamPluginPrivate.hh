@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_PLUGIN_PRIVATE_HH
+#define NPS_BEAM_PLUGIN_PRIVATE_HH
+
+#include <chrono>
+#include <thread>
+
+#include "gazebo/msgs/msgs.hh"
+#include "gazebo/physics/PhysicsTypes.hh"
+#include "gazebo/transport/TransportTypes.hh"
+
+#include "NpsBeamStageChain.hh"
+
+namespace gazebo
+{
+  /// \internal
+  /// \brief Private data for the NpsBeamPlugin class
+  class NpsBeamPluginPrivate
+  {
+    /// \brief Clock of the stage timing window.
+    public: typedef std::chrono::steady_clock Clock;
+
+    /// \brief Stages in declaration order.
+    public: NpsBeamStageChain chain;
+
+    /// \brief Frames waiting for the worker.
+    public: NpsBeamStageQueue queue;
+
+    /// \brief Worker running the stages.
+    public: std::thread worker;
+
+    /// \brief World the sensor is in.
+    public: physics::WorldPtr world;
+
+    /// \brief Entity the sensor is attached to.
+    public: physics::EntityPtr parentEntity;
+
+    /// \brief Transport node of the plugin.
+    public: transport::NodePtr node;
+
+    /// \brief Publisher of stage timings, null if disabled.
+    public: transport::PublisherPtr statsPub;
+
+    /// \brief Stage timings message, reused every window.
+    public: msgs::Param_V statsMsg;
+
+    /// \brief Stage timings publish rate in Hz.
+    public: double statsRate = 1.0;
+
+    /// \brief Start of the current stage timing window.
+    public: Clock::time_point windowStart;
+  };
+}
+#endif
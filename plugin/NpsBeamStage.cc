@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <boost/algorithm/string/replace.hpp>
+
+#include "gazebo/common/Console.hh"
+#include "gazebo/transport/Node.hh"
+#include "NpsBeamScanKernel.hh"
+#include "NpsBeamScanProcessor.hh"
+#include "NpsBeamSensor.hh"
+#include "NpsBeamStage.hh"
+
+using namespace gazebo;
+
+//////////////////////////////////////////////////
+NpsBeamStage::~NpsBeamStage()
+{
+}
+
+//////////////////////////////////////////////////
+std::unique_ptr<NpsBeamStage> NpsBeamStage::Create(const std::string &_type)
+{
+  std::unique_ptr<NpsBeamStage> stage;
+  if (_type == "median")
+    stage.reset(new NpsBeamMedianStage);
+  else if (_type == "decimate")
+    stage.reset(new NpsBeamDecimateStage);
+  else if (_type == "range_gate")
+    stage.reset(new NpsBeamRangeGateStage);
+  else if (_type == "temporal_average")
+    stage.reset(new NpsBeamTemporalAverageStage);
+  else if (_type == "publish")
+    stage.reset(new NpsBeamPublishStage);
+
+  if (stage)
+    stage->SetName(_type);
+  return stage;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamStage::Load(sdf::ElementPtr /*_sdf*/,
+    const sensors::NpsBeamSensor &/*_sensor*/, transport::NodePtr /*_node*/)
+{
+  return true;
+}
+
+//////////////////////////////////////////////////
+const std::string &NpsBeamStage::Name() const
+{
+  return this->name;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamStage::SetName(const std::string &_name)
+{
+  this->name = _name;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamMedianStage::Load(sdf::ElementPtr _sdf,
+    const sensors::NpsBeamSensor &/*_sensor*/, transport::NodePtr /*_node*/)
+{
+  const unsigned int size = NpsBeamStageParam<unsigned int>(_sdf, "window",
+      3);
+  if (size < 3 || size % 2 == 0)
+  {
+    gzerr << "Median window must be odd and at least 3, got " << size
+          << "\n";
+    return false;
+  }
+  this->radius = size / 2;
+  this->intensities = NpsBeamStageParam<bool>(_sdf, "intensities", false);
+  this->window.reserve(size);
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamMedianStage::Process(sensors::NpsBeamFrame &_frame)
+{
+  const unsigned int width = _frame.width;
+  this->row.resize(width);
+
+  for (int channel = 0; channel < (this->intensities ? 2 : 1); ++channel)
+  {
+    std::vector<float> &data =
+      channel == 0 ? _frame.ranges : _frame.intensities;
+    for (unsigned int v = 0; v < _frame.height; ++v)
+    {
+      float *cells = data.data() + static_cast<size_t>(v) * width;
+      std::copy(cells, cells + width, this->row.begin());
+      for (unsigned int h = 0; h < width; ++h)
+      {
+        // The window shrinks at the row ends; NaN cells are ignored
+        const unsigned int first = h >= this->radius ? h - this->radius : 0;
+        const unsigned int last = std::min(width - 1, h + this->radius);
+        this->window.clear();
+        for (unsigned int i = first; i <= last; ++i)
+        {
+          if (!std::isnan(this->row[i]))
+            this->window.push_back(this->row[i]);
+        }
+        if (this->window.empty())
+          continue;
+
+        std::vector<float>::iterator middle =
+          this->window.begin() + (this->window.size() - 1) / 2;
+        std::nth_element(this->window.begin(), middle, this->window.end());
+        cells[h] = *middle;
+      }
+    }
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamDecimateStage::Load(sdf::ElementPtr _sdf,
+    const sensors::NpsBeamSensor &/*_sensor*/, transport::NodePtr /*_node*/)
+{
+  this->horizontal = std::max(1u,
+      NpsBeamStageParam<unsigned int>(_sdf, "horizontal", 1));
+  this->vertical = std::max(1u,
+      NpsBeamStageParam<unsigned int>(_sdf, "vertical", 1));
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamDecimateStage::Process(sensors::NpsBeamFrame &_frame)
+{
+  const unsigned int width =
+    (_frame.width + this->horizontal - 1) / this->horizontal;
+  const unsigned int height =
+    (_frame.height + this->vertical - 1) / this->vertical;
+
+  // Kept cells never move forward, so the frame is compacted in place
+  for (unsigned int v = 0; v < height; ++v)
+  {
+    const size_t in = static_cast<size_t>(v) * this->vertical * _frame.width;
+    const size_t out = static_cast<size_t>(v) * width;
+    for (unsigned int h = 0; h < width; ++h)
+    {
+      _frame.ranges[out + h] = _frame.ranges[in + h * this->horizontal];
+      _frame.intensities[out + h] =
+        _frame.intensities[in + h * this->horizontal];
+    }
+  }
+
+  _frame.angleStep *= this->horizontal;
+  _frame.angleMax = _frame.angleMin + (width - 1) * _frame.angleStep;
+  _frame.verticalAngleStep *= this->vertical;
+  _frame.verticalAngleMax =
+    _frame.verticalAngleMin + (height - 1) * _frame.verticalAngleStep;
+  _frame.Resize(width, height);
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRangeGateStage::Load(sdf::ElementPtr _sdf,
+    const sensors::NpsBeamSensor &_sensor, transport::NodePtr /*_node*/)
+{
+  this->min = NpsBeamStageParam<float>(_sdf, "min", _sensor.RangeMin());
+  this->max = NpsBeamStageParam<float>(_sdf, "max", _sensor.RangeMax());
+  if (this->min >= this->max)
+  {
+    gzerr << "Range gate min[" << this->min << "] must be below max["
+          << this->max << "]\n";
+    return false;
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRangeGateStage::Process(sensors::NpsBeamFrame &_frame)
+{
+  sensors::ProcessBeamRanges(_frame.ranges.data(), nullptr,
+      _frame.ranges.data(), _frame.ranges.size(), this->min, this->max);
+  _frame.rangeMin = this->min;
+  _frame.rangeMax = this->max;
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamTemporalAverageStage::Load(sdf::ElementPtr _sdf,
+    const sensors::NpsBeamSensor &/*_sensor*/, transport::NodePtr /*_node*/)
+{
+  this->alpha = NpsBeamStageParam<float>(_sdf, "alpha", 0.5f);
+  if (this->alpha <= 0 || this->alpha > 1)
+  {
+    gzerr << "Temporal average alpha must be in (0, 1], got "
+          << this->alpha << "\n";
+    return false;
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamTemporalAverageStage::Process(sensors::NpsBeamFrame &_frame)
+{
+  const size_t count = _frame.ranges.size();
+  if (this->ranges.size() != count)
+  {
+    this->ranges = _frame.ranges;
+    this->intensities = _frame.intensities;
+    return true;
+  }
+
+  const float keep = 1.0f - this->alpha;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const float range = _frame.ranges[i];
+    if (std::isfinite(range) && std::isfinite(this->ranges[i]))
+    {
+      this->ranges[i] = keep * this->ranges[i] + this->alpha * range;
+      this->intensities[i] = keep * this->intensities[i] +
+        this->alpha * _frame.intensities[i];
+    }
+    else
+    {
+      this->ranges[i] = range;
+      this->intensities[i] = _frame.intensities[i];
+    }
+  }
+
+  std::copy(this->ranges.begin(), this->ranges.end(), _frame.ranges.begin());
+  std::copy(this->intensities.begin(), this->intensities.end(),
+      _frame.intensities.begin());
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamPublishStage::Load(sdf::ElementPtr _sdf,
+    const sensors::NpsBeamSensor &_sensor, transport::NodePtr _node)
+{
+  std::string topicName = "~/";
+  topicName += _sensor.ParentName() + "/" + _sensor.Name() + "/processed";
+  boost::replace_all(topicName, "::", "/");
+  topicName = NpsBeamStageParam<std::string>(_sdf, "topic", topicName);
+
+  this->pub = _node->Advertise<msgs::LaserScanStamped>(topicName, 50);
+  this->msg.mutable_scan()->set_frame(_sensor.ParentName());
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamPublishStage::Process(sensors::NpsBeamFrame &_frame)
+{
+  if (!this->pub->HasConnections())
+    return true;
+
+  msgs::Set(this->msg.mutable_time(), common::Time(_frame.sec, _frame.nsec));
+  sensors::NpsBeamScanProcessor::FillScan(_frame, this->msg.mutable_scan());
+  this->pub->Publish(this->msg);
+  return true;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_STAGE_HH
+#define NPS_BEAM_STAGE_HH
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sdf/sdf.hh>
+
+#include "gazebo/msgs/msgs.hh"
+#include "gazebo/transport/TransportTypes.hh"
+
+#include "NpsBeamFrameStore.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamSensor;
+  }
+
+  /// \internal
+  /// \brief Read an optional stage configuration value.
+  /// \param[in] _elem Parent element, may be null.
+  /// \param[in] _name Child element or attribute holding the value.
+  /// \param[in] _default Value returned when it is missing.
+  /// \return The configured value or _default.
+  template <typename T>
+  T NpsBeamStageParam(sdf::ElementPtr _elem, const std::string &_name,
+      const T &_default)
+  {
+    if (_elem && (_elem->HasElement(_name) || _elem->HasAttribute(_name)))
+      return _elem->Get<T>(_name);
+    return _default;
+  }
+
+  /// \brief One processing step of the NpsBeamPlugin stage chain.
+  ///
+  /// Stages run in the order they are declared, on the plugin worker
+  /// thread, over a raw frame of the sensor's ray grid. A stage may
+  /// modify the frame in place, including its size, and may stop the
+  /// chain for the frame.
+  class NpsBeamStage
+  {
+    /// \brief Destructor
+    public: virtual ~NpsBeamStage();
+
+    /// \brief Create a stage by type.
+    /// \param[in] _type "median", "decimate", "range_gate",
+    /// "temporal_average" or "publish".
+    /// \return The stage, or null if _type is unknown.
+    public: static std::unique_ptr<NpsBeamStage> Create(
+                const std::string &_type);
+
+    /// \brief Configure the stage.
+    /// \param[in] _sdf The <stage> element.
+    /// \param[in] _sensor Sensor the plugin is attached to.
+    /// \param[in] _node Transport node of the plugin.
+    /// \return False if the configuration is invalid.
+    public: virtual bool Load(sdf::ElementPtr _sdf,
+                const sensors::NpsBeamSensor &_sensor,
+                transport::NodePtr _node);
+
+    /// \brief Process a frame.
+    /// \param[in,out] _frame Frame to process.
+    /// \return False to skip the remaining stages for this frame.
+    public: virtual bool Process(sensors::NpsBeamFrame &_frame) = 0;
+
+    /// \brief Get the stage name, used in the stage timings.
+    /// \return The name attribute of the stage, or its type.
+    public: const std::string &Name() const;
+
+    /// \brief Set the stage name.
+    /// \param[in] _name Stage name.
+    public: void SetName(const std::string &_name);
+
+    /// \brief Stage name.
+    private: std::string name;
+  };
+
+  /// \brief Median filter along each row of the frame.
+  class NpsBeamMedianStage : public NpsBeamStage
+  {
+    // Documentation inherited
+    public: virtual bool Load(sdf::ElementPtr _sdf,
+                const sensors::NpsBeamSensor &_sensor,
+                transport::NodePtr _node);
+
+    // Documentation inherited
+    public: virtual bool Process(sensors::NpsBeamFrame &_frame);
+
+    /// \brief Half of the odd window size.
+    private: unsigned int radius = 1;
+
+    /// \brief Filter intensities as well as ranges.
+    private: bool intensities = false;
+
+    /// \brief Copy of the row being filtered.
+    private: std::vector<float> row;
+
+    /// \brief Window being sorted.
+    private: std::vector<float> window;
+  };
+
+  /// \brief Keep every n-th cell along each axis.
+  class NpsBeamDecimateStage : public NpsBeamStage
+  {
+    // Documentation inherited
+    public: virtual bool Load(sdf::ElementPtr _sdf,
+                const sensors::NpsBeamSensor &_sensor,
+                transport::NodePtr _node);
+
+    // Documentation inherited
+    public: virtual bool Process(sensors::NpsBeamFrame &_frame);
+
+    /// \brief Horizontal decimation factor.
+    private: unsigned int horizontal = 1;
+
+    /// \brief Vertical decimation factor.
+    private: unsigned int vertical = 1;
+  };
+
+  /// \brief Mask ranges outside a gate, like REP 117 masking at the
+  /// range limits of the sensor.
+  class NpsBeamRangeGateStage : public NpsBeamStage
+  {
+    // Documentation inherited
+    public: virtual bool Load(sdf::ElementPtr _sdf,
+                const sensors::NpsBeamSensor &_sensor,
+                transport::NodePtr _node);
+
+    // Documentation inherited
+    public: virtual bool Process(sensors::NpsBeamFrame &_frame);
+
+    /// \brief Nearest range kept.
+    private: float min = 0;
+
+    /// \brief Farthest range kept.
+    private: float max = 0;
+  };
+
+  /// \brief Exponential moving average of every cell over frames.
+  ///
+  /// Cells that are not finite pass through and restart the average,
+  /// and the average restarts whenever the frame size changes.
+  class NpsBeamTemporalAverageStage : public NpsBeamStage
+  {
+    // Documentation inherited
+    public: virtual bool Load(sdf::ElementPtr _sdf,
+                const sensors::NpsBeamSensor &_sensor,
+                transport::NodePtr _node);
+
+    // Documentation inherited
+    public: virtual bool Process(sensors::NpsBeamFrame &_frame);
+
+    /// \brief Weight of the newest frame.
+    private: float alpha = 0.5f;
+
+    /// \brief Running average of the ranges.
+    private: std::vector<float> ranges;
+
+    /// \brief Running average of the intensities.
+    private: std::vector<float> intensities;
+  };
+
+  /// \brief Publish the frame as msgs::LaserScanStamped.
+  class NpsBeamPublishStage : public NpsBeamStage
+  {
+    // Documentation inherited
+    public: virtual bool Load(sdf::ElementPtr _sdf,
+                const sensors::NpsBeamSensor &_sensor,
+                transport::NodePtr _node);
+
+    // Documentation inherited
+    public: virtual bool Process(sensors::NpsBeamFrame &_frame);
+
+    /// \brief Scan publisher.
+    private: transport::PublisherPtr pub;
+
+    /// \brief Scan message, reused every frame.
+    private: msgs::LaserScanStamped msg;
+  };
+}
+#endif
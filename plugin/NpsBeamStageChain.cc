@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+
+#include "NpsBeamStageChain.hh"
+
+using namespace gazebo;
+
+//////////////////////////////////////////////////
+void NpsBeamStageChain::Add(std::unique_ptr<NpsBeamStage> _stage)
+{
+  this->stages.push_back(std::move(_stage));
+  this->stats.push_back(StageStats());
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamStageChain::Size() const
+{
+  return this->stages.size();
+}
+
+//////////////////////////////////////////////////
+const NpsBeamStage &NpsBeamStageChain::Stage(const size_t _index) const
+{
+  return *this->stages[_index];
+}
+
+//////////////////////////////////////////////////
+const NpsBeamStageChain::StageStats &NpsBeamStageChain::Stats(
+    const size_t _index) const
+{
+  return this->stats[_index];
+}
+
+//////////////////////////////////////////////////
+void NpsBeamStageChain::ResetStats()
+{
+  std::fill(this->stats.begin(), this->stats.end(), StageStats());
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamStageChain::Process(sensors::NpsBeamFrame &_frame)
+{
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < this->stages.size(); ++i)
+  {
+    const bool next = this->stages[i]->Process(_frame);
+    const Clock::time_point end = Clock::now();
+    const uint64_t ns = std::chrono::duration_cast<
+      std::chrono::nanoseconds>(end - start).count();
+    StageStats &stageStats = this->stats[i];
+    ++stageStats.count;
+    stageStats.totalNs += ns;
+    stageStats.maxNs = std::max(stageStats.maxNs, ns);
+    start = end;
+    if (!next)
+      return i + 1;
+  }
+  return this->stages.size();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamStageQueue::Configure(const unsigned int _depth,
+    const bool _dropOldest, const unsigned int _width,
+    const unsigned int _height)
+{
+  const unsigned int depth = std::max(1u, _depth);
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->frames.clear();
+  this->freeFrames.clear();
+  for (unsigned int i = 0; i < depth + 2; ++i)
+  {
+    this->frames.emplace_back(new sensors::NpsBeamFrame);
+    this->frames.back()->Resize(_width, _height);
+    this->freeFrames.push_back(this->frames.back().get());
+  }
+  this->queue.assign(depth, nullptr);
+  this->head = 0;
+  this->count = 0;
+  this->dropOldest = _dropOldest;
+  this->dropped = 0;
+  this->queued = 0;
+  this->stop = false;
+}
+
+//////////////////////////////////////////////////
+sensors::NpsBeamFrame *NpsBeamStageQueue::Acquire()
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->queue.empty())
+    return nullptr;
+
+  if (this->count < this->queue.size())
+  {
+    sensors::NpsBeamFrame *frame = this->freeFrames.back();
+    this->freeFrames.pop_back();
+    return frame;
+  }
+
+  ++this->dropped;
+  if (!this->dropOldest)
+    return nullptr;
+
+  // Reuse the oldest queued frame for the new one
+  sensors::NpsBeamFrame *frame = this->queue[this->head];
+  this->head = (this->head + 1) % this->queue.size();
+  --this->count;
+  return frame;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamStageQueue::Push(sensors::NpsBeamFrame *_frame)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->queue[(this->head + this->count) % this->queue.size()] = _frame;
+    ++this->count;
+    ++this->queued;
+  }
+  this->condition.notify_one();
+}
+
+//////////////////////////////////////////////////
+sensors::NpsBeamFrame *NpsBeamStageQueue::Pop()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->condition.wait(lock, [this]()
+      {
+        return this->stop || this->count > 0;
+      });
+  if (this->stop)
+    return nullptr;
+
+  sensors::NpsBeamFrame *frame = this->queue[this->head];
+  this->head = (this->head + 1) % this->queue.size();
+  --this->count;
+  return frame;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamStageQueue::Release(sensors::NpsBeamFrame *_frame)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->freeFrames.push_back(_frame);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamStageQueue::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->condition.notify_all();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamStageQueue::TakeCounts(uint64_t &_queued, uint64_t &_dropped)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  _queued = this->queued;
+  _dropped = this->dropped;
+  this->queued = 0;
+  this->dropped = 0;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamStageQueue::Depth() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->queue.size();
+}
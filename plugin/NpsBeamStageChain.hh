@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_STAGE_CHAIN_HH
+#define NPS_BEAM_STAGE_CHAIN_HH
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamStage.hh"
+
+namespace gazebo
+{
+  /// \brief Stages of NpsBeamPlugin in declaration order, with the
+  /// timing of each over the current window.
+  class NpsBeamStageChain
+  {
+    /// \brief Clock used for stage timing.
+    public: typedef std::chrono::steady_clock Clock;
+
+    /// \brief Timing of one stage over the current window.
+    public: struct StageStats
+    {
+      /// \brief Frames processed.
+      uint64_t count = 0;
+
+      /// \brief Sum of durations in nanoseconds.
+      uint64_t totalNs = 0;
+
+      /// \brief Largest duration in nanoseconds.
+      uint64_t maxNs = 0;
+    };
+
+    /// \brief Append a stage to the chain.
+    /// \param[in] _stage Loaded stage.
+    public: void Add(std::unique_ptr<NpsBeamStage> _stage);
+
+    /// \brief Get the number of stages.
+    /// \return Stage count.
+    public: size_t Size() const;
+
+    /// \brief Get a stage.
+    /// \param[in] _index Stage index in declaration order.
+    /// \return The stage.
+    public: const NpsBeamStage &Stage(const size_t _index) const;
+
+    /// \brief Get the timing of a stage over the current window.
+    /// \param[in] _index Stage index in declaration order.
+    /// \return The stage timing.
+    public: const StageStats &Stats(const size_t _index) const;
+
+    /// \brief Start a new timing window.
+    public: void ResetStats();
+
+    /// \brief Run the stages over a frame, in order, until one stops
+    /// the chain.
+    /// \param[in,out] _frame Frame to process.
+    /// \return Number of stages that ran.
+    public: size_t Process(sensors::NpsBeamFrame &_frame);
+
+    /// \brief Stages in declaration order.
+    private: std::vector<std::unique_ptr<NpsBeamStage>> stages;
+
+    /// \brief Timing of each stage.
+    private: std::vector<StageStats> stats;
+  };
+
+  /// \brief Hands raw frames from the render callback of NpsBeamPlugin to
+  /// its worker through a fixed set of pooled frames.
+  ///
+  /// Every frame is allocated by Configure: the queue depth, one being
+  /// filled and one being processed, so a frame to fill is available
+  /// while the queue has room. When the queue is full Acquire either
+  /// takes back the oldest queued frame or drops the new one, so a slow
+  /// worker never stalls rendering.
+  class NpsBeamStageQueue
+  {
+    /// \brief Allocate the frames and empty the queue.
+    /// \param[in] _depth Number of frames that may wait for the worker,
+    /// at least 1.
+    /// \param[in] _dropOldest When the queue is full, replace the oldest
+    /// queued frame rather than drop the new one.
+    /// \param[in] _width Initial frame width in cells.
+    /// \param[in] _height Initial frame height in cells.
+    public: void Configure(const unsigned int _depth, const bool _dropOldest,
+                const unsigned int _width, const unsigned int _height);
+
+    /// \brief Get a frame to fill, counting a dropped frame if the queue
+    /// is full.
+    /// \return Frame to fill and Push, or null if the new frame is
+    /// dropped.
+    public: sensors::NpsBeamFrame *Acquire();
+
+    /// \brief Queue a frame filled after Acquire.
+    /// \param[in] _frame Frame for the worker.
+    public: void Push(sensors::NpsBeamFrame *_frame);
+
+    /// \brief Wait for the oldest queued frame.
+    /// \return Frame to process and Release, or null once stopped.
+    public: sensors::NpsBeamFrame *Pop();
+
+    /// \brief Return a processed frame to the pool.
+    /// \param[in] _frame Frame returned by Pop.
+    public: void Release(sensors::NpsBeamFrame *_frame);
+
+    /// \brief Wake the worker and make Pop return null from now on.
+    public: void Stop();
+
+    /// \brief Get the frames queued and dropped since the last call.
+    /// \param[out] _queued Frames queued.
+    /// \param[out] _dropped Frames dropped.
+    public: void TakeCounts(uint64_t &_queued, uint64_t &_dropped);
+
+    /// \brief Get the queue depth.
+    /// \return Number of frames that may wait for the worker.
+    public: size_t Depth() const;
+
+    /// \brief Frames owned by the queue.
+    private: std::vector<std::unique_ptr<sensors::NpsBeamFrame>> frames;
+
+    /// \brief Frames ready to be filled.
+    private: std::vector<sensors::NpsBeamFrame *> freeFrames;
+
+    /// \brief Ring of filled frames waiting for the worker.
+    private: std::vector<sensors::NpsBeamFrame *> queue;
+
+    /// \brief Index of the oldest queued frame.
+    private: size_t head = 0;
+
+    /// \brief Number of queued frames.
+    private: size_t count = 0;
+
+    /// \brief Replace the oldest queued frame when full.
+    private: bool dropOldest = true;
+
+    /// \brief Frames dropped since TakeCounts.
+    private: uint64_t dropped = 0;
+
+    /// \brief Frames queued since TakeCounts.
+    private: uint64_t queued = 0;
+
+    /// \brief True once stopped.
+    private: bool stop = false;
+
+    /// \brief Protects every member but frames.
+    private: mutable std::mutex mutex;
+
+    /// \brief Signals the worker about queued frames and stop.
+    private: std::condition_variable condition;
+  };
+}
+#endif
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "NpsBeamStageChain.hh"
+
+using namespace gazebo;
+
+namespace
+{
+  /// \brief Stage that logs its id and appends it to the first range.
+  class RecordingStage : public NpsBeamStage
+  {
+    /// \brief Constructor
+    /// \param[in] _id Stage id.
+    /// \param[in] _next Value returned by Process.
+    /// \param[in] _log Log of the stages run.
+    public: RecordingStage(const int _id, const bool _next,
+                std::vector<int> &_log)
+            : id(_id), next(_next), log(_log)
+    {
+      this->SetName("stage" + std::to_string(_id));
+    }
+
+    // Documentation inherited
+    public: virtual bool Process(sensors::NpsBeamFrame &_frame)
+    {
+      this->log.push_back(this->id);
+      _frame.ranges[0] = _frame.ranges[0] * 10 + this->id;
+      return this->next;
+    }
+
+    /// \brief Stage id.
+    private: int id;
+
+    /// \brief Value returned by Process.
+    private: bool next;
+
+    /// \brief Log of the stages run.
+    private: std::vector<int> &log;
+  };
+
+  /// \brief Acquire a frame, stamp it and queue it.
+  /// \param[in] _queue Queue.
+  /// \param[in] _sec Stamp of the frame.
+  /// \return The frame, or null if it was dropped.
+  sensors::NpsBeamFrame *Render(NpsBeamStageQueue &_queue, const int _sec)
+  {
+    sensors::NpsBeamFrame *frame = _queue.Acquire();
+    if (frame)
+    {
+      frame->sec = _sec;
+      _queue.Push(frame);
+    }
+    return frame;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamStageChain, StageOrder)
+{
+  std::vector<int> log;
+  NpsBeamStageChain chain;
+  for (int id = 1; id <= 3; ++id)
+  {
+    chain.Add(std::unique_ptr<NpsBeamStage>(
+          new RecordingStage(id, true, log)));
+  }
+  ASSERT_EQ(3u, chain.Size());
+  EXPECT_EQ("stage2", chain.Stage(1).Name());
+
+  // Each stage sees the frame as the previous one left it
+  sensors::NpsBeamFrame frame;
+  frame.Resize(4, 1);
+  frame.ranges[0] = 0;
+  EXPECT_EQ(3u, chain.Process(frame));
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), log);
+  EXPECT_FLOAT_EQ(123.0f, frame.ranges[0]);
+
+  EXPECT_EQ(3u, chain.Process(frame));
+  for (size_t i = 0; i < chain.Size(); ++i)
+  {
+    EXPECT_EQ(2u, chain.Stats(i).count);
+    EXPECT_GE(chain.Stats(i).totalNs, chain.Stats(i).maxNs);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamStageChain, EarlyStop)
+{
+  std::vector<int> log;
+  NpsBeamStageChain chain;
+  chain.Add(std::unique_ptr<NpsBeamStage>(new RecordingStage(1, true, log)));
+  chain.Add(std::unique_ptr<NpsBeamStage>(new RecordingStage(2, false, log)));
+  chain.Add(std::unique_ptr<NpsBeamStage>(new RecordingStage(3, true, log)));
+
+  // The second stage stops the chain, so the third never runs
+  sensors::NpsBeamFrame frame;
+  frame.Resize(4, 1);
+  frame.ranges[0] = 0;
+  EXPECT_EQ(2u, chain.Process(frame));
+  EXPECT_EQ(std::vector<int>({1, 2}), log);
+  EXPECT_FLOAT_EQ(12.0f, frame.ranges[0]);
+  EXPECT_EQ(1u, chain.Stats(0).count);
+  EXPECT_EQ(1u, chain.Stats(1).count);
+  EXPECT_EQ(0u, chain.Stats(2).count);
+
+  chain.ResetStats();
+  for (size_t i = 0; i < chain.Size(); ++i)
+  {
+    EXPECT_EQ(0u, chain.Stats(i).count);
+    EXPECT_EQ(0u, chain.Stats(i).totalNs);
+    EXPECT_EQ(0u, chain.Stats(i).maxNs);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamStageQueue, DropOldest)
+{
+  NpsBeamStageQueue queue;
+  queue.Configure(2, true, 8, 2);
+  EXPECT_EQ(2u, queue.Depth());
+
+  // A full queue hands the oldest queued frame back for the new one
+  sensors::NpsBeamFrame *first = Render(queue, 1);
+  sensors::NpsBeamFrame *second = Render(queue, 2);
+  ASSERT_NE(nullptr, first);
+  ASSERT_NE(nullptr, second);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(first, Render(queue, 3));
+  EXPECT_EQ(second, Render(queue, 4));
+
+  sensors::NpsBeamFrame *frame = queue.Pop();
+  ASSERT_NE(nullptr, frame);
+  EXPECT_EQ(3, frame->sec);
+  EXPECT_EQ(8u, frame->width);
+  queue.Release(frame);
+  frame = queue.Pop();
+  ASSERT_NE(nullptr, frame);
+  EXPECT_EQ(4, frame->sec);
+  queue.Release(frame);
+
+  uint64_t queued;
+  uint64_t dropped;
+  queue.TakeCounts(queued, dropped);
+  EXPECT_EQ(4u, queued);
+  EXPECT_EQ(2u, dropped);
+  queue.TakeCounts(queued, dropped);
+  EXPECT_EQ(0u, queued);
+  EXPECT_EQ(0u, dropped);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamStageQueue, DropNewest)
+{
+  NpsBeamStageQueue queue;
+  queue.Configure(2, false, 8, 2);
+
+  // A full queue drops the new frame and keeps the queued ones
+  EXPECT_NE(nullptr, Render(queue, 1));
+  EXPECT_NE(nullptr, Render(queue, 2));
+  EXPECT_EQ(nullptr, Render(queue, 3));
+  EXPECT_EQ(nullptr, Render(queue, 4));
+
+  sensors::NpsBeamFrame *frame = queue.Pop();
+  EXPECT_EQ(1, frame->sec);
+  queue.Release(frame);
+
+  // Room again after the worker took a frame
+  EXPECT_NE(nullptr, Render(queue, 5));
+  frame = queue.Pop();
+  EXPECT_EQ(2, frame->sec);
+  queue.Release(frame);
+  frame = queue.Pop();
+  EXPECT_EQ(5, frame->sec);
+  queue.Release(frame);
+
+  uint64_t queued;
+  uint64_t dropped;
+  queue.TakeCounts(queued, dropped);
+  EXPECT_EQ(3u, queued);
+  EXPECT_EQ(2u, dropped);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamStageQueue, FrameInProcess)
+{
+  NpsBeamStageQueue queue;
+  queue.Configure(1, true, 4, 1);
+
+  // The frame the worker holds is never handed out to be filled, even
+  // while the render side keeps replacing the queued frame
+  Render(queue, 1);
+  sensors::NpsBeamFrame *held = queue.Pop();
+  ASSERT_NE(nullptr, held);
+  for (int i = 2; i < 10; ++i)
+  {
+    sensors::NpsBeamFrame *frame = Render(queue, i);
+    ASSERT_NE(nullptr, frame);
+    EXPECT_NE(held, frame);
+  }
+  EXPECT_EQ(1, held->sec);
+  queue.Release(held);
+
+  sensors::NpsBeamFrame *frame = queue.Pop();
+  EXPECT_EQ(9, frame->sec);
+  queue.Release(frame);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamStageQueue, Worker)
+{
+  NpsBeamStageQueue queue;
+  queue.Configure(2, true, 64, 4);
+
+  // Frames reach the worker in order, and every frame is either
+  // processed or counted as dropped
+  const int frames = 2000;
+  std::vector<int> processed;
+  std::thread worker([&]()
+  {
+    while (sensors::NpsBeamFrame *frame = queue.Pop())
+    {
+      processed.push_back(frame->sec);
+      const bool last = frame->sec == frames;
+      queue.Release(frame);
+      if (last)
+        break;
+    }
+  });
+
+  for (int i = 1; i <= frames; ++i)
+    Render(queue, i);
+  worker.join();
+
+  uint64_t queued;
+  uint64_t dropped;
+  queue.TakeCounts(queued, dropped);
+  EXPECT_EQ(static_cast<uint64_t>(frames), queued);
+  EXPECT_EQ(static_cast<uint64_t>(frames), processed.size() + dropped);
+  ASSERT_FALSE(processed.empty());
+  EXPECT_EQ(frames, processed.back());
+  for (size_t i = 1; i < processed.size(); ++i)
+    EXPECT_LT(processed[i - 1], processed[i]);
+
+  // Stop wakes a waiting worker
+  std::thread waiting([&]()
+  {
+    EXPECT_EQ(nullptr, queue.Pop());
+  });
+  queue.Stop();
+  waiting.join();
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
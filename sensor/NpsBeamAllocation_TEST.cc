@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "NpsBeamDiagnostics.hh"
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamMultiEcho.hh"
+#include "NpsBeamNoise.hh"
+#include "NpsBeamOutputs.hh"
+#include "NpsBeamPipeline.hh"
+#include "NpsBeamScanKernel.hh"
+#include "NpsBeamScanProcessor.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+/// \brief Number of heap allocations made by this process.
+static std::atomic<uint64_t> g_allocations(0);
+
+/// \brief Number of heap allocations made by this thread.
+static thread_local uint64_t t_allocations = 0;
+
+/// \brief t_allocations at the last MemoryPublisher checkpoint.
+static thread_local uint64_t t_mark = 0;
+
+//////////////////////////////////////////////////
+void *operator new(size_t _size)
+{
+  ++g_allocations;
+  ++t_allocations;
+  if (void *ptr = std::malloc(_size ? _size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+//////////////////////////////////////////////////
+void *operator new[](size_t _size)
+{
+  return operator new(_size);
+}
+
+//////////////////////////////////////////////////
+void operator delete(void *_ptr) noexcept
+{
+  std::free(_ptr);
+}
+
+//////////////////////////////////////////////////
+void operator delete[](void *_ptr) noexcept
+{
+  std::free(_ptr);
+}
+
+//////////////////////////////////////////////////
+void operator delete(void *_ptr, size_t) noexcept
+{
+  std::free(_ptr);
+}
+
+//////////////////////////////////////////////////
+void operator delete[](void *_ptr, size_t) noexcept
+{
+  std::free(_ptr);
+}
+
+namespace
+{
+  const double kAngleMin = -1.2;
+  const double kAngleMax = 1.2;
+  const double kVerticalMin = -0.3;
+  const double kVerticalMax = 0.3;
+
+  /// \brief Rays per row of the test frames. Four pool chunks wide so
+  /// the threaded ParallelFor paths run.
+  const unsigned int kWidth = 512;
+
+  /// \brief Rows of the test frames.
+  const unsigned int kHeight = 64;
+
+  /// \brief Interleaved (range, intensity, unused) frame of a wavy wall,
+  /// with missing returns and returns beyond the range limit.
+  std::vector<float> WallFrame(const unsigned int _width,
+      const unsigned int _height)
+  {
+    std::vector<float> data(static_cast<size_t>(_width) * _height * 3);
+    for (unsigned int v = 0; v < _height; ++v)
+    {
+      for (unsigned int h = 0; h < _width; ++h)
+      {
+        const float range = 5.0f + 4.0f * std::sin(h * 0.01f) +
+          0.5f * std::cos(v * 0.1f);
+        float *cell = &data[(static_cast<size_t>(v) * _width + h) * 3];
+        cell[0] = (h + v) % 97 == 0 ? NAN : (h % 61 == 0 ? 100.0f : range);
+        cell[1] = 1.0f;
+        cell[2] = 0.0f;
+      }
+    }
+    return data;
+  }
+
+  /// \brief Fill a frame from BeginWrite with WallFrame data.
+  void FillFrame(NpsBeamFrame *_frame, const std::vector<float> &_data,
+      const unsigned int _width, const unsigned int _height)
+  {
+    _frame->Resize(_width, _height);
+    _frame->rangeMin = 0.5;
+    _frame->rangeMax = 30.0;
+    _frame->angleMin = kAngleMin;
+    _frame->angleMax = kAngleMax;
+    _frame->angleStep = (kAngleMax - kAngleMin) / std::max(1u, _width - 1);
+    _frame->verticalAngleMin = kVerticalMin;
+    _frame->verticalAngleMax = kVerticalMax;
+    _frame->verticalAngleStep = (kVerticalMax - kVerticalMin) /
+      std::max(1u, _height - 1);
+    _frame->pose[3] = 1.0;
+    DeinterleaveBeamFrame(_data.data(),
+        static_cast<size_t>(_width) * _height, 3, _frame->ranges.data(),
+        _frame->intensities.data());
+  }
+
+  /// \brief Outputs of the sensor.
+  enum Output
+  {
+    OUTPUT_SCAN,
+    OUTPUT_BEAM_IMAGE,
+    OUTPUT_FAN_IMAGE,
+    OUTPUT_COMPACT,
+    OUTPUT_ECHOES,
+    OUTPUT_POINT_CLOUD,
+    OUTPUT_DIAGNOSTICS,
+    OUTPUT_COUNT
+  };
+
+  /// \brief Output names for failure messages.
+  const char *kOutputNames[OUTPUT_COUNT] = {"scan", "beam_image",
+    "fan_image", "compact", "echoes", "point_cloud", "diagnostics"};
+
+  /// \brief Publisher that serializes messages into a reused buffer in
+  /// place of sending them.
+  ///
+  /// Charges its output with the allocations its thread made since the
+  /// previous publish, so in ProcessFrame order the beam image also
+  /// carries the processing and the scan the shared memory write.
+  class MemoryPublisher : public NpsBeamPublisher
+  {
+    /// \brief Constructor.
+    /// \param[in] _allocations Allocation count of the output.
+    public: explicit MemoryPublisher(uint64_t &_allocations)
+            : allocations(_allocations)
+            {
+            }
+
+    // Documentation inherited
+    public: virtual bool HasConnections() const
+            {
+              return true;
+            }
+
+    // Documentation inherited
+    public: virtual void Publish(const google::protobuf::Message &_msg)
+            {
+              _msg.SerializeToString(&this->buffer);
+              this->allocations += t_allocations - t_mark;
+              t_mark = t_allocations;
+              ++this->published;
+            }
+
+    /// \brief Allocation count of the output.
+    public: uint64_t &allocations;
+
+    /// \brief Last serialized message.
+    public: std::string buffer;
+
+    /// \brief Number of messages published.
+    public: unsigned int published = 0;
+  };
+
+  /// \brief Sensor outputs and the update thread state feeding them.
+  struct OutputSensor
+  {
+    NpsBeamOutputs outputs;
+    NpsBeamGeometry geom;
+    NpsBeamMultiEcho multiEcho;
+    NpsBeamPipeline pipeline;
+    MemoryPublisher *publishers[OUTPUT_COUNT] = {};
+    uint64_t allocations[OUTPUT_COUNT] = {};
+  };
+
+  /// \brief Configure every output of _sensor for kWidth by kHeight
+  /// frames, as NpsBeamSensor::Load does from <nps:beam>, with memory
+  /// publishers in place of topics.
+  void ConfigureOutputs(OutputSensor &_sensor, NpsBeamWorkerPool &_pool)
+  {
+    NpsBeamGeometry &geom = _sensor.geom;
+    geom.angleMin = kAngleMin;
+    geom.angleMax = kAngleMax;
+    geom.angleResolution = (kAngleMax - kAngleMin) / (kWidth - 1);
+    geom.verticalAngleMin = kVerticalMin;
+    geom.verticalAngleMax = kVerticalMax;
+    geom.verticalAngleResolution =
+      (kVerticalMax - kVerticalMin) / (kHeight - 1);
+    geom.rangeMin = 0.5;
+    geom.rangeMax = 30.0;
+    geom.rangeResolution = 0.001;
+    geom.rayCount = geom.rangeCount = geom.fullRayCount =
+      geom.fullRangeCount = kWidth;
+    geom.verticalRayCount = geom.verticalRangeCount = kHeight;
+    geom.version = 1;
+
+    NpsBeamOutputs &outputs = _sensor.outputs;
+    outputs.processor.SetPool(&_pool);
+    NpsBeamNoiseEngine engine;
+    engine.Configure(0.0, 0.01, 0.0, 0.0, 0.0, 1);
+    outputs.processor.SetNoise(engine);
+
+    outputs.beamImageBeams = 256;
+    outputs.beamImageBins = 1000;
+    outputs.fanImageWidth = 512;
+    outputs.fanImageHeight = 512;
+    outputs.shmName = "/nps_beam_allocation_test";
+    outputs.shmSlots = 4;
+    outputs.diagnosticsRate = 1.0;
+    outputs.laserMsg.mutable_scan()->set_frame("test");
+    outputs.echoMsg.set_type("nps_beam_echoes");
+
+    NpsBeamPublisherPtr *pubs[OUTPUT_COUNT] = {&outputs.scanPub,
+      &outputs.beamImagePub, &outputs.fanImagePub, &outputs.compactPub,
+      &outputs.echoPub, &outputs.pointCloudPub, &outputs.diagnosticsPub};
+    for (int o = 0; o < OUTPUT_COUNT; ++o)
+    {
+      _sensor.publishers[o] = new MemoryPublisher(_sensor.allocations[o]);
+      pubs[o]->reset(_sensor.publishers[o]);
+    }
+
+    std::vector<double> angles;
+    std::vector<double> verticalAngles;
+    outputs.BeamAngles(geom, angles, verticalAngles);
+    _sensor.multiEcho.Configure(kWidth, kHeight, kAngleMin, kAngleMax,
+        kVerticalMin, kVerticalMax, angles, verticalAngles, 3, 0.5f);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamAllocation, FillScanSteadyState)
+{
+  const std::vector<float> data = WallFrame(kWidth, kHeight);
+  NpsBeamFrame frames[2];
+  FillFrame(&frames[0], data, kWidth, kHeight);
+  FillFrame(&frames[1], data, kWidth, kHeight - 8);
+
+  // Once the fields have grown to the larger size, switching between
+  // sizes every frame, as a resolution change does, reuses them
+  msgs::LaserScan scan;
+  NpsBeamScanProcessor::FillScan(frames[0], &scan);
+  NpsBeamScanProcessor::FillScan(frames[1], &scan);
+
+  const uint64_t before = g_allocations;
+  for (int i = 0; i < 20; ++i)
+  {
+    NpsBeamScanProcessor::FillScan(frames[i % 2], &scan);
+    ASSERT_EQ(static_cast<int>(frames[i % 2].ranges.size()),
+        scan.ranges_size());
+  }
+  EXPECT_EQ(0u, g_allocations - before);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamAllocation, OutputsSteadyState)
+{
+  // Workers even on a single core host, so the threaded ParallelFor and
+  // pipeline paths are counted too
+  NpsBeamWorkerPool pool(3);
+  std::unique_ptr<OutputSensor> sensor(new OutputSensor);
+  ConfigureOutputs(*sensor, pool);
+  sensor->pipeline.Start(2, &pool);
+
+  const std::vector<float> data = WallFrame(kWidth, kHeight);
+  NpsBeamDiagnostics::Clock::time_point now =
+    NpsBeamDiagnostics::Clock::now();
+
+  // One update: echoes from the raw rays on the update thread, then the
+  // sensor's own processing on the pipeline thread. The job captures two
+  // pointers, so queueing it does not allocate.
+  OutputSensor *state = sensor.get();
+  auto tick = [&]()
+  {
+    NpsBeamFrame *frame = state->outputs.frameStore.BeginWrite();
+    FillFrame(frame, data, kWidth, kHeight);
+    frame->ResizeEchoes(state->multiEcho.Echoes());
+    state->multiEcho.Apply(frame->ranges.data(), frame->intensities.data(),
+        static_cast<float>(frame->rangeMin),
+        static_cast<float>(frame->rangeMax), frame->echoRanges.data(),
+        frame->echoIntensities.data(), frame->echoCounts.data(), &pool);
+    state->pipeline.Submit([state, frame]()
+        {
+          t_mark = t_allocations;
+          state->outputs.ProcessFrame(frame, state->geom,
+              static_cast<int>(frame->ranges.size()), false);
+        }, true);
+
+    // A summary every update rather than at the diagnostics rate, to
+    // catch growth
+    now += std::chrono::seconds(1);
+    t_mark = t_allocations;
+    state->outputs.PublishDiagnostics(now);
+  };
+
+  // Warm up so every buffer reaches its steady state size
+  for (int i = 0; i < 5; ++i)
+    tick();
+  sensor->pipeline.Flush();
+  std::fill(sensor->allocations, sensor->allocations + OUTPUT_COUNT, 0);
+
+  const uint64_t before = g_allocations;
+  for (int i = 0; i < 20; ++i)
+    tick();
+  sensor->pipeline.Flush();
+  const uint64_t allocations = g_allocations - before;
+
+  for (int o = 0; o < OUTPUT_COUNT; ++o)
+  {
+    EXPECT_EQ(25u, sensor->publishers[o]->published) << kOutputNames[o];
+    EXPECT_FALSE(sensor->publishers[o]->buffer.empty()) << kOutputNames[o];
+    EXPECT_EQ(0u, sensor->allocations[o]) << kOutputNames[o];
+  }
+  EXPECT_EQ(0u, allocations);
+
+  sensor->pipeline.Stop();
+  sensor->outputs.shmWriter.Close();
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,2164 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+// Offline benchmark of the NpsBeamSensor post-render path.
+//
+// Feeds recorded or synthetic laser frames, in the interleaved layout
+// delivered by ConnectNewLaserFrame, through deinterleaving, noise, REP 117
+// masking, LaserScan fill and serialization, without rendering or a GPU.
+//
+// Usage:
+//   NpsBeamBench [--rays N,N,...] [--cameras N,N,...] [--vertical N]
+//                [--frames N] [--noise STDDEV] [--replay FILE]
+//                [--resolution METERS] [--sensors N,N,...]
+//
+// A replay file is a sequence of frames, each a header of three uint32
+// (width, height, depth) followed by width * height * depth float32
+// values, i.e. the arguments of the new laser frame event.
+//
+// The fill table copies processed frames of 32k, 128k and 1M rays into
+// a LaserScan element by element, as the sensor did before, and with the
+// bulk FillScan, once at a fixed size and once alternating between two
+// sizes every frame, and reports the speedup.
+//
+// The accessor table times the geometry accessor calls of one sensor
+// update, reading the scan SDF elements as the accessors did before the
+// geometry snapshot, and reading the snapshot per call and per frame.
+//
+// The kernel table times the REP 117 range masking kernels the build
+// includes, scalar, SSE2 and with NPS_BEAM_AVX2 AVX2, on the same ranges
+// and noise, and reports the speedup over the scalar kernel.
+//
+// The CPU ray caster used without rendering is timed on a closed room
+// and on the same room cluttered with spheres; its accuracy is checked by
+// the unit tests.
+//
+// The sector table ray casts the active sector of a 130 degree sonar fan
+// in the cluttered room, at fixed widths and with a 30 degree scanning
+// head that moves one ray column per frame and rebuilds its directions
+// each time, and reports the speedup over casting the whole fan.
+//
+// The multi-echo table reduces a 130 by 20 degree fan cast in the
+// cluttered room to one to five echoes per beam, each beam covering four
+// ray columns and every row, and reports the echoes found and the encoded
+// bytes per beam.
+//
+// The resampling table maps a smooth synthetic field sampled on the ray
+// grid onto coarser, finer and non-uniformly spaced beam angles through
+// the gather table. Its accuracy and edge handling are checked by
+// NpsBeamResampler_TEST.
+//
+// The point cloud table compares the direction table path with computing
+// each point from the scan angles with per point trigonometry, as a
+// consumer of LaserScanStamped does, and reports the largest distance
+// between the two.
+//
+// The shared memory table hands processed frames to a reader thread, one
+// at a time so each delivery is timed on its own, through the shared
+// memory ring and through a transport like path that serializes a
+// LaserScanStamped, sends it over a loopback TCP socket as Gazebo
+// transport does, and parses it on the other side. Latency runs from
+// handing over the frame until the reader holds its ranges.
+//
+// The beam image table bins frames into a 256 beam by 1000 bin
+// intensity image with a Gaussian vertical beam pattern, on the calling
+// thread and on the worker pool, as the sensor's beam_image output does.
+// NpsBeamIntensityBinner_TEST checks the bins it fills.
+//
+// The diagnostics table runs frames through NpsBeamOutputs::ProcessFrame
+// with the scan output serialized, as the sensor does, once with
+// diagnostics disabled, the default, and once enabled and summarized at
+// 1 Hz, and reports the overhead of the enabled row.
+//
+// The fan image table remaps a 256 beam by 1000 bin polar image onto
+// square fan images of growing size with the remap table, and with
+// computing the range and angle of every pixel each frame, and reports
+// the largest difference between the two.
+//
+// The recording table writes 128k cell frames through NpsBeamRecorder,
+// first as fast as the recorder accepts them and then paced at 30 Hz,
+// timing each hand over on the writing thread; the last column of the
+// paced row counts dropped frames. The replay row reads every frame back
+// with NpsBeamRecordReader and its last column is the time to seek a
+// stamp in microseconds.
+//
+// The sensor scaling table runs the post-render path of many sensors at
+// once through NpsBeamScheduler ticks, each with the ray count of the
+// first --rays entry and half of them at half the rate of the others,
+// either on one pipeline thread per sensor or with every pipeline on the
+// shared work stealing pool. It reports the aggregate frames per second
+// and the scheduler's time per tick outside the sensor callbacks.
+//
+// The culling table moves a sonar through a 2 km harbour of 5000 models
+// on a seabed, with 2% of the models drifting every frame, and reports
+// the visible and culled models per frame and the time to update and
+// query the cull index, against testing every model. The mismatch column
+// counts frames where the two disagree.
+//
+// The startup table initializes many CPU ray casting sensors in a room
+// cluttered with spheres, each building the hierarchy of its own
+// collision scene either one after the other on the calling thread or on
+// the worker pool as NpsBeamCpuSource does, and reports the time from
+// the start until the median and the last sensor processed their first
+// scan.
+//
+// After the throughput table, a bandwidth table compares the serialized
+// LaserScanStamped with the compact scan encodings and reports the
+// largest range error of a decode round trip.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sdf/sdf.hh>
+
+#include "NpsBeamCullIndex.hh"
+#include "NpsBeamFanImage.hh"
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamGpuLayout.hh"
+#include "NpsBeamIntensityBinner.hh"
+#include "NpsBeamMultiEcho.hh"
+#include "NpsBeamNoise.hh"
+#include "NpsBeamOutputs.hh"
+#include "NpsBeamPipeline.hh"
+#include "NpsBeamPointCloud.hh"
+#include "NpsBeamRecorder.hh"
+#include "NpsBeamRayCaster.hh"
+#include "NpsBeamResampler.hh"
+#include "NpsBeamScanCodec.hh"
+#include "NpsBeamScanKernel.hh"
+#include "NpsBeamScanProcessor.hh"
+#include "NpsBeamScheduler.hh"
+#include "NpsBeamShmRing.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief One interleaved laser frame.
+  struct RawFrame
+  {
+    unsigned int width;
+    unsigned int height;
+    unsigned int depth;
+    std::vector<float> data;
+  };
+
+  /// \brief Benchmark options.
+  struct Options
+  {
+    std::vector<unsigned int> rays = {32768, 131072, 1048576};
+    std::vector<unsigned int> cameras = {1, 2, 3};
+    unsigned int vertical = 64;
+    unsigned int frames = 200;
+    double noise = 0.01;
+    double resolution = 0.001;
+    std::vector<unsigned int> sensors = {1, 2, 4, 8, 16, 32, 64};
+    std::string replay;
+  };
+
+  /// \brief Parse a comma separated list of unsigned integers.
+  std::vector<unsigned int> ParseList(const std::string &_text)
+  {
+    std::vector<unsigned int> values;
+    std::stringstream stream(_text);
+    std::string item;
+    while (std::getline(stream, item, ','))
+      values.push_back(std::stoul(item));
+    return values;
+  }
+
+  /// \brief Make a synthetic frame of a sensor looking at a wavy wall,
+  /// with rays split over _cameras sub-cameras like NpsBeamSensor::Init.
+  RawFrame SyntheticFrame(const unsigned int _rays,
+      const unsigned int _cameras, const unsigned int _vertical)
+  {
+    RawFrame frame;
+    frame.height = std::max(1u, std::min(_vertical, _rays));
+    frame.width = (_rays / frame.height / _cameras) * _cameras;
+    frame.depth = 3;
+    frame.data.resize(
+        static_cast<size_t>(frame.width) * frame.height * frame.depth);
+
+    const unsigned int perCamera = frame.width / _cameras;
+    for (unsigned int v = 0; v < frame.height; ++v)
+    {
+      for (unsigned int h = 0; h < frame.width; ++h)
+      {
+        // Seams between sub-cameras get a small range discontinuity
+        const unsigned int camera = h / perCamera;
+        const float range = 5.0f + 4.0f * std::sin(h * 0.01f) +
+          0.5f * std::cos(v * 0.1f) + 0.05f * camera;
+        float *cell =
+          &frame.data[(static_cast<size_t>(v) * frame.width + h) * 3];
+        cell[0] = (h + v) % 97 == 0 ? NAN : (h % 61 == 0 ? 100.0f : range);
+        cell[1] = 1.0f;
+        cell[2] = 0.0f;
+      }
+    }
+    return frame;
+  }
+
+  /// \brief Load frames from a replay file.
+  std::vector<RawFrame> LoadFrames(const std::string &_path)
+  {
+    std::vector<RawFrame> frames;
+    std::ifstream file(_path, std::ios::binary);
+    RawFrame frame;
+    while (file.read(reinterpret_cast<char *>(&frame.width), 4) &&
+           file.read(reinterpret_cast<char *>(&frame.height), 4) &&
+           file.read(reinterpret_cast<char *>(&frame.depth), 4))
+    {
+      frame.data.resize(
+          static_cast<size_t>(frame.width) * frame.height * frame.depth);
+      if (!file.read(reinterpret_cast<char *>(frame.data.data()),
+            frame.data.size() * sizeof(float)))
+      {
+        break;
+      }
+      frames.push_back(frame);
+    }
+    return frames;
+  }
+
+  /// \brief Get a percentile of sorted samples.
+  double Percentile(const std::vector<double> &_sorted, const double _p)
+  {
+    if (_sorted.empty())
+      return 0;
+    const size_t index = std::min(_sorted.size() - 1,
+        static_cast<size_t>(_p * (_sorted.size() - 1) + 0.5));
+    return _sorted[index];
+  }
+
+  /// \brief Run the post-render path over _frames and print one result
+  /// row.
+  void Run(const std::string &_label, const std::vector<RawFrame> &_frames,
+      const Options &_options)
+  {
+    NpsBeamScanProcessor processor;
+    processor.SetPool(&NpsBeamWorkerPool::Instance());
+    if (_options.noise > 0)
+    {
+      NpsBeamNoiseEngine engine;
+      engine.Configure(0.0, _options.noise, 0.0, 0.0, 0.0, 1);
+      processor.SetNoise(engine);
+    }
+
+    NpsBeamFrameStore store;
+    msgs::LaserScanStamped msg;
+    msgs::Set(msg.mutable_time(), common::Time());
+    msg.mutable_scan()->set_frame("bench");
+    std::string serialized;
+
+    auto runFrame = [&](const RawFrame &_raw)
+    {
+      const size_t count = static_cast<size_t>(_raw.width) * _raw.height;
+      NpsBeamFrame *frame = store.BeginWrite();
+      frame->Resize(_raw.width, _raw.height);
+      frame->rangeMin = 0.5;
+      frame->rangeMax = 30.0;
+      DeinterleaveBeamFrame(_raw.data.data(), count, _raw.depth,
+          frame->ranges.data(), frame->intensities.data());
+      processor.Process(*frame, count);
+      NpsBeamScanProcessor::FillScan(*frame, msg.mutable_scan());
+      msg.SerializeToString(&serialized);
+      store.EndWrite(frame);
+    };
+
+    // Warm up so buffers reach their steady state size
+    for (size_t i = 0; i < std::min<size_t>(_frames.size(), 3) + 2; ++i)
+      runFrame(_frames[i % _frames.size()]);
+
+    std::vector<double> latencies;
+    latencies.reserve(_options.frames);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+    {
+      const auto frameStart = std::chrono::steady_clock::now();
+      runFrame(_frames[i % _frames.size()]);
+      latencies.push_back(std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - frameStart).count());
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    const size_t cells =
+      static_cast<size_t>(_frames[0].width) * _frames[0].height;
+
+    std::printf("%-28s %10zu %10.1f %10.2f %10.1f %10.1f\n",
+        _label.c_str(), cells, _options.frames / seconds,
+        cells * _options.frames / seconds / 1e6,
+        Percentile(latencies, 0.5), Percentile(latencies, 0.99));
+  }
+
+  /// \brief Fill a LaserScan element by element, as UpdateImpl did
+  /// before the bulk copy: regrow the fields one value at a time when the
+  /// size changes, then set every value.
+  void FillScanPerElement(const NpsBeamFrame &_frame,
+      msgs::LaserScan *_scan)
+  {
+    const int numRays = static_cast<int>(_frame.ranges.size());
+    if (_scan->ranges_size() != numRays)
+    {
+      _scan->clear_ranges();
+      _scan->clear_intensities();
+      for (int i = 0; i < numRays; ++i)
+      {
+        _scan->add_ranges(NAN);
+        _scan->add_intensities(NAN);
+      }
+    }
+    for (int i = 0; i < numRays; ++i)
+    {
+      _scan->set_ranges(i, _frame.ranges[i]);
+      _scan->set_intensities(i, _frame.intensities[i]);
+    }
+  }
+
+  /// \brief Time filling the LaserScan of a processed frame of _rays
+  /// cells element by element and with FillScan, at a fixed size and
+  /// with the size changing every frame as when the resolution is
+  /// switched at run time, and print one row each.
+  void RunFill(const unsigned int _rays, const Options &_options)
+  {
+    // Two frames of slightly different size for the switching rows
+    NpsBeamFrame frames[2];
+    for (int k = 0; k < 2; ++k)
+    {
+      const RawFrame raw = SyntheticFrame(_rays - k * _rays / 8, 1,
+          _options.vertical);
+      const size_t count = static_cast<size_t>(raw.width) * raw.height;
+      frames[k].Resize(raw.width, raw.height);
+      DeinterleaveBeamFrame(raw.data.data(), count, raw.depth,
+          frames[k].ranges.data(), frames[k].intensities.data());
+    }
+
+    auto timeRow = [&](const std::string &_label, const bool _switch,
+        const bool _bulk, const double _baseRate)
+    {
+      msgs::LaserScan scan;
+      const auto fill = [&](const unsigned int _i)
+      {
+        const NpsBeamFrame &frame = frames[_switch ? _i % 2 : 0];
+        if (_bulk)
+          NpsBeamScanProcessor::FillScan(frame, &scan);
+        else
+          FillScanPerElement(frame, &scan);
+      };
+      fill(0);
+      fill(1);
+
+      const auto start = std::chrono::steady_clock::now();
+      for (unsigned int i = 0; i < _options.frames; ++i)
+        fill(i);
+      const double seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+
+      const double rate = frames[0].ranges.size() * _options.frames /
+        seconds;
+      std::printf("%-28s %10zu %10.1f %10.1f %10.2f\n",
+          _label.c_str(), frames[0].ranges.size(), _options.frames / seconds,
+          rate / 1e6, _baseRate > 0 ? rate / _baseRate : 1.0);
+      return rate;
+    };
+
+    const double elementRate = timeRow("fill per element", false, false,
+        0.0);
+    timeRow("fill bulk", false, true, elementRate);
+    const double switchRate = timeRow("fill per element switching", true,
+        false, 0.0);
+    timeRow("fill bulk switching", true, true, switchRate);
+  }
+
+  /// \brief Scan geometry read as NpsBeamSensor reads its NpsBeamGeometry.
+  struct GeometrySnapshot
+  {
+    double angleMin;
+    double angleMax;
+    double angleResolution;
+    double verticalAngleMin;
+    double verticalAngleMax;
+    double verticalAngleResolution;
+    double rangeMin;
+    double rangeMax;
+    double rangeResolution;
+    int rayCount;
+    int rangeCount;
+    int verticalRayCount;
+    int verticalRangeCount;
+  };
+
+  /// \brief Number of geometry accessor calls UpdateImpl made per frame.
+  const unsigned int kAccessorCalls = 13;
+
+  /// \brief Time the geometry accessor calls of one UpdateImpl, reading
+  /// the scan SDF elements as the accessors used to, taking a snapshot
+  /// per call as the public accessors now do, and taking one snapshot
+  /// per frame as UpdateImpl does, and print one row each.
+  void RunAccessors()
+  {
+    const std::string xml =
+      "<sdf version='1.6'><model name='m'><link name='l'>"
+      "<sensor name='beam' type='ray'><ray>"
+      "<scan><horizontal><samples>640</samples><resolution>1</resolution>"
+      "<min_angle>-1.1</min_angle><max_angle>1.1</max_angle></horizontal>"
+      "<vertical><samples>16</samples><resolution>1</resolution>"
+      "<min_angle>-0.2</min_angle><max_angle>0.2</max_angle></vertical>"
+      "</scan><range><min>0.5</min><max>30</max>"
+      "<resolution>0.01</resolution></range>"
+      "</ray></sensor></link></model></sdf>";
+    sdf::SDFPtr sdfFile(new sdf::SDF);
+    sdf::init(sdfFile);
+    if (!sdf::readString(xml, sdfFile))
+    {
+      std::fprintf(stderr, "Failed to parse the accessor SDF\n");
+      return;
+    }
+    sdf::ElementPtr rayElem = sdfFile->Root()->GetElement("model")->
+      GetElement("link")->GetElement("sensor")->GetElement("ray");
+    sdf::ElementPtr scanElem = rayElem->GetElement("scan");
+    sdf::ElementPtr horzElem = scanElem->GetElement("horizontal");
+    sdf::ElementPtr vertElem = scanElem->GetElement("vertical");
+    sdf::ElementPtr rangeElem = rayElem->GetElement("range");
+
+    std::shared_ptr<GeometrySnapshot> geom(new GeometrySnapshot);
+    geom->angleMin = horzElem->Get<double>("min_angle");
+    geom->angleMax = horzElem->Get<double>("max_angle");
+    geom->rayCount = horzElem->Get<unsigned int>("samples");
+    geom->rangeCount = geom->rayCount * horzElem->Get<double>("resolution");
+    geom->verticalAngleMin = vertElem->Get<double>("min_angle");
+    geom->verticalAngleMax = vertElem->Get<double>("max_angle");
+    geom->verticalRayCount = vertElem->Get<unsigned int>("samples");
+    geom->verticalRangeCount = geom->verticalRayCount *
+      vertElem->Get<double>("resolution");
+    geom->angleResolution = (geom->angleMax - geom->angleMin) /
+      (geom->rangeCount - 1);
+    geom->verticalAngleResolution =
+      (geom->verticalAngleMax - geom->verticalAngleMin) /
+      (geom->verticalRangeCount - 1);
+    geom->rangeMin = rangeElem->Get<double>("min");
+    geom->rangeMax = rangeElem->Get<double>("max");
+    geom->rangeResolution = rangeElem->Get<double>("resolution");
+    std::shared_ptr<const GeometrySnapshot> snapshot = geom;
+
+    // Accessor bodies before the geometry snapshot
+    auto sdfFrame = [&]()
+    {
+      double sum = 0;
+      const double angleMin = horzElem->Get<double>("min_angle");
+      const double angleMax = horzElem->Get<double>("max_angle");
+      const int rayCount = horzElem->Get<unsigned int>("samples");
+      const int rangeCount =
+        rayCount * horzElem->Get<double>("resolution");
+      sum += angleMin + angleMax + rayCount + rangeCount;
+      sum += (angleMax - angleMin) / (rangeCount - 1);
+      if (scanElem->HasElement("vertical"))
+      {
+        const double verticalMin = vertElem->Get<double>("min_angle");
+        const double verticalMax = vertElem->Get<double>("max_angle");
+        const int verticalRays = vertElem->Get<unsigned int>("samples");
+        const int verticalRanges = std::max(1, static_cast<int>(
+              verticalRays * vertElem->Get<double>("resolution")));
+        sum += verticalMin + verticalMax + verticalRays + verticalRanges;
+        sum += (verticalMax - verticalMin) / (verticalRanges - 1);
+      }
+      sum += rangeElem->Get<double>("min");
+      sum += rangeElem->Get<double>("max");
+      sum += rangeElem->Get<double>("resolution");
+      return sum;
+    };
+
+    // Public accessors, each taking its own snapshot
+    auto callFrame = [&]()
+    {
+      double sum = 0;
+      sum += std::atomic_load(&snapshot)->angleMin;
+      sum += std::atomic_load(&snapshot)->angleMax;
+      sum += std::atomic_load(&snapshot)->rayCount;
+      sum += std::atomic_load(&snapshot)->rangeCount;
+      sum += std::atomic_load(&snapshot)->angleResolution;
+      sum += std::atomic_load(&snapshot)->verticalAngleMin;
+      sum += std::atomic_load(&snapshot)->verticalAngleMax;
+      sum += std::atomic_load(&snapshot)->verticalRayCount;
+      sum += std::atomic_load(&snapshot)->verticalRangeCount;
+      sum += std::atomic_load(&snapshot)->verticalAngleResolution;
+      sum += std::atomic_load(&snapshot)->rangeMin;
+      sum += std::atomic_load(&snapshot)->rangeMax;
+      sum += std::atomic_load(&snapshot)->rangeResolution;
+      return sum;
+    };
+
+    // UpdateImpl, one snapshot per frame
+    auto snapshotFrame = [&]()
+    {
+      const std::shared_ptr<const GeometrySnapshot> frameGeom =
+        std::atomic_load(&snapshot);
+      return frameGeom->angleMin + frameGeom->angleMax +
+        frameGeom->rayCount + frameGeom->rangeCount +
+        frameGeom->angleResolution + frameGeom->verticalAngleMin +
+        frameGeom->verticalAngleMax + frameGeom->verticalRayCount +
+        frameGeom->verticalRangeCount + frameGeom->verticalAngleResolution +
+        frameGeom->rangeMin + frameGeom->rangeMax +
+        frameGeom->rangeResolution;
+    };
+
+    double sdfNs = 0;
+    auto timeRow = [&](const char *_label, const unsigned int _frames,
+        const std::function<double()> &_frame)
+    {
+      volatile double sink = 0;
+      const auto start = std::chrono::steady_clock::now();
+      for (unsigned int i = 0; i < _frames; ++i)
+        sink = sink + _frame();
+      const double ns = std::chrono::duration<double, std::nano>(
+          std::chrono::steady_clock::now() - start).count() / _frames;
+      if (sdfNs == 0)
+        sdfNs = ns;
+      std::printf("%-28s %10u %10.1f %10.2f %10.1f\n", _label,
+          kAccessorCalls, ns, ns / kAccessorCalls, sdfNs / ns);
+    };
+
+    timeRow("accessors sdf", 20000, sdfFrame);
+    timeRow("accessors snapshot/call", 1000000, callFrame);
+    timeRow("accessors snapshot/frame", 1000000, snapshotFrame);
+  }
+
+  /// \brief Time one range masking kernel on _rays cells with noise and
+  /// print one row.
+  /// \return Cells per second.
+  double RunKernel(const std::string &_label,
+      void (*_kernel)(const float *, const float *, float *, const size_t,
+        const float, const float),
+      const unsigned int _rays, const double _baseRate,
+      const Options &_options)
+  {
+    const RawFrame raw = SyntheticFrame(_rays, 1, _options.vertical);
+    const size_t count = static_cast<size_t>(raw.width) * raw.height;
+    std::vector<float> ranges(count);
+    DeinterleaveBeamFrame(raw.data.data(), count, raw.depth, ranges.data(),
+        nullptr);
+
+    NpsBeamNoiseEngine engine;
+    engine.Configure(0.0, _options.noise, 0.0, 0.0, 0.0, 1);
+    std::vector<float> noise(count);
+    engine.Fill(ranges.data(), noise.data(), count, 0, nullptr);
+
+    std::vector<float> out(count);
+    _kernel(ranges.data(), noise.data(), out.data(), count, 0.5f, 30.0f);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+      _kernel(ranges.data(), noise.data(), out.data(), count, 0.5f, 30.0f);
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    const double rate = count * _options.frames / seconds;
+    std::printf("%-28s %10zu %10.1f %10.1f %10.2f\n", _label.c_str(),
+        count, _options.frames / seconds, rate / 1e6,
+        _baseRate > 0 ? rate / _baseRate : 1.0);
+    return rate;
+  }
+
+  /// \brief Encode the first of _frames with each scan encoding and print
+  /// one bandwidth row per encoding.
+  void RunBandwidth(const std::string &_label,
+      const std::vector<RawFrame> &_frames, const Options &_options)
+  {
+    const RawFrame &raw = _frames[0];
+    const size_t count = static_cast<size_t>(raw.width) * raw.height;
+
+    NpsBeamScanProcessor processor;
+    NpsBeamFrame frame;
+    frame.Resize(raw.width, raw.height);
+    frame.rangeMin = 0.5;
+    frame.rangeMax = 30.0;
+    DeinterleaveBeamFrame(raw.data.data(), count, raw.depth,
+        frame.ranges.data(), frame.intensities.data());
+    processor.Process(frame, count);
+
+    msgs::LaserScanStamped msg;
+    msgs::Set(msg.mutable_time(), common::Time());
+    msg.mutable_scan()->set_frame("bench");
+    NpsBeamScanProcessor::FillScan(frame, msg.mutable_scan());
+    std::string serialized;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+      msg.SerializeToString(&serialized);
+    const double scanUs = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count() / _options.frames;
+    std::printf("%-28s %-14s %12zu %10.2f %10.1f %10s\n", _label.c_str(),
+        "laser_scan", serialized.size(),
+        static_cast<double>(serialized.size()) / count, scanUs, "-");
+
+    for (int delta = 0; delta < 2; ++delta)
+    {
+      NpsBeamScanCodec codec;
+      codec.Configure(_options.resolution, 0.0, delta != 0, true);
+
+      std::string encoded;
+      const auto encodeStart = std::chrono::steady_clock::now();
+      for (unsigned int i = 0; i < _options.frames; ++i)
+        codec.Encode(frame, encoded);
+      const double encodeUs = std::chrono::duration<double, std::micro>(
+          std::chrono::steady_clock::now() - encodeStart).count() /
+        _options.frames;
+
+      NpsBeamFrame decoded;
+      double maxError = -1;
+      if (NpsBeamScanCodec::Decode(encoded.data(), encoded.size(), decoded))
+      {
+        maxError = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+          const float a = frame.ranges[i];
+          const float b = decoded.ranges[i];
+          if (std::isfinite(a) || std::isfinite(b))
+            maxError = std::max(maxError, std::fabs(double(a) - b));
+          else if (std::isnan(a) != std::isnan(b) ||
+                   (!std::isnan(a) && a != b))
+            maxError = HUGE_VAL;
+        }
+      }
+
+      char error[32];
+      if (maxError < 0)
+        std::snprintf(error, sizeof(error), "decode failed");
+      else
+        std::snprintf(error, sizeof(error), "%.5f", maxError);
+      std::printf("%-28s %-14s %12zu %10.2f %10.1f %10s\n", _label.c_str(),
+          delta ? "compact_delta" : "compact", encoded.size(),
+          static_cast<double>(encoded.size()) / count, encodeUs, error);
+    }
+  }
+
+  /// \brief Fill a ray caster with a closed cubic room cluttered with
+  /// spheres, without building it.
+  void AddRoom(NpsBeamRayCaster &_caster, const float _halfRoom,
+      const unsigned int _spheres)
+  {
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    NpsBeamRayCaster::MakeBox(2 * _halfRoom, 2 * _halfRoom, 2 * _halfRoom,
+        vertices, indices);
+    _caster.AddMesh(vertices, indices, 1.0f);
+
+    for (unsigned int i = 0; i < _spheres; ++i)
+    {
+      vertices.clear();
+      indices.clear();
+      NpsBeamRayCaster::MakeSphere(0.25f, 24, vertices, indices);
+      const unsigned int mesh = _caster.AddMesh(vertices, indices, 2.0f);
+      const float transform[12] = {
+        1, 0, 0, std::fmod(i * 2.713f, 16.0f) - 8.0f,
+        0, 1, 0, std::fmod(i * 5.117f, 16.0f) - 8.0f,
+        0, 0, 1, std::fmod(i * 3.331f, 16.0f) - 8.0f};
+      _caster.SetTransform(mesh, transform);
+    }
+  }
+
+  /// \brief Fill a ray caster with a closed cubic room cluttered with
+  /// spheres, and build it.
+  void BuildRoom(NpsBeamRayCaster &_caster, const float _halfRoom,
+      const unsigned int _spheres)
+  {
+    AddRoom(_caster, _halfRoom, _spheres);
+    _caster.Build();
+  }
+
+  /// \brief Make unit ray directions fanning over the full sphere.
+  void SphereFan(const unsigned int _width, const unsigned int _height,
+      std::vector<float> &_directions)
+  {
+    _directions.resize(static_cast<size_t>(_width) * _height * 3);
+    for (unsigned int v = 0; v < _height; ++v)
+    {
+      const double pitch = -1.4 + 2.8 * v / std::max(1u, _height - 1);
+      for (unsigned int h = 0; h < _width; ++h)
+      {
+        const double yaw = -M_PI + 2 * M_PI * h / _width;
+        float *dir = &_directions[(static_cast<size_t>(v) * _width + h) * 3];
+        dir[0] = std::cos(pitch) * std::cos(yaw);
+        dir[1] = std::cos(pitch) * std::sin(yaw);
+        dir[2] = std::sin(pitch);
+      }
+    }
+  }
+
+  /// \brief Ray cast a full sphere fan from the center of a 20 m room,
+  /// optionally cluttered with spheres, and print one result row.
+  void RunRayCast(const unsigned int _rays, const unsigned int _spheres,
+      const Options &_options)
+  {
+    const float halfRoom = 10.0f;
+    NpsBeamRayCaster caster;
+    BuildRoom(caster, halfRoom, _spheres);
+
+    // Fan over the full sphere of directions
+    const unsigned int height = std::max(1u, std::min(_options.vertical,
+          _rays));
+    const unsigned int width = _rays / height;
+    const size_t count = static_cast<size_t>(width) * height;
+    std::vector<float> directions;
+    SphereFan(width, height, directions);
+
+    const float origin[3] = {0.1f, -0.2f, 0.05f};
+    const float rotation[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    std::vector<float> out(count * 3);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+    {
+      caster.Cast(origin, rotation, directions.data(), count, 0.1f, 100.0f,
+          out.data(), 3, &NpsBeamWorkerPool::Instance());
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-28s %10zu %10zu %10.1f %10.2f\n",
+        ("raycast spheres=" + std::to_string(_spheres)).c_str(), count,
+        caster.TriangleCount(), _options.frames / seconds,
+        count * _options.frames / seconds / 1e6);
+  }
+
+  /// \brief Ray cast the active sector of a 130 by 20 degree sonar fan
+  /// of _rays rays in a cluttered room, and print one result row.
+  /// \param[in] _rays Number of rays of the whole fan.
+  /// \param[in] _width Sector width in degrees, 130 for the whole fan.
+  /// \param[in] _sweep True to move the sector by one ray column every
+  /// frame, rebuilding its directions as NpsBeamCpuSource does.
+  /// \param[in] _fullRate Frames per second of the whole fan, 0 if this
+  /// is the whole fan.
+  /// \param[in] _options Benchmark options.
+  /// \return Frames per second.
+  double RunSector(const unsigned int _rays, const double _width,
+      const bool _sweep, const double _fullRate, const Options &_options)
+  {
+    NpsBeamRayCaster caster;
+    BuildRoom(caster, 10.0f, 500);
+
+    const double fan = 130.0 * M_PI / 180.0;
+    const double vertical = 20.0 * M_PI / 180.0;
+    const unsigned int height = std::max(1u, std::min(_options.vertical,
+          _rays));
+    const unsigned int fullWidth = std::max(2u, _rays / height);
+    const double step = fan / (fullWidth - 1);
+    const unsigned int width = std::min(fullWidth, std::max(2u,
+          static_cast<unsigned int>(std::ceil(
+              _width * M_PI / 180.0 / step)) + 1));
+    const size_t count = static_cast<size_t>(width) * height;
+
+    std::vector<float> directions(count * 3);
+    auto build = [&](const unsigned int _first)
+    {
+      for (unsigned int v = 0; v < height; ++v)
+      {
+        const double pitch = -vertical * 0.5 +
+          vertical * v / std::max(1u, height - 1);
+        for (unsigned int h = 0; h < width; ++h)
+        {
+          const double yaw = -fan * 0.5 + (_first + h) * step;
+          float *dir = &directions[(static_cast<size_t>(v) * width + h) * 3];
+          dir[0] = std::cos(pitch) * std::cos(yaw);
+          dir[1] = std::cos(pitch) * std::sin(yaw);
+          dir[2] = std::sin(pitch);
+        }
+      }
+    };
+    build((fullWidth - width) / 2);
+
+    const float origin[3] = {0.1f, -0.2f, 0.05f};
+    const float rotation[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    std::vector<float> out(count * 3);
+
+    // The head bounces between the ends of the fan
+    const unsigned int travel = fullWidth - width;
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+    {
+      if (_sweep && travel > 0)
+      {
+        const unsigned int phase = i % (2 * travel);
+        build(phase <= travel ? phase : 2 * travel - phase);
+      }
+      caster.Cast(origin, rotation, directions.data(), count, 0.1f, 100.0f,
+          out.data(), 3, &NpsBeamWorkerPool::Instance());
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    const double rate = _options.frames / seconds;
+
+    char label[64];
+    std::snprintf(label, sizeof(label), "sector %s %.0f deg",
+        _sweep ? "sweep" : "fixed", _width);
+    std::printf("%-28s %10zu %10u %10.1f %10.2f %10.2f\n", label, count,
+        width, rate, count * rate / 1e6,
+        _fullRate > 0 ? rate / _fullRate : 1.0);
+    return rate;
+  }
+
+  /// \brief Reduce the rays of a 130 by 20 degree sonar fan in the
+  /// cluttered room to K echoes per beam, and print one result row.
+  /// \param[in] _rays Number of rays of the fan.
+  /// \param[in] _echoes Echoes kept per beam.
+  /// \param[in] _options Benchmark options.
+  void RunEchoes(const unsigned int _rays, const unsigned int _echoes,
+      const Options &_options)
+  {
+    NpsBeamRayCaster caster;
+    BuildRoom(caster, 10.0f, 500);
+
+    const double fan = 130.0 * M_PI / 180.0;
+    const double vertical = 20.0 * M_PI / 180.0;
+    const unsigned int height = std::max(1u, std::min(_options.vertical,
+          _rays));
+    const unsigned int width = std::max(2u, _rays / height);
+    const size_t count = static_cast<size_t>(width) * height;
+    const unsigned int beams = std::max(1u, width / 4);
+
+    // Wide vertical beams see the walls, floor and spheres at once
+    std::vector<float> directions(count * 3);
+    for (unsigned int v = 0; v < height; ++v)
+    {
+      const double pitch = -vertical * 0.5 +
+        vertical * v / std::max(1u, height - 1);
+      for (unsigned int h = 0; h < width; ++h)
+      {
+        const double yaw = -fan * 0.5 + fan * h / (width - 1);
+        float *dir = &directions[(static_cast<size_t>(v) * width + h) * 3];
+        dir[0] = std::cos(pitch) * std::cos(yaw);
+        dir[1] = std::cos(pitch) * std::sin(yaw);
+        dir[2] = std::sin(pitch);
+      }
+    }
+
+    const float origin[3] = {0.1f, -0.2f, 0.05f};
+    const float rotation[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    std::vector<float> cast(count * 2);
+    caster.Cast(origin, rotation, directions.data(), count, 0.1f, 100.0f,
+        cast.data(), 2, &NpsBeamWorkerPool::Instance());
+    std::vector<float> ranges(count);
+    std::vector<float> intensities(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      ranges[i] = cast[i * 2];
+      intensities[i] = cast[i * 2 + 1];
+    }
+
+    NpsBeamMultiEcho multiEcho;
+    multiEcho.Configure(width, height, -fan * 0.5, fan * 0.5,
+        -vertical * 0.5, vertical * 0.5,
+        NpsBeamResampler::UniformAngles(-fan * 0.5, fan * 0.5, beams),
+        std::vector<double>(1, 0.0), _echoes, 0.5f);
+
+    NpsBeamFrame frame;
+    frame.Resize(beams, 1);
+    frame.ResizeEchoes(multiEcho.Echoes());
+    std::string encoded;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+    {
+      multiEcho.Apply(ranges.data(), intensities.data(), 0.1f, 100.0f,
+          frame.echoRanges.data(), frame.echoIntensities.data(),
+          frame.echoCounts.data(), &NpsBeamWorkerPool::Instance());
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    NpsBeamMultiEcho::Encode(frame, encoded);
+    size_t found = 0;
+    for (uint8_t echoes : frame.echoCounts)
+      found += echoes;
+
+    std::printf("%-28s %10zu %10u %10.1f %10.2f %10.2f %10.1f\n",
+        ("echoes k=" + std::to_string(_echoes)).c_str(), count, beams,
+        _options.frames / seconds, count * _options.frames / seconds / 1e6,
+        static_cast<double>(found) / beams,
+        static_cast<double>(encoded.size()) / beams);
+  }
+
+  /// \brief Smooth range field the resampling timings sample.
+  double ResampleField(const double _yaw, const double _pitch)
+  {
+    return 5.0 + 2.0 * std::sin(3.0 * _yaw) + std::cos(4.0 * _pitch);
+  }
+
+  /// \brief Resample a ray grid of _rays rays onto beam angles and print
+  /// one result row.
+  /// \param[in] _rays Number of source rays.
+  /// \param[in] _label Case name.
+  /// \param[in] _scale Output cells per source ray along each axis.
+  /// \param[in] _uniform False to space the output beams closer towards
+  /// the center.
+  void RunResample(const unsigned int _rays, const std::string &_label,
+      const double _scale, const bool _uniform, const Options &_options)
+  {
+    const double angleMin = -1.2;
+    const double angleMax = 1.2;
+    const double verticalMin = -0.3;
+    const double verticalMax = 0.3;
+
+    const unsigned int height = std::max(1u, std::min(_options.vertical,
+          _rays));
+    const unsigned int width = _rays / height;
+    const std::vector<double> rayAngles =
+      NpsBeamResampler::UniformAngles(angleMin, angleMax, width);
+    const std::vector<double> rayVerticalAngles =
+      NpsBeamResampler::UniformAngles(verticalMin, verticalMax, height);
+
+    std::vector<float> ranges(static_cast<size_t>(width) * height);
+    std::vector<float> intensities(ranges.size(), 1.0f);
+    for (unsigned int v = 0; v < height; ++v)
+    {
+      for (unsigned int h = 0; h < width; ++h)
+      {
+        ranges[static_cast<size_t>(v) * width + h] =
+          ResampleField(rayAngles[h], rayVerticalAngles[v]);
+      }
+    }
+
+    const unsigned int outWidth = std::max(1u,
+        static_cast<unsigned int>(width * _scale));
+    const unsigned int outHeight = std::max(1u,
+        static_cast<unsigned int>(height * _scale));
+    std::vector<double> angles =
+      NpsBeamResampler::UniformAngles(angleMin, angleMax, outWidth);
+    if (!_uniform)
+    {
+      // Denser towards the center, like a focused array
+      for (double &angle : angles)
+        angle = angleMax * std::sin(angle / angleMax * M_PI / 2);
+    }
+    const std::vector<double> verticalAngles =
+      NpsBeamResampler::UniformAngles(verticalMin, verticalMax, outHeight);
+
+    NpsBeamResampler resampler;
+    resampler.Configure(width, height, angleMin, angleMax, verticalMin,
+        verticalMax, angles, verticalAngles, 0.5f);
+
+    std::vector<float> outRanges(resampler.OutputCount());
+    std::vector<float> outIntensities(resampler.OutputCount());
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+    {
+      resampler.Apply(ranges.data(), intensities.data(), outRanges.data(),
+          outIntensities.data(), &NpsBeamWorkerPool::Instance());
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-28s %10zu %10zu %10.1f %10.2f\n",
+        ("resample " + _label).c_str(), ranges.size(), outRanges.size(),
+        _options.frames / seconds,
+        outRanges.size() * _options.frames / seconds / 1e6);
+  }
+
+  /// \brief Compute the points of a frame with per point trigonometry.
+  /// \return Number of points written.
+  size_t NaivePointCloud(const NpsBeamFrame &_frame, float *_out)
+  {
+    const double *p = _frame.pose;
+    const double w = p[3];
+    const double x = p[4];
+    const double y = p[5];
+    const double z = p[6];
+    const double rot[9] = {
+      1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w),
+      2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w),
+      2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y)};
+
+    size_t points = 0;
+    for (unsigned int v = 0; v < _frame.height; ++v)
+    {
+      const double pitch = _frame.height > 1 ?
+        _frame.verticalAngleMin + v * _frame.verticalAngleStep :
+        0.5 * (_frame.verticalAngleMin + _frame.verticalAngleMax);
+      for (unsigned int h = 0; h < _frame.width; ++h)
+      {
+        const size_t cell = static_cast<size_t>(v) * _frame.width + h;
+        const double range = _frame.ranges[cell];
+        if (!std::isfinite(range))
+          continue;
+
+        const double yaw = _frame.angleMin + h * _frame.angleStep;
+        const double sx = range * std::cos(pitch) * std::cos(yaw);
+        const double sy = range * std::cos(pitch) * std::sin(yaw);
+        const double sz = range * std::sin(pitch);
+        float *point = _out + points * NpsBeamPointCloud::PointStride;
+        point[0] = rot[0] * sx + rot[1] * sy + rot[2] * sz + p[0];
+        point[1] = rot[3] * sx + rot[4] * sy + rot[5] * sz + p[1];
+        point[2] = rot[6] * sx + rot[7] * sy + rot[8] * sz + p[2];
+        point[3] = _frame.intensities[cell];
+        ++points;
+      }
+    }
+    return points;
+  }
+
+  /// \brief Turn a processed synthetic frame into a world frame point
+  /// cloud with the direction table and with per point trigonometry, and
+  /// print one row for each.
+  void RunPointCloud(const RawFrame &_raw, const Options &_options)
+  {
+    const size_t count = static_cast<size_t>(_raw.width) * _raw.height;
+    NpsBeamFrame frame;
+    frame.Resize(_raw.width, _raw.height);
+    frame.rangeMin = 0.5;
+    frame.rangeMax = 30.0;
+    frame.angleMin = -1.2;
+    frame.angleMax = 1.2;
+    frame.angleStep = (frame.angleMax - frame.angleMin) /
+      std::max(1u, _raw.width - 1);
+    frame.verticalAngleMin = -0.3;
+    frame.verticalAngleMax = 0.3;
+    frame.verticalAngleStep = (frame.verticalAngleMax -
+        frame.verticalAngleMin) / std::max(1u, _raw.height - 1);
+    const double pose[7] = {120.5, -43.25, -7.0,
+      0.9238795, 0.0, 0.0, 0.3826834};
+    std::copy(pose, pose + 7, frame.pose);
+    DeinterleaveBeamFrame(_raw.data.data(), count, _raw.depth,
+        frame.ranges.data(), frame.intensities.data());
+    NpsBeamScanProcessor processor;
+    processor.Process(frame, count);
+
+    NpsBeamPointCloud cloud;
+    cloud.Configure(
+        NpsBeamResampler::UniformAngles(frame.angleMin, frame.angleMax,
+          frame.width),
+        NpsBeamResampler::UniformAngles(frame.verticalAngleMin,
+          frame.verticalAngleMax, frame.height));
+
+    std::vector<float> table(count * NpsBeamPointCloud::PointStride);
+    std::vector<float> naive(count * NpsBeamPointCloud::PointStride);
+    size_t tablePoints = 0;
+    size_t naivePoints = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+      tablePoints = cloud.Build(frame, true, table.data());
+    const double tableSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < _options.frames; ++i)
+      naivePoints = NaivePointCloud(frame, naive.data());
+    const double naiveSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    double maxError = naivePoints == tablePoints ? 0 : HUGE_VAL;
+    for (size_t i = 0; maxError < HUGE_VAL && i < tablePoints; ++i)
+    {
+      const float *a = &table[i * NpsBeamPointCloud::PointStride];
+      const float *b = &naive[i * NpsBeamPointCloud::PointStride];
+      maxError = std::max(maxError, std::sqrt(
+            (double(a[0]) - b[0]) * (double(a[0]) - b[0]) +
+            (double(a[1]) - b[1]) * (double(a[1]) - b[1]) +
+            (double(a[2]) - b[2]) * (double(a[2]) - b[2])));
+    }
+
+    std::printf("%-28s %10zu %10zu %10.1f %10.2f %10.5f\n",
+        "point_cloud table", count, tablePoints,
+        _options.frames / tableSeconds,
+        tablePoints * _options.frames / tableSeconds / 1e6, maxError);
+    std::printf("%-28s %10zu %10zu %10.1f %10.2f %10s\n",
+        "point_cloud trig", count, naivePoints,
+        _options.frames / naiveSeconds,
+        naivePoints * _options.frames / naiveSeconds / 1e6, "-");
+  }
+
+  /// \brief Nanoseconds on the steady clock.
+  int64_t Now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /// \brief Write or read exactly _size bytes of a socket.
+  /// \return False if the socket failed or closed.
+  bool Transfer(const int _socket, char *_data, size_t _size,
+      const bool _write)
+  {
+    while (_size > 0)
+    {
+      const ssize_t done = _write ? send(_socket, _data, _size, 0) :
+        recv(_socket, _data, _size, 0);
+      if (done <= 0)
+        return false;
+      _data += done;
+      _size -= static_cast<size_t>(done);
+    }
+    return true;
+  }
+
+  /// \brief Connect a pair of loopback TCP sockets.
+  /// \param[out] _sockets Sending and receiving socket.
+  /// \return False if the sockets could not be connected.
+  bool LoopbackPair(int _sockets[2])
+  {
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    bool ok = listener >= 0 &&
+      bind(listener, reinterpret_cast<sockaddr *>(&address), length) == 0 &&
+      listen(listener, 1) == 0 &&
+      getsockname(listener, reinterpret_cast<sockaddr *>(&address),
+          &length) == 0;
+
+    _sockets[0] = ok ? socket(AF_INET, SOCK_STREAM, 0) : -1;
+    ok = ok && _sockets[0] >= 0 && connect(_sockets[0],
+        reinterpret_cast<sockaddr *>(&address), length) == 0;
+    _sockets[1] = ok ? accept(listener, nullptr, nullptr) : -1;
+    ok = ok && _sockets[1] >= 0;
+    if (listener >= 0)
+      close(listener);
+
+    const int noDelay = 1;
+    for (int i = 0; ok && i < 2; ++i)
+    {
+      setsockopt(_sockets[i], IPPROTO_TCP, TCP_NODELAY, &noDelay,
+          sizeof(noDelay));
+    }
+    return ok;
+  }
+
+  /// \brief Print one row of the shared memory table.
+  void PrintDelivery(const std::string &_label, const size_t _cells,
+      std::vector<double> &_latencies, const double _seconds)
+  {
+    std::sort(_latencies.begin(), _latencies.end());
+    std::printf("%-28s %10zu %10.1f %10.1f %10.1f %10.1f\n",
+        _label.c_str(), _cells, _latencies.size() / _seconds,
+        _cells * 2 * sizeof(float) * _latencies.size() / _seconds / 1e6,
+        Percentile(_latencies, 0.5), Percentile(_latencies, 0.99));
+  }
+
+  /// \brief Deliver processed frames to a reader thread through the
+  /// shared memory ring and over loopback TCP, and print one row each.
+  void RunShm(const RawFrame &_raw, const Options &_options)
+  {
+    const size_t count = static_cast<size_t>(_raw.width) * _raw.height;
+    NpsBeamFrame frame;
+    frame.Resize(_raw.width, _raw.height);
+    frame.rangeMin = 0.5;
+    frame.rangeMax = 30.0;
+    DeinterleaveBeamFrame(_raw.data.data(), count, _raw.depth,
+        frame.ranges.data(), frame.intensities.data());
+    NpsBeamScanProcessor processor;
+    processor.Process(frame, count);
+
+    const unsigned int frames = std::max(1u, _options.frames);
+    std::vector<double> latencies;
+    latencies.reserve(frames);
+
+    // The reader acknowledges each frame with its receive time, and the
+    // writer waits for it so only one frame is in flight.
+    std::atomic<int64_t> received(0);
+    auto await = [&](const int64_t _sent)
+    {
+      int64_t time;
+      while ((time = received.load()) == 0)
+        std::this_thread::yield();
+      received = 0;
+      latencies.push_back((time - _sent) / 1e3);
+    };
+
+    const std::string name = "/nps_beam_bench_" + std::to_string(getpid());
+    NpsBeamShmWriter writer;
+    NpsBeamShmReader reader;
+    if (writer.Create(name, 8, count) && reader.Open(name))
+    {
+      std::atomic<bool> done(false);
+      std::thread thread([&]()
+          {
+            NpsBeamFrame copy;
+            while (!done)
+            {
+              if (reader.ReadNext(copy))
+                received = Now();
+              else
+                std::this_thread::yield();
+            }
+          });
+
+      const auto start = std::chrono::steady_clock::now();
+      for (unsigned int i = 0; i < frames; ++i)
+      {
+        const int64_t sent = Now();
+        writer.Write(frame);
+        await(sent);
+      }
+      const double seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      done = true;
+      thread.join();
+      PrintDelivery("shared memory", count, latencies, seconds);
+    }
+    else
+      std::printf("%-28s unavailable\n", "shared memory");
+    reader.Close();
+    writer.Close();
+
+    int sockets[2];
+    if (!LoopbackPair(sockets))
+    {
+      std::printf("%-28s unavailable\n", "transport tcp");
+      return;
+    }
+
+    latencies.clear();
+    std::thread thread([&]()
+        {
+          msgs::LaserScanStamped msg;
+          std::string buffer;
+          std::vector<float> ranges;
+          uint32_t size;
+          while (Transfer(sockets[1], reinterpret_cast<char *>(&size),
+                sizeof(size), false))
+          {
+            buffer.resize(size);
+            if (!Transfer(sockets[1], &buffer[0], size, false) ||
+                !msg.ParseFromString(buffer))
+            {
+              break;
+            }
+            ranges.assign(msg.scan().ranges().begin(),
+                msg.scan().ranges().end());
+            received = Now();
+          }
+        });
+
+    msgs::LaserScanStamped msg;
+    msgs::Set(msg.mutable_time(), common::Time());
+    msg.mutable_scan()->set_frame("bench");
+    std::string serialized;
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < frames; ++i)
+    {
+      const int64_t sent = Now();
+      NpsBeamScanProcessor::FillScan(frame, msg.mutable_scan());
+      msg.SerializeToString(&serialized);
+      uint32_t size = static_cast<uint32_t>(serialized.size());
+      if (!Transfer(sockets[0], reinterpret_cast<char *>(&size),
+            sizeof(size), true) ||
+          !Transfer(sockets[0], &serialized[0], size, true))
+      {
+        break;
+      }
+      await(sent);
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    close(sockets[0]);
+    thread.join();
+    close(sockets[1]);
+    PrintDelivery("transport tcp", count, latencies, seconds);
+  }
+
+  /// \brief Record frames to a file, in a burst and at 30 Hz, then read
+  /// them back, and print the recorder and replay rows.
+  void RunRecord(const RawFrame &_raw, const Options &_options)
+  {
+    const size_t count = static_cast<size_t>(_raw.width) * _raw.height;
+    const double frameMB = count * 2 * sizeof(float) / 1e6;
+    NpsBeamFrame frame;
+    frame.Resize(_raw.width, _raw.height);
+    DeinterleaveBeamFrame(_raw.data.data(), count, _raw.depth,
+        frame.ranges.data(), frame.intensities.data());
+
+    const unsigned int frames = std::max(1u, _options.frames);
+    const std::string path =
+      "/tmp/nps_beam_bench_" + std::to_string(getpid()) + ".beamrec";
+
+    // Burst: time the hand over on the calling thread, and the whole
+    // recording until the file is closed
+    NpsBeamRecorder recorder;
+    if (!recorder.Open(path, 64 << 20, 4))
+    {
+      std::printf("%-28s unavailable\n", "recorder");
+      return;
+    }
+    std::vector<double> latencies;
+    latencies.reserve(frames);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < frames; ++i)
+    {
+      frame.sequence = i;
+      frame.sec = i / 30;
+      frame.nsec = (i % 30) * 33333333;
+      const int64_t begin = Now();
+      while (!recorder.Write(frame))
+        std::this_thread::yield();
+      latencies.push_back((Now() - begin) / 1e3);
+    }
+    recorder.Close();
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%-28s %10zu %10.1f %10.1f %10.1f %10.1f %10s\n",
+        "recorder burst", count, frames / seconds,
+        frames * frameMB / seconds, Percentile(latencies, 0.5),
+        Percentile(latencies, 0.99), "-");
+
+    // Paced like a 30 Hz sensor, where no frame should be dropped
+    const std::string paced = path + ".paced";
+    const unsigned int pacedFrames = std::min(frames, 60u);
+    latencies.clear();
+    recorder.Open(paced, 64 << 20, 4);
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < pacedFrames; ++i)
+    {
+      std::this_thread::sleep_until(start + std::chrono::microseconds(
+            i * 33333));
+      const int64_t begin = Now();
+      recorder.Write(frame);
+      latencies.push_back((Now() - begin) / 1e3);
+    }
+    recorder.Close();
+    seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%-28s %10zu %10.1f %10.1f %10.1f %10.1f %10llu\n",
+        "recorder 30 Hz", count, pacedFrames / seconds,
+        pacedFrames * frameMB / seconds, Percentile(latencies, 0.5),
+        Percentile(latencies, 0.99),
+        static_cast<unsigned long long>(recorder.Dropped()));
+    unlink(paced.c_str());
+
+    // Replay: read every frame in order, then seek random stamps
+    NpsBeamRecordReader reader;
+    if (!reader.Open(path) || reader.Count() != frames)
+    {
+      std::printf("%-28s failed\n", "replay");
+      unlink(path.c_str());
+      return;
+    }
+    NpsBeamFrame copy;
+    latencies.clear();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reader.Count(); ++i)
+    {
+      const int64_t begin = Now();
+      reader.Read(i, copy);
+      latencies.push_back((Now() - begin) / 1e3);
+    }
+    seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    const unsigned int seeks = 100000;
+    const int64_t span = reader.Stamp(reader.Count() - 1);
+    size_t checksum = 0;
+    const int64_t seekStart = Now();
+    for (unsigned int i = 0; i < seeks; ++i)
+      checksum += reader.Seek((i * 7919ll) % (span + 1));
+    const double seekUs = (Now() - seekStart) / 1e3 / seeks;
+
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%-28s %10zu %10.1f %10.1f %10.1f %10.1f %10.3f\n",
+        "replay read", count, reader.Count() / seconds,
+        reader.Count() * frameMB / seconds, Percentile(latencies, 0.5),
+        Percentile(latencies, 0.99), checksum > 0 ? seekUs : 0.0);
+    reader.Close();
+    unlink(path.c_str());
+  }
+
+  /// \brief Remap a polar image onto a fan image by computing the polar
+  /// position of every pixel, laid out like NpsBeamFanImage.
+  void NaiveFanImage(const float *_polar, const unsigned int _beams,
+      const unsigned int _bins, const double _angleMin,
+      const double _angleMax, const double _rangeMin, const double _rangeMax,
+      const unsigned int _size, const double _resolution, float *_out)
+  {
+    const double yMax = _rangeMax * std::sin(_angleMax);
+    const double yMin = _rangeMax * std::sin(_angleMin);
+    const double top = _rangeMax + (_size * _resolution - _rangeMax) / 2;
+    const double left = yMax + (_size * _resolution - (yMax - yMin)) / 2;
+    const double beamStep = (_angleMax - _angleMin) / _beams;
+    for (unsigned int v = 0; v < _size; ++v)
+    {
+      const double x = top - (v + 0.5) * _resolution;
+      for (unsigned int u = 0; u < _size; ++u)
+      {
+        const double y = left - (u + 0.5) * _resolution;
+        const double range = std::sqrt(x * x + y * y);
+        const double angle = std::atan2(y, x);
+        float &out = _out[static_cast<size_t>(v) * _size + u];
+        if (range < _rangeMin || range > _rangeMax || angle < _angleMin ||
+            angle > _angleMax)
+        {
+          out = 0.0f;
+          continue;
+        }
+
+        const double bu = std::min(std::max((range - _rangeMin) * _bins /
+              (_rangeMax - _rangeMin) - 0.5, 0.0), _bins - 1.0);
+        const double au = std::min(std::max((angle - _angleMin) /
+              beamStep - 0.5, 0.0), _beams - 1.0);
+        const unsigned int k = std::min<unsigned int>(bu, _bins - 2);
+        const unsigned int b = std::min<unsigned int>(au, _beams - 2);
+        const float *p = _polar + b * _bins + k;
+        const float wx = bu - k;
+        const float wy = au - b;
+        const float t = p[0] + (p[1] - p[0]) * wx;
+        const float d = p[_bins] + (p[_bins + 1] - p[_bins]) * wx;
+        out = t + (d - t) * wy;
+      }
+    }
+  }
+
+  /// \brief Remap a synthetic polar image onto a square fan image with
+  /// the remap table and with per pixel trigonometry, and print one row
+  /// for each.
+  void RunFanImage(const unsigned int _size, const Options &_options)
+  {
+    const unsigned int beams = 256;
+    const unsigned int bins = 1000;
+    const double angleMin = -1.1;
+    const double angleMax = 1.1;
+    const double rangeMin = 0.5;
+    const double rangeMax = 30.0;
+
+    std::vector<float> polar(static_cast<size_t>(beams) * bins);
+    for (unsigned int b = 0; b < beams; ++b)
+    {
+      for (unsigned int k = 0; k < bins; ++k)
+      {
+        polar[b * bins + k] = 2.0f + std::sin(b * 0.07f) *
+          std::cos(k * 0.013f);
+      }
+    }
+    const double beamStep = (angleMax - angleMin) / beams;
+    const std::vector<double> beamAngles = NpsBeamResampler::UniformAngles(
+        angleMin + beamStep / 2, angleMax - beamStep / 2, beams);
+
+    NpsBeamFanImage fan;
+    auto start = std::chrono::steady_clock::now();
+    fan.Configure(_size, _size, angleMin, angleMax, beamAngles, bins,
+        rangeMin, rangeMax);
+    const double buildMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    const size_t pixels = static_cast<size_t>(_size) * _size;
+    const unsigned int frames = std::max(3u, static_cast<unsigned int>(
+          _options.frames * 262144.0 / pixels));
+    std::vector<float> table(pixels);
+    std::vector<float> naive(pixels);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < frames; ++i)
+      fan.Apply(polar.data(), table.data(), &NpsBeamWorkerPool::Instance());
+    const double tableSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < frames; ++i)
+    {
+      NaiveFanImage(polar.data(), beams, bins, angleMin, angleMax, rangeMin,
+          rangeMax, _size, fan.Resolution(), naive.data());
+    }
+    const double naiveSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    double maxError = 0;
+    for (size_t i = 0; i < pixels; ++i)
+      maxError = std::max(maxError, std::fabs(double(table[i]) - naive[i]));
+
+    const std::string label = "fan " + std::to_string(_size) + "x" +
+      std::to_string(_size);
+    std::printf("%-28s %10zu %10.1f %10.2f %10.1f %10.5f\n",
+        (label + " table").c_str(), fan.FanPixelCount(),
+        frames / tableSeconds, pixels * frames / tableSeconds / 1e6,
+        buildMs, maxError);
+    std::printf("%-28s %10zu %10.1f %10.2f %10s %10s\n",
+        (label + " trig").c_str(), fan.FanPixelCount(),
+        frames / naiveSeconds, pixels * frames / naiveSeconds / 1e6, "-",
+        "-");
+  }
+
+  /// \brief Bin a frame into a 256 beam by 1000 bin intensity image on
+  /// the calling thread and on the worker pool, and print one row each.
+  void RunBinner(const RawFrame &_raw, const Options &_options)
+  {
+    const size_t cells = static_cast<size_t>(_raw.width) * _raw.height;
+    std::vector<float> ranges(cells);
+    std::vector<float> intensities(cells);
+    for (size_t i = 0; i < cells; ++i)
+    {
+      ranges[i] = _raw.data[i * _raw.depth];
+      intensities[i] = _raw.data[i * _raw.depth + 1];
+    }
+
+    NpsBeamIntensityBinner binner;
+    binner.Configure(_raw.width, _raw.height, 256, 1000, 0.5f, 20.0f,
+        NpsBeamIntensityBinner::GaussianPattern(_raw.height, -0.1,
+          0.2 / std::max(1u, _raw.height - 1), 0.1));
+    std::vector<float> image(
+        static_cast<size_t>(binner.Beams()) * binner.Bins());
+
+    double serialRate = 0;
+    for (int pooled = 0; pooled < 2; ++pooled)
+    {
+      NpsBeamWorkerPool *pool =
+        pooled ? &NpsBeamWorkerPool::Instance() : nullptr;
+      const auto start = std::chrono::steady_clock::now();
+      for (unsigned int i = 0; i < _options.frames; ++i)
+      {
+        binner.Accumulate(ranges.data(), intensities.data(), image.data(),
+            pool);
+      }
+      const double seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      const double rate = _options.frames / seconds;
+      if (!pooled)
+        serialRate = rate;
+
+      std::printf("%-28s %10zu %10.1f %10.1f %10.2f\n",
+          pooled ? "beam image 256x1000 pool" : "beam image 256x1000 serial",
+          cells, rate, cells * rate / 1e6, rate / serialRate);
+    }
+  }
+
+  /// \brief Publisher that serializes each message into a reused buffer.
+  class SerializingPublisher : public NpsBeamPublisher
+  {
+    // Documentation inherited
+    public: virtual bool HasConnections() const
+            {
+              return true;
+            }
+
+    // Documentation inherited
+    public: virtual void Publish(const google::protobuf::Message &_msg)
+            {
+              _msg.SerializeToString(&this->buffer);
+            }
+
+    /// \brief Last serialized message.
+    private: std::string buffer;
+  };
+
+  /// \brief Process a frame through NpsBeamOutputs as the sensor does,
+  /// with diagnostics disabled and enabled, and print one row each.
+  void RunDiagnostics(const RawFrame &_raw, const Options &_options)
+  {
+    const size_t cells = static_cast<size_t>(_raw.width) * _raw.height;
+
+    NpsBeamGeometry geom;
+    geom.angleMin = -1.0;
+    geom.angleMax = 1.0;
+    geom.rangeMin = 0.5;
+    geom.rangeMax = 30.0;
+    geom.rangeResolution = _options.resolution;
+    geom.rayCount = geom.rangeCount = geom.fullRayCount =
+      geom.fullRangeCount = _raw.width;
+    geom.verticalRayCount = geom.verticalRangeCount = _raw.height;
+    geom.version = 1;
+
+    double offRate = 0;
+    for (int enabled = 0; enabled < 2; ++enabled)
+    {
+      NpsBeamOutputs outputs;
+      outputs.processor.SetPool(&NpsBeamWorkerPool::Instance());
+      if (_options.noise > 0)
+      {
+        NpsBeamNoiseEngine engine;
+        engine.Configure(0.0, _options.noise, 0.0, 0.0, 0.0, 1);
+        outputs.processor.SetNoise(engine);
+      }
+      outputs.laserMsg.mutable_scan()->set_frame("bench");
+      outputs.scanPub.reset(new SerializingPublisher);
+      outputs.diagnostics.SetEnabled(enabled != 0);
+      if (enabled)
+      {
+        outputs.diagnosticsRate = 1.0;
+        outputs.diagnosticsPub.reset(new SerializingPublisher);
+      }
+
+      // One update: the frame is timed around ProcessFrame and the
+      // summary published if due, as UpdateImpl does
+      auto runFrame = [&]()
+      {
+        const NpsBeamDiagnostics::Clock::time_point start =
+          NpsBeamDiagnostics::Clock::now();
+        NpsBeamFrame *frame = outputs.frameStore.BeginWrite();
+        frame->Resize(_raw.width, _raw.height);
+        frame->rangeMin = geom.rangeMin;
+        frame->rangeMax = geom.rangeMax;
+        DeinterleaveBeamFrame(_raw.data.data(), cells, _raw.depth,
+            frame->ranges.data(), frame->intensities.data());
+        outputs.ProcessFrame(frame, geom, static_cast<int>(cells), false);
+
+        const NpsBeamDiagnostics::Clock::time_point end =
+          NpsBeamDiagnostics::Clock::now();
+        outputs.diagnostics.Record(NpsBeamDiagnostics::UPDATE, start, end);
+        outputs.PublishDiagnostics(end);
+      };
+
+      for (int i = 0; i < 5; ++i)
+        runFrame();
+
+      std::vector<double> latencies;
+      latencies.reserve(_options.frames);
+      const auto start = std::chrono::steady_clock::now();
+      for (unsigned int i = 0; i < _options.frames; ++i)
+      {
+        const auto frameStart = std::chrono::steady_clock::now();
+        runFrame();
+        latencies.push_back(std::chrono::duration<double, std::micro>(
+              std::chrono::steady_clock::now() - frameStart).count());
+      }
+      const double seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      const double rate = _options.frames / seconds;
+      if (!enabled)
+        offRate = rate;
+
+      std::sort(latencies.begin(), latencies.end());
+      std::printf("%-28s %10zu %10.1f %10.1f %10.1f %9.1f%%\n",
+          enabled ? "diagnostics 1 Hz" : "diagnostics off", cells, rate,
+          Percentile(latencies, 0.5), Percentile(latencies, 0.99),
+          100.0 * (offRate / rate - 1.0));
+    }
+  }
+
+  /// \brief Cull a 5000 model harbour around a sonar moving through it,
+  /// with the index and by testing every model, and print one row each.
+  /// \param[in] _range Sonar range in meters.
+  void RunCull(const double _range, const Options &_options)
+  {
+    const unsigned int models = 5000;
+    std::vector<double> boxes(models * 6);
+    unsigned int seed = 7;
+    auto random = [&seed]()
+    {
+      seed = seed * 1664525u + 1013904223u;
+      return (seed >> 8) / 16777216.0;
+    };
+    auto place = [&](const unsigned int _i)
+    {
+      double *box = &boxes[_i * 6];
+      const double size = 0.5 + 8.0 * random() * random();
+      const double center[3] = {2000.0 * random() - 1000.0,
+        2000.0 * random() - 1000.0, 4.0 * random() - 3.0};
+      for (int k = 0; k < 3; ++k)
+      {
+        box[k] = center[k] - size / 2;
+        box[k + 3] = center[k] + size / 2;
+      }
+    };
+
+    // Seabed terrain under the whole harbour, then buoys and hulls
+    const double terrain[6] = {-1000, -1000, -40, 1000, 1000, -5};
+    std::copy(terrain, terrain + 6, boxes.begin());
+    for (unsigned int i = 1; i < models; ++i)
+      place(i);
+
+    NpsBeamCullIndex index(10.0);
+    for (unsigned int i = 0; i < models; ++i)
+      index.Insert(&boxes[i * 6], &boxes[i * 6 + 3]);
+
+    NpsBeamCullVolume volume;
+    volume.range = _range;
+    volume.angleMin = -1.1;
+    volume.angleMax = 1.1;
+    volume.verticalAngleMin = -0.35;
+    volume.verticalAngleMax = 0.35;
+    auto move = [&](const unsigned int _frame)
+    {
+      const double yaw = _frame * 0.01;
+      volume.origin[0] = 600.0 * std::cos(yaw * 0.3);
+      volume.origin[1] = 600.0 * std::sin(yaw * 0.2);
+      volume.origin[2] = -2.0;
+      volume.rotation[0] = std::cos(yaw);
+      volume.rotation[1] = -std::sin(yaw);
+      volume.rotation[3] = std::sin(yaw);
+      volume.rotation[4] = std::cos(yaw);
+    };
+
+    // Each frame 2% of the models drift, like floating objects
+    const unsigned int frames = std::max(1u, _options.frames) * 5;
+    std::vector<unsigned int> moved;
+    std::vector<unsigned int> culled;
+    std::vector<unsigned int> brute;
+    size_t culledTotal = 0;
+    size_t mismatches = 0;
+    double indexSeconds = 0;
+    double bruteSeconds = 0;
+    for (unsigned int f = 0; f < frames; ++f)
+    {
+      moved.clear();
+      for (unsigned int m = 0; m < models / 50; ++m)
+      {
+        moved.push_back(1 + static_cast<unsigned int>(
+              random() * (models - 1)));
+        place(moved.back());
+      }
+      move(f);
+
+      auto start = std::chrono::steady_clock::now();
+      for (const unsigned int i : moved)
+        index.Update(i, &boxes[i * 6], &boxes[i * 6 + 3]);
+      index.Cull(volume, culled);
+      auto end = std::chrono::steady_clock::now();
+      indexSeconds += std::chrono::duration<double>(end - start).count();
+
+      start = end;
+      brute.clear();
+      for (unsigned int i = 0; i < models; ++i)
+      {
+        if (!volume.Intersects(&boxes[i * 6], &boxes[i * 6 + 3]))
+          brute.push_back(i);
+      }
+      end = std::chrono::steady_clock::now();
+      bruteSeconds += std::chrono::duration<double>(end - start).count();
+
+      culledTotal += culled.size();
+      if (culled != brute)
+        ++mismatches;
+    }
+
+    const double culledMean = static_cast<double>(culledTotal) / frames;
+    std::printf("%-28s %10u %10.1f %10.1f %10.2f %10zu\n",
+        ("cull index range=" + std::to_string(
+          static_cast<int>(_range))).c_str(), models, models - culledMean,
+        culledMean, indexSeconds / frames * 1e6, mismatches);
+    std::printf("%-28s %10u %10.1f %10.1f %10.2f %10s\n",
+        ("cull all range=" + std::to_string(
+          static_cast<int>(_range))).c_str(), models, models - culledMean,
+        culledMean, bruteSeconds / frames * 1e6, "-");
+  }
+
+  /// \brief Post-render state of one simulated sensor.
+  struct BenchSensor
+  {
+    NpsBeamScanProcessor processor;
+    NpsBeamFrameStore store;
+    NpsBeamPipeline pipeline;
+    msgs::LaserScanStamped msg;
+    std::string serialized;
+    double period = 0;
+    double lastUpdate = -1e9;
+  };
+
+  /// \brief Run _sensors simulated sensors through a render scheduler for
+  /// _options.frames / 4 ticks and print one result row.
+  /// \param[in] _sensors Number of sensors.
+  /// \param[in] _raw Frame every sensor reads back.
+  /// \param[in] _shared Run the pipelines on the shared pool instead of
+  /// one thread each.
+  void RunSensors(const unsigned int _sensors, const RawFrame &_raw,
+      const bool _shared, const Options &_options)
+  {
+    NpsBeamWorkerPool &pool = NpsBeamWorkerPool::Instance();
+    const size_t count = static_cast<size_t>(_raw.width) * _raw.height;
+
+    // Ticks advance a simulated clock at 20 Hz; half the sensors run at
+    // 20 Hz and half at 10 Hz, so the scheduler keeps two rate groups
+    NpsBeamScheduler scheduler;
+    const double tickPeriod = 0.05;
+    double simTime = 0;
+    double callbackSeconds = 0;
+    size_t frames = 0;
+
+    std::vector<std::unique_ptr<BenchSensor>> sensors;
+    std::vector<unsigned int> ids;
+    for (unsigned int i = 0; i < _sensors; ++i)
+    {
+      std::unique_ptr<BenchSensor> sensor(new BenchSensor);
+      sensor->processor.SetPool(&pool);
+      if (_options.noise > 0)
+      {
+        NpsBeamNoiseEngine engine;
+        engine.Configure(0.0, _options.noise, 0.0, 0.0, 0.0, i + 1);
+        sensor->processor.SetNoise(engine);
+      }
+      sensor->pipeline.Start(2, _shared ? &pool : nullptr);
+      msgs::Set(sensor->msg.mutable_time(), common::Time());
+      sensor->msg.mutable_scan()->set_frame("bench");
+      const double rate = i % 2 ? 10.0 : 20.0;
+      sensor->period = 1.0 / rate;
+
+      // Like NpsBeamSensor: render declines when not due, the readback
+      // deinterleaves the frame and hands it to the pipeline
+      BenchSensor *data = sensor.get();
+      ids.push_back(scheduler.Add(rate,
+          [data, &simTime, &callbackSeconds]()
+          {
+            const auto start = std::chrono::steady_clock::now();
+            const bool due =
+              simTime - data->lastUpdate >= data->period - 1e-9;
+            if (due)
+              data->lastUpdate = simTime;
+            callbackSeconds += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            return due;
+          },
+          [data, &_raw, count, &callbackSeconds, &frames]()
+          {
+            const auto start = std::chrono::steady_clock::now();
+            NpsBeamFrame *frame = data->store.BeginWrite();
+            frame->Resize(_raw.width, _raw.height);
+            frame->rangeMin = 0.5;
+            frame->rangeMax = 30.0;
+            DeinterleaveBeamFrame(_raw.data.data(), count, _raw.depth,
+                frame->ranges.data(), frame->intensities.data());
+            data->pipeline.Submit([data, frame, count]()
+                {
+                  data->processor.Process(*frame, count);
+                  NpsBeamScanProcessor::FillScan(*frame,
+                      data->msg.mutable_scan());
+                  data->msg.SerializeToString(&data->serialized);
+                  data->store.EndWrite(frame);
+                }, true);
+            ++frames;
+            callbackSeconds += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+          }));
+      sensors.push_back(std::move(sensor));
+    }
+
+    for (int i = 0; i < 4; ++i, simTime += tickPeriod)
+      scheduler.Tick();
+    for (auto &sensor : sensors)
+      sensor->pipeline.Flush();
+
+    const unsigned int ticks = std::max(2u, _options.frames / 4);
+    frames = 0;
+    callbackSeconds = 0;
+    const auto start = std::chrono::steady_clock::now();
+    double tickSeconds = 0;
+    for (unsigned int i = 0; i < ticks; ++i, simTime += tickPeriod)
+    {
+      const auto tickStart = std::chrono::steady_clock::now();
+      scheduler.Tick();
+      tickSeconds += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - tickStart).count();
+    }
+    for (auto &sensor : sensors)
+      sensor->pipeline.Flush();
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    for (unsigned int id : ids)
+      scheduler.Remove(id);
+
+    std::printf("%-28s %10u %10zu %10.1f %10.1f %10.2f %10.2f\n",
+        (_shared ? "sensors shared_pool" : "sensors thread_each"),
+        _sensors, count, frames / seconds, ticks / seconds,
+        count * frames / seconds / 1e6,
+        (tickSeconds - callbackSeconds) / ticks * 1e6);
+  }
+
+  /// \brief Initialization state of one CPU ray casting sensor.
+  struct StartupSensor
+  {
+    NpsBeamGpuLayout layout;
+    NpsBeamRayCaster caster;
+    std::atomic<bool> ready{false};
+    NpsBeamFrame frame;
+    std::vector<float> data;
+  };
+
+  /// \brief Start _sensors CPU ray casting sensors in a cluttered room,
+  /// building their scenes one after the other or on the worker pool, and
+  /// print the time until every sensor published its first scan.
+  /// \param[in] _sensors Number of sensors.
+  /// \param[in] _concurrent Build the scenes on the pool, as
+  /// NpsBeamCpuSource does.
+  void RunStartup(const unsigned int _sensors, const bool _concurrent,
+      const Options &_options)
+  {
+    NpsBeamWorkerPool &pool = NpsBeamWorkerPool::Instance();
+    const unsigned int spheres = 200;
+    const unsigned int height = std::max(1u, std::min(_options.vertical,
+          _options.rays[0]));
+    const unsigned int width = _options.rays[0] / height;
+    const size_t count = static_cast<size_t>(width) * height;
+    std::vector<float> directions;
+    SphereFan(width, height, directions);
+    const float origin[3] = {0.1f, -0.2f, 0.05f};
+    const float rotation[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    NpsBeamScanProcessor processor;
+    processor.SetPool(&pool);
+
+    std::vector<std::unique_ptr<StartupSensor>> sensors;
+    for (unsigned int i = 0; i < _sensors; ++i)
+      sensors.emplace_back(new StartupSensor);
+
+    // Init runs one sensor after the other, like the sensor manager
+    const auto start = std::chrono::steady_clock::now();
+    for (auto &sensor : sensors)
+    {
+      StartupSensor *data = sensor.get();
+      data->layout = NpsBeamGpuLayout::Compute(width, height, -M_PI,
+          M_PI, -1.4, 1.4);
+      // Shapes are read on the calling thread, only the hierarchy is
+      // built on the pool
+      AddRoom(data->caster, 10.0f, spheres);
+      auto build = [data]()
+      {
+        data->caster.Build();
+        data->ready = true;
+      };
+      if (_concurrent)
+        pool.Post(build);
+      else
+        build();
+    }
+
+    // First update of every sensor: wait for its scene, cast and process
+    std::vector<double> firstScan;
+    size_t triangles = 0;
+    for (auto &sensor : sensors)
+    {
+      while (!sensor->ready)
+        std::this_thread::yield();
+      sensor->data.resize(count * 3);
+      sensor->caster.Cast(origin, rotation, directions.data(), count, 0.1f,
+          100.0f, sensor->data.data(), 3, &pool);
+      sensor->frame.Resize(width, height);
+      sensor->frame.rangeMin = 0.1;
+      sensor->frame.rangeMax = 100.0;
+      DeinterleaveBeamFrame(sensor->data.data(), count, 3,
+          sensor->frame.ranges.data(), sensor->frame.intensities.data());
+      processor.Process(sensor->frame, count);
+      firstScan.push_back(std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count());
+      triangles = sensor->caster.TriangleCount();
+    }
+
+    std::printf("%-28s %10u %10zu %10zu %10.1f %10.1f\n",
+        _concurrent ? "startup concurrent" : "startup serial", _sensors,
+        count, triangles, firstScan[firstScan.size() / 2],
+        firstScan.back());
+  }
+
+  /// \brief Print the bandwidth table header.
+  void PrintBandwidthHeader()
+  {
+    std::printf("\n%-28s %-14s %12s %10s %10s %10s\n", "case", "encoding",
+        "bytes", "bytes/cell", "encode us", "max error");
+  }
+}
+
+//////////////////////////////////////////////////
+int main(int _argc, char **_argv)
+{
+  Options options;
+  for (int i = 1; i + 1 < _argc; i += 2)
+  {
+    const std::string arg = _argv[i];
+    const std::string value = _argv[i + 1];
+    if (arg == "--rays")
+      options.rays = ParseList(value);
+    else if (arg == "--cameras")
+      options.cameras = ParseList(value);
+    else if (arg == "--vertical")
+      options.vertical = std::stoul(value);
+    else if (arg == "--frames")
+      options.frames = std::stoul(value);
+    else if (arg == "--noise")
+      options.noise = std::stod(value);
+    else if (arg == "--resolution")
+      options.resolution = std::stod(value);
+    else if (arg == "--sensors")
+      options.sensors = ParseList(value);
+    else if (arg == "--replay")
+      options.replay = value;
+    else
+    {
+      std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  std::printf("kernel isa: %s, worker threads: %u\n", BeamScanKernelIsa(),
+      NpsBeamWorkerPool::Instance().ThreadCount());
+  std::printf("%-28s %10s %10s %10s %10s %10s\n", "case", "cells",
+      "frames/s", "Mcells/s", "p50 us", "p99 us");
+
+  if (!options.replay.empty())
+  {
+    const std::vector<RawFrame> frames = LoadFrames(options.replay);
+    if (frames.empty())
+    {
+      std::fprintf(stderr, "No frames in %s\n", options.replay.c_str());
+      return 1;
+    }
+    Run("replay", frames, options);
+    PrintBandwidthHeader();
+    RunBandwidth("replay", frames, options);
+    return 0;
+  }
+
+  for (unsigned int rays : options.rays)
+  {
+    for (unsigned int cameras : options.cameras)
+    {
+      std::vector<RawFrame> frames(1,
+          SyntheticFrame(rays, cameras, options.vertical));
+      Run("synthetic cameras=" + std::to_string(cameras), frames, options);
+    }
+  }
+
+  std::printf("\n%-28s %10s %10s %10s %10s\n", "case", "rays",
+      "frames/s", "Mrays/s", "speedup");
+  for (unsigned int rays : {32768u, 131072u, 1048576u})
+    RunFill(rays, options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s\n", "case", "calls",
+      "ns/frame", "ns/call", "speedup");
+  RunAccessors();
+
+  std::printf("\n%-28s %10s %10s %10s %10s\n", "case", "cells",
+      "frames/s", "Mcells/s", "speedup");
+  for (unsigned int rays : options.rays)
+  {
+    const double scalarRate = RunKernel("kernel scalar",
+        ProcessBeamRangesScalar, rays, 0.0, options);
+#if defined(__SSE2__)
+    RunKernel("kernel sse2", ProcessBeamRangesSse2, rays, scalarRate,
+        options);
+#endif
+#if defined(__AVX2__)
+    RunKernel("kernel avx2", ProcessBeamRangesAvx2, rays, scalarRate,
+        options);
+#endif
+  }
+
+  std::printf("\n%-28s %10s %10s %10s %10s\n", "case", "rays",
+      "triangles", "frames/s", "Mrays/s");
+  for (unsigned int rays : options.rays)
+  {
+    RunRayCast(rays, 0, options);
+    RunRayCast(rays, 500, options);
+  }
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s\n", "case", "rays",
+      "columns", "frames/s", "Mrays/s", "speedup");
+  {
+    const double fullRate = RunSector(options.rays[0], 130.0, false, 0.0,
+        options);
+    for (double width : {60.0, 30.0, 10.0})
+      RunSector(options.rays[0], width, false, fullRate, options);
+    RunSector(options.rays[0], 30.0, true, fullRate, options);
+  }
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s %10s\n", "case", "rays",
+      "beams", "frames/s", "Mrays/s", "echoes/bm", "bytes/bm");
+  for (unsigned int echoes = 1; echoes <= 5; ++echoes)
+    RunEchoes(options.rays[0], echoes, options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s\n", "case", "rays",
+      "cells", "frames/s", "Mcells/s");
+  for (unsigned int rays : options.rays)
+  {
+    RunResample(rays, "identity", 1.0, true, options);
+    RunResample(rays, "half", 0.5, true, options);
+    RunResample(rays, "double", 2.0, true, options);
+    RunResample(rays, "nonuniform", 1.0, false, options);
+  }
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s\n", "case", "cells",
+      "points", "frames/s", "Mpoints/s", "max error");
+  for (unsigned int rays : options.rays)
+    RunPointCloud(SyntheticFrame(rays, 1, options.vertical), options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s\n", "case", "cells",
+      "frames/s", "Mcells/s", "speedup");
+  for (unsigned int rays : options.rays)
+    RunBinner(SyntheticFrame(rays, 1, options.vertical), options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s\n", "case", "cells",
+      "frames/s", "p50 us", "p99 us", "overhead");
+  for (unsigned int rays : options.rays)
+    RunDiagnostics(SyntheticFrame(rays, 1, options.vertical), options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s\n", "case",
+      "fan pixels", "frames/s", "Mpixels/s", "build ms", "max error");
+  for (unsigned int size : {1024u, 2048u, 4096u})
+    RunFanImage(size, options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s\n", "case", "cells",
+      "frames/s", "MB/s", "p50 us", "p99 us");
+  for (unsigned int rays : options.rays)
+    RunShm(SyntheticFrame(rays, 1, options.vertical), options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s %10s\n", "case", "cells",
+      "frames/s", "MB/s", "p50 us", "p99 us", "drop/seek");
+  RunRecord(SyntheticFrame(131072, 1, options.vertical), options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s %10s\n", "case",
+      "sensors", "cells", "frames/s", "ticks/s", "Mcells/s", "sched us");
+  {
+    const RawFrame raw = SyntheticFrame(options.rays[0], 1,
+        options.vertical);
+    for (int shared = 0; shared < 2; ++shared)
+    {
+      for (unsigned int sensors : options.sensors)
+        RunSensors(sensors, raw, shared != 0, options);
+    }
+  }
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s\n", "case", "models",
+      "visible", "culled", "us/frame", "mismatch");
+  for (double range : {30.0, 100.0, 300.0})
+    RunCull(range, options);
+
+  std::printf("\n%-28s %10s %10s %10s %10s %10s\n", "case", "sensors",
+      "cells", "triangles", "p50 ms", "last ms");
+  for (int concurrent = 0; concurrent < 2; ++concurrent)
+  {
+    for (unsigned int sensors : options.sensors)
+      RunStartup(sensors, concurrent != 0, options);
+  }
+
+  PrintBandwidthHeader();
+  for (unsigned int rays : options.rays)
+  {
+    std::vector<RawFrame> frames(1,
+        SyntheticFrame(rays, 1, options.vertical));
+    RunBandwidth("synthetic", frames, options);
+  }
+
+  return 0;
+}
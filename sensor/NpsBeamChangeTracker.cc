@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+
+#include <ignition/math/Box.hh>
+
+#include "gazebo/physics/Link.hh"
+#include "gazebo/physics/Model.hh"
+#include "gazebo/physics/World.hh"
+
+#include "NpsBeamChangeTracker.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+void NpsBeamChangeTracker::Configure(const double _position,
+    const double _angle)
+{
+  this->positionTolerance = _position;
+  this->angleTolerance = _angle;
+  this->Reset();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamChangeTracker::Reset()
+{
+  this->valid = false;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamChangeTracker::Unchanged(const physics::WorldPtr &_world,
+    const physics::EntityPtr &_exclude, const ignition::math::Pose3d &_pose,
+    const double _range, const unsigned int _version)
+{
+  const ignition::math::Vector3d &origin = _pose.Pos();
+
+  this->Begin();
+  for (const physics::ModelPtr &model : _world->Models())
+  {
+    // Distance from the sensor to the closest point of the bounding box
+    const ignition::math::Box box = model->BoundingBox();
+    const ignition::math::Vector3d closest(
+        std::min(std::max(origin.X(), box.Min().X()), box.Max().X()),
+        std::min(std::max(origin.Y(), box.Min().Y()), box.Max().Y()),
+        std::min(std::max(origin.Z(), box.Min().Z()), box.Max().Z()));
+    if (closest.Distance(origin) > _range)
+      continue;
+
+    for (const physics::LinkPtr &link : model->GetLinks())
+    {
+      if (link == _exclude)
+        continue;
+
+      this->Add(link->GetId(), link->WorldPose());
+    }
+  }
+
+  return this->Commit(_pose, _version);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamChangeTracker::Begin()
+{
+  this->current.clear();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamChangeTracker::Add(const uint32_t _id,
+    const ignition::math::Pose3d &_pose)
+{
+  Entry entry;
+  entry.id = _id;
+  entry.pose = _pose;
+  this->current.push_back(entry);
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamChangeTracker::Commit(const ignition::math::Pose3d &_pose,
+    const unsigned int _version)
+{
+  bool same = this->valid && _version == this->referenceVersion &&
+    this->Near(_pose, this->referencePose) &&
+    this->current.size() == this->reference.size();
+  for (size_t i = 0; same && i < this->current.size(); ++i)
+  {
+    same = this->current[i].id == this->reference[i].id &&
+      this->Near(this->current[i].pose, this->reference[i].pose);
+  }
+
+  if (same)
+    return true;
+
+  std::swap(this->current, this->reference);
+  this->referencePose = _pose;
+  this->referenceVersion = _version;
+  this->valid = true;
+  return false;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamChangeTracker::Near(const ignition::math::Pose3d &_a,
+    const ignition::math::Pose3d &_b) const
+{
+  if (_a.Pos().Distance(_b.Pos()) > this->positionTolerance)
+    return false;
+
+  // Angle of the rotation between the two orientations
+  const double dot = std::min(1.0, std::fabs(
+        _a.Rot().W() * _b.Rot().W() + _a.Rot().X() * _b.Rot().X() +
+        _a.Rot().Y() * _b.Rot().Y() + _a.Rot().Z() * _b.Rot().Z()));
+  return 2.0 * std::acos(dot) <= this->angleTolerance;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_CHANGE_TRACKER_HH
+#define NPS_BEAM_CHANGE_TRACKER_HH
+
+#include <cstdint>
+#include <vector>
+
+#include <ignition/math/Pose3.hh>
+
+#include "gazebo/physics/PhysicsTypes.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Decides whether a beam sensor would see the same scene as
+    /// in its last rendered frame.
+    ///
+    /// The signature of a frame is the sensor world pose, the scan
+    /// geometry version and the world pose of every link of every model
+    /// whose bounding box comes within the maximum range of the sensor.
+    /// The range sphere is a conservative superset of the view frustum.
+    /// Poses are compared against the frame last rendered rather than
+    /// the previous tick, so slow drift still triggers a render once it
+    /// exceeds the tolerances. Changes that do not move a link, such as
+    /// visual plugins or material changes, are not detected.
+    class NpsBeamChangeTracker
+    {
+      /// \brief Set the tolerances under which a pose counts as unchanged.
+      /// \param[in] _position Position tolerance in meters.
+      /// \param[in] _angle Rotation tolerance in radians.
+      public: void Configure(const double _position, const double _angle);
+
+      /// \brief Forget the rendered frame, so the next Unchanged call
+      /// returns false.
+      public: void Reset();
+
+      /// \brief Check whether the scene changed since the last frame
+      /// rendered, and take the current scene as the reference if it did.
+      /// \param[in] _world World the sensor is in.
+      /// \param[in] _exclude Link the sensor is attached to, not part of
+      /// the signature.
+      /// \param[in] _pose Sensor world pose.
+      /// \param[in] _range Maximum range of the sensor.
+      /// \param[in] _version Scan geometry version.
+      /// \return True if the last rendered frame may be reused.
+      public: bool Unchanged(const physics::WorldPtr &_world,
+                  const physics::EntityPtr &_exclude,
+                  const ignition::math::Pose3d &_pose, const double _range,
+                  const unsigned int _version);
+
+      /// \brief Start the signature of the current tick.
+      public: void Begin();
+
+      /// \brief Add a link to the signature of the current tick. Links
+      /// must be added in the same order every tick.
+      /// \param[in] _id Link id.
+      /// \param[in] _pose Link world pose.
+      public: void Add(const uint32_t _id,
+                  const ignition::math::Pose3d &_pose);
+
+      /// \brief Compare the signature of the current tick with the last
+      /// frame rendered, and take it as the reference if it changed.
+      /// \param[in] _pose Sensor world pose.
+      /// \param[in] _version Scan geometry version.
+      /// \return True if the last rendered frame may be reused.
+      public: bool Commit(const ignition::math::Pose3d &_pose,
+                  const unsigned int _version);
+
+      /// \brief Pose of one link in range.
+      private: struct Entry
+      {
+        /// \brief Link id.
+        uint32_t id;
+
+        /// \brief Link world pose.
+        ignition::math::Pose3d pose;
+      };
+
+      /// \brief Check whether two poses are within the tolerances.
+      /// \param[in] _a First pose.
+      /// \param[in] _b Second pose.
+      /// \return True if _a and _b count as the same pose.
+      private: bool Near(const ignition::math::Pose3d &_a,
+                   const ignition::math::Pose3d &_b) const;
+
+      /// \brief Position tolerance in meters.
+      private: double positionTolerance = 0.001;
+
+      /// \brief Rotation tolerance in radians.
+      private: double angleTolerance = 0.001;
+
+      /// \brief Signature of the last rendered frame.
+      private: std::vector<Entry> reference;
+
+      /// \brief Signature of the current tick, kept to reuse its storage.
+      private: std::vector<Entry> current;
+
+      /// \brief Sensor pose of the last rendered frame.
+      private: ignition::math::Pose3d referencePose;
+
+      /// \brief Geometry version of the last rendered frame.
+      private: unsigned int referenceVersion = 0;
+
+      /// \brief True once reference holds a rendered frame.
+      private: bool valid = false;
+    };
+  }
+}
+#endif
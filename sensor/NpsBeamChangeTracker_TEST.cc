@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "NpsBeamChangeTracker.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Pose rotated about z.
+  /// \param[in] _x Position along x.
+  /// \param[in] _yaw Rotation in radians.
+  ignition::math::Pose3d Pose(const double _x, const double _yaw = 0)
+  {
+    return ignition::math::Pose3d(_x, 2, 0.5, std::cos(_yaw / 2), 0, 0,
+        std::sin(_yaw / 2));
+  }
+
+  /// \brief Sensor pose used by the tests.
+  const ignition::math::Pose3d kSensor(0, 0, 1, 1, 0, 0, 0);
+
+  /// \brief Run one tick with two links.
+  /// \param[in] _tracker Tracker.
+  /// \param[in] _first Pose of the first link.
+  /// \param[in] _second Pose of the second link.
+  /// \param[in] _version Geometry version.
+  /// \return True if the last rendered frame may be reused.
+  bool Tick(NpsBeamChangeTracker &_tracker,
+      const ignition::math::Pose3d &_first,
+      const ignition::math::Pose3d &_second, const unsigned int _version = 1)
+  {
+    _tracker.Begin();
+    _tracker.Add(7, _first);
+    _tracker.Add(9, _second);
+    return _tracker.Commit(kSensor, _version);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamChangeTracker, Tolerances)
+{
+  NpsBeamChangeTracker tracker;
+  tracker.Configure(0.01, 0.02);
+
+  // Nothing rendered yet
+  EXPECT_FALSE(Tick(tracker, Pose(1), Pose(3)));
+  EXPECT_TRUE(Tick(tracker, Pose(1), Pose(3)));
+
+  // Position within and past the tolerance of the rendered frame
+  EXPECT_TRUE(Tick(tracker, Pose(1.009), Pose(3)));
+  EXPECT_TRUE(Tick(tracker, Pose(1), Pose(2.991)));
+  EXPECT_FALSE(Tick(tracker, Pose(1.011), Pose(3)));
+  EXPECT_TRUE(Tick(tracker, Pose(1.011), Pose(3)));
+
+  // Rotation within and past the tolerance
+  EXPECT_TRUE(Tick(tracker, Pose(1.011), Pose(3, 0.019)));
+  EXPECT_FALSE(Tick(tracker, Pose(1.011), Pose(3, 0.021)));
+
+  // The negated quaternion is the same orientation
+  const ignition::math::Pose3d rotated = Pose(3, 0.021);
+  const ignition::math::Pose3d negated(3, 2, 0.5, -rotated.Rot().W(),
+      -rotated.Rot().X(), -rotated.Rot().Y(), -rotated.Rot().Z());
+  EXPECT_TRUE(Tick(tracker, Pose(1.011), negated));
+
+  // The sensor pose has the same tolerances
+  tracker.Begin();
+  tracker.Add(7, Pose(1.011));
+  tracker.Add(9, rotated);
+  EXPECT_FALSE(tracker.Commit(
+        ignition::math::Pose3d(0.02, 0, 1, 1, 0, 0, 0), 1));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamChangeTracker, Signature)
+{
+  NpsBeamChangeTracker tracker;
+  tracker.Configure(0.001, 0.001);
+  EXPECT_FALSE(Tick(tracker, Pose(1), Pose(3)));
+  EXPECT_TRUE(Tick(tracker, Pose(1), Pose(3)));
+
+  // A new geometry version always renders
+  EXPECT_FALSE(Tick(tracker, Pose(1), Pose(3), 2));
+  EXPECT_TRUE(Tick(tracker, Pose(1), Pose(3), 2));
+
+  // A link coming into range
+  tracker.Begin();
+  tracker.Add(7, Pose(1));
+  tracker.Add(8, Pose(5));
+  tracker.Add(9, Pose(3));
+  EXPECT_FALSE(tracker.Commit(kSensor, 2));
+
+  // A link leaving range, and the same count of different links
+  EXPECT_FALSE(Tick(tracker, Pose(1), Pose(3), 2));
+  tracker.Begin();
+  tracker.Add(7, Pose(1));
+  tracker.Add(8, Pose(3));
+  EXPECT_FALSE(tracker.Commit(kSensor, 2));
+
+  // Reset forgets the rendered frame
+  EXPECT_FALSE(Tick(tracker, Pose(1), Pose(3), 2));
+  tracker.Reset();
+  EXPECT_FALSE(Tick(tracker, Pose(1), Pose(3), 2));
+  EXPECT_TRUE(Tick(tracker, Pose(1), Pose(3), 2));
+
+  // So does configuring new tolerances
+  tracker.Configure(0.01, 0.01);
+  EXPECT_FALSE(Tick(tracker, Pose(1), Pose(3), 2));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamChangeTracker, DriftHits)
+{
+  // A link drifting by 0.4 mm per tick is compared against the frame
+  // last rendered, so every third tick exceeds the 1 mm tolerance
+  NpsBeamChangeTracker tracker;
+  tracker.Configure(0.001, 0.001);
+
+  unsigned int hits = 0;
+  unsigned int misses = 0;
+  for (int i = 0; i < 30; ++i)
+  {
+    if (Tick(tracker, Pose(1 + 0.0004 * i), Pose(3)))
+      ++hits;
+    else
+    {
+      ++misses;
+      EXPECT_EQ(0, i % 3) << "tick " << i;
+    }
+  }
+  EXPECT_EQ(20u, hits);
+  EXPECT_EQ(10u, misses);
+
+  // A static scene hits every tick after the first
+  tracker.Reset();
+  hits = 0;
+  for (int i = 0; i < 30; ++i)
+    hits += Tick(tracker, Pose(1), Pose(3)) ? 1 : 0;
+  EXPECT_EQ(29u, hits);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
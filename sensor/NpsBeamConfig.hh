@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_CONFIG_HH
+#define NPS_BEAM_CONFIG_HH
+
+#include <string>
+#include <sdf/sdf.hh>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Name of the sensor's configuration element.
+    ///
+    /// SDFormat drops unknown children of <sensor>, but keeps namespaced
+    /// custom elements and their children, so the configuration lives in
+    /// <nps:beam>.
+    static const char *const kNpsBeamConfigName = "nps:beam";
+
+    /// \internal
+    /// \brief Get an optional child of an nps_beam configuration element.
+    /// \param[in] _elem Parent element, may be null.
+    /// \param[in] _name Child element name.
+    /// \return The child element, or null if _elem or the child is missing.
+    inline sdf::ElementPtr NpsBeamElement(sdf::ElementPtr _elem,
+        const std::string &_name)
+    {
+      if (_elem && _elem->HasElement(_name))
+        return _elem->GetElement(_name);
+      return sdf::ElementPtr();
+    }
+
+    /// \internal
+    /// \brief Read an optional nps_beam configuration value.
+    /// \param[in] _elem Parent element, may be null.
+    /// \param[in] _name Child element holding the value.
+    /// \param[in] _default Value returned when the child is missing.
+    /// \return The configured value or _default.
+    template <typename T>
+    T NpsBeamParam(sdf::ElementPtr _elem, const std::string &_name,
+        const T &_default)
+    {
+      if (_elem && _elem->HasElement(_name))
+        return _elem->Get<T>(_name);
+      return _default;
+    }
+
+    /// \internal
+    /// \brief Get the <nps:beam> configuration element of a sensor.
+    /// \param[in] _sensorElem The <sensor> element, may be null.
+    /// \return The configuration element, or null if it is missing.
+    inline sdf::ElementPtr NpsBeamConfigElement(sdf::ElementPtr _sensorElem)
+    {
+      return NpsBeamElement(_sensorElem, kNpsBeamConfigName);
+    }
+  }
+}
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "NpsBeamConfig.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Find the first nps_beam sensor of a parsed world.
+  sdf::ElementPtr FindSensor(sdf::SDFPtr _sdf)
+  {
+    sdf::ElementPtr world = _sdf->Root()->GetElement("world");
+    for (sdf::ElementPtr model = world->GetElement("model"); model;
+         model = model->GetNextElement("model"))
+    {
+      if (!model->HasElement("link"))
+        continue;
+      sdf::ElementPtr link = model->GetElement("link");
+      if (!link->HasElement("sensor"))
+        continue;
+      sdf::ElementPtr sensor = link->GetElement("sensor");
+      if (sensor->Get<std::string>("type") == "nps_beam")
+        return sensor;
+    }
+    return sdf::ElementPtr();
+  }
+
+  /// \brief Parse an SDF string.
+  sdf::SDFPtr ParseString(const std::string &_xml)
+  {
+    sdf::SDFPtr result(new sdf::SDF());
+    sdf::init(result);
+    if (!sdf::readString(_xml, result))
+      return sdf::SDFPtr();
+    return result;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamConfig, ExampleWorld)
+{
+  sdf::SDFPtr parsed(new sdf::SDF());
+  sdf::init(parsed);
+  ASSERT_TRUE(sdf::readFile(NPS_BEAM_EXAMPLE_WORLD, parsed));
+
+  sdf::ElementPtr sensor = FindSensor(parsed);
+  ASSERT_TRUE(sensor != nullptr);
+
+  sdf::ElementPtr config = NpsBeamConfigElement(sensor);
+  ASSERT_TRUE(config != nullptr);
+  EXPECT_EQ("auto", NpsBeamParam<std::string>(config, "source", "gpu"));
+  EXPECT_EQ(1234u, NpsBeamParam<unsigned int>(config, "noise_seed", 0));
+
+  sdf::ElementPtr beamImage = NpsBeamElement(config, "beam_image");
+  ASSERT_TRUE(beamImage != nullptr);
+  EXPECT_EQ(256u, NpsBeamParam<unsigned int>(beamImage, "beams", 0));
+  EXPECT_EQ(1000u, NpsBeamParam<unsigned int>(beamImage, "bins", 0));
+  EXPECT_DOUBLE_EQ(0.2,
+      NpsBeamParam<double>(beamImage, "vertical_beamwidth", 0.0));
+  EXPECT_TRUE(NpsBeamParam<bool>(beamImage, "use_intensity", false));
+
+  sdf::ElementPtr fanImage = NpsBeamElement(config, "fan_image");
+  ASSERT_TRUE(fanImage != nullptr);
+  EXPECT_EQ(512u, NpsBeamParam<unsigned int>(fanImage, "width", 0));
+  EXPECT_EQ(512u, NpsBeamParam<unsigned int>(fanImage, "height", 0));
+
+  // Options the world leaves out fall back to their defaults
+  EXPECT_TRUE(NpsBeamElement(config, "compact") == nullptr);
+  EXPECT_EQ(7u, NpsBeamParam<unsigned int>(
+        NpsBeamElement(config, "pipeline"), "depth", 7));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamConfig, UnnamespacedElementIsDropped)
+{
+  const std::string xml =
+    "<sdf version='1.6'>"
+    "  <world name='default'>"
+    "    <model name='m'>"
+    "      <link name='link'>"
+    "        <sensor name='sonar' type='nps_beam'>"
+    "          <nps_beam><beam_image><bins>10</bins></beam_image></nps_beam>"
+    "        </sensor>"
+    "      </link>"
+    "    </model>"
+    "  </world>"
+    "</sdf>";
+
+  sdf::SDFPtr parsed = ParseString(xml);
+  ASSERT_TRUE(parsed != nullptr);
+  sdf::ElementPtr sensor = FindSensor(parsed);
+  ASSERT_TRUE(sensor != nullptr);
+  EXPECT_FALSE(sensor->HasElement("nps_beam"));
+  EXPECT_TRUE(NpsBeamConfigElement(sensor) == nullptr);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamConfig, MissingConfig)
+{
+  EXPECT_TRUE(NpsBeamConfigElement(sdf::ElementPtr()) == nullptr);
+  EXPECT_TRUE(NpsBeamElement(sdf::ElementPtr(), "beam_image") == nullptr);
+  EXPECT_DOUBLE_EQ(2.5,
+      NpsBeamParam<double>(sdf::ElementPtr(), "rate", 2.5));
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+
+#include <ignition/math/Matrix3.hh>
+
+#include "gazebo/common/CommonIface.hh"
+#include "gazebo/common/Console.hh"
+#include "gazebo/common/Mesh.hh"
+#include "gazebo/common/MeshManager.hh"
+#include "gazebo/physics/BoxShape.hh"
+#include "gazebo/physics/Collision.hh"
+#include "gazebo/physics/CylinderShape.hh"
+#include "gazebo/physics/Link.hh"
+#include "gazebo/physics/MeshShape.hh"
+#include "gazebo/physics/Model.hh"
+#include "gazebo/physics/PlaneShape.hh"
+#include "gazebo/physics/SphereShape.hh"
+#include "gazebo/physics/World.hh"
+
+#include "NpsBeamCpuSource.hh"
+#include "NpsBeamScanKernel.hh"
+#include "NpsBeamSensorPrivate.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Segments around curved primitives.
+  const unsigned int kSegments = 48;
+
+  /// \brief Convert a pose to a row major 3x4 transform.
+  void PoseToTransform(const ignition::math::Pose3d &_pose, float _out[12])
+  {
+    const ignition::math::Matrix3d rot(_pose.Rot());
+    for (int r = 0; r < 3; ++r)
+    {
+      for (int c = 0; c < 3; ++c)
+        _out[r * 4 + c] = static_cast<float>(rot(r, c));
+      _out[r * 4 + 3] = static_cast<float>(_pose.Pos()[r]);
+    }
+  }
+
+  /// \brief Triangulate a collision shape in its collision frame.
+  /// \return False if the shape type is not supported.
+  bool ShapeMesh(const physics::ShapePtr &_shape,
+      std::vector<float> &_vertices, std::vector<uint32_t> &_indices)
+  {
+    if (_shape->HasType(physics::Base::BOX_SHAPE))
+    {
+      const ignition::math::Vector3d size =
+        boost::static_pointer_cast<physics::BoxShape>(_shape)->Size();
+      NpsBeamRayCaster::MakeBox(size.X(), size.Y(), size.Z(), _vertices,
+          _indices);
+    }
+    else if (_shape->HasType(physics::Base::SPHERE_SHAPE))
+    {
+      NpsBeamRayCaster::MakeSphere(
+          boost::static_pointer_cast<physics::SphereShape>(
+            _shape)->GetRadius(), kSegments, _vertices, _indices);
+    }
+    else if (_shape->HasType(physics::Base::CYLINDER_SHAPE))
+    {
+      physics::CylinderShapePtr cylinder =
+        boost::static_pointer_cast<physics::CylinderShape>(_shape);
+      NpsBeamRayCaster::MakeCylinder(cylinder->GetRadius(),
+          cylinder->GetLength(), kSegments, _vertices, _indices);
+    }
+    else if (_shape->HasType(physics::Base::PLANE_SHAPE))
+    {
+      physics::PlaneShapePtr plane =
+        boost::static_pointer_cast<physics::PlaneShape>(_shape);
+      const ignition::math::Vector2d size = plane->Size();
+      const ignition::math::Quaterniond rot =
+        ignition::math::Quaterniond::From2Axes(
+            ignition::math::Vector3d::UnitZ, plane->Normal().Normalized());
+
+      const uint32_t base = static_cast<uint32_t>(_vertices.size() / 3);
+      for (int i = 0; i < 4; ++i)
+      {
+        const ignition::math::Vector3d corner = rot.RotateVector(
+            ignition::math::Vector3d((i & 1 ? 0.5 : -0.5) * size.X(),
+              (i & 2 ? 0.5 : -0.5) * size.Y(), 0));
+        _vertices.insert(_vertices.end(), {static_cast<float>(corner.X()),
+            static_cast<float>(corner.Y()), static_cast<float>(corner.Z())});
+      }
+      _indices.insert(_indices.end(),
+          {base, base + 1, base + 2, base + 1, base + 3, base + 2});
+    }
+    else if (_shape->HasType(physics::Base::MESH_SHAPE))
+    {
+      physics::MeshShapePtr meshShape =
+        boost::static_pointer_cast<physics::MeshShape>(_shape);
+      const common::Mesh *mesh = common::MeshManager::Instance()->Load(
+          common::find_file(meshShape->GetMeshURI()));
+      if (!mesh)
+        return false;
+
+      const ignition::math::Vector3d scale = meshShape->Size();
+      for (unsigned int s = 0; s < mesh->GetSubMeshCount(); ++s)
+      {
+        const common::SubMesh *subMesh = mesh->GetSubMesh(s);
+        if (subMesh->GetPrimitiveType() != common::SubMesh::TRIANGLES)
+          continue;
+
+        const uint32_t base = static_cast<uint32_t>(_vertices.size() / 3);
+        for (unsigned int v = 0; v < subMesh->GetVertexCount(); ++v)
+        {
+          const ignition::math::Vector3d p = subMesh->Vertex(v) * scale;
+          _vertices.insert(_vertices.end(), {static_cast<float>(p.X()),
+              static_cast<float>(p.Y()), static_cast<float>(p.Z())});
+        }
+        for (unsigned int i = 0; i < subMesh->GetIndexCount(); ++i)
+          _indices.push_back(base + subMesh->GetIndex(i));
+      }
+    }
+    else
+    {
+      return false;
+    }
+
+    return true;
+  }
+}
+
+//////////////////////////////////////////////////
+NpsBeamCpuSource::~NpsBeamCpuSource()
+{
+  this->WaitForScene();
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamCpuSource::Init(NpsBeamSensor &_sensor,
+    const NpsBeamSourceContext &_context)
+{
+  this->sensor = &_sensor;
+  this->world = _context.world;
+  this->exclude = _context.parent;
+
+  // The mesh manager and the physics state are not thread safe, so the
+  // shapes are read here and only the hierarchy is built while the other
+  // sensors initialize
+  this->CollectScene();
+  this->sceneBuilding = true;
+  NpsBeamWorkerPool::Instance().Post([this]()
+      {
+        this->caster.Build();
+        this->sceneReady = true;
+        std::lock_guard<std::mutex> lock(this->sceneMutex);
+        this->sceneBuilding = false;
+        this->sceneCondition.notify_all();
+      });
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCpuSource::Fini()
+{
+  this->WaitForScene();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCpuSource::WaitForScene()
+{
+  std::unique_lock<std::mutex> lock(this->sceneMutex);
+  this->sceneCondition.wait(lock, [this]() { return !this->sceneBuilding; });
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCpuSource::CollectScene()
+{
+  this->caster.Clear();
+  this->collisions.clear();
+
+  const physics::Model_V models = this->world->Models();
+  for (const physics::ModelPtr &model : models)
+  {
+    for (const physics::LinkPtr &link : model->GetLinks())
+    {
+      if (link == this->exclude)
+        continue;
+
+      for (const physics::CollisionPtr &collision : link->GetCollisions())
+      {
+        std::vector<float> vertices;
+        std::vector<uint32_t> indices;
+        if (!ShapeMesh(collision->GetShape(), vertices, indices))
+        {
+          gzwarn << "Collision [" << collision->GetScopedName()
+                 << "] has a shape the CPU ray caster does not support.\n";
+          continue;
+        }
+
+        const unsigned int mesh = this->caster.AddMesh(vertices, indices,
+            collision->GetLaserRetro());
+        float transform[12];
+        PoseToTransform(collision->WorldPose(), transform);
+        this->caster.SetTransform(mesh, transform);
+        this->collisions.push_back(std::make_pair(collision, mesh));
+      }
+    }
+  }
+
+  this->SceneIds(this->collisionIds);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCpuSource::SceneIds(std::vector<uint32_t> &_ids) const
+{
+  // Walk the children rather than copying the model and collision
+  // lists, so checking an unchanged world does not allocate
+  _ids.clear();
+  const unsigned int models = this->world->ModelCount();
+  for (unsigned int m = 0; m < models; ++m)
+  {
+    const physics::ModelPtr model = this->world->ModelByIndex(m);
+    if (!model)
+      continue;
+
+    for (const physics::LinkPtr &link : model->GetLinks())
+    {
+      if (link == this->exclude)
+        continue;
+
+      for (unsigned int c = 0; c < link->GetChildCount(); ++c)
+      {
+        const physics::BasePtr child = link->GetChild(c);
+        if (child->HasType(physics::Base::COLLISION))
+          _ids.push_back(child->GetId());
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCpuSource::UpdateDirections(const NpsBeamGeometry &_geom)
+{
+  this->width = std::max(1, _geom.rayCount);
+  this->height = std::max(1, _geom.verticalRayCount);
+  this->directions.resize(static_cast<size_t>(this->width) * this->height * 3);
+  this->data.resize(static_cast<size_t>(this->width) * this->height * 3);
+
+  const double hStep = this->width > 1 ?
+    (_geom.angleMax - _geom.angleMin) / (this->width - 1) : 0.0;
+  const double vStep = this->height > 1 ?
+    (_geom.verticalAngleMax - _geom.verticalAngleMin) / (this->height - 1) :
+    0.0;
+
+  float *dir = this->directions.data();
+  for (unsigned int v = 0; v < this->height; ++v)
+  {
+    const double pitch = _geom.verticalAngleMin + v * vStep;
+    for (unsigned int h = 0; h < this->width; ++h, dir += 3)
+    {
+      const double yaw = _geom.angleMin + h * hStep;
+      dir[0] = static_cast<float>(std::cos(pitch) * std::cos(yaw));
+      dir[1] = static_cast<float>(std::cos(pitch) * std::sin(yaw));
+      dir[2] = static_cast<float>(std::sin(pitch));
+    }
+  }
+
+  this->directionsVersion = _geom.version;
+  this->directionsReady = true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamCpuSource::SupportsSector() const
+{
+  return true;
+}
+
+//////////////////////////////////////////////////
+common::Time NpsBeamCpuSource::Render(const NpsBeamGeometry &_geom,
+    const ignition::math::Pose3d &_pose)
+{
+  this->WaitForScene();
+  // Collect the scene again when any collision was added or removed,
+  // which a model count misses when one model replaces another
+  if (this->sceneReady)
+    this->SceneIds(this->sceneIds);
+  if (!this->sceneReady || this->sceneIds != this->collisionIds)
+  {
+    this->CollectScene();
+    this->caster.Build();
+    this->sceneReady = true;
+  }
+  else
+  {
+    float transform[12];
+    for (const auto &collision : this->collisions)
+    {
+      PoseToTransform(collision.first->WorldPose(), transform);
+      this->caster.SetTransform(collision.second, transform);
+    }
+    this->caster.Refit();
+  }
+
+  if (!this->directionsReady || this->directionsVersion != _geom.version)
+    this->UpdateDirections(_geom);
+
+  const float origin[3] = {static_cast<float>(_pose.Pos().X()),
+    static_cast<float>(_pose.Pos().Y()), static_cast<float>(_pose.Pos().Z())};
+  float rotation[12];
+  PoseToTransform(ignition::math::Pose3d(ignition::math::Vector3d::Zero,
+        _pose.Rot()), rotation);
+  const float rot3[9] = {rotation[0], rotation[1], rotation[2],
+    rotation[4], rotation[5], rotation[6],
+    rotation[8], rotation[9], rotation[10]};
+
+  this->caster.Cast(origin, rot3, this->directions.data(),
+      static_cast<size_t>(this->width) * this->height,
+      static_cast<float>(_geom.rangeMin), static_cast<float>(_geom.rangeMax),
+      this->data.data(), 3, &NpsBeamWorkerPool::Instance());
+
+  this->frameTime = this->world->SimTime();
+  this->newLaserFrame(this->data.data(), this->width, this->height, 3,
+      "PF_FLOAT32_RGB");
+
+  return this->frameTime;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamCpuSource::Read(float *_ranges, float *_intensities,
+    const size_t _count)
+{
+  const size_t count = std::min(_count,
+      static_cast<size_t>(this->width) * this->height);
+  DeinterleaveBeamFrame(this->data.data(), count, 3, _ranges, _intensities);
+  return count;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamCpuSource::TriangleCount() const
+{
+  return this->caster.TriangleCount();
+}
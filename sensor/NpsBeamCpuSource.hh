@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_CPU_SOURCE_HH
+#define NPS_BEAM_CPU_SOURCE_HH
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "NpsBeamFrameSource.hh"
+#include "NpsBeamRayCaster.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Frame source that ray casts the world's collision shapes on
+    /// the CPU.
+    ///
+    /// The default source when rendering is disabled. Boxes, spheres,
+    /// cylinders, planes and meshes of every model are turned into
+    /// triangle meshes once; each frame only the collision poses are
+    /// refreshed and the hierarchy refit. Init reads the shapes and poses
+    /// on the calling thread, since neither the mesh manager nor the
+    /// physics state may be used from other threads, and then builds the
+    /// hierarchy on the worker pool, so sensors initialized one after the
+    /// other build their scenes concurrently; the first Render waits for
+    /// it. Frames have the interleaved
+    /// layout of rendering::GpuLaser and are announced through the same
+    /// new laser frame event.
+    class NpsBeamCpuSource : public NpsBeamFrameSource
+    {
+      /// \brief Destructor, waits for a scene build in flight.
+      public: virtual ~NpsBeamCpuSource();
+
+      // Documentation inherited
+      public: virtual bool Init(NpsBeamSensor &_sensor,
+                  const NpsBeamSourceContext &_context);
+
+      // Documentation inherited
+      public: virtual void Fini();
+
+      // Documentation inherited
+      public: virtual bool SupportsSector() const;
+
+      // Documentation inherited
+      public: virtual common::Time Render(const NpsBeamGeometry &_geom,
+                  const ignition::math::Pose3d &_pose);
+
+      // Documentation inherited
+      public: virtual size_t Read(float *_ranges, float *_intensities,
+                  const size_t _count);
+
+      /// \brief Number of triangles ray cast.
+      /// \return Triangle count.
+      public: size_t TriangleCount() const;
+
+      /// \brief Refill the ray caster with the world's collision shapes
+      /// and poses, without building its hierarchy. Must run on the
+      /// thread that owns the world.
+      private: void CollectScene();
+
+      /// \brief Get the ids of the collisions of the world's models,
+      /// except those of the excluded link, in model order. Must run on
+      /// the thread that owns the world.
+      /// \param[out] _ids Collision ids, reusing the vector's storage.
+      private: void SceneIds(std::vector<uint32_t> &_ids) const;
+
+      /// \brief Wait until the scene build started by Init finished.
+      private: void WaitForScene();
+
+      /// \brief Recompute the ray directions for a geometry.
+      private: void UpdateDirections(const NpsBeamGeometry &_geom);
+
+      /// \brief World to ray cast.
+      private: physics::WorldPtr world;
+
+      /// \brief Link whose collisions are skipped.
+      private: physics::EntityPtr exclude;
+
+      /// \brief Ray caster over the world's collisions.
+      private: NpsBeamRayCaster caster;
+
+      /// \brief Ray cast collisions and their mesh ids.
+      private: std::vector<std::pair<physics::CollisionPtr, unsigned int>>
+               collisions;
+
+      /// \brief SceneIds of the world when the scene was built.
+      private: std::vector<uint32_t> collisionIds;
+
+      /// \brief SceneIds of the world at the current frame.
+      private: std::vector<uint32_t> sceneIds;
+
+      /// \brief True once the scene was built.
+      private: bool sceneReady = false;
+
+      /// \brief True while the worker pool builds the scene.
+      private: bool sceneBuilding = false;
+
+      /// \brief Protects sceneBuilding.
+      private: std::mutex sceneMutex;
+
+      /// \brief Signaled when the scene build finished.
+      private: std::condition_variable sceneCondition;
+
+      /// \brief Unit ray directions in the sensor frame.
+      private: std::vector<float> directions;
+
+      /// \brief Geometry version of the directions.
+      private: unsigned int directionsVersion = 0;
+
+      /// \brief True once the directions were computed.
+      private: bool directionsReady = false;
+
+      /// \brief Interleaved frame data.
+      private: std::vector<float> data;
+
+      /// \brief Frame width.
+      private: unsigned int width = 0;
+
+      /// \brief Frame height.
+      private: unsigned int height = 0;
+    };
+  }
+}
+#endif
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+
+#include "NpsBeamCullIndex.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Wrap an angle into [-pi, pi].
+  /// \param[in] _angle Angle in radians.
+  /// \return Wrapped angle.
+  double WrapAngle(const double _angle)
+  {
+    return std::atan2(std::sin(_angle), std::cos(_angle));
+  }
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamCullVolume::Intersects(const double _min[3],
+    const double _max[3]) const
+{
+  // Bounding sphere of the box in the sensor frame
+  double world[3];
+  double radius = 0;
+  for (int k = 0; k < 3; ++k)
+  {
+    world[k] = (_min[k] + _max[k]) / 2 - this->origin[k];
+    radius += (_max[k] - _min[k]) * (_max[k] - _min[k]);
+  }
+  radius = std::sqrt(radius) / 2;
+
+  double local[3];
+  for (int k = 0; k < 3; ++k)
+  {
+    local[k] = this->rotation[k] * world[0] +
+      this->rotation[3 + k] * world[1] + this->rotation[6 + k] * world[2];
+  }
+
+  // Exact distance from the sensor to the box for the range test
+  double outside = 0;
+  for (int k = 0; k < 3; ++k)
+  {
+    const double d = std::max(std::max(_min[k] - this->origin[k],
+          this->origin[k] - _max[k]), 0.0);
+    outside += d * d;
+  }
+  if (outside > this->range * this->range)
+    return false;
+
+  const double distance = std::sqrt(local[0] * local[0] +
+      local[1] * local[1] + local[2] * local[2]);
+  if (distance <= radius)
+    return true;
+
+  // Elevation spread of the sphere
+  const double flat = std::sqrt(local[0] * local[0] + local[1] * local[1]);
+  const double pitch = std::atan2(local[2], flat);
+  const double pitchSpread = std::asin(radius / distance);
+  if (pitch + pitchSpread < this->verticalAngleMin ||
+      pitch - pitchSpread > this->verticalAngleMax)
+  {
+    return false;
+  }
+
+  // Azimuth spread of the sphere, unbounded above or below the sensor
+  const double halfFan = (this->angleMax - this->angleMin) / 2;
+  if (flat <= radius || halfFan >= M_PI)
+    return true;
+  const double yaw = WrapAngle(std::atan2(local[1], local[0]) -
+      (this->angleMin + this->angleMax) / 2);
+  return std::fabs(yaw) <= halfFan + std::asin(radius / flat);
+}
+
+//////////////////////////////////////////////////
+NpsBeamCullIndex::NpsBeamCullIndex(const double _cellSize)
+{
+  this->Reset(_cellSize);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCullIndex::Reset(const double _cellSize)
+{
+  this->cellSize = std::max(_cellSize, 1e-3);
+  this->objects.clear();
+  this->freeIds.clear();
+  this->cells.clear();
+  this->large.clear();
+  this->count = 0;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamCullIndex::Insert(const double _min[3],
+    const double _max[3])
+{
+  unsigned int id;
+  if (!this->freeIds.empty())
+  {
+    id = this->freeIds.back();
+    this->freeIds.pop_back();
+  }
+  else
+  {
+    id = static_cast<unsigned int>(this->objects.size());
+    this->objects.push_back(Object());
+  }
+
+  Object &object = this->objects[id];
+  std::copy(_min, _min + 3, object.min);
+  std::copy(_max, _max + 3, object.max);
+  object.live = true;
+  object.visible = 0;
+  this->Link(id);
+  ++this->count;
+  return id;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCullIndex::Update(const unsigned int _id, const double _min[3],
+    const double _max[3])
+{
+  Object &object = this->objects[_id];
+  std::copy(_min, _min + 3, object.min);
+  std::copy(_max, _max + 3, object.max);
+
+  // Most moves stay within the cell
+  const bool large = _max[0] - _min[0] > this->cellSize ||
+    _max[1] - _min[1] > this->cellSize;
+  if (large == object.large && (large || this->CellKey(
+          (_min[0] + _max[0]) / 2, (_min[1] + _max[1]) / 2) == object.cell))
+  {
+    return;
+  }
+
+  // Unlink uses the old placement, Link computes the new one
+  this->Unlink(_id);
+  this->Link(_id);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCullIndex::Remove(const unsigned int _id)
+{
+  if (_id >= this->objects.size() || !this->objects[_id].live)
+    return;
+
+  this->Unlink(_id);
+  this->objects[_id].live = false;
+  this->freeIds.push_back(_id);
+  --this->count;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamCullIndex::Count() const
+{
+  return this->count;
+}
+
+//////////////////////////////////////////////////
+double NpsBeamCullIndex::CellSize() const
+{
+  return this->cellSize;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCullIndex::Cull(const NpsBeamCullVolume &_volume,
+    std::vector<unsigned int> &_culled)
+{
+  _culled.clear();
+  if (++this->pass == 0)
+  {
+    // Pass numbers wrapped; forget old marks
+    for (Object &object : this->objects)
+      object.visible = 0;
+    this->pass = 1;
+  }
+
+  this->Mark(this->large, _volume);
+
+  // Small objects stick out of their cell by at most half a cell
+  const double reach = _volume.range + this->cellSize / 2;
+  const double x0 = std::floor((_volume.origin[0] - reach) / this->cellSize);
+  const double x1 = std::floor((_volume.origin[0] + reach) / this->cellSize);
+  const double y0 = std::floor((_volume.origin[1] - reach) / this->cellSize);
+  const double y1 = std::floor((_volume.origin[1] + reach) / this->cellSize);
+  if ((x1 - x0 + 1) * (y1 - y0 + 1) > static_cast<double>(this->cells.size()))
+  {
+    // The range covers more cells than are occupied
+    for (const auto &cell : this->cells)
+      this->Mark(cell.second, _volume);
+  }
+  else
+  {
+    for (double x = x0; x <= x1; ++x)
+    {
+      for (double y = y0; y <= y1; ++y)
+      {
+        const auto cell = this->cells.find(this->CellKey(
+              (x + 0.5) * this->cellSize, (y + 0.5) * this->cellSize));
+        if (cell != this->cells.end())
+          this->Mark(cell->second, _volume);
+      }
+    }
+  }
+
+  for (unsigned int id = 0; id < this->objects.size(); ++id)
+  {
+    const Object &object = this->objects[id];
+    if (object.live && object.visible != this->pass)
+      _culled.push_back(id);
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCullIndex::Link(const unsigned int _id)
+{
+  Object &object = this->objects[_id];
+  object.large = object.max[0] - object.min[0] > this->cellSize ||
+    object.max[1] - object.min[1] > this->cellSize;
+
+  std::vector<unsigned int> *list = &this->large;
+  if (!object.large)
+  {
+    object.cell = this->CellKey((object.min[0] + object.max[0]) / 2,
+        (object.min[1] + object.max[1]) / 2);
+    list = &this->cells[object.cell];
+  }
+  object.slot = static_cast<unsigned int>(list->size());
+  list->push_back(_id);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCullIndex::Unlink(const unsigned int _id)
+{
+  const Object &object = this->objects[_id];
+  auto cell = this->cells.end();
+  std::vector<unsigned int> *list = &this->large;
+  if (!object.large)
+  {
+    cell = this->cells.find(object.cell);
+    list = &cell->second;
+  }
+
+  // Swap the last object of the list into the slot
+  const unsigned int last = list->back();
+  (*list)[object.slot] = last;
+  this->objects[last].slot = object.slot;
+  list->pop_back();
+
+  if (list->empty() && cell != this->cells.end())
+    this->cells.erase(cell);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamCullIndex::Mark(const std::vector<unsigned int> &_ids,
+    const NpsBeamCullVolume &_volume)
+{
+  for (const unsigned int id : _ids)
+  {
+    Object &object = this->objects[id];
+    if (_volume.Intersects(object.min, object.max))
+      object.visible = this->pass;
+  }
+}
+
+//////////////////////////////////////////////////
+int64_t NpsBeamCullIndex::CellKey(const double _x, const double _y) const
+{
+  const int64_t x = static_cast<int64_t>(std::floor(_x / this->cellSize));
+  const int64_t y = static_cast<int64_t>(std::floor(_y / this->cellSize));
+  return static_cast<int64_t>((static_cast<uint64_t>(x) << 32) ^
+      static_cast<uint32_t>(y));
+}
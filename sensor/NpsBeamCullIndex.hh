@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_CULL_INDEX_HH
+#define NPS_BEAM_CULL_INDEX_HH
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Region a beam sensor can see: the fan of its scan angles
+    /// out to its maximum range.
+    class NpsBeamCullVolume
+    {
+      /// \brief Check whether a box may be seen.
+      ///
+      /// The test is conservative: it uses the sphere around the box, so
+      /// it never rejects a box a ray could hit, but may keep one near
+      /// the edge of the fan.
+      /// \param[in] _min Minimum corner of the box in world coordinates.
+      /// \param[in] _max Maximum corner of the box in world coordinates.
+      /// \return False if no ray of the fan can reach the box.
+      public: bool Intersects(const double _min[3],
+                  const double _max[3]) const;
+
+      /// \brief Sensor position in world coordinates.
+      public: double origin[3] = {0, 0, 0};
+
+      /// \brief Sensor orientation, a row major matrix from the sensor to
+      /// the world frame.
+      public: double rotation[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+
+      /// \brief Maximum range.
+      public: double range = 0;
+
+      /// \brief Minimum horizontal angle in radians.
+      public: double angleMin = 0;
+
+      /// \brief Maximum horizontal angle in radians.
+      public: double angleMax = 0;
+
+      /// \brief Minimum vertical angle in radians.
+      public: double verticalAngleMin = 0;
+
+      /// \brief Maximum vertical angle in radians.
+      public: double verticalAngleMax = 0;
+    };
+
+    /// \brief Spatial index of object bounding boxes for culling what a
+    /// beam sensor cannot see.
+    ///
+    /// A loose grid over the horizontal plane: an object is stored in the
+    /// cell holding the center of its box if the box is at most one cell
+    /// wide, so a query only visits the cells around the sensor's range.
+    /// Objects larger than a cell, such as terrain, are kept apart and
+    /// tested on every query. Inserting, moving and removing an object
+    /// costs a hash lookup, so the index follows moving models one
+    /// object at a time instead of being rebuilt.
+    class NpsBeamCullIndex
+    {
+      /// \brief Constructor
+      /// \param[in] _cellSize Grid cell size in meters.
+      public: explicit NpsBeamCullIndex(const double _cellSize = 10.0);
+
+      /// \brief Remove every object and set the cell size.
+      /// \param[in] _cellSize Grid cell size in meters.
+      public: void Reset(const double _cellSize);
+
+      /// \brief Add an object.
+      /// \param[in] _min Minimum corner of its box.
+      /// \param[in] _max Maximum corner of its box.
+      /// \return Object id; ids are handed out in order from 0 after
+      /// Reset, and ids of removed objects are reused.
+      public: unsigned int Insert(const double _min[3],
+                  const double _max[3]);
+
+      /// \brief Move an object.
+      /// \param[in] _id Object id.
+      /// \param[in] _min Minimum corner of its new box.
+      /// \param[in] _max Maximum corner of its new box.
+      public: void Update(const unsigned int _id, const double _min[3],
+                  const double _max[3]);
+
+      /// \brief Remove an object.
+      /// \param[in] _id Object id.
+      public: void Remove(const unsigned int _id);
+
+      /// \brief Number of objects in the index.
+      /// \return Object count.
+      public: size_t Count() const;
+
+      /// \brief Get the grid cell size.
+      /// \return Cell size in meters.
+      public: double CellSize() const;
+
+      /// \brief Find the objects a sensor cannot see.
+      /// \param[in] _volume Region the sensor sees.
+      /// \param[out] _culled Ids of every object outside the region.
+      public: void Cull(const NpsBeamCullVolume &_volume,
+                  std::vector<unsigned int> &_culled);
+
+      /// \brief An indexed object.
+      private: struct Object
+      {
+        /// \brief Minimum corner of the box.
+        double min[3];
+
+        /// \brief Maximum corner of the box.
+        double max[3];
+
+        /// \brief Key of its cell, unused for large objects.
+        int64_t cell;
+
+        /// \brief Position in its cell or in the large object list.
+        unsigned int slot;
+
+        /// \brief True if kept in the large object list.
+        bool large;
+
+        /// \brief True unless removed.
+        bool live;
+
+        /// \brief Cull pass that last found the object visible.
+        unsigned int visible;
+      };
+
+      /// \brief Put an object into its cell or the large object list.
+      /// \param[in] _id Object id.
+      private: void Link(const unsigned int _id);
+
+      /// \brief Take an object out of its cell or the large object list.
+      /// \param[in] _id Object id.
+      private: void Unlink(const unsigned int _id);
+
+      /// \brief Test the objects of a list and mark the visible ones.
+      /// \param[in] _ids Object ids.
+      /// \param[in] _volume Region the sensor sees.
+      private: void Mark(const std::vector<unsigned int> &_ids,
+                   const NpsBeamCullVolume &_volume);
+
+      /// \brief Get the key of the cell holding a point.
+      /// \param[in] _x X coordinate.
+      /// \param[in] _y Y coordinate.
+      /// \return Cell key.
+      private: int64_t CellKey(const double _x, const double _y) const;
+
+      /// \brief Grid cell size in meters.
+      private: double cellSize;
+
+      /// \brief Objects by id.
+      private: std::vector<Object> objects;
+
+      /// \brief Ids of removed objects.
+      private: std::vector<unsigned int> freeIds;
+
+      /// \brief Object ids of each occupied cell.
+      private: std::unordered_map<int64_t, std::vector<unsigned int>> cells;
+
+      /// \brief Ids of objects larger than a cell.
+      private: std::vector<unsigned int> large;
+
+      /// \brief Number of live objects.
+      private: size_t count = 0;
+
+      /// \brief Number of the current cull pass.
+      private: unsigned int pass = 0;
+    };
+  }
+}
+#endif
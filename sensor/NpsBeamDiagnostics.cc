@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+
+#include "NpsBeamDiagnostics.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+NpsBeamDiagnostics::NpsBeamDiagnostics()
+: enabled(true),
+  windowStart(Clock::now())
+{
+  for (int s = 0; s < STAGE_COUNT; ++s)
+  {
+    for (int b = 0; b < kBuckets; ++b)
+      this->buckets[s][b] = 0;
+    this->totalNs[s] = 0;
+    this->maxNs[s] = 0;
+  }
+  for (int c = 0; c < COUNTER_COUNT; ++c)
+    this->counters[c] = 0;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamDiagnostics::SetEnabled(const bool _enabled)
+{
+  this->enabled.store(_enabled, std::memory_order_relaxed);
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamDiagnostics::Enabled() const
+{
+  return this->enabled.load(std::memory_order_relaxed);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamDiagnostics::Record(const Stage _stage,
+    const Clock::time_point &_start, const Clock::time_point &_end)
+{
+  if (!this->enabled.load(std::memory_order_relaxed))
+    return;
+
+  const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      _end - _start).count();
+
+  // Bucket by the bit length of the duration in microseconds
+  uint64_t us = ns / 1000;
+  int bucket = 0;
+  while (us > 0 && bucket < kBuckets - 1)
+  {
+    us >>= 1;
+    ++bucket;
+  }
+
+  this->buckets[_stage][bucket].fetch_add(1, std::memory_order_relaxed);
+  this->totalNs[_stage].fetch_add(ns, std::memory_order_relaxed);
+
+  uint64_t previous = this->maxNs[_stage].load(std::memory_order_relaxed);
+  while (ns > previous && !this->maxNs[_stage].compare_exchange_weak(
+        previous, ns, std::memory_order_relaxed))
+  {
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamDiagnostics::Count(const Counter _counter, const uint64_t _amount)
+{
+  if (!this->enabled.load(std::memory_order_relaxed))
+    return;
+
+  this->counters[_counter].fetch_add(_amount, std::memory_order_relaxed);
+}
+
+//////////////////////////////////////////////////
+NpsBeamDiagnostics::Snapshot NpsBeamDiagnostics::TakeSnapshot()
+{
+  Snapshot snapshot;
+
+  const Clock::time_point now = Clock::now();
+  snapshot.windowSeconds =
+    std::chrono::duration<double>(now - this->windowStart).count();
+  this->windowStart = now;
+
+  for (int s = 0; s < STAGE_COUNT; ++s)
+  {
+    uint64_t histogram[kBuckets];
+    uint64_t count = 0;
+    for (int b = 0; b < kBuckets; ++b)
+    {
+      histogram[b] = this->buckets[s][b].exchange(0,
+          std::memory_order_relaxed);
+      count += histogram[b];
+    }
+
+    StageStats &stats = snapshot.stages[s];
+    stats.count = count;
+    stats.meanUs = count > 0 ?
+      this->totalNs[s].exchange(0, std::memory_order_relaxed) * 1e-3 / count :
+      0.0;
+    stats.maxUs = this->maxNs[s].exchange(0, std::memory_order_relaxed) * 1e-3;
+
+    // Report the upper edge of the bucket holding each percentile
+    stats.p50Us = 0;
+    stats.p99Us = 0;
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets && count > 0; ++b)
+    {
+      const uint64_t before = seen;
+      seen += histogram[b];
+      const double edge = std::min(static_cast<double>(1ull << b),
+          stats.maxUs);
+      if (before < (count + 1) / 2 && seen >= (count + 1) / 2)
+        stats.p50Us = edge;
+      if (before < count - count / 100 && seen >= count - count / 100)
+        stats.p99Us = edge;
+    }
+  }
+
+  for (int c = 0; c < COUNTER_COUNT; ++c)
+  {
+    snapshot.counters[c] =
+      this->counters[c].exchange(0, std::memory_order_relaxed);
+  }
+
+  return snapshot;
+}
+
+//////////////////////////////////////////////////
+const char *NpsBeamDiagnostics::StageName(const Stage _stage)
+{
+  static const char *names[STAGE_COUNT] =
+    {"render", "post_render", "process", "publish", "update"};
+  return names[_stage];
+}
+
+//////////////////////////////////////////////////
+const char *NpsBeamDiagnostics::CounterName(const Counter _counter)
+{
+  static const char *names[COUNTER_COUNT] =
+    {"frames", "skipped_not_rendered", "skipped_no_update",
+     "bytes_published", "dropped_pipeline_full", "incremental_hits",
+     "incremental_misses", "record_dropped", "culled"};
+  return names[_counter];
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_DIAGNOSTICS_HH
+#define NPS_BEAM_DIAGNOSTICS_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Per-stage timing and frame counters of a beam sensor.
+    ///
+    /// Recording a sample is a few relaxed atomic increments, so stages
+    /// may be timed from the render and update threads at once. Stage
+    /// durations go into log2 histograms covering the current window,
+    /// which TakeSnapshot() reports and resets. Disabled diagnostics
+    /// ignore samples after a single relaxed load.
+    class NpsBeamDiagnostics
+    {
+      /// \brief Timed stages of a frame.
+      public: enum Stage
+      {
+        /// \brief laserCam->Render() in the render thread.
+        RENDER = 0,
+
+        /// \brief laserCam->PostRender() readback.
+        POST_RENDER,
+
+        /// \brief Gather, noise, masking and message fill.
+        PROCESS,
+
+        /// \brief Publishing of every output.
+        PUBLISH,
+
+        /// \brief Whole UpdateImpl call.
+        UPDATE,
+
+        /// \brief Number of stages.
+        STAGE_COUNT
+      };
+
+      /// \brief Frame counters.
+      public: enum Counter
+      {
+        /// \brief Frames processed and published.
+        FRAMES = 0,
+
+        /// \brief UpdateImpl calls without a rendered frame.
+        SKIPPED_NOT_RENDERED,
+
+        /// \brief Render ticks skipped because no update was due.
+        SKIPPED_NO_UPDATE,
+
+        /// \brief Bytes of published messages.
+        BYTES_PUBLISHED,
+
+        /// \brief Frames dropped because the pipeline was full.
+        DROPPED_PIPELINE_FULL,
+
+        /// \brief Incremental mode frames that reused the last raw frame.
+        INCREMENTAL_HITS,
+
+        /// \brief Incremental mode frames that had to be rendered.
+        INCREMENTAL_MISSES,
+
+        /// \brief Frames the recorder dropped because its writer fell
+        /// behind.
+        RECORD_DROPPED,
+        /// \brief Models left out of renders because no ray could reach
+        /// them, summed over frames.
+        CULLED,
+
+        /// \brief Number of counters.
+        COUNTER_COUNT
+      };
+
+      /// \brief Summary of one stage over a window.
+      public: struct StageStats
+      {
+        /// \brief Number of samples.
+        uint64_t count;
+
+        /// \brief Mean duration in microseconds.
+        double meanUs;
+
+        /// \brief Median duration in microseconds, bucket resolution.
+        double p50Us;
+
+        /// \brief 99th percentile duration in microseconds.
+        double p99Us;
+
+        /// \brief Largest duration in microseconds.
+        double maxUs;
+      };
+
+      /// \brief Summary of a window.
+      public: struct Snapshot
+      {
+        /// \brief Per stage statistics.
+        StageStats stages[STAGE_COUNT];
+
+        /// \brief Counter increments over the window.
+        uint64_t counters[COUNTER_COUNT];
+
+        /// \brief Window length in seconds.
+        double windowSeconds;
+      };
+
+      /// \brief Monotonic clock used for stage timing.
+      public: typedef std::chrono::steady_clock Clock;
+
+      /// \brief Constructor
+      public: NpsBeamDiagnostics();
+
+      /// \brief Enable or disable recording. Enabled by default.
+      /// \param[in] _enabled False to ignore samples and counts.
+      public: void SetEnabled(const bool _enabled);
+
+      /// \brief Check whether recording is enabled.
+      /// \return True if samples and counts are recorded.
+      public: bool Enabled() const;
+
+      /// \brief Record one stage duration.
+      /// \param[in] _stage Stage.
+      /// \param[in] _start Stage start time.
+      /// \param[in] _end Stage end time.
+      public: void Record(const Stage _stage, const Clock::time_point &_start,
+                          const Clock::time_point &_end);
+
+      /// \brief Increment a counter.
+      /// \param[in] _counter Counter.
+      /// \param[in] _amount Increment.
+      public: void Count(const Counter _counter, const uint64_t _amount = 1);
+
+      /// \brief Summarize and reset the current window.
+      /// \return Window summary.
+      public: Snapshot TakeSnapshot();
+
+      /// \brief Get the name of a stage.
+      /// \param[in] _stage Stage.
+      /// \return Stage name.
+      public: static const char *StageName(const Stage _stage);
+
+      /// \brief Get the name of a counter.
+      /// \param[in] _counter Counter.
+      /// \return Counter name.
+      public: static const char *CounterName(const Counter _counter);
+
+      /// \brief Histogram buckets; bucket i holds durations in
+      /// [2^(i-1), 2^i) microseconds.
+      private: static const int kBuckets = 32;
+
+      /// \brief Per stage histograms.
+      private: std::atomic<uint64_t> buckets[STAGE_COUNT][kBuckets];
+
+      /// \brief Per stage sum of durations in nanoseconds.
+      private: std::atomic<uint64_t> totalNs[STAGE_COUNT];
+
+      /// \brief Per stage largest duration in nanoseconds.
+      private: std::atomic<uint64_t> maxNs[STAGE_COUNT];
+
+      /// \brief Counters.
+      private: std::atomic<uint64_t> counters[COUNTER_COUNT];
+
+      /// \brief True if samples and counts are recorded.
+      private: std::atomic<bool> enabled;
+
+      /// \brief Start of the current window.
+      private: Clock::time_point windowStart;
+    };
+  }
+}
+#endif
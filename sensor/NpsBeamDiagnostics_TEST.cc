@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "NpsBeamDiagnostics.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Record one stage sample of a duration.
+  /// \param[in] _diagnostics Diagnostics to record into.
+  /// \param[in] _stage Stage.
+  /// \param[in] _us Duration in microseconds.
+  void RecordUs(NpsBeamDiagnostics &_diagnostics,
+      const NpsBeamDiagnostics::Stage _stage, const int _us)
+  {
+    const NpsBeamDiagnostics::Clock::time_point start;
+    _diagnostics.Record(_stage, start, start + std::chrono::microseconds(_us));
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamDiagnostics, WindowAggregation)
+{
+  NpsBeamDiagnostics diagnostics;
+
+  // 99 fast samples and one slow outlier: the percentiles report the
+  // upper edge of the bucket holding them, the mean and max the outlier
+  for (int i = 0; i < 99; ++i)
+    RecordUs(diagnostics, NpsBeamDiagnostics::PROCESS, 1);
+  RecordUs(diagnostics, NpsBeamDiagnostics::PROCESS, 1000);
+
+  // Percentile edges never exceed the largest sample
+  for (int i = 0; i < 10; ++i)
+    RecordUs(diagnostics, NpsBeamDiagnostics::PUBLISH, 10);
+
+  diagnostics.Count(NpsBeamDiagnostics::FRAMES);
+  diagnostics.Count(NpsBeamDiagnostics::FRAMES);
+  diagnostics.Count(NpsBeamDiagnostics::BYTES_PUBLISHED, 100);
+  diagnostics.Count(NpsBeamDiagnostics::BYTES_PUBLISHED, 50);
+
+  const NpsBeamDiagnostics::Snapshot snapshot = diagnostics.TakeSnapshot();
+
+  const NpsBeamDiagnostics::StageStats &process =
+    snapshot.stages[NpsBeamDiagnostics::PROCESS];
+  EXPECT_EQ(100u, process.count);
+  EXPECT_DOUBLE_EQ((99 * 1.0 + 1000.0) / 100, process.meanUs);
+  EXPECT_DOUBLE_EQ(2.0, process.p50Us);
+  EXPECT_DOUBLE_EQ(2.0, process.p99Us);
+  EXPECT_DOUBLE_EQ(1000.0, process.maxUs);
+
+  const NpsBeamDiagnostics::StageStats &publish =
+    snapshot.stages[NpsBeamDiagnostics::PUBLISH];
+  EXPECT_EQ(10u, publish.count);
+  EXPECT_DOUBLE_EQ(10.0, publish.meanUs);
+  EXPECT_DOUBLE_EQ(10.0, publish.p50Us);
+  EXPECT_DOUBLE_EQ(10.0, publish.p99Us);
+  EXPECT_DOUBLE_EQ(10.0, publish.maxUs);
+
+  EXPECT_EQ(0u, snapshot.stages[NpsBeamDiagnostics::RENDER].count);
+  EXPECT_DOUBLE_EQ(0.0, snapshot.stages[NpsBeamDiagnostics::RENDER].meanUs);
+
+  EXPECT_EQ(2u, snapshot.counters[NpsBeamDiagnostics::FRAMES]);
+  EXPECT_EQ(150u, snapshot.counters[NpsBeamDiagnostics::BYTES_PUBLISHED]);
+  EXPECT_EQ(0u, snapshot.counters[NpsBeamDiagnostics::CULLED]);
+  EXPECT_GE(snapshot.windowSeconds, 0.0);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamDiagnostics, SnapshotResetsWindow)
+{
+  NpsBeamDiagnostics diagnostics;
+  RecordUs(diagnostics, NpsBeamDiagnostics::UPDATE, 500);
+  diagnostics.Count(NpsBeamDiagnostics::SKIPPED_NOT_RENDERED, 3);
+  diagnostics.TakeSnapshot();
+
+  // A new window starts empty
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  NpsBeamDiagnostics::Snapshot snapshot = diagnostics.TakeSnapshot();
+  for (int s = 0; s < NpsBeamDiagnostics::STAGE_COUNT; ++s)
+  {
+    EXPECT_EQ(0u, snapshot.stages[s].count);
+    EXPECT_DOUBLE_EQ(0.0, snapshot.stages[s].maxUs);
+    EXPECT_DOUBLE_EQ(0.0, snapshot.stages[s].p99Us);
+  }
+  for (int c = 0; c < NpsBeamDiagnostics::COUNTER_COUNT; ++c)
+    EXPECT_EQ(0u, snapshot.counters[c]);
+  EXPECT_GE(snapshot.windowSeconds, 0.015);
+
+  // It then holds only what was recorded since the last snapshot
+  RecordUs(diagnostics, NpsBeamDiagnostics::UPDATE, 4);
+  snapshot = diagnostics.TakeSnapshot();
+  EXPECT_EQ(1u, snapshot.stages[NpsBeamDiagnostics::UPDATE].count);
+  EXPECT_DOUBLE_EQ(4.0, snapshot.stages[NpsBeamDiagnostics::UPDATE].maxUs);
+  EXPECT_LT(snapshot.windowSeconds, 1.0);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamDiagnostics, Disabled)
+{
+  NpsBeamDiagnostics diagnostics;
+  EXPECT_TRUE(diagnostics.Enabled());
+
+  diagnostics.SetEnabled(false);
+  EXPECT_FALSE(diagnostics.Enabled());
+  RecordUs(diagnostics, NpsBeamDiagnostics::RENDER, 100);
+  diagnostics.Count(NpsBeamDiagnostics::FRAMES);
+  NpsBeamDiagnostics::Snapshot snapshot = diagnostics.TakeSnapshot();
+  EXPECT_EQ(0u, snapshot.stages[NpsBeamDiagnostics::RENDER].count);
+  EXPECT_EQ(0u, snapshot.counters[NpsBeamDiagnostics::FRAMES]);
+
+  diagnostics.SetEnabled(true);
+  diagnostics.Count(NpsBeamDiagnostics::FRAMES);
+  snapshot = diagnostics.TakeSnapshot();
+  EXPECT_EQ(1u, snapshot.counters[NpsBeamDiagnostics::FRAMES]);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamDiagnostics, ConcurrentRecording)
+{
+  // The render and update threads record at once
+  NpsBeamDiagnostics diagnostics;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+  {
+    threads.emplace_back([&diagnostics, t]()
+        {
+          for (int i = 0; i < 1000; ++i)
+          {
+            RecordUs(diagnostics, NpsBeamDiagnostics::RENDER, 1 + t);
+            diagnostics.Count(NpsBeamDiagnostics::FRAMES);
+          }
+        });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+
+  const NpsBeamDiagnostics::Snapshot snapshot = diagnostics.TakeSnapshot();
+  EXPECT_EQ(4000u, snapshot.stages[NpsBeamDiagnostics::RENDER].count);
+  EXPECT_DOUBLE_EQ(2.5, snapshot.stages[NpsBeamDiagnostics::RENDER].meanUs);
+  EXPECT_DOUBLE_EQ(4.0, snapshot.stages[NpsBeamDiagnostics::RENDER].maxUs);
+  EXPECT_EQ(4000u, snapshot.counters[NpsBeamDiagnostics::FRAMES]);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamDiagnostics, Names)
+{
+  EXPECT_STREQ("render", NpsBeamDiagnostics::StageName(
+        NpsBeamDiagnostics::RENDER));
+  EXPECT_STREQ("update", NpsBeamDiagnostics::StageName(
+        NpsBeamDiagnostics::UPDATE));
+  EXPECT_STREQ("frames", NpsBeamDiagnostics::CounterName(
+        NpsBeamDiagnostics::FRAMES));
+  EXPECT_STREQ("culled", NpsBeamDiagnostics::CounterName(
+        NpsBeamDiagnostics::CULLED));
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
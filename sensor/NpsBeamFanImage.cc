@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#include "NpsBeamFanImage.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Image rows per pool chunk.
+  const size_t kRowGrain = 16;
+
+  /// \brief Map a value onto sample positions.
+  /// \param[in] _u Fractional sample position.
+  /// \param[in] _count Number of samples.
+  /// \param[out] _index Lower sample index.
+  /// \param[out] _weight Weight of the upper sample.
+  void MapSample(const double _u, const unsigned int _count,
+      int32_t &_index, float &_weight)
+  {
+    if (_count < 2)
+    {
+      _index = 0;
+      _weight = 0.0f;
+      return;
+    }
+
+    const double u = std::min(std::max(_u, 0.0),
+        static_cast<double>(_count - 1));
+    _index = std::min(static_cast<int32_t>(u),
+        static_cast<int32_t>(_count) - 2);
+    _weight = static_cast<float>(u - _index);
+  }
+
+  /// \brief Blend the four texels of one pixel.
+  inline float FanPixel(const float *_polar, const int32_t _base,
+      const int32_t _stepX, const int32_t _stepY, const float _wx,
+      const float _wy)
+  {
+    const float a = _polar[_base];
+    const float b = _polar[_base + _stepX];
+    const float c = _polar[_base + _stepY];
+    const float d = _polar[_base + _stepX + _stepY];
+    const float top = a + (b - a) * _wx;
+    const float bottom = c + (d - c) * _wx;
+    return top + (bottom - top) * _wy;
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamFanImage::Configure(const unsigned int _width,
+    const unsigned int _height, const double _angleMin,
+    const double _angleMax, const std::vector<double> &_beamAngles,
+    const unsigned int _bins, const double _rangeMin, const double _rangeMax)
+{
+  this->width = _width;
+  this->height = _height;
+  this->binStep = _bins > 1 ? 1 : 0;
+  this->beamStep = _beamAngles.size() > 1 ? static_cast<int32_t>(_bins) : 0;
+  this->runs.clear();
+  this->rowRuns.assign(1, 0);
+  this->bases.clear();
+  this->weightsX.clear();
+  this->weightsY.clear();
+
+  // Bounds of the fan in the sensor plane: the apex, both edges at the
+  // farthest range and every axis the arc crosses
+  double xMin = 0, xMax = 0, yMin = 0, yMax = 0;
+  const double axes[6] = {_angleMin, _angleMax, -M_PI, -M_PI / 2, 0,
+    M_PI / 2};
+  for (double angle : axes)
+  {
+    if (angle < _angleMin || angle > _angleMax)
+      continue;
+    xMin = std::min(xMin, _rangeMax * std::cos(angle));
+    xMax = std::max(xMax, _rangeMax * std::cos(angle));
+    yMin = std::min(yMin, _rangeMax * std::sin(angle));
+    yMax = std::max(yMax, _rangeMax * std::sin(angle));
+  }
+  if (_angleMax >= M_PI)
+    xMin = -_rangeMax;
+
+  this->resolution = std::max((xMax - xMin) / std::max(1u, _height),
+      (yMax - yMin) / std::max(1u, _width));
+  if (this->resolution <= 0 || _beamAngles.empty() || _bins == 0)
+  {
+    this->rowRuns.assign(this->height + 1, 0);
+    return;
+  }
+
+  // Center the fan in the image
+  const double top = xMax + (_height * this->resolution - (xMax - xMin)) / 2;
+  const double left = yMax + (_width * this->resolution - (yMax - yMin)) / 2;
+  const double binScale = _bins / (_rangeMax - _rangeMin);
+
+  for (unsigned int v = 0; v < _height; ++v)
+  {
+    const double x = top - (v + 0.5) * this->resolution;
+    bool inside = false;
+    for (unsigned int u = 0; u < _width; ++u)
+    {
+      const double y = left - (u + 0.5) * this->resolution;
+      const double range = std::sqrt(x * x + y * y);
+      const double angle = std::atan2(y, x);
+      if (range < _rangeMin || range > _rangeMax || angle < _angleMin ||
+          angle > _angleMax)
+      {
+        inside = false;
+        continue;
+      }
+
+      if (!inside)
+      {
+        Run run;
+        run.pixel = v * _width + u;
+        run.entry = static_cast<uint32_t>(this->bases.size());
+        run.count = 0;
+        this->runs.push_back(run);
+        inside = true;
+      }
+      ++this->runs.back().count;
+
+      // Bin centers sit half a bin into each bin; beams may be spaced
+      // unevenly, so find the pair of beams around the angle
+      int32_t bin;
+      float weightX;
+      MapSample((range - _rangeMin) * binScale - 0.5, _bins, bin, weightX);
+
+      const size_t upper = std::upper_bound(_beamAngles.begin(),
+          _beamAngles.end(), angle) - _beamAngles.begin();
+      double beamU = 0;
+      if (upper >= _beamAngles.size())
+        beamU = _beamAngles.size() - 1.0;
+      else if (upper > 0)
+      {
+        beamU = upper - 1 + (angle - _beamAngles[upper - 1]) /
+          (_beamAngles[upper] - _beamAngles[upper - 1]);
+      }
+      int32_t beam;
+      float weightY;
+      MapSample(beamU, static_cast<unsigned int>(_beamAngles.size()), beam,
+          weightY);
+
+      this->bases.push_back(beam * static_cast<int32_t>(_bins) + bin);
+      this->weightsX.push_back(weightX);
+      this->weightsY.push_back(weightY);
+    }
+    this->rowRuns.push_back(static_cast<uint32_t>(this->runs.size()));
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamFanImage::Apply(const float *_polar, float *_out,
+    NpsBeamWorkerPool *_pool) const
+{
+  if (_pool)
+  {
+    _pool->ParallelFor(this->height, kRowGrain,
+        [&](const size_t _begin, const size_t _end)
+        {
+          this->ApplyRows(_polar, _out, _begin, _end);
+        });
+  }
+  else
+    this->ApplyRows(_polar, _out, 0, this->height);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamFanImage::ApplyRows(const float *_polar, float *_out,
+    const size_t _begin, const size_t _end) const
+{
+  std::memset(_out + _begin * this->width, 0,
+      (_end - _begin) * this->width * sizeof(float));
+
+  const int32_t sx = this->binStep;
+  const int32_t sy = this->beamStep;
+
+  for (uint32_t r = this->rowRuns[_begin]; r < this->rowRuns[_end]; ++r)
+  {
+    const Run &run = this->runs[r];
+    const int32_t *base = &this->bases[run.entry];
+    const float *wx = &this->weightsX[run.entry];
+    const float *wy = &this->weightsY[run.entry];
+    float *out = _out + run.pixel;
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i vStepX = _mm256_set1_epi32(sx);
+    const __m256i vStepY = _mm256_set1_epi32(sy);
+
+    for (; i + 8 <= run.count; i += 8)
+    {
+      const __m256i ia = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(base + i));
+      const __m256i ib = _mm256_add_epi32(ia, vStepX);
+      const __m256i ic = _mm256_add_epi32(ia, vStepY);
+      const __m256i id = _mm256_add_epi32(ib, vStepY);
+      const __m256 vx = _mm256_loadu_ps(wx + i);
+      const __m256 vy = _mm256_loadu_ps(wy + i);
+
+      const __m256 a = _mm256_i32gather_ps(_polar, ia, 4);
+      const __m256 b = _mm256_i32gather_ps(_polar, ib, 4);
+      const __m256 c = _mm256_i32gather_ps(_polar, ic, 4);
+      const __m256 d = _mm256_i32gather_ps(_polar, id, 4);
+      const __m256 top = _mm256_add_ps(a,
+          _mm256_mul_ps(_mm256_sub_ps(b, a), vx));
+      const __m256 bottom = _mm256_add_ps(c,
+          _mm256_mul_ps(_mm256_sub_ps(d, c), vx));
+      _mm256_storeu_ps(out + i, _mm256_add_ps(top,
+            _mm256_mul_ps(_mm256_sub_ps(bottom, top), vy)));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= run.count; i += 4)
+    {
+      const int32_t *b = base + i;
+      const __m128 vx = _mm_loadu_ps(wx + i);
+      const __m128 vy = _mm_loadu_ps(wy + i);
+
+      // No gather instruction, so assemble the texels lane by lane
+      const __m128 ta = _mm_setr_ps(_polar[b[0]], _polar[b[1]],
+          _polar[b[2]], _polar[b[3]]);
+      const __m128 tb = _mm_setr_ps(_polar[b[0] + sx], _polar[b[1] + sx],
+          _polar[b[2] + sx], _polar[b[3] + sx]);
+      const __m128 tc = _mm_setr_ps(_polar[b[0] + sy], _polar[b[1] + sy],
+          _polar[b[2] + sy], _polar[b[3] + sy]);
+      const __m128 td = _mm_setr_ps(_polar[b[0] + sx + sy],
+          _polar[b[1] + sx + sy], _polar[b[2] + sx + sy],
+          _polar[b[3] + sx + sy]);
+      const __m128 top = _mm_add_ps(ta, _mm_mul_ps(_mm_sub_ps(tb, ta), vx));
+      const __m128 bottom =
+        _mm_add_ps(tc, _mm_mul_ps(_mm_sub_ps(td, tc), vx));
+      _mm_storeu_ps(out + i, _mm_add_ps(top,
+            _mm_mul_ps(_mm_sub_ps(bottom, top), vy)));
+    }
+#endif
+
+    for (; i < run.count; ++i)
+      out[i] = FanPixel(_polar, base[i], sx, sy, wx[i], wy[i]);
+  }
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamFanImage::Width() const
+{
+  return this->width;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamFanImage::Height() const
+{
+  return this->height;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamFanImage::FanPixelCount() const
+{
+  return this->bases.size();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamFanImage::Resolution() const
+{
+  return this->resolution;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_FAN_IMAGE_HH
+#define NPS_BEAM_FAN_IMAGE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamWorkerPool;
+
+    /// \brief Remaps a polar beam image onto the Cartesian fan image of
+    /// a sonar display through a precomputed table.
+    ///
+    /// The polar image is beam major, one row of range bins per beam,
+    /// as NpsBeamIntensityBinner produces it. The fan image looks down
+    /// on the sensor plane with the sensor at the apex, forward up and
+    /// positive angles to the left, scaled so the whole fan fits the
+    /// image. Configure computes, once per geometry, the polar texel and
+    /// bilinear weights of every pixel inside the fan and groups those
+    /// pixels into runs along each image row; Apply then costs four
+    /// gathers and three blends per fan pixel and clears the rest.
+    class NpsBeamFanImage
+    {
+      /// \brief Build the remap table.
+      /// \param[in] _width Image width in pixels.
+      /// \param[in] _height Image height in pixels.
+      /// \param[in] _angleMin Angle of the right edge of the fan.
+      /// \param[in] _angleMax Angle of the left edge of the fan.
+      /// \param[in] _beamAngles Center angle of each polar row, in
+      /// increasing order.
+      /// \param[in] _bins Range bins per polar row.
+      /// \param[in] _rangeMin Range of the start of the first bin.
+      /// \param[in] _rangeMax Range of the end of the last bin.
+      public: void Configure(const unsigned int _width,
+                  const unsigned int _height, const double _angleMin,
+                  const double _angleMax,
+                  const std::vector<double> &_beamAngles,
+                  const unsigned int _bins, const double _rangeMin,
+                  const double _rangeMax);
+
+      /// \brief Remap one polar image.
+      /// \param[in] _polar Beams * bins polar image.
+      /// \param[out] _out Width * height image, row major.
+      /// \param[in] _pool Pool to spread image rows over, or null to run
+      /// on the calling thread.
+      public: void Apply(const float *_polar, float *_out,
+                  NpsBeamWorkerPool *_pool) const;
+
+      /// \brief Image width.
+      /// \return Width in pixels.
+      public: unsigned int Width() const;
+
+      /// \brief Image height.
+      /// \return Height in pixels.
+      public: unsigned int Height() const;
+
+      /// \brief Number of pixels inside the fan.
+      /// \return Pixel count.
+      public: size_t FanPixelCount() const;
+
+      /// \brief Size of a pixel.
+      /// \return Meters per pixel.
+      public: double Resolution() const;
+
+      /// \brief Remap a range of image rows.
+      private: void ApplyRows(const float *_polar, float *_out,
+                   const size_t _begin, const size_t _end) const;
+
+      /// \brief Pixels along a row that lie inside the fan.
+      private: struct Run
+      {
+        /// \brief Index of the first pixel in the image.
+        uint32_t pixel;
+
+        /// \brief Index of the first pixel in the table.
+        uint32_t entry;
+
+        /// \brief Number of pixels.
+        uint32_t count;
+      };
+
+      /// \brief Image width.
+      private: unsigned int width = 0;
+
+      /// \brief Image height.
+      private: unsigned int height = 0;
+
+      /// \brief Meters per pixel.
+      private: double resolution = 0;
+
+      /// \brief Offset from a texel to the next bin, 0 for a single bin.
+      private: int32_t binStep = 0;
+
+      /// \brief Offset from a texel to the texel of the next beam, 0 for
+      /// a single beam.
+      private: int32_t beamStep = 0;
+
+      /// \brief Runs of every row in order.
+      private: std::vector<Run> runs;
+
+      /// \brief First run of each row, height + 1 entries.
+      private: std::vector<uint32_t> rowRuns;
+
+      /// \brief Polar index of the lower bin and beam of each fan pixel.
+      private: std::vector<int32_t> bases;
+
+      /// \brief Weight of the upper bin of each fan pixel.
+      private: std::vector<float> weightsX;
+
+      /// \brief Weight of the upper beam of each fan pixel.
+      private: std::vector<float> weightsY;
+    };
+  }
+}
+#endif
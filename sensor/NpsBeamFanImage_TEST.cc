@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "NpsBeamFanImage.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Fan used by the tests: a quarter circle facing forward.
+  const double kAngleMin = -M_PI / 4;
+  const double kAngleMax = M_PI / 4;
+  const double kRangeMin = 1.0;
+  const double kRangeMax = 10.0;
+  const unsigned int kBins = 40;
+  const unsigned int kWidth = 96;
+  const unsigned int kHeight = 72;
+
+  /// \brief Unevenly spaced beams covering the fan.
+  std::vector<double> BeamAngles()
+  {
+    std::vector<double> angles;
+    for (int i = 0; i <= 12; ++i)
+    {
+      const double u = i / 12.0;
+      angles.push_back(kAngleMin + (kAngleMax - kAngleMin) * u * u);
+    }
+    return angles;
+  }
+
+  /// \brief Sensor plane position of a pixel center. The fan spans x
+  /// from the apex to kRangeMax and y symmetrically, centered in the
+  /// image with forward up and positive y to the left.
+  void PixelPosition(const double _resolution, const unsigned int _u,
+      const unsigned int _v, double &_range, double &_angle)
+  {
+    const double xMax = kRangeMax;
+    const double yMax = kRangeMax * std::sin(kAngleMax);
+    const double top = xMax + (kHeight * _resolution - xMax) / 2;
+    const double left = yMax + (kWidth * _resolution - 2 * yMax) / 2;
+    const double x = top - (_v + 0.5) * _resolution;
+    const double y = left - (_u + 0.5) * _resolution;
+    _range = std::sqrt(x * x + y * y);
+    _angle = std::atan2(y, x);
+  }
+
+  /// \brief Polar image linear in the bin center range and the beam
+  /// angle, which bilinear sampling reproduces exactly.
+  std::vector<float> LinearPolar(const std::vector<double> &_beamAngles)
+  {
+    const double binSize = (kRangeMax - kRangeMin) / kBins;
+    std::vector<float> polar(_beamAngles.size() * kBins);
+    for (size_t beam = 0; beam < _beamAngles.size(); ++beam)
+    {
+      for (unsigned int bin = 0; bin < kBins; ++bin)
+      {
+        polar[beam * kBins + bin] = static_cast<float>(
+            kRangeMin + (bin + 0.5) * binSize + 10 * _beamAngles[beam]);
+      }
+    }
+    return polar;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamFanImage, FanCoverage)
+{
+  const std::vector<double> beamAngles = BeamAngles();
+  NpsBeamFanImage fan;
+  fan.Configure(kWidth, kHeight, kAngleMin, kAngleMax, beamAngles, kBins,
+      kRangeMin, kRangeMax);
+  EXPECT_EQ(kWidth, fan.Width());
+  EXPECT_EQ(kHeight, fan.Height());
+
+  // The fan is 2 sin(pi/4) kRangeMax wide, which limits the scale
+  EXPECT_NEAR(2 * kRangeMax * std::sin(kAngleMax) / kWidth,
+      fan.Resolution(), 1e-12);
+
+  // Pixels outside the fan are cleared, inside they sample the polar image
+  const std::vector<float> polar(beamAngles.size() * kBins, 1.0f);
+  std::vector<float> image(kWidth * kHeight, -1.0f);
+  fan.Apply(polar.data(), image.data(), nullptr);
+
+  size_t inside = 0;
+  for (unsigned int v = 0; v < kHeight; ++v)
+  {
+    for (unsigned int u = 0; u < kWidth; ++u)
+    {
+      double range, angle;
+      PixelPosition(fan.Resolution(), u, v, range, angle);
+      const bool fanPixel = range >= kRangeMin && range <= kRangeMax &&
+        angle >= kAngleMin && angle <= kAngleMax;
+      inside += fanPixel ? 1 : 0;
+      EXPECT_FLOAT_EQ(fanPixel ? 1.0f : 0.0f, image[v * kWidth + u])
+        << "pixel " << u << ", " << v;
+    }
+  }
+  EXPECT_EQ(inside, fan.FanPixelCount());
+
+  // Roughly the area of the fan in pixels
+  const double area = (kAngleMax - kAngleMin) / 2 *
+    (kRangeMax * kRangeMax - kRangeMin * kRangeMin) /
+    (fan.Resolution() * fan.Resolution());
+  EXPECT_NEAR(area, static_cast<double>(inside), 0.05 * area);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamFanImage, BilinearSampling)
+{
+  const std::vector<double> beamAngles = BeamAngles();
+  NpsBeamFanImage fan;
+  fan.Configure(kWidth, kHeight, kAngleMin, kAngleMax, beamAngles, kBins,
+      kRangeMin, kRangeMax);
+
+  const std::vector<float> polar = LinearPolar(beamAngles);
+  std::vector<float> image(kWidth * kHeight);
+  fan.Apply(polar.data(), image.data(), nullptr);
+
+  // Each pixel gets the polar value at its range and angle, clamped to
+  // the outermost bin centers and beams
+  const double binSize = (kRangeMax - kRangeMin) / kBins;
+  for (unsigned int v = 0; v < kHeight; ++v)
+  {
+    for (unsigned int u = 0; u < kWidth; ++u)
+    {
+      double range, angle;
+      PixelPosition(fan.Resolution(), u, v, range, angle);
+      if (range < kRangeMin || range > kRangeMax || angle < kAngleMin ||
+          angle > kAngleMax)
+      {
+        continue;
+      }
+
+      range = std::min(std::max(range, kRangeMin + binSize / 2),
+          kRangeMax - binSize / 2);
+      angle = std::min(std::max(angle, beamAngles.front()),
+          beamAngles.back());
+      EXPECT_NEAR(range + 10 * angle, image[v * kWidth + u], 1e-4)
+        << "pixel " << u << ", " << v;
+    }
+  }
+
+  // Rows spread over a pool give the same image
+  NpsBeamWorkerPool pool(3);
+  std::vector<float> pooled(kWidth * kHeight, -1.0f);
+  fan.Apply(polar.data(), pooled.data(), &pool);
+  EXPECT_EQ(image, pooled);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamFanImage, SingleBeam)
+{
+  // One beam spreads its bins across the whole fan
+  NpsBeamFanImage fan;
+  fan.Configure(kWidth, kHeight, kAngleMin, kAngleMax,
+      std::vector<double>(1, 0.0), kBins, kRangeMin, kRangeMax);
+  ASSERT_GT(fan.FanPixelCount(), 0u);
+
+  const std::vector<float> polar = LinearPolar(std::vector<double>(1, 0.0));
+  std::vector<float> image(kWidth * kHeight);
+  fan.Apply(polar.data(), image.data(), nullptr);
+
+  const double binSize = (kRangeMax - kRangeMin) / kBins;
+  for (unsigned int v = 0; v < kHeight; ++v)
+  {
+    for (unsigned int u = 0; u < kWidth; ++u)
+    {
+      double range, angle;
+      PixelPosition(fan.Resolution(), u, v, range, angle);
+      if (range < kRangeMin || range > kRangeMax || angle < kAngleMin ||
+          angle > kAngleMax)
+      {
+        continue;
+      }
+
+      range = std::min(std::max(range, kRangeMin + binSize / 2),
+          kRangeMax - binSize / 2);
+      EXPECT_NEAR(range, image[v * kWidth + u], 1e-4);
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamFanImage, EmptyGeometry)
+{
+  // Without beams nothing is inside the fan, but the image is cleared
+  NpsBeamFanImage fan;
+  fan.Configure(8, 8, kAngleMin, kAngleMax, std::vector<double>(), kBins,
+      kRangeMin, kRangeMax);
+  EXPECT_EQ(0u, fan.FanPixelCount());
+
+  std::vector<float> image(64, -1.0f);
+  fan.Apply(nullptr, image.data(), nullptr);
+  EXPECT_EQ(std::vector<float>(64, 0.0f), image);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
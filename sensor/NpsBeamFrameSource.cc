@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include "NpsBeamCpuSource.hh"
+#include "NpsBeamFrameSource.hh"
+#include "NpsBeamGpuSource.hh"
+#include "NpsBeamReplaySource.hh"
+#include "NpsBeamSensor.hh"
+#include "NpsBeamSyntheticSource.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+NpsBeamFrameSource::~NpsBeamFrameSource()
+{
+}
+
+//////////////////////////////////////////////////
+std::unique_ptr<NpsBeamFrameSource> NpsBeamFrameSource::Create(
+    const std::string &_name)
+{
+  std::unique_ptr<NpsBeamFrameSource> source;
+  if (_name == "gpu")
+    source.reset(new NpsBeamGpuSource);
+  else if (_name == "cpu")
+    source.reset(new NpsBeamCpuSource);
+  else if (_name == "synthetic")
+    source.reset(new NpsBeamSyntheticSource);
+  else if (_name == "replay")
+    source.reset(new NpsBeamReplaySource);
+  return source;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamFrameSource::Fini()
+{
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamFrameSource::RendersOnRenderEvent() const
+{
+  return false;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamFrameSource::SupportsSector() const
+{
+  return false;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamFrameSource::PostRender()
+{
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamFrameSource::FramePose(ignition::math::Pose3d &/*_pose*/) const
+{
+  return false;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamFrameSource::CameraCount() const
+{
+  return 1;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamFrameSource::IsHorizontal() const
+{
+  return true;
+}
+
+//////////////////////////////////////////////////
+double NpsBeamFrameSource::HorzFOV() const
+{
+  return (this->sensor->AngleMax() - this->sensor->AngleMin()).Radian();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamFrameSource::CosHorzFOV() const
+{
+  return this->HorzFOV();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamFrameSource::VertFOV() const
+{
+  return (this->sensor->VerticalAngleMax() -
+      this->sensor->VerticalAngleMin()).Radian();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamFrameSource::CosVertFOV() const
+{
+  return this->VertFOV();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamFrameSource::RayCountRatio() const
+{
+  return static_cast<double>(this->sensor->RayCount()) /
+    this->sensor->VerticalRayCount();
+}
+
+//////////////////////////////////////////////////
+event::ConnectionPtr NpsBeamFrameSource::ConnectNewLaserFrame(
+    LaserFrameFunction _subscriber)
+{
+  return this->newLaserFrame.Connect(_subscriber);
+}
+
+//////////////////////////////////////////////////
+common::Time NpsBeamFrameSource::FrameTime() const
+{
+  return this->frameTime;
+}
+
+//////////////////////////////////////////////////
+rendering::GpuLaserPtr NpsBeamFrameSource::LaserCamera() const
+{
+  return rendering::GpuLaserPtr();
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamFrameSource::CulledCount() const
+{
+  return 0;
+}
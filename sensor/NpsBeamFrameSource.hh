@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_FRAME_SOURCE_HH
+#define NPS_BEAM_FRAME_SOURCE_HH
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <ignition/math/Pose3.hh>
+#include <sdf/sdf.hh>
+
+#include "gazebo/common/Event.hh"
+#include "gazebo/common/Time.hh"
+#include "gazebo/physics/PhysicsTypes.hh"
+#include "gazebo/rendering/RenderTypes.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamGeometry;
+    class NpsBeamSensor;
+
+    /// \brief Everything a frame source may need from its sensor besides
+    /// the sensor's public interface.
+    class NpsBeamSourceContext
+    {
+      /// \brief World the sensor is in.
+      public: physics::WorldPtr world;
+
+      /// \brief Entity the sensor is attached to.
+      public: physics::EntityPtr parent;
+
+      /// \brief The <nps:beam> configuration element, may be null.
+      public: sdf::ElementPtr config;
+    };
+
+    /// \brief Producer of raw beam frames for NpsBeamSensor.
+    ///
+    /// A source owns the device specific setup of the scan geometry,
+    /// produces one frame per Render and hands out its ranges and
+    /// intensities through Read, in the row major order of the published
+    /// scan. The sensor runs the same post-render path on every source.
+    ///
+    /// Sources that render on the render event (RendersOnRenderEvent)
+    /// get Render and then PostRender from the render thread, through the
+    /// NpsBeamScheduler, and Read from the update thread; all other
+    /// sources get Render immediately before Read on the update thread.
+    class NpsBeamFrameSource
+    {
+      /// \brief New laser frame callback, with the arguments of
+      /// rendering::GpuLaser::ConnectNewLaserFrame.
+      public: typedef std::function<void(const float *, unsigned int,
+                  unsigned int, unsigned int, const std::string &)>
+              LaserFrameFunction;
+
+      /// \brief Destructor
+      public: virtual ~NpsBeamFrameSource();
+
+      /// \brief Create a source by name.
+      /// \param[in] _name "gpu", "cpu", "synthetic" or "replay".
+      /// \return The source, or null if _name is unknown.
+      public: static std::unique_ptr<NpsBeamFrameSource> Create(
+                  const std::string &_name);
+
+      /// \brief Set up the source for a sensor.
+      ///
+      /// May adjust the sensor's scan geometry to what the source
+      /// supports, e.g. cap the vertical field of view.
+      /// \param[in] _sensor Sensor the frames are for.
+      /// \param[in] _context Sensor context.
+      /// \return False if the source cannot run.
+      public: virtual bool Init(NpsBeamSensor &_sensor,
+                  const NpsBeamSourceContext &_context) = 0;
+
+      /// \brief Release the source's resources.
+      public: virtual void Fini();
+
+      /// \brief Check whether Render must be called from the render event.
+      /// \return True for rendering based sources.
+      public: virtual bool RendersOnRenderEvent() const;
+
+      /// \brief Check whether the source produces frames of an active
+      /// sector, narrower than the whole fan.
+      ///
+      /// Such sources must produce exactly the rays of the geometry they
+      /// are given in Render, whose angles may change between frames.
+      /// \return False to always be given the whole fan.
+      public: virtual bool SupportsSector() const;
+
+      /// \brief Produce a frame.
+      /// \param[in] _geom Scan geometry.
+      /// \param[in] _pose Sensor world pose. Sources rendering on the
+      /// render event follow the parent visual and get a zero pose.
+      /// \return Simulation time the frame represents.
+      public: virtual common::Time Render(const NpsBeamGeometry &_geom,
+                  const ignition::math::Pose3d &_pose) = 0;
+
+      /// \brief Complete a frame started on the render event.
+      public: virtual void PostRender();
+
+      /// \brief Get the pose the last frame was taken at, for sources
+      /// that know it better than the sensor, such as a replay.
+      /// \param[out] _pose Sensor world pose of the last frame.
+      /// \return False to keep the sensor's own pose.
+      public: virtual bool FramePose(ignition::math::Pose3d &_pose) const;
+
+      /// \brief Copy the last frame out.
+      /// \param[out] _ranges Output ranges.
+      /// \param[out] _intensities Output intensities.
+      /// \param[in] _count Maximum number of cells to copy.
+      /// \return Number of cells copied.
+      public: virtual size_t Read(float *_ranges, float *_intensities,
+                  const size_t _count) = 0;
+
+      /// \brief Number of cameras the scan is split over.
+      /// \return Camera count.
+      public: virtual unsigned int CameraCount() const;
+
+      /// \brief Check whether the scan is horizontal.
+      /// \return True if horizontal.
+      public: virtual bool IsHorizontal() const;
+
+      /// \brief Horizontal field of view of one camera.
+      /// \return Field of view in radians.
+      public: virtual double HorzFOV() const;
+
+      /// \brief Horizontal field of view covering the vertical extent.
+      /// \return Field of view in radians.
+      public: virtual double CosHorzFOV() const;
+
+      /// \brief Vertical field of view.
+      /// \return Field of view in radians.
+      public: virtual double VertFOV() const;
+
+      /// \brief Vertical field of view covering the horizontal extent.
+      /// \return Field of view in radians.
+      public: virtual double CosVertFOV() const;
+
+      /// \brief Ratio of horizontal to vertical rays.
+      /// \return Ray count ratio.
+      public: virtual double RayCountRatio() const;
+
+      /// \brief Connect to the new laser frame event.
+      /// \param[in] _subscriber Event callback.
+      /// \return The connection, which must be kept in scope.
+      public: virtual event::ConnectionPtr ConnectNewLaserFrame(
+                  LaserFrameFunction _subscriber);
+
+      /// \brief Get the simulation time of the last frame, the time
+      /// Render returned for it. Set before the new laser frame event
+      /// fires, so callbacks can stamp the frame they are given.
+      /// \return Frame time.
+      public: common::Time FrameTime() const;
+
+      /// \brief Get the laser camera of rendering based sources.
+      /// \return The laser camera, or null.
+      public: virtual rendering::GpuLaserPtr LaserCamera() const;
+
+      /// \brief Get the number of objects left out of the last frame
+      /// because no ray could reach them.
+      /// \return Culled object count, 0 for sources that do not cull.
+      public: virtual unsigned int CulledCount() const;
+
+      /// \brief Sensor the source was initialized for.
+      protected: NpsBeamSensor *sensor = nullptr;
+
+      /// \brief Simulation time of the last frame, see FrameTime.
+      protected: common::Time frameTime;
+
+      /// \brief New laser frame event of non rendering sources.
+      protected: event::EventT<void(const float *, unsigned int,
+                 unsigned int, unsigned int, const std::string &)>
+                 newLaserFrame;
+    };
+  }
+}
+#endif
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <atomic>
+
+#include "NpsBeamFrameStore.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+void NpsBeamFrame::Resize(const unsigned int _width,
+    const unsigned int _height)
+{
+  this->width = _width;
+  this->height = _height;
+  this->ranges.resize(static_cast<size_t>(_width) * _height);
+  this->intensities.resize(static_cast<size_t>(_width) * _height);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamFrame::ResizeEchoes(const unsigned int _echoes)
+{
+  const size_t cells = static_cast<size_t>(this->width) * this->height;
+  this->echoes = _echoes;
+  this->echoRanges.resize(cells * _echoes);
+  this->echoIntensities.resize(cells * _echoes);
+  this->echoCounts.resize(_echoes > 0 ? cells : 0);
+}
+
+//////////////////////////////////////////////////
+NpsBeamFrameStore::NpsBeamFrameStore(const unsigned int _slots)
+{
+  for (unsigned int i = 0; i < std::max(_slots, 3u); ++i)
+    this->slots.push_back(std::make_shared<NpsBeamFrame>());
+  this->writing.assign(this->slots.size(), false);
+}
+
+//////////////////////////////////////////////////
+NpsBeamFrame *NpsBeamFrameStore::BeginWrite()
+{
+  const NpsBeamFramePtr current = this->Latest();
+
+  std::lock_guard<std::mutex> lock(this->writeMutex);
+
+  // Readers can only take new references to the latest frame, so any
+  // other idle slot referenced by the store alone is free to overwrite.
+  for (size_t i = 0; i < this->slots.size(); ++i)
+  {
+    if (!this->writing[i] && this->slots[i] != current &&
+        this->slots[i].use_count() == 1)
+    {
+      // use_count() is a relaxed load; order it after the release of
+      // the last reader's reference, so that reader's accesses to the
+      // frame happen before it is overwritten
+      std::atomic_thread_fence(std::memory_order_acquire);
+      this->writing[i] = true;
+      this->slots[i]->sequence = 0;
+      return this->slots[i].get();
+    }
+  }
+
+  // Every other frame is held by a reader, grow instead of waiting.
+  this->slots.push_back(std::make_shared<NpsBeamFrame>());
+  this->writing.push_back(true);
+  return this->slots.back().get();
+}
+
+//////////////////////////////////////////////////
+uint64_t NpsBeamFrameStore::AssignSequence(NpsBeamFrame *_frame)
+{
+  std::lock_guard<std::mutex> lock(this->writeMutex);
+  if (_frame->sequence == 0)
+    _frame->sequence = ++this->sequence;
+  return _frame->sequence;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamFrameStore::EndWrite(NpsBeamFrame *_frame)
+{
+  std::shared_ptr<NpsBeamFrame> frame;
+  {
+    std::lock_guard<std::mutex> lock(this->writeMutex);
+    for (size_t i = 0; i < this->slots.size(); ++i)
+    {
+      if (this->slots[i].get() == _frame && this->writing[i])
+      {
+        frame = this->slots[i];
+        if (frame->sequence == 0)
+          frame->sequence = ++this->sequence;
+        this->writing[i] = false;
+        break;
+      }
+    }
+  }
+
+  if (frame)
+    std::atomic_store(&this->latest, NpsBeamFramePtr(frame));
+}
+
+//////////////////////////////////////////////////
+void NpsBeamFrameStore::AbortWrite(NpsBeamFrame *_frame)
+{
+  std::lock_guard<std::mutex> lock(this->writeMutex);
+  for (size_t i = 0; i < this->slots.size(); ++i)
+  {
+    if (this->slots[i].get() == _frame)
+      this->writing[i] = false;
+  }
+}
+
+//////////////////////////////////////////////////
+NpsBeamFramePtr NpsBeamFrameStore::Latest() const
+{
+  return std::atomic_load(&this->latest);
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamFrameStore::SlotCount() const
+{
+  std::lock_guard<std::mutex> lock(this->writeMutex);
+  return this->slots.size();
+}
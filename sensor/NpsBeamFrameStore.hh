@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_FRAME_STORE_HH
+#define NPS_BEAM_FRAME_STORE_HH
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief One complete, processed beam scan.
+    ///
+    /// Ranges and intensities are stored row major, vertical index first,
+    /// in the same order as the published LaserScan.
+    class NpsBeamFrame
+    {
+      /// \brief Processed ranges, width * height values.
+      public: std::vector<float> ranges;
+
+      /// \brief Intensities, width * height values.
+      public: std::vector<float> intensities;
+
+      /// \brief Echo ranges, echoes values per cell in range order, NaN
+      /// past the cell's echo count. Empty without multi-echo output.
+      public: std::vector<float> echoRanges;
+
+      /// \brief Echo intensities, laid out as echoRanges.
+      public: std::vector<float> echoIntensities;
+
+      /// \brief Number of echoes found in each cell.
+      public: std::vector<uint8_t> echoCounts;
+
+      /// \brief Echo slots per cell, 0 without multi-echo output.
+      public: unsigned int echoes = 0;
+
+      /// \brief Number of horizontal cells.
+      public: unsigned int width = 0;
+
+      /// \brief Number of vertical cells.
+      public: unsigned int height = 0;
+
+      /// \brief Monotonic frame counter assigned by the frame store, 0
+      /// until the frame is numbered.
+      public: uint64_t sequence = 0;
+
+      /// \brief Measurement time, seconds part.
+      public: int32_t sec = 0;
+
+      /// \brief Measurement time, nanoseconds part.
+      public: int32_t nsec = 0;
+
+      /// \brief Sensor world pose as x, y, z, qw, qx, qy, qz.
+      public: double pose[7] = {0, 0, 0, 1, 0, 0, 0};
+
+      /// \brief Minimum horizontal angle in radians.
+      public: double angleMin = 0;
+
+      /// \brief Maximum horizontal angle in radians.
+      public: double angleMax = 0;
+
+      /// \brief Horizontal angle step in radians.
+      public: double angleStep = 0;
+
+      /// \brief Minimum vertical angle in radians.
+      public: double verticalAngleMin = 0;
+
+      /// \brief Maximum vertical angle in radians.
+      public: double verticalAngleMax = 0;
+
+      /// \brief Vertical angle step in radians.
+      public: double verticalAngleStep = 0;
+
+      /// \brief Minimum range.
+      public: double rangeMin = 0;
+
+      /// \brief Maximum range.
+      public: double rangeMax = 0;
+
+      /// \brief Resize the range and intensity arrays.
+      /// \param[in] _width Number of horizontal cells.
+      /// \param[in] _height Number of vertical cells.
+      public: void Resize(const unsigned int _width,
+                          const unsigned int _height);
+
+      /// \brief Resize the echo arrays to the current cell count.
+      /// \param[in] _echoes Echo slots per cell, 0 to drop the echoes.
+      public: void ResizeEchoes(const unsigned int _echoes);
+    };
+
+    /// \def NpsBeamFramePtr
+    /// \brief Shared pointer to an immutable beam frame.
+    typedef std::shared_ptr<const NpsBeamFrame> NpsBeamFramePtr;
+
+    /// \brief Frame store handing out immutable frames to readers.
+    ///
+    /// The producer fills a private frame between BeginWrite and
+    /// EndWrite, which makes it the latest frame. Several frames may be
+    /// in flight at once, e.g. when processing is pipelined, and they are
+    /// expected to end in the order they began. Readers on any thread get
+    /// a reference counted view of the latest frame through Latest() and
+    /// never block the producer. A frame is only reused once no reader
+    /// holds it, so a reader always sees one whole scan. A frame may be
+    /// numbered with AssignSequence before EndWrite, so outputs encoded
+    /// ahead of publication carry the sequence readers will see.
+    class NpsBeamFrameStore
+    {
+      /// \brief Constructor
+      /// \param[in] _slots Number of preallocated frames, at least 3 so
+      /// the producer never waits on a single reader.
+      public: explicit NpsBeamFrameStore(const unsigned int _slots = 3);
+
+      /// \brief Get a frame to fill.
+      /// \return Writable frame, not visible to readers until EndWrite.
+      public: NpsBeamFrame *BeginWrite();
+
+      /// \brief Give a frame returned by BeginWrite its sequence number
+      /// without publishing it. Frames must be numbered in the order they
+      /// end; calling it again on the same write is a no-op.
+      /// \param[in] _frame Frame to number.
+      /// \return The frame's sequence number.
+      public: uint64_t AssignSequence(NpsBeamFrame *_frame);
+
+      /// \brief Publish a frame returned by BeginWrite, numbering it first
+      /// unless AssignSequence already did.
+      /// \param[in] _frame Frame to publish.
+      public: void EndWrite(NpsBeamFrame *_frame);
+
+      /// \brief Return a frame from BeginWrite without publishing it.
+      /// \param[in] _frame Frame to discard.
+      public: void AbortWrite(NpsBeamFrame *_frame);
+
+      /// \brief Get the latest complete frame.
+      /// \return Latest frame, or null if nothing was written yet.
+      public: NpsBeamFramePtr Latest() const;
+
+      /// \brief Number of frames owned by the store.
+      /// \return Frame count.
+      public: size_t SlotCount() const;
+
+      /// \brief Frames owned by the store.
+      private: std::vector<std::shared_ptr<NpsBeamFrame>> slots;
+
+      /// \brief True for slots between BeginWrite and EndWrite.
+      private: std::vector<bool> writing;
+
+      /// \brief Protects slots, writing and sequence. Readers never take
+      /// it.
+      private: mutable std::mutex writeMutex;
+
+      /// \brief Next sequence number.
+      private: uint64_t sequence = 0;
+
+      /// \brief Latest complete frame, accessed atomically.
+      private: NpsBeamFramePtr latest;
+    };
+  }
+}
+#endif
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "NpsBeamFrameStore.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Fill a frame so every value can be checked against its
+  /// sequence.
+  void FillFrame(NpsBeamFrame &_frame, const uint64_t _index)
+  {
+    // Vary the size so slots are resized while readers hold others
+    _frame.Resize(256 + static_cast<unsigned int>(_index % 7) * 64, 4);
+    const float value = static_cast<float>(_index);
+    std::fill(_frame.ranges.begin(), _frame.ranges.end(), value);
+    std::fill(_frame.intensities.begin(), _frame.intensities.end(),
+        -value);
+    _frame.sec = static_cast<int32_t>(_index);
+    _frame.nsec = static_cast<int32_t>(_index % 1000000000);
+  }
+
+  /// \brief Check that a frame holds one whole write.
+  /// \return True if the frame is consistent.
+  bool Consistent(const NpsBeamFrame &_frame)
+  {
+    const size_t cells = static_cast<size_t>(_frame.width) * _frame.height;
+    if (_frame.ranges.size() != cells || _frame.intensities.size() != cells)
+      return false;
+
+    // Frames are numbered 1, 2, ... in the order they were filled
+    const uint64_t index = _frame.sequence - 1;
+    const float value = static_cast<float>(index);
+    if (_frame.sec != static_cast<int32_t>(index) ||
+        _frame.width != 256 + (index % 7) * 64)
+    {
+      return false;
+    }
+    for (size_t i = 0; i < cells; ++i)
+    {
+      if (_frame.ranges[i] != value || _frame.intensities[i] != -value)
+        return false;
+    }
+    return true;
+  }
+
+  /// \brief Read the latest frame until the writer is done.
+  void Reader(const NpsBeamFrameStore &_store, const std::atomic<bool> &_done,
+      std::atomic<unsigned int> &_errors, std::atomic<uint64_t> &_reads)
+  {
+    uint64_t last = 0;
+    NpsBeamFramePtr held;
+    uint64_t reads = 0;
+    while (!_done)
+    {
+      const NpsBeamFramePtr frame = _store.Latest();
+      if (!frame)
+        continue;
+
+      if (frame->sequence < last || !Consistent(*frame))
+        ++_errors;
+      last = frame->sequence;
+
+      // Keep every few frames a while, so the writer has to skip or
+      // grow past slots held by readers
+      if (++reads % 5 == 0)
+        held = frame;
+      else if (reads % 5 == 3)
+        held.reset();
+
+      if (held && !Consistent(*held))
+        ++_errors;
+    }
+    _reads += reads;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamFrameStore, SequenceStartsAtOne)
+{
+  NpsBeamFrameStore store;
+  EXPECT_TRUE(store.Latest() == nullptr);
+
+  NpsBeamFrame *frame = store.BeginWrite();
+  store.AbortWrite(frame);
+  EXPECT_TRUE(store.Latest() == nullptr);
+
+  frame = store.BeginWrite();
+  EXPECT_EQ(0u, frame->sequence);
+  store.EndWrite(frame);
+  ASSERT_TRUE(store.Latest() != nullptr);
+  EXPECT_EQ(1u, store.Latest()->sequence);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamFrameStore, InFlightFramesEndInOrder)
+{
+  NpsBeamFrameStore store;
+  NpsBeamFrame *first = store.BeginWrite();
+  NpsBeamFrame *second = store.BeginWrite();
+  ASSERT_NE(first, second);
+
+  FillFrame(*first, 0);
+  FillFrame(*second, 1);
+  EXPECT_EQ(1u, store.AssignSequence(first));
+  store.EndWrite(first);
+  EXPECT_EQ(2u, store.AssignSequence(second));
+  store.EndWrite(second);
+
+  const NpsBeamFramePtr latest = store.Latest();
+  EXPECT_EQ(second, latest.get());
+  EXPECT_TRUE(Consistent(*latest));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamFrameStore, ConcurrentReaders)
+{
+  NpsBeamFrameStore store;
+  std::atomic<bool> done(false);
+  std::atomic<unsigned int> errors(0);
+  std::atomic<uint64_t> reads(0);
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; ++i)
+  {
+    readers.emplace_back(Reader, std::cref(store), std::cref(done),
+        std::ref(errors), std::ref(reads));
+  }
+
+  // Two frames in flight at a time, as with a pipelined sensor
+  const uint64_t frames = 20000;
+  std::thread writer([&]()
+  {
+    NpsBeamFrame *pending = nullptr;
+    for (uint64_t i = 0; i < frames; ++i)
+    {
+      NpsBeamFrame *frame = store.BeginWrite();
+      FillFrame(*frame, i);
+      if (pending)
+        store.EndWrite(pending);
+      pending = frame;
+      if (i % 64 == 0)
+        std::this_thread::yield();
+    }
+    store.EndWrite(pending);
+  });
+
+  writer.join();
+  done = true;
+  for (std::thread &reader : readers)
+    reader.join();
+
+  EXPECT_EQ(0u, errors);
+  EXPECT_GT(reads, 0u);
+  ASSERT_TRUE(store.Latest() != nullptr);
+  EXPECT_EQ(frames, store.Latest()->sequence);
+  EXPECT_TRUE(Consistent(*store.Latest()));
+
+  // Readers hold at most two frames each, besides the latest and the
+  // one in flight
+  EXPECT_LE(store.SlotCount(), 3u * 2u + 2u + 1u);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2015 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_GEOMETRY_HH
+#define NPS_BEAM_GEOMETRY_HH
+
+#include <memory>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \internal
+    /// \brief Immutable snapshot of the scan geometry read from SDF.
+    ///
+    /// Built once in Load and replaced whenever one of the angle setters
+    /// changes the SDF, so accessors never parse SDF elements. Frames are
+    /// produced with the snapshot of the active sector, which narrows the
+    /// horizontal fan to whole ray columns of it.
+    class NpsBeamGeometry
+    {
+      /// \brief Minimum horizontal angle in radians.
+      public: double angleMin = 0;
+
+      /// \brief Maximum horizontal angle in radians.
+      public: double angleMax = 0;
+
+      /// \brief Radians between each horizontal range.
+      public: double angleResolution = 0;
+
+      /// \brief Minimum vertical angle in radians.
+      public: double verticalAngleMin = 0;
+
+      /// \brief Maximum vertical angle in radians.
+      public: double verticalAngleMax = 0;
+
+      /// \brief Radians between each vertical range.
+      public: double verticalAngleResolution = 0;
+
+      /// \brief Minimum range.
+      public: double rangeMin = 0;
+
+      /// \brief Maximum range.
+      public: double rangeMax = 0;
+
+      /// \brief Range resolution.
+      public: double rangeResolution = 0;
+
+      /// \brief Horizontal ray count.
+      public: int rayCount = 0;
+
+      /// \brief Horizontal range count.
+      public: int rangeCount = 0;
+
+      /// \brief Vertical ray count.
+      public: int verticalRayCount = 1;
+
+      /// \brief Vertical range count.
+      public: int verticalRangeCount = 1;
+
+      /// \brief Horizontal ray count of the whole fan.
+      public: int fullRayCount = 0;
+
+      /// \brief Horizontal range count of the whole fan.
+      public: int fullRangeCount = 0;
+
+      /// \brief First ray column of the active sector in the whole fan.
+      public: int sectorRayOffset = 0;
+
+      /// \brief First range column of the active sector in the whole fan.
+      public: int sectorRangeOffset = 0;
+
+      /// \brief Changes every time the geometry or the active sector
+      /// changes.
+      public: unsigned int version = 0;
+    };
+
+    /// \def NpsBeamGeometryPtr
+    /// \brief Shared pointer to an immutable geometry snapshot.
+    typedef std::shared_ptr<const NpsBeamGeometry> NpsBeamGeometryPtr;
+  }
+}
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+
+#include "NpsBeamGpuLayout.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+NpsBeamGpuLayout NpsBeamGpuLayout::Compute(const int _rayCount,
+    const int _verticalRayCount, const double _angleMin,
+    const double _angleMax, const double _verticalAngleMin,
+    const double _verticalAngleMax)
+{
+  NpsBeamGpuLayout layout;
+  layout.horizontal = _verticalRayCount == 1;
+  layout.horzHalfAngle = (_angleMax + _angleMin) / 2.0;
+  layout.vertHalfAngle = (_verticalAngleMax + _verticalAngleMin) / 2.0;
+  layout.horzFOV = std::min(_angleMax - _angleMin, 2 * M_PI);
+  layout.vertFOV = _verticalAngleMax - _verticalAngleMin;
+  layout.verticalAngleMin = _verticalAngleMin;
+  layout.verticalAngleMax = _verticalAngleMax;
+
+  if (layout.horzFOV > 2.8)
+    layout.cameraCount = layout.horzFOV > 5.6 ? 3 : 2;
+
+  layout.horzFOV /= layout.cameraCount;
+  int horzRayCount = _rayCount / static_cast<int>(layout.cameraCount);
+  int vertRayCount = _verticalRayCount;
+
+  if (layout.vertFOV > M_PI / 2)
+  {
+    layout.vertFOV = M_PI / 2;
+    layout.verticalCapped = true;
+    layout.verticalAngleMin = layout.vertHalfAngle - layout.vertFOV / 2;
+    layout.verticalAngleMax = layout.vertHalfAngle + layout.vertFOV / 2;
+  }
+
+  if (horzRayCount * vertRayCount < _rayCount * _verticalRayCount)
+  {
+    horzRayCount = std::max(horzRayCount, _rayCount);
+    vertRayCount = std::max(vertRayCount, _verticalRayCount);
+  }
+
+  layout.cosHorzFOV = layout.horzFOV;
+  layout.cosVertFOV = layout.vertFOV;
+
+  // Stretch the texture across the fan, keeping square pixels
+  if (layout.horizontal ? vertRayCount > 1 : horzRayCount > 1)
+  {
+    if (layout.horizontal)
+    {
+      layout.cosHorzFOV = 2 * atan(tan(layout.horzFOV / 2) /
+          cos(layout.vertFOV / 2));
+      layout.rayCountRatio =
+        tan(layout.cosHorzFOV / 2.0) / tan(layout.vertFOV / 2.0);
+    }
+    else
+    {
+      layout.cosVertFOV = 2 * atan(tan(layout.vertFOV / 2) /
+          cos(layout.horzFOV / 2));
+      layout.rayCountRatio =
+        tan(layout.horzFOV / 2.0) / tan(layout.cosVertFOV / 2.0);
+    }
+
+    if ((horzRayCount / layout.rayCountRatio) > vertRayCount)
+      vertRayCount = horzRayCount / layout.rayCountRatio;
+    else
+      horzRayCount = vertRayCount * layout.rayCountRatio;
+  }
+
+  layout.textureWidth = horzRayCount;
+  layout.textureHeight = vertRayCount;
+  return layout;
+}
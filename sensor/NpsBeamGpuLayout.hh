@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_GPU_LAYOUT_HH
+#define NPS_BEAM_GPU_LAYOUT_HH
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Camera layout of a GPU laser, derived from the scan
+    /// geometry alone.
+    ///
+    /// Splits the horizontal field of view over up to three cameras, caps
+    /// the vertical field of view at 90 degrees and stretches the render
+    /// texture so its rays cover the whole fan. Compute needs neither
+    /// rendering nor the sensor, so it can run on any thread;
+    /// NpsBeamGpuSource only applies the result to the laser camera.
+    class NpsBeamGpuLayout
+    {
+      /// \brief Derive the layout of a scan geometry.
+      /// \param[in] _rayCount Horizontal ray count.
+      /// \param[in] _verticalRayCount Vertical ray count.
+      /// \param[in] _angleMin Minimum horizontal angle in radians.
+      /// \param[in] _angleMax Maximum horizontal angle in radians.
+      /// \param[in] _verticalAngleMin Minimum vertical angle in radians.
+      /// \param[in] _verticalAngleMax Maximum vertical angle in radians.
+      /// \return Layout of the laser camera.
+      public: static NpsBeamGpuLayout Compute(const int _rayCount,
+                  const int _verticalRayCount, const double _angleMin,
+                  const double _angleMax, const double _verticalAngleMin,
+                  const double _verticalAngleMax);
+
+      /// \brief True if the scan is a single horizontal row.
+      public: bool horizontal = true;
+
+      /// \brief Number of cameras the horizontal fan is split over.
+      public: unsigned int cameraCount = 1;
+
+      /// \brief Horizontal field of view of one camera.
+      public: double horzFOV = 0;
+
+      /// \brief Vertical field of view, at most 90 degrees.
+      public: double vertFOV = 0;
+
+      /// \brief Angle of the middle of the horizontal fan.
+      public: double horzHalfAngle = 0;
+
+      /// \brief Angle of the middle of the vertical fan.
+      public: double vertHalfAngle = 0;
+
+      /// \brief Horizontal field of view of the stretched render texture.
+      public: double cosHorzFOV = 0;
+
+      /// \brief Vertical field of view of the stretched render texture.
+      public: double cosVertFOV = 0;
+
+      /// \brief Horizontal to vertical ray ratio of the texture, 0 if the
+      /// texture is not stretched.
+      public: double rayCountRatio = 0;
+
+      /// \brief Render texture width in pixels.
+      public: int textureWidth = 0;
+
+      /// \brief Render texture height in pixels.
+      public: int textureHeight = 0;
+
+      /// \brief True if the vertical field of view was capped.
+      public: bool verticalCapped = false;
+
+      /// \brief Minimum vertical angle after capping.
+      public: double verticalAngleMin = 0;
+
+      /// \brief Maximum vertical angle after capping.
+      public: double verticalAngleMax = 0;
+    };
+  }
+}
+#endif
@@ -0,0 +1,455 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include <ignition/math/Matrix3.hh>
+
+#include "gazebo/common/Console.hh"
+#include "gazebo/physics/World.hh"
+#include "gazebo/rendering/GpuLaser.hh"
+#include "gazebo/rendering/RenderingIface.hh"
+#include "gazebo/rendering/Scene.hh"
+#include "gazebo/rendering/Visual.hh"
+
+#include "NpsBeamGpuLayout.hh"
+#include "NpsBeamGpuSource.hh"
+#include "NpsBeamSensor.hh"
+#include "NpsBeamSensorPrivate.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Get a copy of the camera SDF description.
+  ///
+  /// camera.sdf is read and parsed from disk once per process; every
+  /// laser camera gets its own clone of the parsed template.
+  /// \return Camera element with default values.
+  sdf::ElementPtr CameraTemplate()
+  {
+    static const sdf::ElementPtr cameraTemplate = []()
+      {
+        sdf::ElementPtr elem(new sdf::Element);
+        sdf::initFile("camera.sdf", elem);
+        return elem;
+      }();
+    return cameraTemplate->Clone();
+  }
+
+  /// \brief Get the world box of a visual.
+  /// \param[in] _box Box in the visual's frame.
+  /// \param[in] _pose World pose of the visual.
+  /// \param[out] _min Minimum corner in world coordinates.
+  /// \param[out] _max Maximum corner in world coordinates.
+  void WorldBox(const ignition::math::Box &_box,
+      const ignition::math::Pose3d &_pose, double _min[3], double _max[3])
+  {
+    // Visuals without geometry are never culled
+    if (_box.Min().X() > _box.Max().X())
+    {
+      std::fill(_min, _min + 3, -1e12);
+      std::fill(_max, _max + 3, 1e12);
+      return;
+    }
+
+    std::fill(_min, _min + 3, HUGE_VAL);
+    std::fill(_max, _max + 3, -HUGE_VAL);
+    for (int i = 0; i < 8; ++i)
+    {
+      const ignition::math::Vector3d corner(
+          (i & 1) ? _box.Max().X() : _box.Min().X(),
+          (i & 2) ? _box.Max().Y() : _box.Min().Y(),
+          (i & 4) ? _box.Max().Z() : _box.Min().Z());
+      const ignition::math::Vector3d world =
+        _pose.Rot().RotateVector(corner) + _pose.Pos();
+      for (int k = 0; k < 3; ++k)
+      {
+        _min[k] = std::min(_min[k], world[k]);
+        _max[k] = std::max(_max[k], world[k]);
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamGpuSource::Init(NpsBeamSensor &_sensor,
+    const NpsBeamSourceContext &_context)
+{
+  this->sensor = &_sensor;
+
+  const std::string worldName = _context.world->Name();
+  if (worldName.empty())
+  {
+    gzerr << "No world name\n";
+    return false;
+  }
+
+  this->scene = rendering::get_scene(worldName);
+
+  if (!this->scene)
+    this->scene = rendering::create_scene(worldName, false, true);
+
+  this->laserCam = this->scene->CreateGpuLaser(_sensor.Name(), false);
+
+  if (!this->laserCam)
+  {
+    gzerr << "Unable to create gpu laser sensor\n";
+    return false;
+  }
+  this->laserCam->SetCaptureData(true);
+
+  const NpsBeamGpuLayout layout = NpsBeamGpuLayout::Compute(
+      _sensor.RayCount(), _sensor.VerticalRayCount(),
+      _sensor.AngleMin().Radian(), _sensor.AngleMax().Radian(),
+      _sensor.VerticalAngleMin().Radian(),
+      _sensor.VerticalAngleMax().Radian());
+
+  // initialize GpuLaser from the layout
+  this->laserCam->SetIsHorizontal(layout.horizontal);
+  this->laserCam->SetNearClip(_sensor.RangeMin());
+  this->laserCam->SetFarClip(_sensor.RangeMax());
+  this->laserCam->SetHorzHalfAngle(layout.horzHalfAngle);
+  this->laserCam->SetVertHalfAngle(layout.vertHalfAngle);
+  this->laserCam->SetCameraCount(layout.cameraCount);
+  this->laserCam->SetHorzFOV(layout.horzFOV);
+  this->laserCam->SetVertFOV(layout.vertFOV);
+  this->laserCam->SetCosHorzFOV(layout.cosHorzFOV);
+  this->laserCam->SetCosVertFOV(layout.cosVertFOV);
+  if (layout.rayCountRatio > 0)
+    this->laserCam->SetRayCountRatio(layout.rayCountRatio);
+
+  if (layout.verticalCapped)
+  {
+    gzwarn << "Vertical FOV for block GPU laser is capped at 90 degrees.\n";
+    _sensor.SetVerticalAngleMin(layout.verticalAngleMin);
+    _sensor.SetVerticalAngleMax(layout.verticalAngleMax);
+  }
+
+  // Initialize camera sdf for GpuLaser
+  this->cameraElem = CameraTemplate();
+
+  this->cameraElem->GetElement("horizontal_fov")->Set(layout.cosHorzFOV);
+
+  sdf::ElementPtr ptr = this->cameraElem->GetElement("image");
+  ptr->GetElement("width")->Set(layout.textureWidth);
+  ptr->GetElement("height")->Set(layout.textureHeight);
+  ptr->GetElement("format")->Set("R8G8B8");
+
+  ptr = this->cameraElem->GetElement("clip");
+  ptr->GetElement("near")->Set(this->laserCam->NearClip());
+  ptr->GetElement("far")->Set(this->laserCam->FarClip());
+
+  // Load camera sdf for GpuLaser
+  this->laserCam->Load(this->cameraElem);
+
+  // initialize GpuLaser
+  this->laserCam->Init();
+
+  // GpuLaser delivers one cell per ray, evenly spaced in angle; the
+  // sensor resamples them onto the range cells itself
+  this->laserCam->SetRangeCount(_sensor.RayCount(),
+      _sensor.VerticalRayCount());
+  this->laserCam->SetClipDist(_sensor.RangeMin(), _sensor.RangeMax());
+  this->laserCam->CreateLaserTexture(_sensor.ScopedName() + "_RttTex_Laser");
+  this->laserCam->CreateRenderTexture(_sensor.ScopedName() + "_RttTex_Image");
+  this->laserCam->SetWorldPose(_sensor.Pose());
+  this->laserCam->AttachToVisual(_sensor.ParentId(), true, 0, 0);
+
+  sdf::ElementPtr cullElem = NpsBeamElement(_context.config, "cull");
+  this->cull = NpsBeamParam<bool>(cullElem, "enabled", true);
+  this->cullIndex.Reset(NpsBeamParam<double>(cullElem, "cell_size", 10.0));
+
+  // Disable clouds and moon on server side until fixed and also to improve
+  // performance
+  this->scene->SetSkyXMode(rendering::Scene::GZ_SKYX_ALL &
+      ~rendering::Scene::GZ_SKYX_CLOUDS &
+      ~rendering::Scene::GZ_SKYX_MOON);
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamGpuSource::Fini()
+{
+  if (this->scene && this->laserCam)
+    this->scene->RemoveCamera(this->laserCam->Name());
+  this->scene.reset();
+  this->laserCam.reset();
+  this->cullVisuals.clear();
+  this->cullBoxes.clear();
+  this->cullPoses.clear();
+  this->cullIds.clear();
+  this->cullSeen.clear();
+  this->cullIndex.Reset(this->cullIndex.CellSize());
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamGpuSource::RendersOnRenderEvent() const
+{
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamGpuSource::SupportsSector() const
+{
+  return true;
+}
+
+//////////////////////////////////////////////////
+common::Time NpsBeamGpuSource::Render(const NpsBeamGeometry &_geom,
+    const ignition::math::Pose3d &/*_pose*/)
+{
+  // The laser camera always renders the whole fan; Read picks the sector
+  // columns out of it, and culling already hides what lies outside
+  this->fullWidth = std::max(1, _geom.fullRayCount);
+  this->sectorOffset = _geom.sectorRayOffset;
+  this->sectorWidth = _geom.rayCount;
+
+  if (this->cull)
+    this->HideCulled(_geom);
+
+  // The laser camera announces the frame on PostRender, in this tick
+  this->frameTime = this->scene->SimTime();
+
+  // The camera follows the parent visual, so the pose is already set
+  this->laserCam->Render();
+
+  this->ShowCulled();
+  return this->frameTime;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamGpuSource::PostRender()
+{
+  this->laserCam->PostRender();
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamGpuSource::Read(float *_ranges, float *_intensities,
+    const size_t _count)
+{
+  size_t count = 0;
+  auto dataIter = this->laserCam->LaserDataBegin();
+  auto dataEnd = this->laserCam->LaserDataEnd();
+  if (this->sectorWidth >= this->fullWidth)
+  {
+    for (; dataIter != dataEnd && count < _count; ++dataIter, ++count)
+    {
+      const rendering::GpuLaserData data = *dataIter;
+      _ranges[count] = data.range;
+      _intensities[count] = data.intensity;
+    }
+    return count;
+  }
+
+  // Rows are fullWidth rays wide; keep the sector columns of each
+  int column = 0;
+  for (; dataIter != dataEnd && count < _count; ++dataIter)
+  {
+    if (column >= this->sectorOffset &&
+        column < this->sectorOffset + this->sectorWidth)
+    {
+      const rendering::GpuLaserData data = *dataIter;
+      _ranges[count] = data.range;
+      _intensities[count] = data.intensity;
+      ++count;
+    }
+    if (++column == this->fullWidth)
+      column = 0;
+  }
+  return count;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamGpuSource::CameraCount() const
+{
+  return this->laserCam->CameraCount();
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamGpuSource::IsHorizontal() const
+{
+  return this->laserCam->IsHorizontal();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamGpuSource::HorzFOV() const
+{
+  return this->laserCam->HorzFOV();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamGpuSource::CosHorzFOV() const
+{
+  return this->laserCam->CosHorzFOV();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamGpuSource::VertFOV() const
+{
+  return this->laserCam->VertFOV();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamGpuSource::CosVertFOV() const
+{
+  return this->laserCam->CosVertFOV();
+}
+
+//////////////////////////////////////////////////
+double NpsBeamGpuSource::RayCountRatio() const
+{
+  return this->laserCam->RayCountRatio();
+}
+
+//////////////////////////////////////////////////
+event::ConnectionPtr NpsBeamGpuSource::ConnectNewLaserFrame(
+    LaserFrameFunction _subscriber)
+{
+  return this->laserCam->ConnectNewLaserFrame(_subscriber);
+}
+
+//////////////////////////////////////////////////
+rendering::GpuLaserPtr NpsBeamGpuSource::LaserCamera() const
+{
+  return this->laserCam;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamGpuSource::CulledCount() const
+{
+  return this->cull ? static_cast<unsigned int>(this->culled.size()) : 0;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamGpuSource::UpdateCullIndex()
+{
+  rendering::VisualPtr worldVisual = this->scene->WorldVisual();
+  const unsigned int children = worldVisual->GetChildCount();
+  const unsigned int pass = ++this->cullPass;
+  double min[3];
+  double max[3];
+
+  for (unsigned int i = 0; i < children; ++i)
+  {
+    rendering::VisualPtr visual = worldVisual->GetChild(i);
+    const auto found = this->cullIds.find(visual->GetId());
+    if (found == this->cullIds.end())
+    {
+      // A model that appeared since the last pass
+      const ignition::math::Box box = visual->BoundingBox();
+      const ignition::math::Pose3d pose = visual->WorldPose();
+      WorldBox(box, pose, min, max);
+      const unsigned int id = this->cullIndex.Insert(min, max);
+      if (id >= this->cullVisuals.size())
+      {
+        this->cullVisuals.resize(id + 1);
+        this->cullBoxes.resize(id + 1);
+        this->cullPoses.resize(id + 1);
+        this->cullSeen.resize(id + 1);
+      }
+      this->cullVisuals[id] = visual;
+      this->cullBoxes[id] = box;
+      this->cullPoses[id] = pose;
+      this->cullSeen[id] = pass;
+      this->cullIds[visual->GetId()] = id;
+      continue;
+    }
+
+    const unsigned int id = found->second;
+    this->cullSeen[id] = pass;
+
+    const ignition::math::Pose3d pose = visual->WorldPose();
+    if (pose == this->cullPoses[id])
+      continue;
+
+    this->cullPoses[id] = pose;
+    WorldBox(this->cullBoxes[id], pose, min, max);
+    this->cullIndex.Update(id, min, max);
+  }
+
+  // Every child was found once, so more tracked visuals than children
+  // means models left the scene, even when as many others were added
+  if (this->cullIds.size() <= children)
+    return;
+
+  for (auto it = this->cullIds.begin(); it != this->cullIds.end();)
+  {
+    const unsigned int id = it->second;
+    if (this->cullSeen[id] == pass)
+    {
+      ++it;
+      continue;
+    }
+
+    this->cullIndex.Remove(id);
+    this->cullVisuals[id].reset();
+    it = this->cullIds.erase(it);
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamGpuSource::HideCulled(const NpsBeamGeometry &_geom)
+{
+  this->UpdateCullIndex();
+
+  // The sub-cameras together cover the whole fan of the scan
+  const ignition::math::Pose3d pose = this->laserCam->WorldPose();
+  const ignition::math::Matrix3d rotation(pose.Rot());
+  NpsBeamCullVolume volume;
+  for (int i = 0; i < 3; ++i)
+  {
+    volume.origin[i] = pose.Pos()[i];
+    for (int j = 0; j < 3; ++j)
+      volume.rotation[i * 3 + j] = rotation(i, j);
+  }
+  volume.range = _geom.rangeMax;
+  volume.angleMin = _geom.angleMin;
+  volume.angleMax = _geom.angleMax;
+  volume.verticalAngleMin = _geom.verticalAngleMin;
+  volume.verticalAngleMax = _geom.verticalAngleMax;
+  this->cullIndex.Cull(volume, this->culled);
+
+  for (const unsigned int id : this->culled)
+    this->HideVisual(this->cullVisuals[id]);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamGpuSource::HideVisual(const rendering::VisualPtr &_visual)
+{
+  // A cascading SetVisible(true) would also show children that were
+  // hidden on purpose, such as collision visuals, so every visible node
+  // of the tree is hidden and later shown on its own
+  if (!_visual->GetVisible())
+    return;
+
+  _visual->SetVisible(false, false);
+  this->hidden.push_back(_visual);
+  for (unsigned int i = 0; i < _visual->GetChildCount(); ++i)
+    this->HideVisual(_visual->GetChild(i));
+}
+
+//////////////////////////////////////////////////
+void NpsBeamGpuSource::ShowCulled()
+{
+  for (const rendering::VisualPtr &visual : this->hidden)
+    visual->SetVisible(true, false);
+  this->hidden.clear();
+}
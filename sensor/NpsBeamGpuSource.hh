@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_GPU_SOURCE_HH
+#define NPS_BEAM_GPU_SOURCE_HH
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <ignition/math/Box.hh>
+
+#include "NpsBeamCullIndex.hh"
+#include "NpsBeamFrameSource.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Frame source rendering the scan with rendering::GpuLaser.
+    ///
+    /// The laser camera only clips at the maximum range, so every model
+    /// in the scene would still go through its passes. Unless disabled
+    /// with <cull><enabled>false</enabled></cull>, the source keeps the
+    /// bounding boxes of the scene's model visuals in an NpsBeamCullIndex,
+    /// hides the visuals no ray of the fan can reach for the duration of
+    /// each render and shows them again right after, so other cameras
+    /// sharing the scene are unaffected.
+    class NpsBeamGpuSource : public NpsBeamFrameSource
+    {
+      // Documentation inherited
+      public: virtual bool Init(NpsBeamSensor &_sensor,
+                  const NpsBeamSourceContext &_context);
+
+      // Documentation inherited
+      public: virtual void Fini();
+
+      // Documentation inherited
+      public: virtual bool RendersOnRenderEvent() const;
+
+      // Documentation inherited
+      public: virtual bool SupportsSector() const;
+
+      // Documentation inherited
+      public: virtual common::Time Render(const NpsBeamGeometry &_geom,
+                  const ignition::math::Pose3d &_pose);
+
+      // Documentation inherited
+      public: virtual void PostRender();
+
+      // Documentation inherited
+      public: virtual size_t Read(float *_ranges, float *_intensities,
+                  const size_t _count);
+
+      // Documentation inherited
+      public: virtual unsigned int CameraCount() const;
+
+      // Documentation inherited
+      public: virtual bool IsHorizontal() const;
+
+      // Documentation inherited
+      public: virtual double HorzFOV() const;
+
+      // Documentation inherited
+      public: virtual double CosHorzFOV() const;
+
+      // Documentation inherited
+      public: virtual double VertFOV() const;
+
+      // Documentation inherited
+      public: virtual double CosVertFOV() const;
+
+      // Documentation inherited
+      public: virtual double RayCountRatio() const;
+
+      // Documentation inherited
+      public: virtual event::ConnectionPtr ConnectNewLaserFrame(
+                  LaserFrameFunction _subscriber);
+
+      // Documentation inherited
+      public: virtual rendering::GpuLaserPtr LaserCamera() const;
+
+      // Documentation inherited
+      public: virtual unsigned int CulledCount() const;
+
+      /// \brief Track the scene's model visuals in the cull index by
+      /// visual id: index the visuals that appeared, drop the ones that
+      /// left the scene and refresh the boxes of the ones that moved.
+      private: void UpdateCullIndex();
+
+      /// \brief Hide the visuals outside the sensor's fan.
+      /// \param[in] _geom Scan geometry.
+      private: void HideCulled(const NpsBeamGeometry &_geom);
+
+      /// \brief Hide a visual and its visible descendants one node at a
+      /// time, remembering each in hidden.
+      /// \param[in] _visual Root of the tree to hide.
+      private: void HideVisual(const rendering::VisualPtr &_visual);
+
+      /// \brief Show the visuals hidden by HideCulled again, without
+      /// touching the ones that were already hidden.
+      private: void ShowCulled();
+
+      /// \brief Scene the laser camera renders.
+      private: rendering::ScenePtr scene;
+
+      /// \brief Laser camera.
+      private: rendering::GpuLaserPtr laserCam;
+
+      /// \brief Camera SDF element of the laser camera.
+      private: sdf::ElementPtr cameraElem;
+
+      /// \brief True to hide the visuals outside the fan while rendering.
+      private: bool cull = true;
+
+      /// \brief Index of the model visual boxes in world coordinates.
+      private: NpsBeamCullIndex cullIndex;
+
+      /// \brief Tracked model visuals by cull index id, null for ids
+      /// of removed visuals.
+      private: std::vector<rendering::VisualPtr> cullVisuals;
+
+      /// \brief Cull index id of each tracked visual by visual id.
+      private: std::unordered_map<uint32_t, unsigned int> cullIds;
+
+      /// \brief UpdateCullIndex pass that last found each tracked visual
+      /// in the scene, by cull index id.
+      private: std::vector<unsigned int> cullSeen;
+
+      /// \brief Number of the current UpdateCullIndex pass.
+      private: unsigned int cullPass = 0;
+
+      /// \brief Bounding box of each tracked visual in its own frame.
+      private: std::vector<ignition::math::Box> cullBoxes;
+
+      /// \brief World pose of each tracked visual when its box was
+      /// indexed.
+      private: std::vector<ignition::math::Pose3d> cullPoses;
+
+      /// \brief Ids of the visuals outside the fan.
+      private: std::vector<unsigned int> culled;
+
+      /// \brief Visuals hidden for the current render, each hidden
+      /// without cascading to its children.
+      private: std::vector<rendering::VisualPtr> hidden;
+
+      /// \brief Horizontal ray count of the rendered fan.
+      private: int fullWidth = 0;
+
+      /// \brief First column of the sector read out of the rendered fan.
+      private: int sectorOffset = 0;
+
+      /// \brief Number of columns read out of the rendered fan.
+      private: int sectorWidth = 0;
+    };
+  }
+}
+#endif
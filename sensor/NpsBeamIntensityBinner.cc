@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "NpsBeamWorkerPool.hh"
+#include "NpsBeamIntensityBinner.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+void NpsBeamIntensityBinner::Configure(const unsigned int _width,
+    const unsigned int _height, const unsigned int _beams,
+    const unsigned int _bins, const float _rangeMin, const float _rangeMax,
+    const std::vector<float> &_rowWeights)
+{
+  this->width = _width;
+  this->height = _height;
+  this->beams = std::max(1u, std::min(_beams, _width));
+  this->bins = std::max(1u, _bins);
+  this->rangeMin = _rangeMin;
+  this->binScale = this->bins / std::max(_rangeMax - _rangeMin, 1e-6f);
+
+  this->beamColumns.resize(this->beams + 1);
+  for (unsigned int b = 0; b <= this->beams; ++b)
+  {
+    this->beamColumns[b] = static_cast<unsigned int>(
+        (static_cast<uint64_t>(b) * this->width) / this->beams);
+  }
+
+  // Normalize so a beam full of unit returns in one bin sums to 1
+  this->rowWeights.assign(this->height, 1.0f);
+  if (_rowWeights.size() == this->height)
+    this->rowWeights = _rowWeights;
+
+  float sum = 0;
+  for (float w : this->rowWeights)
+    sum += w;
+  for (float &w : this->rowWeights)
+    w = sum > 0 ? w / sum : 0;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamIntensityBinner::Accumulate(const float *_ranges,
+    const float *_intensities, float *_out, NpsBeamWorkerPool *_pool) const
+{
+  if (!_pool)
+  {
+    this->AccumulateBeams(_ranges, _intensities, _out, 0, this->beams);
+    return;
+  }
+
+  // Aim for chunks of at least 64k cells to amortize scheduling
+  const size_t cellsPerBeam =
+    static_cast<size_t>(this->height) * this->width / this->beams;
+  const size_t grain = std::max<size_t>(1, 65536 / (cellsPerBeam + 1));
+
+  _pool->ParallelFor(this->beams, grain,
+      [&](size_t _begin, size_t _end)
+      {
+        this->AccumulateBeams(_ranges, _intensities, _out, _begin, _end);
+      });
+}
+
+//////////////////////////////////////////////////
+void NpsBeamIntensityBinner::AccumulateBeams(const float *_ranges,
+    const float *_intensities, float *_out, const size_t _begin,
+    const size_t _end) const
+{
+  const int lastBin = static_cast<int>(this->bins) - 1;
+
+  for (size_t b = _begin; b < _end; ++b)
+  {
+    float *profile = _out + b * this->bins;
+    std::fill(profile, profile + this->bins, 0.0f);
+
+    const unsigned int colBegin = this->beamColumns[b];
+    const unsigned int colEnd = this->beamColumns[b + 1];
+    const float columnWeight = 1.0f / std::max(1u, colEnd - colBegin);
+
+    for (unsigned int row = 0; row < this->height; ++row)
+    {
+      const float weight = this->rowWeights[row] * columnWeight;
+      if (weight <= 0)
+        continue;
+
+      const size_t rowOffset = static_cast<size_t>(row) * this->width;
+      for (unsigned int col = colBegin; col < colEnd; ++col)
+      {
+        const float range = _ranges[rowOffset + col];
+        if (!std::isfinite(range))
+          continue;
+
+        // Rays outside the range limits are dropped; one at the far
+        // limit falls into the last bin
+        const float position = (range - this->rangeMin) * this->binScale;
+        if (position < 0 || position > this->bins)
+          continue;
+        const int bin = std::min(lastBin, static_cast<int>(position));
+
+        profile[bin] += weight *
+          (_intensities ? _intensities[rowOffset + col] : 1.0f);
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamIntensityBinner::Beams() const
+{
+  return this->beams;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamIntensityBinner::Bins() const
+{
+  return this->bins;
+}
+
+//////////////////////////////////////////////////
+std::vector<float> NpsBeamIntensityBinner::GaussianPattern(
+    const unsigned int _rows, const double _angleMin, const double _angleStep,
+    const double _beamwidth)
+{
+  std::vector<float> weights(_rows, 1.0f);
+  if (_rows < 2 || _beamwidth <= 0)
+    return weights;
+
+  // FWHM = 2 * sqrt(2 ln 2) * sigma
+  const double sigma = _beamwidth / 2.3548200450309493;
+  for (unsigned int i = 0; i < _rows; ++i)
+  {
+    const double angle = (_angleMin + i * _angleStep) / sigma;
+    weights[i] = static_cast<float>(std::exp(-0.5 * angle * angle));
+  }
+  return weights;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_INTENSITY_BINNER_HH
+#define NPS_BEAM_INTENSITY_BINNER_HH
+
+#include <cstddef>
+#include <vector>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamWorkerPool;
+
+    /// \brief Turns per-ray ranges and intensities into per-beam
+    /// intensity-vs-range profiles.
+    ///
+    /// The ray frame is width columns by height rows. Each output beam
+    /// covers a contiguous group of columns and every row of them, with
+    /// rows weighted by the vertical beam pattern. The output is beam
+    /// major: beams rows of bins values, so each worker fills whole rows
+    /// and never shares a cache line with another beam's accumulators.
+    class NpsBeamIntensityBinner
+    {
+      /// \brief Set the frame and output geometry.
+      /// \param[in] _width Number of ray columns in the frame.
+      /// \param[in] _height Number of ray rows in the frame.
+      /// \param[in] _beams Number of output beams, at most _width.
+      /// \param[in] _bins Number of range bins per beam.
+      /// \param[in] _rangeMin Range of the start of the first bin.
+      /// \param[in] _rangeMax Range of the end of the last bin.
+      /// \param[in] _rowWeights Beam pattern weight of each row, empty
+      /// for uniform weighting.
+      public: void Configure(const unsigned int _width,
+                  const unsigned int _height, const unsigned int _beams,
+                  const unsigned int _bins, const float _rangeMin,
+                  const float _rangeMax,
+                  const std::vector<float> &_rowWeights);
+
+      /// \brief Scatter one frame into the beam profiles.
+      /// \param[in] _ranges Width * height processed ranges, non-finite
+      /// values and those outside the range limits are skipped.
+      /// \param[in] _intensities Width * height intensities, or null to
+      /// count every return as 1.
+      /// \param[out] _out Beams * bins accumulated intensities.
+      /// \param[in] _pool Pool to spread beams over, or null to run on the
+      /// calling thread.
+      public: void Accumulate(const float *_ranges, const float *_intensities,
+                  float *_out, NpsBeamWorkerPool *_pool) const;
+
+      /// \brief Number of output beams.
+      /// \return Beam count.
+      public: unsigned int Beams() const;
+
+      /// \brief Number of range bins per beam.
+      /// \return Bin count.
+      public: unsigned int Bins() const;
+
+      /// \brief Compute Gaussian beam pattern weights for evenly spaced
+      /// rows.
+      /// \param[in] _rows Number of rows.
+      /// \param[in] _angleMin Angle of the first row relative to the beam
+      /// axis.
+      /// \param[in] _angleStep Angle between rows.
+      /// \param[in] _beamwidth Full width at half maximum of the pattern.
+      /// \return Weight per row.
+      public: static std::vector<float> GaussianPattern(
+                  const unsigned int _rows, const double _angleMin,
+                  const double _angleStep, const double _beamwidth);
+
+      /// \brief Accumulate a range of beams.
+      private: void AccumulateBeams(const float *_ranges,
+                   const float *_intensities, float *_out,
+                   const size_t _begin, const size_t _end) const;
+
+      /// \brief Frame columns.
+      private: unsigned int width = 0;
+
+      /// \brief Frame rows.
+      private: unsigned int height = 0;
+
+      /// \brief Output beams.
+      private: unsigned int beams = 0;
+
+      /// \brief Bins per beam.
+      private: unsigned int bins = 0;
+
+      /// \brief Range of the start of the first bin.
+      private: float rangeMin = 0;
+
+      /// \brief Bins per unit range.
+      private: float binScale = 0;
+
+      /// \brief First frame column of each beam, beams + 1 entries.
+      private: std::vector<unsigned int> beamColumns;
+
+      /// \brief Normalized weight of each row.
+      private: std::vector<float> rowWeights;
+    };
+  }
+}
+#endif
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "NpsBeamIntensityBinner.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+/////////////////////////////////////////////////
+TEST(NpsBeamIntensityBinner, BinPlacement)
+{
+  // Two beams of two columns each, ten 1 m bins
+  NpsBeamIntensityBinner binner;
+  binner.Configure(4, 1, 2, 10, 0.0f, 10.0f, std::vector<float>());
+  EXPECT_EQ(2u, binner.Beams());
+  EXPECT_EQ(10u, binner.Bins());
+
+  const std::vector<float> ranges = {0.5f, 3.2f, 9.99f, 10.0f};
+  const std::vector<float> intensities = {1.0f, 2.0f, 3.0f, 4.0f};
+  std::vector<float> out(20, -1.0f);
+  binner.Accumulate(ranges.data(), intensities.data(), out.data(), nullptr);
+
+  // Each column of a beam weighs half, the far limit is in the last bin
+  std::vector<float> expected(20, 0.0f);
+  expected[0] = 0.5f;
+  expected[3] = 1.0f;
+  expected[10 + 9] = 3.5f;
+  for (size_t i = 0; i < out.size(); ++i)
+    EXPECT_FLOAT_EQ(expected[i], out[i]) << "cell " << i;
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamIntensityBinner, OutOfRangeDropped)
+{
+  const float inf = std::numeric_limits<float>::infinity();
+  const std::vector<float> ranges = {0.5f, 5.5f, NAN, inf, -inf, 1.0f};
+
+  NpsBeamIntensityBinner binner;
+  binner.Configure(6, 1, 1, 4, 1.0f, 5.0f, std::vector<float>());
+
+  // Without intensities every kept return counts as 1
+  std::vector<float> out(4, -1.0f);
+  binner.Accumulate(ranges.data(), nullptr, out.data(), nullptr);
+
+  // Only the return at the near limit is kept, weighted by one column
+  EXPECT_FLOAT_EQ(1.0f / 6, out[0]);
+  EXPECT_FLOAT_EQ(0.0f, out[1]);
+  EXPECT_FLOAT_EQ(0.0f, out[2]);
+  EXPECT_FLOAT_EQ(0.0f, out[3]);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamIntensityBinner, VerticalBeamPattern)
+{
+  // Rows at the full width of the pattern are at 1/16 of the peak, and
+  // at half of it at half the width
+  const std::vector<float> weights =
+    NpsBeamIntensityBinner::GaussianPattern(3, -0.1, 0.1, 0.1);
+  ASSERT_EQ(3u, weights.size());
+  EXPECT_NEAR(0.0625, weights[0], 1e-6);
+  EXPECT_NEAR(1.0, weights[1], 1e-6);
+  EXPECT_NEAR(0.0625, weights[2], 1e-6);
+  EXPECT_NEAR(0.5, NpsBeamIntensityBinner::GaussianPattern(
+        2, 0.0, 0.05, 0.1)[1], 1e-6);
+
+  // No beamwidth weighs every row the same
+  EXPECT_EQ(std::vector<float>(3, 1.0f),
+      NpsBeamIntensityBinner::GaussianPattern(3, -0.1, 0.1, 0.0));
+
+  // One column of three rows, each row returning in its own bin
+  NpsBeamIntensityBinner binner;
+  binner.Configure(1, 3, 1, 3, 0.0f, 3.0f, weights);
+  const std::vector<float> ranges = {0.5f, 1.5f, 2.5f};
+  const std::vector<float> intensities = {1.0f, 1.0f, 1.0f};
+  std::vector<float> out(3);
+  binner.Accumulate(ranges.data(), intensities.data(), out.data(), nullptr);
+
+  // Weights are normalized to sum to 1
+  EXPECT_FLOAT_EQ(0.0625f / 1.125f, out[0]);
+  EXPECT_FLOAT_EQ(1.0f / 1.125f, out[1]);
+  EXPECT_FLOAT_EQ(0.0625f / 1.125f, out[2]);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamIntensityBinner, PoolMatchesSerial)
+{
+  // Large enough that the pool splits the beams into several chunks
+  const unsigned int width = 2048;
+  const unsigned int height = 64;
+  std::vector<float> ranges(width * height);
+  std::vector<float> intensities(width * height);
+  for (unsigned int v = 0; v < height; ++v)
+  {
+    for (unsigned int h = 0; h < width; ++h)
+    {
+      const size_t i = v * width + h;
+      ranges[i] = (h + v) % 89 == 0 ? NAN :
+        5.0f + 4.0f * std::sin(h * 0.013f) + 0.3f * std::cos(v * 0.2f);
+      intensities[i] = 0.5f + 0.5f * std::cos(h * 0.07f);
+    }
+  }
+
+  NpsBeamIntensityBinner binner;
+  binner.Configure(width, height, 256, 1000, 0.5f, 20.0f,
+      NpsBeamIntensityBinner::GaussianPattern(height, -0.1, 0.2 / 63, 0.1));
+
+  std::vector<float> serial(256 * 1000);
+  binner.Accumulate(ranges.data(), intensities.data(), serial.data(),
+      nullptr);
+
+  NpsBeamWorkerPool pool(3);
+  std::vector<float> pooled(serial.size(), -1.0f);
+  binner.Accumulate(ranges.data(), intensities.data(), pooled.data(),
+      &pool);
+
+  double sum = 0;
+  for (size_t i = 0; i < serial.size(); ++i)
+  {
+    ASSERT_EQ(serial[i], pooled[i]) << "cell " << i;
+    sum += serial[i];
+  }
+  EXPECT_GT(sum, 0.0);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
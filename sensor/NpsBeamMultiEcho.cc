@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "NpsBeamMultiEcho.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+const unsigned int NpsBeamMultiEcho::MaxEchoes;
+
+namespace
+{
+  /// \brief Output cells per pool chunk.
+  const size_t kBeamGrain = 256;
+
+  /// \brief Clusters tracked per footprint before the closest two merge.
+  const unsigned int kClusterCapacity = 2 * NpsBeamMultiEcho::MaxEchoes;
+
+  /// \brief Encoded echoes magic, "NPSE".
+  const uint8_t kMagic[4] = {'N', 'P', 'S', 'E'};
+
+  /// \brief Encoded echoes format version.
+  const uint8_t kVersion = 1;
+
+  /// \brief Size of the encoded header in bytes.
+  const size_t kHeaderSize = 4 + 1 + 1 + 4 + 4 + 8 + 4 + 4 + 7 * 8 + 8 * 8 +
+    4;
+
+  /// \brief Returns grouped within the range gap of each other.
+  struct Cluster
+  {
+    /// \brief Shortest range.
+    float nearest;
+
+    /// \brief Longest range.
+    float farthest;
+
+    /// \brief Sum of the ranges weighted by intensity.
+    float weighted;
+
+    /// \brief Sum of the intensities.
+    float energy;
+
+    /// \brief Sum of the ranges.
+    float sum;
+
+    /// \brief Number of returns.
+    unsigned int count;
+  };
+
+  /// \brief Fold cluster _b into cluster _a.
+  inline void Merge(Cluster &_a, const Cluster &_b)
+  {
+    _a.nearest = std::min(_a.nearest, _b.nearest);
+    _a.farthest = std::max(_a.farthest, _b.farthest);
+    _a.weighted += _b.weighted;
+    _a.energy += _b.energy;
+    _a.sum += _b.sum;
+    _a.count += _b.count;
+  }
+
+  /// \brief Check whether cluster _a is stronger than cluster _b.
+  inline bool Stronger(const Cluster &_a, const Cluster &_b)
+  {
+    return _a.energy > _b.energy ||
+      (_a.energy == _b.energy && _a.count > _b.count);
+  }
+
+  /// \brief Add one return to the range ordered clusters of a footprint.
+  /// \param[in,out] _clusters Clusters, room for kClusterCapacity + 1.
+  /// \param[in,out] _count Number of clusters.
+  /// \param[in] _range Range of the return.
+  /// \param[in] _intensity Intensity of the return, at least 0.
+  /// \param[in] _gap Largest range gap within one cluster.
+  inline void AddReturn(Cluster *_clusters, unsigned int &_count,
+      const float _range, const float _intensity, const float _gap)
+  {
+    unsigned int p = 0;
+    while (p < _count && _clusters[p].farthest + _gap < _range)
+      ++p;
+
+    if (p < _count && _clusters[p].nearest - _gap <= _range)
+    {
+      Cluster &cluster = _clusters[p];
+      cluster.nearest = std::min(cluster.nearest, _range);
+      cluster.weighted += _range * _intensity;
+      cluster.energy += _intensity;
+      cluster.sum += _range;
+      ++cluster.count;
+
+      // Growing the far end may close the gap to the next cluster
+      if (_range > cluster.farthest)
+      {
+        cluster.farthest = _range;
+        if (p + 1 < _count &&
+            _clusters[p + 1].nearest - cluster.farthest <= _gap)
+        {
+          Merge(cluster, _clusters[p + 1]);
+          std::copy(_clusters + p + 2, _clusters + _count,
+              _clusters + p + 1);
+          --_count;
+        }
+      }
+      return;
+    }
+
+    std::copy_backward(_clusters + p, _clusters + _count,
+        _clusters + _count + 1);
+    Cluster &cluster = _clusters[p];
+    cluster.nearest = _range;
+    cluster.farthest = _range;
+    cluster.weighted = _range * _intensity;
+    cluster.energy = _intensity;
+    cluster.sum = _range;
+    cluster.count = 1;
+    ++_count;
+
+    if (_count <= kClusterCapacity)
+      return;
+
+    // Out of room: merge the two clusters closest to each other
+    unsigned int closest = 0;
+    for (unsigned int i = 1; i + 1 < _count; ++i)
+    {
+      if (_clusters[i + 1].nearest - _clusters[i].farthest <
+          _clusters[closest + 1].nearest - _clusters[closest].farthest)
+      {
+        closest = i;
+      }
+    }
+    Merge(_clusters[closest], _clusters[closest + 1]);
+    std::copy(_clusters + closest + 2, _clusters + _count,
+        _clusters + closest + 1);
+    --_count;
+  }
+
+  /// \brief Compute the source index range of each output index along
+  /// one axis.
+  ///
+  /// A source sample belongs to the output whose angle is nearest; an
+  /// output between two samples takes the nearest sample.
+  /// \param[in] _count Number of source samples.
+  /// \param[in] _min Angle of the first sample.
+  /// \param[in] _max Angle of the last sample.
+  /// \param[in] _angles Output angles, in increasing order.
+  /// \param[out] _begin First sample of each output.
+  /// \param[out] _end One past the last sample of each output.
+  void Footprints(const unsigned int _count, const double _min,
+      const double _max, const std::vector<double> &_angles,
+      std::vector<uint32_t> &_begin, std::vector<uint32_t> &_end)
+  {
+    const size_t outputs = std::max<size_t>(_angles.size(), 1);
+    _begin.assign(outputs, 0);
+    _end.assign(outputs, _count);
+    if (_count < 2 || _max <= _min || _angles.size() < 2)
+      return;
+
+    const double step = (_max - _min) / (_count - 1);
+    auto sample = [&](const double _angle)
+    {
+      // Samples on a boundary go to the upper output
+      const double u = std::ceil((_angle - _min) / step - 1e-9);
+      return static_cast<uint32_t>(std::min(std::max(u, 0.0),
+            static_cast<double>(_count)));
+    };
+
+    for (size_t c = 0; c < outputs; ++c)
+    {
+      if (c > 0)
+        _begin[c] = sample(0.5 * (_angles[c - 1] + _angles[c]));
+      if (c + 1 < outputs)
+        _end[c] = sample(0.5 * (_angles[c] + _angles[c + 1]));
+
+      if (_begin[c] >= _end[c])
+      {
+        const double nearest = std::round((_angles[c] - _min) / step);
+        _begin[c] = static_cast<uint32_t>(std::min(std::max(nearest, 0.0),
+              static_cast<double>(_count - 1)));
+        _end[c] = _begin[c] + 1;
+      }
+    }
+  }
+
+  /// \brief Write an unsigned integer in little endian order.
+  template <typename T>
+  inline uint8_t *PutUint(uint8_t *_out, const T _value)
+  {
+    for (size_t i = 0; i < sizeof(T); ++i)
+      _out[i] = static_cast<uint8_t>(_value >> (8 * i));
+    return _out + sizeof(T);
+  }
+
+  /// \brief Read an unsigned integer in little endian order.
+  template <typename T>
+  inline const uint8_t *GetUint(const uint8_t *_in, T &_value)
+  {
+    _value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+      _value |= static_cast<T>(_in[i]) << (8 * i);
+    return _in + sizeof(T);
+  }
+
+  /// \brief Write a float in little endian order.
+  inline uint8_t *PutFloat(uint8_t *_out, const float _value)
+  {
+    uint32_t bits;
+    std::memcpy(&bits, &_value, sizeof(bits));
+    return PutUint(_out, bits);
+  }
+
+  /// \brief Read a float in little endian order.
+  inline const uint8_t *GetFloat(const uint8_t *_in, float &_value)
+  {
+    uint32_t bits;
+    _in = GetUint(_in, bits);
+    std::memcpy(&_value, &bits, sizeof(bits));
+    return _in;
+  }
+
+  /// \brief Write a double in little endian order.
+  inline uint8_t *PutDouble(uint8_t *_out, const double _value)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &_value, sizeof(bits));
+    return PutUint(_out, bits);
+  }
+
+  /// \brief Read a double in little endian order.
+  inline const uint8_t *GetDouble(const uint8_t *_in, double &_value)
+  {
+    uint64_t bits;
+    _in = GetUint(_in, bits);
+    std::memcpy(&_value, &bits, sizeof(bits));
+    return _in;
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamMultiEcho::Configure(const unsigned int _width,
+    const unsigned int _height, const double _angleMin,
+    const double _angleMax, const double _verticalAngleMin,
+    const double _verticalAngleMax, const std::vector<double> &_angles,
+    const std::vector<double> &_verticalAngles, const unsigned int _echoes,
+    const float _gap)
+{
+  this->sourceWidth = std::max(1u, _width);
+  this->sourceHeight = std::max(1u, _height);
+  this->echoes = std::min(std::max(_echoes, 1u), MaxEchoes);
+  this->gap = std::max(_gap, 0.0f);
+
+  Footprints(this->sourceWidth, _angleMin, _angleMax, _angles,
+      this->columnBegin, this->columnEnd);
+  Footprints(this->sourceHeight, _verticalAngleMin, _verticalAngleMax,
+      _verticalAngles, this->rowBegin, this->rowEnd);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamMultiEcho::Apply(const float *_ranges,
+    const float *_intensities, const float _rangeMin, const float _rangeMax,
+    float *_outRanges, float *_outIntensities, uint8_t *_outCounts,
+    NpsBeamWorkerPool *_pool) const
+{
+  const size_t count = this->OutputCount();
+  if (_pool)
+  {
+    _pool->ParallelFor(count, kBeamGrain,
+        [&](const size_t _begin, const size_t _end)
+        {
+          this->ApplyCells(_ranges, _intensities, _rangeMin, _rangeMax,
+              _outRanges, _outIntensities, _outCounts, _begin, _end);
+        });
+  }
+  else
+  {
+    this->ApplyCells(_ranges, _intensities, _rangeMin, _rangeMax,
+        _outRanges, _outIntensities, _outCounts, 0, count);
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamMultiEcho::ApplyCells(const float *_ranges,
+    const float *_intensities, const float _rangeMin, const float _rangeMax,
+    float *_outRanges, float *_outIntensities, uint8_t *_outCounts,
+    const size_t _begin, const size_t _end) const
+{
+  const size_t width = this->columnBegin.size();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  Cluster clusters[kClusterCapacity + 1];
+  bool keep[kClusterCapacity + 1];
+
+  for (size_t cell = _begin; cell < _end; ++cell)
+  {
+    const size_t row = cell / width;
+    const size_t column = cell % width;
+    const uint32_t h0 = this->columnBegin[column];
+    const uint32_t h1 = this->columnEnd[column];
+    const uint32_t v0 = this->rowBegin[row];
+    const uint32_t v1 = this->rowEnd[row];
+
+    unsigned int count = 0;
+    for (uint32_t v = v0; v < v1; ++v)
+    {
+      const size_t base = static_cast<size_t>(v) * this->sourceWidth;
+      for (uint32_t h = h0; h < h1; ++h)
+      {
+        const float range = _ranges[base + h];
+        if (!(range >= _rangeMin && range <= _rangeMax))
+          continue;
+
+        float intensity = _intensities ? _intensities[base + h] : 1.0f;
+        if (!(intensity > 0))
+          intensity = 0;
+        AddReturn(clusters, count, range, intensity, this->gap);
+      }
+    }
+
+    // Strongest first, then the first and last, then by strength
+    const unsigned int wanted = std::min(this->echoes, count);
+    unsigned int kept = 0;
+    std::fill(keep, keep + count, false);
+    auto pick = [&](const unsigned int _index)
+    {
+      if (kept < wanted && !keep[_index])
+      {
+        keep[_index] = true;
+        ++kept;
+      }
+    };
+    auto strongest = [&]()
+    {
+      unsigned int best = count;
+      for (unsigned int i = 0; i < count; ++i)
+      {
+        if (!keep[i] && (best == count || Stronger(clusters[i],
+                clusters[best])))
+        {
+          best = i;
+        }
+      }
+      return best;
+    };
+
+    if (wanted > 0)
+    {
+      pick(strongest());
+      pick(0);
+      pick(count - 1);
+      while (kept < wanted)
+        pick(strongest());
+    }
+
+    const float footprint = static_cast<float>(h1 - h0) * (v1 - v0);
+    float *outRanges = _outRanges + cell * this->echoes;
+    float *outIntensities = _outIntensities + cell * this->echoes;
+    unsigned int k = 0;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      if (!keep[i])
+        continue;
+
+      const Cluster &cluster = clusters[i];
+      outRanges[k] = cluster.energy > 0 ?
+        cluster.weighted / cluster.energy : cluster.sum / cluster.count;
+      outIntensities[k] = cluster.energy / footprint;
+      ++k;
+    }
+    std::fill(outRanges + k, outRanges + this->echoes, nan);
+    std::fill(outIntensities + k, outIntensities + this->echoes, nan);
+    _outCounts[cell] = static_cast<uint8_t>(k);
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamMultiEcho::Encode(const NpsBeamFrame &_frame, std::string &_out)
+{
+  const size_t cells = _frame.echoCounts.size();
+  size_t total = 0;
+  for (size_t i = 0; i < cells; ++i)
+    total += _frame.echoCounts[i];
+
+  _out.resize(kHeaderSize + cells + total * 8);
+  uint8_t *out = reinterpret_cast<uint8_t *>(&_out[0]);
+
+  out = std::copy(kMagic, kMagic + 4, out);
+  *out++ = kVersion;
+  *out++ = static_cast<uint8_t>(_frame.echoes);
+  out = PutUint(out, static_cast<uint32_t>(_frame.width));
+  out = PutUint(out, static_cast<uint32_t>(_frame.height));
+  out = PutUint(out, static_cast<uint64_t>(_frame.sequence));
+  out = PutUint(out, static_cast<uint32_t>(_frame.sec));
+  out = PutUint(out, static_cast<uint32_t>(_frame.nsec));
+  for (int i = 0; i < 7; ++i)
+    out = PutDouble(out, _frame.pose[i]);
+  out = PutDouble(out, _frame.angleMin);
+  out = PutDouble(out, _frame.angleMax);
+  out = PutDouble(out, _frame.angleStep);
+  out = PutDouble(out, _frame.verticalAngleMin);
+  out = PutDouble(out, _frame.verticalAngleMax);
+  out = PutDouble(out, _frame.verticalAngleStep);
+  out = PutDouble(out, _frame.rangeMin);
+  out = PutDouble(out, _frame.rangeMax);
+  out = PutUint(out, static_cast<uint32_t>(total));
+
+  if (cells > 0)
+    out = std::copy(_frame.echoCounts.begin(), _frame.echoCounts.end(), out);
+
+  for (size_t i = 0; i < cells; ++i)
+  {
+    const size_t base = i * _frame.echoes;
+    for (unsigned int k = 0; k < _frame.echoCounts[i]; ++k)
+    {
+      out = PutFloat(out, _frame.echoRanges[base + k]);
+      out = PutFloat(out, _frame.echoIntensities[base + k]);
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamMultiEcho::Decode(const void *_data, const size_t _size,
+    NpsBeamFrame &_frame)
+{
+  const uint8_t *in = static_cast<const uint8_t *>(_data);
+  if (_size < kHeaderSize || !std::equal(kMagic, kMagic + 4, in) ||
+      in[4] != kVersion || in[5] > MaxEchoes)
+  {
+    return false;
+  }
+
+  const unsigned int echoes = in[5];
+  in += 6;
+  uint32_t width;
+  uint32_t height;
+  uint64_t sequence;
+  uint32_t sec;
+  uint32_t nsec;
+  in = GetUint(in, width);
+  in = GetUint(in, height);
+  in = GetUint(in, sequence);
+  in = GetUint(in, sec);
+  in = GetUint(in, nsec);
+
+  const uint64_t cells = static_cast<uint64_t>(width) * height;
+  if (cells > _size - kHeaderSize || (echoes == 0 && cells > 0))
+    return false;
+
+  for (int i = 0; i < 7; ++i)
+    in = GetDouble(in, _frame.pose[i]);
+  in = GetDouble(in, _frame.angleMin);
+  in = GetDouble(in, _frame.angleMax);
+  in = GetDouble(in, _frame.angleStep);
+  in = GetDouble(in, _frame.verticalAngleMin);
+  in = GetDouble(in, _frame.verticalAngleMax);
+  in = GetDouble(in, _frame.verticalAngleStep);
+  in = GetDouble(in, _frame.rangeMin);
+  in = GetDouble(in, _frame.rangeMax);
+  uint32_t total;
+  in = GetUint(in, total);
+  if (_size != kHeaderSize + cells + static_cast<uint64_t>(total) * 8)
+    return false;
+
+  _frame.width = width;
+  _frame.height = height;
+  _frame.sequence = sequence;
+  _frame.sec = static_cast<int32_t>(sec);
+  _frame.nsec = static_cast<int32_t>(nsec);
+  _frame.ranges.clear();
+  _frame.intensities.clear();
+  _frame.ResizeEchoes(echoes);
+  std::fill(_frame.echoRanges.begin(), _frame.echoRanges.end(),
+      std::numeric_limits<float>::quiet_NaN());
+  std::fill(_frame.echoIntensities.begin(), _frame.echoIntensities.end(),
+      std::numeric_limits<float>::quiet_NaN());
+
+  std::copy(in, in + cells, _frame.echoCounts.begin());
+  const uint8_t *echo = in + cells;
+  uint64_t found = 0;
+  for (uint64_t i = 0; i < cells; ++i)
+  {
+    const unsigned int count = _frame.echoCounts[i];
+    found += count;
+    if (count > echoes || found > total)
+      return false;
+
+    for (unsigned int k = 0; k < count; ++k)
+    {
+      echo = GetFloat(echo, _frame.echoRanges[i * echoes + k]);
+      echo = GetFloat(echo, _frame.echoIntensities[i * echoes + k]);
+    }
+  }
+
+  return found == total;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamMultiEcho::Echoes() const
+{
+  return this->echoes;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamMultiEcho::SourceCount() const
+{
+  return static_cast<size_t>(this->sourceWidth) * this->sourceHeight;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamMultiEcho::OutputCount() const
+{
+  return this->columnBegin.size() * this->rowBegin.size();
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_MULTI_ECHO_HH
+#define NPS_BEAM_MULTI_ECHO_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "NpsBeamFrameStore.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamWorkerPool;
+
+    /// \brief Reduces the rays inside each published beam to up to K
+    /// echoes.
+    ///
+    /// The source is the row major ray grid a frame source produces. Each
+    /// output cell owns the rays whose angles are closer to its beam
+    /// angles than to those of its neighbours, its footprint, and
+    /// Configure computes the footprint bounds once per geometry. Apply
+    /// walks every footprint once, grouping the returns into clusters
+    /// whose ranges lie within the gap of each other, and keeps the
+    /// strongest cluster, then the first, the last and the next strongest
+    /// ones until K are kept. Clusters live in a small fixed array on the
+    /// stack; a footprint with more separate surfaces than it holds
+    /// merges its two closest clusters, so Apply never allocates.
+    ///
+    /// An echo's range is the intensity weighted mean range of its
+    /// cluster, or the plain mean without intensities. Its intensity is
+    /// the cluster's summed intensity over the footprint ray count, so a
+    /// surface filling half the beam returns half the intensity.
+    class NpsBeamMultiEcho
+    {
+      /// \brief Largest number of echoes per beam.
+      public: static const unsigned int MaxEchoes = 8;
+
+      /// \brief Build the footprint tables.
+      /// \param[in] _width Source rays per row.
+      /// \param[in] _height Source rows.
+      /// \param[in] _angleMin Horizontal angle of the first source column.
+      /// \param[in] _angleMax Horizontal angle of the last source column.
+      /// \param[in] _verticalAngleMin Vertical angle of the first source
+      /// row.
+      /// \param[in] _verticalAngleMax Vertical angle of the last source
+      /// row.
+      /// \param[in] _angles Horizontal angle of each output column, in
+      /// increasing order.
+      /// \param[in] _verticalAngles Vertical angle of each output row, in
+      /// increasing order.
+      /// \param[in] _echoes Echoes kept per beam, clamped to
+      /// [1, MaxEchoes].
+      /// \param[in] _gap Largest range gap, in meters, within one echo.
+      public: void Configure(const unsigned int _width,
+                  const unsigned int _height, const double _angleMin,
+                  const double _angleMax, const double _verticalAngleMin,
+                  const double _verticalAngleMax,
+                  const std::vector<double> &_angles,
+                  const std::vector<double> &_verticalAngles,
+                  const unsigned int _echoes, const float _gap);
+
+      /// \brief Find the echoes of one frame.
+      /// \param[in] _ranges SourceCount() raw ranges.
+      /// \param[in] _intensities SourceCount() raw intensities, or null
+      /// to weigh every return as 1.
+      /// \param[in] _rangeMin Shortest valid range.
+      /// \param[in] _rangeMax Longest valid range.
+      /// \param[out] _outRanges Echoes() ranges per output cell, in range
+      /// order, NaN past the cell's echo count.
+      /// \param[out] _outIntensities Echoes() intensities per output
+      /// cell, NaN past the cell's echo count.
+      /// \param[out] _outCounts Echo count of each output cell.
+      /// \param[in] _pool Pool to spread beams over, or null to run on the
+      /// calling thread.
+      public: void Apply(const float *_ranges, const float *_intensities,
+                  const float _rangeMin, const float _rangeMax,
+                  float *_outRanges, float *_outIntensities,
+                  uint8_t *_outCounts, NpsBeamWorkerPool *_pool) const;
+
+      /// \brief Encode the echoes of a frame.
+      ///
+      /// The packet is a little endian header with the frame metadata,
+      /// the echo count of every cell as uint8, and then the range and
+      /// intensity of every echo as float32, in cell order, so cells
+      /// without returns take one byte.
+      /// \param[in] _frame Frame with echoes.
+      /// \param[out] _out Encoded echoes. Its capacity is reused, so a
+      /// string kept across frames settles without reallocating.
+      public: static void Encode(const NpsBeamFrame &_frame,
+                  std::string &_out);
+
+      /// \brief Decode encoded echoes into a frame.
+      ///
+      /// The frame sequence, stamp, pose, angles and echoes are restored;
+      /// its ranges and intensities are left empty.
+      /// \param[in] _data Encoded echoes.
+      /// \param[in] _size Size of _data in bytes.
+      /// \param[out] _frame Decoded frame.
+      /// \return False if _data is not valid encoded echoes.
+      public: static bool Decode(const void *_data, const size_t _size,
+                  NpsBeamFrame &_frame);
+
+      /// \brief Echoes kept per beam.
+      /// \return Echo count.
+      public: unsigned int Echoes() const;
+
+      /// \brief Number of source cells.
+      /// \return Source width times height.
+      public: size_t SourceCount() const;
+
+      /// \brief Number of output cells.
+      /// \return Output width times height.
+      public: size_t OutputCount() const;
+
+      /// \brief Find the echoes of the output cells [_begin, _end).
+      private: void ApplyCells(const float *_ranges,
+                   const float *_intensities, const float _rangeMin,
+                   const float _rangeMax, float *_outRanges,
+                   float *_outIntensities, uint8_t *_outCounts,
+                   const size_t _begin, const size_t _end) const;
+
+      /// \brief First source column of each output column.
+      private: std::vector<uint32_t> columnBegin;
+
+      /// \brief One past the last source column of each output column.
+      private: std::vector<uint32_t> columnEnd;
+
+      /// \brief First source row of each output row.
+      private: std::vector<uint32_t> rowBegin;
+
+      /// \brief One past the last source row of each output row.
+      private: std::vector<uint32_t> rowEnd;
+
+      /// \brief Largest range gap within one echo.
+      private: float gap = 0.5f;
+
+      /// \brief Echoes kept per beam.
+      private: unsigned int echoes = 1;
+
+      /// \brief Source width.
+      private: unsigned int sourceWidth = 0;
+
+      /// \brief Source height.
+      private: unsigned int sourceHeight = 0;
+    };
+  }
+}
+#endif
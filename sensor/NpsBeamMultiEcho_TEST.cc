@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamMultiEcho.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+/////////////////////////////////////////////////
+TEST(NpsBeamMultiEcho, SeparatesSurfaces)
+{
+  // Eight rays under two beams, four rays each
+  NpsBeamMultiEcho multiEcho;
+  multiEcho.Configure(8, 1, -0.1, 0.1, 0, 0, {-0.05, 0.05}, {0}, 2, 0.5f);
+  ASSERT_EQ(8u, multiEcho.SourceCount());
+  ASSERT_EQ(2u, multiEcho.OutputCount());
+
+  // The first beam half hits a wall at 10 m behind an edge at 5 m
+  const std::vector<float> ranges = {5, 5.2f, 10, 10, 7, 7, 7, 7};
+  std::vector<float> outRanges(4);
+  std::vector<float> outIntensities(4);
+  std::vector<uint8_t> outCounts(2);
+  multiEcho.Apply(ranges.data(), nullptr, 0.1f, 50.0f, outRanges.data(),
+      outIntensities.data(), outCounts.data(), nullptr);
+
+  ASSERT_EQ(2u, outCounts[0]);
+  EXPECT_NEAR(5.1f, outRanges[0], 1e-5);
+  EXPECT_NEAR(10.0f, outRanges[1], 1e-5);
+  EXPECT_NEAR(0.5f, outIntensities[0], 1e-5);
+  EXPECT_NEAR(0.5f, outIntensities[1], 1e-5);
+
+  ASSERT_EQ(1u, outCounts[1]);
+  EXPECT_NEAR(7.0f, outRanges[2], 1e-5);
+  EXPECT_NEAR(1.0f, outIntensities[2], 1e-5);
+  EXPECT_TRUE(std::isnan(outRanges[3]));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamMultiEcho, EncodesPublishedSequence)
+{
+  // Echoes are encoded before EndWrite and must carry the sequence
+  // readers get
+  NpsBeamFrameStore store;
+  for (int i = 0; i < 3; ++i)
+  {
+    NpsBeamFrame *frame = store.BeginWrite();
+    frame->Resize(2, 1);
+    frame->ResizeEchoes(2);
+    frame->sec = 3;
+    frame->nsec = 500;
+    frame->echoCounts = {2, 0};
+    frame->echoRanges = {4.0f, 9.0f, NAN, NAN};
+    frame->echoIntensities = {0.25f, 0.75f, NAN, NAN};
+    store.AssignSequence(frame);
+
+    std::string encoded;
+    NpsBeamMultiEcho::Encode(*frame, encoded);
+    store.EndWrite(frame);
+
+    NpsBeamFrame decoded;
+    ASSERT_TRUE(NpsBeamMultiEcho::Decode(encoded.data(), encoded.size(),
+        decoded));
+    EXPECT_EQ(store.Latest()->sequence, decoded.sequence);
+    EXPECT_EQ(static_cast<uint64_t>(i + 1), decoded.sequence);
+    EXPECT_EQ(3, decoded.sec);
+    EXPECT_EQ(500, decoded.nsec);
+    ASSERT_EQ(2u, decoded.echoes);
+    EXPECT_EQ(2u, decoded.echoCounts[0]);
+    EXPECT_EQ(0u, decoded.echoCounts[1]);
+    EXPECT_FLOAT_EQ(9.0f, decoded.echoRanges[1]);
+    EXPECT_FLOAT_EQ(0.75f, decoded.echoIntensities[1]);
+    EXPECT_TRUE(std::isnan(decoded.echoRanges[2]));
+
+    EXPECT_FALSE(NpsBeamMultiEcho::Decode(encoded.data(),
+        encoded.size() - 1, decoded));
+  }
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+
+#include "NpsBeamWorkerPool.hh"
+#include "NpsBeamNoise.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Cells per parallel chunk, a multiple of 4.
+  const size_t kNoiseGrain = 16384;
+
+  /// \brief Uniform float in (0, 1] from 32 random bits.
+  inline float Uniform(const uint32_t _bits)
+  {
+    return (static_cast<float>(_bits >> 8) + 1.0f) * (1.0f / 16777216.0f);
+  }
+
+  /// \brief Box-Muller transform of four random words into four standard
+  /// normal samples.
+  inline void Normals(const uint32_t _bits[4], float _out[4])
+  {
+    for (int i = 0; i < 4; i += 2)
+    {
+      const float radius = std::sqrt(-2.0f * std::log(Uniform(_bits[i])));
+      const float theta = 6.2831853f * Uniform(_bits[i + 1]);
+      _out[i] = radius * std::cos(theta);
+      _out[i + 1] = radius * std::sin(theta);
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void sensors::Philox4x32(const uint32_t _counter[4], const uint32_t _key[2],
+    uint32_t _out[4])
+{
+  const uint64_t m0 = 0xD2511F53;
+  const uint64_t m1 = 0xCD9E8D57;
+
+  uint32_t c0 = _counter[0], c1 = _counter[1];
+  uint32_t c2 = _counter[2], c3 = _counter[3];
+  uint32_t k0 = _key[0], k1 = _key[1];
+
+  for (int round = 0; round < 10; ++round)
+  {
+    const uint64_t p0 = m0 * c0;
+    const uint64_t p1 = m1 * c2;
+    const uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    const uint32_t n1 = static_cast<uint32_t>(p1);
+    const uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    const uint32_t n3 = static_cast<uint32_t>(p0);
+    c0 = n0;
+    c1 = n1;
+    c2 = n2;
+    c3 = n3;
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+
+  _out[0] = c0;
+  _out[1] = c1;
+  _out[2] = c2;
+  _out[3] = c3;
+}
+
+//////////////////////////////////////////////////
+uint32_t sensors::NpsBeamNoiseSalt(const std::string &_name)
+{
+  uint32_t hash = 2166136261u;
+  for (const char c : _name)
+  {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamNoiseEngine::Configure(const double _mean, const double _stddev,
+    const double _biasMean, const double _biasStddev,
+    const double _precision, const uint64_t _seed, const uint32_t _salt)
+{
+  this->key[0] = static_cast<uint32_t>(_seed);
+  this->key[1] = static_cast<uint32_t>(_seed >> 32) ^ _salt;
+
+  // Draw the bias from a stream no frame uses, as Gazebo does once at load
+  const uint32_t counter[4] = {0, 0, 0xFFFFFFFF, 0xFFFFFFFF};
+  uint32_t bits[4];
+  float normals[4];
+  Philox4x32(counter, this->key, bits);
+  Normals(bits, normals);
+
+  this->bias = _biasMean + _biasStddev * normals[0];
+  if (bits[2] & 1)
+    this->bias = -this->bias;
+
+  this->offset = static_cast<float>(_mean + this->bias);
+  this->stddev = static_cast<float>(_stddev);
+  this->precision = static_cast<float>(std::max(0.0, _precision));
+}
+
+//////////////////////////////////////////////////
+void NpsBeamNoiseEngine::Fill(const float *_ranges, float *_noise,
+    const size_t _count, const uint64_t _frame, NpsBeamWorkerPool *_pool) const
+{
+  if (!_pool || _count <= kNoiseGrain)
+  {
+    this->FillRange(_ranges, _noise, 0, _count, _frame);
+    return;
+  }
+
+  // Split on whole grains so chunk starts stay aligned to 4 cells
+  const size_t grains = (_count + kNoiseGrain - 1) / kNoiseGrain;
+  _pool->ParallelFor(grains, 1,
+      [&](size_t _begin, size_t _end)
+      {
+        this->FillRange(_ranges, _noise, _begin * kNoiseGrain,
+            std::min(_end * kNoiseGrain, _count), _frame);
+      });
+}
+
+//////////////////////////////////////////////////
+void NpsBeamNoiseEngine::FillRange(const float *_ranges, float *_noise,
+    const size_t _begin, const size_t _end, const uint64_t _frame) const
+{
+  uint32_t counter[4] = {0, 0, static_cast<uint32_t>(_frame),
+    static_cast<uint32_t>(_frame >> 32)};
+  uint32_t bits[4];
+  float normals[4];
+
+  for (size_t i = _begin; i < _end; i += 4)
+  {
+    const uint64_t block = i / 4;
+    counter[0] = static_cast<uint32_t>(block);
+    counter[1] = static_cast<uint32_t>(block >> 32);
+    Philox4x32(counter, this->key, bits);
+    Normals(bits, normals);
+
+    const size_t n = std::min<size_t>(4, _end - i);
+    for (size_t j = 0; j < n; ++j)
+      _noise[i + j] = this->offset + this->stddev * normals[j];
+  }
+
+  if (this->precision > 0)
+  {
+    for (size_t i = _begin; i < _end; ++i)
+    {
+      const float noisy = _ranges[i] + _noise[i];
+      _noise[i] = std::round(noisy / this->precision) * this->precision -
+        _ranges[i];
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+double NpsBeamNoiseEngine::Bias() const
+{
+  return this->bias;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_NOISE_HH
+#define NPS_BEAM_NOISE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamWorkerPool;
+
+    /// \brief Philox4x32-10 counter based random number generator.
+    ///
+    /// Every (counter, key) pair maps to four independent 32 bit values,
+    /// so any cell of any frame can be drawn without shared state.
+    /// \param[in] _counter 128 bit counter.
+    /// \param[in] _key 64 bit key.
+    /// \param[out] _out Four random values.
+    void Philox4x32(const uint32_t _counter[4], const uint32_t _key[2],
+        uint32_t _out[4]);
+
+    /// \brief Hash a name into a noise stream salt.
+    ///
+    /// FNV-1a, so a name gives the same salt on every platform and run.
+    /// \param[in] _name Name to hash, e.g. the scoped sensor name.
+    /// \return 32 bit salt.
+    uint32_t NpsBeamNoiseSalt(const std::string &_name);
+
+    /// \brief Bulk Gaussian range noise for whole frames.
+    ///
+    /// Mirrors Gazebo's GaussianNoiseModel (additive Gaussian noise, a
+    /// fixed bias with random sign and optional output quantization), but
+    /// draws from counter based streams keyed by seed, salt, frame and
+    /// cell. A frame therefore gets the same noise for a given seed
+    /// regardless of how it is split across threads, and sensors sharing
+    /// a seed but not a salt draw independent noise.
+    class NpsBeamNoiseEngine
+    {
+      /// \brief Set the noise parameters and draw the bias.
+      /// \param[in] _mean Noise mean.
+      /// \param[in] _stddev Noise standard deviation.
+      /// \param[in] _biasMean Mean of the bias distribution.
+      /// \param[in] _biasStddev Standard deviation of the bias.
+      /// \param[in] _precision Output quantization step, 0 to disable.
+      /// \param[in] _seed Stream seed.
+      /// \param[in] _salt Stream salt mixed into the key, e.g. from
+      /// NpsBeamNoiseSalt of the sensor name.
+      public: void Configure(const double _mean, const double _stddev,
+                  const double _biasMean, const double _biasStddev,
+                  const double _precision, const uint64_t _seed,
+                  const uint32_t _salt = 0);
+
+      /// \brief Compute additive noise for every cell of a frame.
+      ///
+      /// _noise[i] is chosen so that _ranges[i] + _noise[i] is the noisy,
+      /// quantized range, which is what ProcessBeamRanges expects.
+      /// \param[in] _ranges Raw ranges.
+      /// \param[out] _noise Additive noise per cell.
+      /// \param[in] _count Number of cells.
+      /// \param[in] _frame Frame number selecting the random stream.
+      /// \param[in] _pool Pool to split the frame over, or null.
+      public: void Fill(const float *_ranges, float *_noise,
+                  const size_t _count, const uint64_t _frame,
+                  NpsBeamWorkerPool *_pool) const;
+
+      /// \brief Get the bias drawn by Configure.
+      /// \return Bias.
+      public: double Bias() const;
+
+      /// \brief Fill a range of cells, _begin must be a multiple of 4.
+      private: void FillRange(const float *_ranges, float *_noise,
+                   const size_t _begin, const size_t _end,
+                   const uint64_t _frame) const;
+
+      /// \brief Noise mean plus bias.
+      private: float offset = 0;
+
+      /// \brief Noise standard deviation.
+      private: float stddev = 0;
+
+      /// \brief Quantization step.
+      private: float precision = 0;
+
+      /// \brief Drawn bias.
+      private: double bias = 0;
+
+      /// \brief Philox key.
+      private: uint32_t key[2] = {0, 0};
+    };
+  }
+}
+#endif
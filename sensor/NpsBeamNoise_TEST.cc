@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "NpsBeamNoise.hh"
+#include "NpsBeamScanProcessor.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Draw the noise of one frame.
+  std::vector<float> Draw(const NpsBeamNoiseEngine &_engine,
+      const uint64_t _frame, NpsBeamWorkerPool *_pool = nullptr)
+  {
+    const size_t count = 40000;
+    std::vector<float> ranges(count, 10.0f);
+    std::vector<float> noise(count);
+    _engine.Fill(ranges.data(), noise.data(), count, _frame, _pool);
+    return noise;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamNoise, Reproducible)
+{
+  NpsBeamNoiseEngine a;
+  NpsBeamNoiseEngine b;
+  const uint32_t salt = NpsBeamNoiseSalt("default::robot::link::beam");
+  a.Configure(0, 0.1, 0, 0, 0, 1234, salt);
+  b.Configure(0, 0.1, 0, 0, 0, 1234, salt);
+
+  NpsBeamWorkerPool pool(3);
+  EXPECT_EQ(Draw(a, 5), Draw(b, 5));
+  EXPECT_EQ(Draw(a, 5), Draw(b, 5, &pool));
+  EXPECT_NE(Draw(a, 5), Draw(a, 6));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamNoise, SaltSeparatesSensors)
+{
+  const uint32_t left = NpsBeamNoiseSalt("default::robot::link::left");
+  const uint32_t right = NpsBeamNoiseSalt("default::robot::link::right");
+  ASSERT_NE(left, right);
+  EXPECT_EQ(left, NpsBeamNoiseSalt("default::robot::link::left"));
+
+  // Same seed, different sensors: the streams must not match
+  NpsBeamNoiseEngine a;
+  NpsBeamNoiseEngine b;
+  a.Configure(0, 0.1, 0, 0.05, 0, 1234, left);
+  b.Configure(0, 0.1, 0, 0.05, 0, 1234, right);
+  EXPECT_NE(a.Bias(), b.Bias());
+
+  const std::vector<float> noiseA = Draw(a, 1);
+  const std::vector<float> noiseB = Draw(b, 1);
+  size_t equal = 0;
+  double sumA = 0, sumB = 0, sumAB = 0;
+  for (size_t i = 0; i < noiseA.size(); ++i)
+  {
+    equal += noiseA[i] == noiseB[i];
+    const double da = noiseA[i] - a.Bias();
+    const double db = noiseB[i] - b.Bias();
+    sumA += da * da;
+    sumB += db * db;
+    sumAB += da * db;
+  }
+  EXPECT_LT(equal, noiseA.size() / 100);
+
+  // Independent streams are uncorrelated
+  EXPECT_LT(std::fabs(sumAB / std::sqrt(sumA * sumB)), 0.05);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamNoise, CustomNoiseReplacesBulk)
+{
+  NpsBeamNoiseEngine engine;
+  engine.Configure(0, 0.1, 0, 0, 0, 1234, NpsBeamNoiseSalt("beam"));
+  NpsBeamScanProcessor processor;
+  processor.SetNoise(engine);
+
+  NpsBeamFrame frame;
+  frame.Resize(64, 2);
+  frame.rangeMin = 1.0f;
+  frame.rangeMax = 20.0f;
+  std::fill(frame.ranges.begin(), frame.ranges.end(), 10.0f);
+  frame.ranges[0] = 30.0f;
+
+  // A per-frame function replaces the bulk noise for that frame only
+  const NpsBeamScanProcessor::NoiseFunction custom =
+    [](double _range) { return _range + 0.5; };
+  processor.Process(frame, frame.ranges.size(), &custom);
+  EXPECT_TRUE(std::isinf(frame.ranges[0]));
+  for (size_t i = 1; i < frame.ranges.size(); ++i)
+    ASSERT_FLOAT_EQ(10.5f, frame.ranges[i]);
+  EXPECT_TRUE(processor.HasBulkNoise());
+
+  std::fill(frame.ranges.begin(), frame.ranges.end(), 10.0f);
+  processor.Process(frame, frame.ranges.size());
+  size_t exact = 0;
+  for (float range : frame.ranges)
+    exact += range == 10.0f || range == 10.5f;
+  EXPECT_LT(exact, frame.ranges.size() / 10);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
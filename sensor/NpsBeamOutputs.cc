@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gazebo/common/Console.hh"
+#include "gazebo/common/Image.hh"
+
+#include "NpsBeamMultiEcho.hh"
+#include "NpsBeamResampler.hh"
+#include "NpsBeamWorkerPool.hh"
+#include "NpsBeamOutputs.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::PublishDiagnostics(
+    const NpsBeamDiagnostics::Clock::time_point &_now)
+{
+  if (!this->diagnosticsPub || _now < this->nextDiagnostics)
+    return;
+
+  this->nextDiagnostics = _now +
+    std::chrono::duration_cast<NpsBeamDiagnostics::Clock::duration>(
+        std::chrono::duration<double>(1.0 / this->diagnosticsRate));
+
+  const NpsBeamDiagnostics::Snapshot snapshot =
+    this->diagnostics.TakeSnapshot();
+  if (!this->diagnosticsPub->HasConnections())
+    return;
+
+  // Clear keeps the repeated params and their name strings allocated,
+  // so a steady summary refills the message in place. Names are assigned
+  // into the kept strings, since set_name builds a new string.
+  auto addValue = [](msgs::Param *_parent, const char *_name,
+      const double _value)
+  {
+    msgs::Param *param = _parent->add_children();
+    param->mutable_name()->assign(_name);
+    param->mutable_value()->set_type(msgs::Any::DOUBLE);
+    param->mutable_value()->set_double_value(_value);
+  };
+
+  msgs::Param_V &msg = this->diagnosticsMsg;
+  msg.Clear();
+
+  msgs::Param *window = msg.add_param();
+  window->mutable_name()->assign("window");
+  addValue(window, "seconds", snapshot.windowSeconds);
+  for (int c = 0; c < NpsBeamDiagnostics::COUNTER_COUNT; ++c)
+  {
+    const NpsBeamDiagnostics::Counter counter =
+      static_cast<NpsBeamDiagnostics::Counter>(c);
+    addValue(window, NpsBeamDiagnostics::CounterName(counter),
+        snapshot.counters[c]);
+  }
+
+  const uint64_t hits =
+    snapshot.counters[NpsBeamDiagnostics::INCREMENTAL_HITS];
+  const uint64_t lookups =
+    hits + snapshot.counters[NpsBeamDiagnostics::INCREMENTAL_MISSES];
+  if (lookups > 0)
+  {
+    addValue(window, "incremental_hit_rate",
+        static_cast<double>(hits) / lookups);
+  }
+
+  for (int s = 0; s < NpsBeamDiagnostics::STAGE_COUNT; ++s)
+  {
+    const NpsBeamDiagnostics::Stage stage =
+      static_cast<NpsBeamDiagnostics::Stage>(s);
+    const NpsBeamDiagnostics::StageStats &stats = snapshot.stages[s];
+
+    msgs::Param *param = msg.add_param();
+    param->mutable_name()->assign(NpsBeamDiagnostics::StageName(stage));
+    addValue(param, "count", stats.count);
+    addValue(param, "mean_us", stats.meanUs);
+    addValue(param, "p50_us", stats.p50Us);
+    addValue(param, "p99_us", stats.p99Us);
+    addValue(param, "max_us", stats.maxUs);
+  }
+
+  this->diagnosticsPub->Publish(msg);
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamOutputs::BeamAngles(const NpsBeamGeometry &_geom,
+    std::vector<double> &_angles, std::vector<double> &_verticalAngles) const
+{
+  bool matched = true;
+
+  // A list for the whole fan is cut down to the active sector
+  if (this->beamAngles.size() == static_cast<size_t>(_geom.fullRangeCount) &&
+      _geom.rangeCount != _geom.fullRangeCount)
+  {
+    _angles.assign(this->beamAngles.begin() + _geom.sectorRangeOffset,
+        this->beamAngles.begin() + _geom.sectorRangeOffset +
+        _geom.rangeCount);
+  }
+  else
+  {
+    _angles = this->beamAngles;
+  }
+
+  if (_angles.size() != static_cast<size_t>(_geom.rangeCount))
+  {
+    matched = _angles.empty();
+    _angles = NpsBeamResampler::UniformAngles(_geom.angleMin,
+        _geom.angleMax, _geom.rangeCount);
+  }
+
+  _verticalAngles = this->verticalBeamAngles;
+  if (_verticalAngles.size() != static_cast<size_t>(_geom.verticalRangeCount))
+  {
+    matched = matched && _verticalAngles.empty();
+    _verticalAngles = NpsBeamResampler::UniformAngles(
+        _geom.verticalAngleMin, _geom.verticalAngleMax,
+        _geom.verticalRangeCount);
+  }
+
+  return matched;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::ConfigureBinner(const NpsBeamFrame &_frame,
+    const NpsBeamGeometry &_geom)
+{
+  if (this->binnerReady && this->binnerVersion == _geom.version)
+    return;
+
+  const double vertFov = _geom.verticalAngleMax - _geom.verticalAngleMin;
+  const double vertStep =
+    _frame.height > 1 ? vertFov / (_frame.height - 1) : 0.0;
+  const double beamwidth =
+    this->beamImageBeamwidth > 0 ? this->beamImageBeamwidth : vertFov;
+
+  this->binner.Configure(_frame.width, _frame.height,
+      this->beamImageBeams > 0 ? this->beamImageBeams : _geom.rangeCount,
+      this->beamImageBins, _geom.rangeMin, _geom.rangeMax,
+      NpsBeamIntensityBinner::GaussianPattern(_frame.height,
+        -vertFov / 2.0, vertStep, beamwidth));
+  this->binnerVersion = _geom.version;
+  this->binnerReady = true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::PublishBeamImage(const NpsBeamFrame &_frame,
+    const NpsBeamGeometry &_geom, const common::Time &_stamp)
+{
+  this->ConfigureBinner(_frame, _geom);
+
+  msgs::Set(this->beamImageMsg.mutable_time(), _stamp);
+
+  msgs::Image *image = this->beamImageMsg.mutable_image();
+  image->set_width(this->binner.Bins());
+  image->set_height(this->binner.Beams());
+  image->set_pixel_format(common::Image::R_FLOAT32);
+  image->set_step(this->binner.Bins() * sizeof(float));
+
+  std::string *bytes = image->mutable_data();
+  bytes->resize(sizeof(float) * this->binner.Bins() * this->binner.Beams());
+
+  this->binner.Accumulate(_frame.ranges.data(),
+      this->beamImageUseIntensity ? _frame.intensities.data() : nullptr,
+      reinterpret_cast<float *>(&(*bytes)[0]),
+      &NpsBeamWorkerPool::Instance());
+
+  this->beamImagePub->Publish(this->beamImageMsg);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::PublishCompactScan(const NpsBeamFrame &_frame,
+    const NpsBeamGeometry &_geom, const common::Time &_stamp)
+{
+  if (!this->compactReady || this->compactVersion != _geom.version)
+  {
+    this->codec.Configure(this->compactResolution > 0 ?
+        this->compactResolution : _geom.rangeResolution,
+        this->compactIntensityMax, this->compactDelta,
+        this->compactIntensities);
+    this->compactVersion = _geom.version;
+    this->compactReady = true;
+
+    // Set once; setting a long string from a literal allocates a copy
+    this->compactMsg.set_type("nps_beam_compact_scan");
+  }
+
+  msgs::Set(this->compactMsg.mutable_stamp(), _stamp);
+  this->codec.Encode(_frame, *this->compactMsg.mutable_serialized_data());
+
+  this->compactPub->Publish(this->compactMsg);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::PublishEchoes(const NpsBeamFrame &_frame,
+    const common::Time &_stamp)
+{
+  msgs::Set(this->echoMsg.mutable_stamp(), _stamp);
+  NpsBeamMultiEcho::Encode(_frame, *this->echoMsg.mutable_serialized_data());
+
+  this->echoPub->Publish(this->echoMsg);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::PublishPointCloud(const NpsBeamFrame &_frame,
+    const NpsBeamGeometry &_geom, const common::Time &_stamp)
+{
+  msgs::PointCloudPacked &msg = this->pointCloudMsg;
+  if (!this->pointCloudReady || this->pointCloudVersion != _geom.version)
+  {
+    std::vector<double> angles;
+    std::vector<double> verticalAngles;
+    this->BeamAngles(_geom, angles, verticalAngles);
+    this->pointCloud.Configure(angles, verticalAngles);
+    this->pointCloudVersion = _geom.version;
+    this->pointCloudReady = true;
+
+    msg.clear_field();
+    const char *names[NpsBeamPointCloud::PointStride] =
+      {"x", "y", "z", "intensity"};
+    for (size_t i = 0; i < NpsBeamPointCloud::PointStride; ++i)
+    {
+      msgs::PointCloudPacked::Field *field = msg.add_field();
+      field->set_name(names[i]);
+      field->set_offset(i * sizeof(float));
+      field->set_datatype(msgs::PointCloudPacked::Field::FLOAT32);
+      field->set_count(1);
+    }
+    msg.set_height(1);
+    msg.set_is_bigendian(false);
+    msg.set_point_step(NpsBeamPointCloud::PointStride * sizeof(float));
+    msg.set_is_dense(true);
+    msg.mutable_header()->set_str_id(this->pointCloudWorld ? "world" :
+        this->laserMsg.scan().frame());
+  }
+
+  // Room for every cell, then trim to the finite returns
+  const size_t pointSize = NpsBeamPointCloud::PointStride * sizeof(float);
+  std::string *data = msg.mutable_data();
+  data->resize(this->pointCloud.Count() * pointSize);
+  const size_t points = this->pointCloud.Build(_frame,
+      this->pointCloudWorld, reinterpret_cast<float *>(&(*data)[0]));
+  data->resize(points * pointSize);
+
+  msgs::Set(msg.mutable_header()->mutable_stamp(), _stamp);
+  msg.set_width(points);
+  msg.set_row_step(points * pointSize);
+
+  this->pointCloudPub->Publish(msg);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::PublishFanImage(const NpsBeamFrame &_frame,
+    const NpsBeamGeometry &_geom, const common::Time &_stamp,
+    const float *_polar)
+{
+  this->ConfigureBinner(_frame, _geom);
+
+  if (!this->fanImageReady || this->fanImageVersion != _geom.version)
+  {
+    // Each beam of the beam image is centered on the columns it bins
+    std::vector<double> angles;
+    std::vector<double> verticalAngles;
+    this->BeamAngles(_geom, angles, verticalAngles);
+    const unsigned int beams = this->binner.Beams();
+    std::vector<double> beamAngles(beams);
+    for (unsigned int b = 0; b < beams; ++b)
+    {
+      const size_t first = (static_cast<uint64_t>(b) * angles.size()) /
+        beams;
+      const size_t last = (static_cast<uint64_t>(b + 1) * angles.size()) /
+        beams;
+      beamAngles[b] = (angles[first] + angles[std::max(first, last - 1)]) /
+        2.0;
+    }
+
+    this->fanImage.Configure(this->fanImageWidth, this->fanImageHeight,
+        _geom.angleMin, _geom.angleMax, beamAngles, this->binner.Bins(),
+        _geom.rangeMin, _geom.rangeMax);
+    this->fanImageVersion = _geom.version;
+    this->fanImageReady = true;
+  }
+
+  NpsBeamWorkerPool *pool = &NpsBeamWorkerPool::Instance();
+  if (!_polar)
+  {
+    this->fanImagePolar.resize(
+        static_cast<size_t>(this->binner.Bins()) * this->binner.Beams());
+    this->binner.Accumulate(_frame.ranges.data(),
+        this->beamImageUseIntensity ? _frame.intensities.data() : nullptr,
+        this->fanImagePolar.data(), pool);
+    _polar = this->fanImagePolar.data();
+  }
+
+  msgs::Set(this->fanImageMsg.mutable_time(), _stamp);
+
+  msgs::Image *image = this->fanImageMsg.mutable_image();
+  image->set_width(this->fanImage.Width());
+  image->set_height(this->fanImage.Height());
+  image->set_pixel_format(common::Image::R_FLOAT32);
+  image->set_step(this->fanImage.Width() * sizeof(float));
+
+  std::string *bytes = image->mutable_data();
+  bytes->resize(
+      sizeof(float) * this->fanImage.Width() * this->fanImage.Height());
+  this->fanImage.Apply(_polar, reinterpret_cast<float *>(&(*bytes)[0]),
+      pool);
+
+  this->fanImagePub->Publish(this->fanImageMsg);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::WriteShm(const NpsBeamFrame &_frame)
+{
+  const size_t cells = _frame.ranges.size();
+  if (cells > this->shmWriter.Cells() &&
+      !this->shmWriter.Create(this->shmName, this->shmSlots, cells))
+  {
+    gzerr << "Unable to create shared memory segment[" << this->shmName
+          << "], disabling shared memory output\n";
+    this->shmName.clear();
+    return;
+  }
+
+  this->shmWriter.Write(_frame);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamOutputs::ProcessFrame(NpsBeamFrame *_frame,
+    const NpsBeamGeometry &_geom, const int _count, const bool _customNoise)
+{
+  const NpsBeamDiagnostics::Clock::time_point start =
+    NpsBeamDiagnostics::Clock::now();
+
+  // Number the frame before it is recorded or any output is encoded, so
+  // the log and the compact and echo messages carry the sequence readers
+  // see once it is published
+  this->frameStore.AssignSequence(_frame);
+
+  // Record the raw frame, before noise and masking, so a replay runs
+  // the same processing again
+  if (this->recorder.IsOpen() && !this->recorder.Write(*_frame))
+    this->diagnostics.Count(NpsBeamDiagnostics::RECORD_DROPPED);
+
+  this->processor.Process(*_frame, _count,
+      _customNoise ? &this->customNoiseFunction : nullptr);
+
+  const common::Time stamp(_frame->sec, _frame->nsec);
+  msgs::Set(this->laserMsg.mutable_time(), stamp);
+  NpsBeamScanProcessor::FillScan(*_frame, this->laserMsg.mutable_scan());
+
+  const NpsBeamDiagnostics::Clock::time_point processed =
+    NpsBeamDiagnostics::Clock::now();
+  this->diagnostics.Record(NpsBeamDiagnostics::PROCESS, start, processed);
+
+  const float *polar = nullptr;
+  if (this->beamImagePub && this->beamImagePub->HasConnections())
+  {
+    this->PublishBeamImage(*_frame, _geom, stamp);
+    this->diagnostics.Count(NpsBeamDiagnostics::BYTES_PUBLISHED,
+        this->beamImageMsg.ByteSizeLong());
+    polar = reinterpret_cast<const float *>(
+        this->beamImageMsg.image().data().data());
+  }
+
+  if (this->fanImagePub && this->fanImagePub->HasConnections())
+  {
+    this->PublishFanImage(*_frame, _geom, stamp, polar);
+    this->diagnostics.Count(NpsBeamDiagnostics::BYTES_PUBLISHED,
+        this->fanImageMsg.ByteSizeLong());
+  }
+
+  if (this->compactPub && this->compactPub->HasConnections())
+  {
+    this->PublishCompactScan(*_frame, _geom, stamp);
+    this->diagnostics.Count(NpsBeamDiagnostics::BYTES_PUBLISHED,
+        this->compactMsg.ByteSizeLong());
+  }
+
+  if (this->echoPub && this->echoPub->HasConnections())
+  {
+    this->PublishEchoes(*_frame, stamp);
+    this->diagnostics.Count(NpsBeamDiagnostics::BYTES_PUBLISHED,
+        this->echoMsg.ByteSizeLong());
+  }
+
+  if (this->pointCloudPub && this->pointCloudPub->HasConnections())
+  {
+    this->PublishPointCloud(*_frame, _geom, stamp);
+    this->diagnostics.Count(NpsBeamDiagnostics::BYTES_PUBLISHED,
+        this->pointCloudMsg.ByteSizeLong());
+  }
+
+  if (!this->shmName.empty())
+    this->WriteShm(*_frame);
+
+  this->frameStore.EndWrite(_frame);
+
+  if (this->scanPub && this->scanPub->HasConnections())
+  {
+    this->scanPub->Publish(this->laserMsg);
+    this->diagnostics.Count(NpsBeamDiagnostics::BYTES_PUBLISHED,
+        this->laserMsg.ByteSizeLong());
+  }
+
+  this->diagnostics.Record(NpsBeamDiagnostics::PUBLISH, processed,
+      NpsBeamDiagnostics::Clock::now());
+  this->diagnostics.Count(NpsBeamDiagnostics::FRAMES);
+}
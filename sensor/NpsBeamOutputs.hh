@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_OUTPUTS_HH
+#define NPS_BEAM_OUTPUTS_HH
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gazebo/msgs/msgs.hh"
+
+#include "NpsBeamDiagnostics.hh"
+#include "NpsBeamFanImage.hh"
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamGeometry.hh"
+#include "NpsBeamIntensityBinner.hh"
+#include "NpsBeamPointCloud.hh"
+#include "NpsBeamRecorder.hh"
+#include "NpsBeamScanCodec.hh"
+#include "NpsBeamScanProcessor.hh"
+#include "NpsBeamShmRing.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \internal
+    /// \brief Destination of the messages of one sensor output.
+    ///
+    /// The sensor adapts its transport publishers to it; tests publish
+    /// into memory instead.
+    class NpsBeamPublisher
+    {
+      /// \brief Destructor.
+      public: virtual ~NpsBeamPublisher() = default;
+
+      /// \brief Check for subscribers.
+      /// \return True if a published message would be delivered.
+      public: virtual bool HasConnections() const = 0;
+
+      /// \brief Publish a message.
+      /// \param[in] _msg Message to publish.
+      public: virtual void Publish(const google::protobuf::Message &_msg) = 0;
+    };
+
+    /// \def NpsBeamPublisherPtr
+    /// \brief Owning pointer to a publisher.
+    typedef std::unique_ptr<NpsBeamPublisher> NpsBeamPublisherPtr;
+
+    /// \internal
+    /// \brief Processes read back frames and produces every output of
+    /// the sensor from them.
+    ///
+    /// Holds the output configuration, the reused output messages and
+    /// their publishers. ProcessFrame runs on the pipeline thread, or
+    /// inline on the update thread when pipelining is disabled, and is
+    /// the only user of the processor and the reused messages.
+    class NpsBeamOutputs
+    {
+      /// \brief Process a read back frame and publish every output with
+      /// subscribers.
+      /// \param[in] _frame Frame with raw data and header, from
+      /// frameStore.BeginWrite.
+      /// \param[in] _geom Geometry the frame was produced with.
+      /// \param[in] _count Number of cells read back.
+      /// \param[in] _customNoise True to apply customNoiseFunction
+      /// instead of the processor's bulk noise.
+      public: void ProcessFrame(NpsBeamFrame *_frame,
+                  const NpsBeamGeometry &_geom, const int _count,
+                  const bool _customNoise);
+
+      /// \brief Publish a diagnostics summary if the publish period
+      /// elapsed.
+      /// \param[in] _now Current time.
+      public: void PublishDiagnostics(
+                  const NpsBeamDiagnostics::Clock::time_point &_now);
+
+      /// \brief Get the beam angles of the published range cells.
+      /// \param[in] _geom Scan geometry.
+      /// \param[out] _angles Horizontal angle of each column.
+      /// \param[out] _verticalAngles Vertical angle of each row.
+      /// \return False if a configured angle list did not match the
+      /// range counts and uniform angles were used instead.
+      public: bool BeamAngles(const NpsBeamGeometry &_geom,
+                  std::vector<double> &_angles,
+                  std::vector<double> &_verticalAngles) const;
+
+      /// \brief Configure the binner for the geometry of a frame, if it
+      /// changed.
+      /// \param[in] _frame Processed frame.
+      /// \param[in] _geom Geometry the frame was produced with.
+      private: void ConfigureBinner(const NpsBeamFrame &_frame,
+                   const NpsBeamGeometry &_geom);
+
+      /// \brief Bin a processed frame into per-beam intensity profiles
+      /// and publish them as a float image, one row per beam.
+      /// \param[in] _frame Processed frame.
+      /// \param[in] _geom Geometry the frame was produced with.
+      /// \param[in] _stamp Measurement time of the frame.
+      private: void PublishBeamImage(const NpsBeamFrame &_frame,
+                   const NpsBeamGeometry &_geom, const common::Time &_stamp);
+
+      /// \brief Encode a processed frame as a compact scan and publish it.
+      /// \param[in] _frame Processed frame.
+      /// \param[in] _geom Geometry the frame was produced with.
+      /// \param[in] _stamp Measurement time of the frame.
+      private: void PublishCompactScan(const NpsBeamFrame &_frame,
+                   const NpsBeamGeometry &_geom, const common::Time &_stamp);
+
+      /// \brief Encode the echoes of a frame and publish them.
+      /// \param[in] _frame Processed frame with echoes.
+      /// \param[in] _stamp Measurement time of the frame.
+      private: void PublishEchoes(const NpsBeamFrame &_frame,
+                   const common::Time &_stamp);
+
+      /// \brief Turn a processed frame into points and publish them.
+      /// \param[in] _frame Processed frame.
+      /// \param[in] _geom Geometry the frame was produced with.
+      /// \param[in] _stamp Measurement time of the frame.
+      private: void PublishPointCloud(const NpsBeamFrame &_frame,
+                   const NpsBeamGeometry &_geom, const common::Time &_stamp);
+
+      /// \brief Remap the beam image of a processed frame onto the fan
+      /// image and publish it as a float image.
+      /// \param[in] _frame Processed frame.
+      /// \param[in] _geom Geometry the frame was produced with.
+      /// \param[in] _stamp Measurement time of the frame.
+      /// \param[in] _polar Beam image of the frame, or null to bin it
+      /// here.
+      private: void PublishFanImage(const NpsBeamFrame &_frame,
+                   const NpsBeamGeometry &_geom, const common::Time &_stamp,
+                   const float *_polar);
+
+      /// \brief Write a processed frame to the shared memory ring,
+      /// creating the segment on the first frame and again when frames
+      /// outgrow it.
+      /// \param[in] _frame Processed frame.
+      private: void WriteShm(const NpsBeamFrame &_frame);
+
+      /// \brief Laser message to publish data.
+      public: msgs::LaserScanStamped laserMsg;
+
+      /// \brief Publisher to publish ray sensor data
+      public: NpsBeamPublisherPtr scanPub;
+
+      /// \brief Processed scans handed out to readers on other threads.
+      public: NpsBeamFrameStore frameStore;
+
+      /// \brief Applies noise and masking, and fills laserMsg.
+      public: NpsBeamScanProcessor processor;
+
+      /// \brief Per-ray noise of the sensor's Gaussian noise model, used
+      /// instead of the bulk noise once a custom noise callback is set.
+      public: NpsBeamScanProcessor::NoiseFunction customNoiseFunction;
+
+      /// \brief Configured horizontal beam angles, empty for uniform.
+      public: std::vector<double> beamAngles;
+
+      /// \brief Configured vertical beam angles, empty for uniform.
+      public: std::vector<double> verticalBeamAngles;
+
+      /// \brief Publisher of the beam intensity image, null if disabled.
+      public: NpsBeamPublisherPtr beamImagePub;
+
+      /// \brief Number of beams in the beam image, 0 for RangeCount().
+      public: unsigned int beamImageBeams = 0;
+
+      /// \brief Number of range bins per beam.
+      public: unsigned int beamImageBins = 1000;
+
+      /// \brief Vertical beam pattern width (FWHM), 0 for the vertical FOV.
+      public: double beamImageBeamwidth = 0;
+
+      /// \brief Weight returns by ray intensity instead of counting them.
+      public: bool beamImageUseIntensity = true;
+
+      /// \brief Scatters frames into the beam image.
+      public: NpsBeamIntensityBinner binner;
+
+      /// \brief Geometry version the binner was configured for.
+      public: unsigned int binnerVersion = 0;
+
+      /// \brief True once the binner was configured.
+      public: bool binnerReady = false;
+
+      /// \brief Beam image message, reused every frame.
+      public: msgs::ImageStamped beamImageMsg;
+
+      /// \brief Publisher of the fan image, null if disabled.
+      public: NpsBeamPublisherPtr fanImagePub;
+
+      /// \brief Fan image width in pixels.
+      public: unsigned int fanImageWidth = 1024;
+
+      /// \brief Fan image height in pixels.
+      public: unsigned int fanImageHeight = 1024;
+
+      /// \brief Remaps the beam image onto the fan image.
+      public: NpsBeamFanImage fanImage;
+
+      /// \brief Geometry version the fan image was configured for.
+      public: unsigned int fanImageVersion = 0;
+
+      /// \brief True once the fan image was configured.
+      public: bool fanImageReady = false;
+
+      /// \brief Beam image of the frame when only the fan is published.
+      public: std::vector<float> fanImagePolar;
+
+      /// \brief Fan image message, reused every frame.
+      public: msgs::ImageStamped fanImageMsg;
+
+      /// \brief Publisher of compact scans, null if disabled.
+      public: NpsBeamPublisherPtr compactPub;
+
+      /// \brief Compact range resolution, 0 for the SDF range resolution.
+      public: double compactResolution = 0;
+
+      /// \brief Intensity mapped to 255, 0 for per-scan scaling.
+      public: double compactIntensityMax = 0;
+
+      /// \brief Delta code compact ranges.
+      public: bool compactDelta = true;
+
+      /// \brief Include intensities in compact scans.
+      public: bool compactIntensities = true;
+
+      /// \brief Encodes compact scans.
+      public: NpsBeamScanCodec codec;
+
+      /// \brief Geometry version the codec was configured for.
+      public: unsigned int compactVersion = 0;
+
+      /// \brief True once the codec was configured.
+      public: bool compactReady = false;
+
+      /// \brief Compact scan message, reused every frame.
+      public: msgs::Packet compactMsg;
+
+      /// \brief Publisher of multi-echo packets, null if disabled.
+      public: NpsBeamPublisherPtr echoPub;
+
+      /// \brief Multi-echo message, reused every frame.
+      public: msgs::Packet echoMsg;
+
+      /// \brief Publisher of point clouds, null if disabled.
+      public: NpsBeamPublisherPtr pointCloudPub;
+
+      /// \brief Publish points in the world frame rather than the sensor
+      /// frame.
+      public: bool pointCloudWorld = true;
+
+      /// \brief Turns frames into points.
+      public: NpsBeamPointCloud pointCloud;
+
+      /// \brief Geometry version the point cloud was configured for.
+      public: unsigned int pointCloudVersion = 0;
+
+      /// \brief True once the point cloud was configured.
+      public: bool pointCloudReady = false;
+
+      /// \brief Point cloud message, reused every frame.
+      public: msgs::PointCloudPacked pointCloudMsg;
+
+      /// \brief Shared memory segment name, empty if disabled.
+      public: std::string shmName;
+
+      /// \brief Number of frame slots of the shared memory ring.
+      public: unsigned int shmSlots = 8;
+
+      /// \brief Writes processed frames to shared memory.
+      public: NpsBeamShmWriter shmWriter;
+
+      /// \brief Records raw frames to a file, if open.
+      public: NpsBeamRecorder recorder;
+
+      /// \brief Stage timings and frame counters.
+      public: NpsBeamDiagnostics diagnostics;
+
+      /// \brief Publisher of diagnostics summaries, null if disabled.
+      public: NpsBeamPublisherPtr diagnosticsPub;
+
+      /// \brief Diagnostics publish rate in Hz.
+      public: double diagnosticsRate = 0;
+
+      /// \brief Earliest time of the next diagnostics summary.
+      public: NpsBeamDiagnostics::Clock::time_point nextDiagnostics;
+
+      /// \brief Diagnostics message, reused every summary.
+      public: msgs::Param_V diagnosticsMsg;
+    };
+  }
+}
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include "NpsBeamPipeline.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+NpsBeamPipeline::NpsBeamPipeline()
+{
+}
+
+//////////////////////////////////////////////////
+NpsBeamPipeline::~NpsBeamPipeline()
+{
+  this->Stop();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamPipeline::Start(const unsigned int _depth,
+    NpsBeamWorkerPool *_pool)
+{
+  this->Stop();
+
+  this->depth = _depth;
+  this->jobs.assign(this->depth, Job());
+  this->head = 0;
+  this->count = 0;
+  this->stop = false;
+  if (this->depth > 0 && _pool)
+    this->pool = _pool;
+  else if (this->depth > 0)
+    this->thread = std::thread(&NpsBeamPipeline::Run, this);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamPipeline::Stop()
+{
+  if (this->pool)
+  {
+    this->Flush();
+    this->pool = nullptr;
+    return;
+  }
+
+  if (!this->thread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->condition.notify_all();
+  this->thread.join();
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamPipeline::Submit(const Job &_job, const bool _block)
+{
+  if (!this->pool && !this->thread.joinable())
+  {
+    _job();
+    return true;
+  }
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  if (this->count >= this->depth)
+  {
+    if (!_block)
+      return false;
+    this->condition.wait(lock,
+        [this]() { return this->count < this->depth; });
+  }
+
+  this->jobs[(this->head + this->count) % this->depth] = _job;
+  ++this->count;
+
+  if (this->pool)
+  {
+    const bool post = !this->posted;
+    this->posted = true;
+    lock.unlock();
+    if (post)
+      this->pool->Post([this]() { this->RunNext(); });
+    return true;
+  }
+
+  lock.unlock();
+  this->condition.notify_all();
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamPipeline::Flush()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->condition.wait(lock, [this]() { return this->count == 0; });
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamPipeline::Depth() const
+{
+  return this->depth;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamPipeline::Run()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (true)
+  {
+    this->condition.wait(lock,
+        [this]() { return this->stop || this->count > 0; });
+
+    if (this->count == 0)
+      return;
+
+    // Keep the job queued while it runs so it counts towards the depth;
+    // Submit never writes the slot at head while it is queued
+    Job &job = this->jobs[this->head];
+    lock.unlock();
+    job();
+    lock.lock();
+
+    this->PopFront();
+    this->condition.notify_all();
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamPipeline::RunNext()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+  Job &job = this->jobs[this->head];
+  lock.unlock();
+  job();
+  lock.lock();
+
+  this->PopFront();
+  this->posted = this->count > 0;
+  const bool post = this->posted;
+  this->condition.notify_all();
+  lock.unlock();
+
+  // Requeue rather than loop so other pipelines on the pool get a turn
+  if (post)
+    this->pool->Post([this]() { this->RunNext(); });
+}
+
+//////////////////////////////////////////////////
+void NpsBeamPipeline::PopFront()
+{
+  // Drop the captures now rather than when the slot is reused
+  this->jobs[this->head] = nullptr;
+  this->head = (this->head + 1) % this->depth;
+  --this->count;
+}
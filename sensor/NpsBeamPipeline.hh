@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_PIPELINE_HH
+#define NPS_BEAM_PIPELINE_HH
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamWorkerPool;
+
+    /// \brief Bounded, in-order stage that runs frame jobs on its own
+    /// thread or on a shared worker pool.
+    ///
+    /// The sensor reads back frame k and hands its processing to the
+    /// pipeline, so rendering and readback of frame k+1 overlap the
+    /// processing and publishing of frame k. Jobs run strictly in
+    /// submission order. At most depth jobs are queued or running; when
+    /// the pipeline is full, Submit either waits for a slot or rejects the
+    /// frame. With a depth of 0 jobs run synchronously in Submit.
+    ///
+    /// On a pool the pipeline has no thread of its own: it posts one job
+    /// at a time, and the next one when that job finished, so the jobs of
+    /// one sensor still run in order while many sensors share the
+    /// workers.
+    ///
+    /// Queued jobs live in a ring sized by Start and run in place, so a
+    /// job whose captures fit in the std::function itself, such as a
+    /// couple of pointers, is queued and run without heap allocations.
+    class NpsBeamPipeline
+    {
+      /// \brief Frame job.
+      public: typedef std::function<void()> Job;
+
+      /// \brief Constructor
+      public: NpsBeamPipeline();
+
+      /// \brief Destructor, finishes queued jobs.
+      public: ~NpsBeamPipeline();
+
+      /// \brief Start the worker.
+      /// \param[in] _depth Maximum number of frames in flight, 0 to run
+      /// jobs synchronously.
+      /// \param[in] _pool Pool to run jobs on, or null to run them on a
+      /// thread of the pipeline.
+      public: void Start(const unsigned int _depth,
+                  NpsBeamWorkerPool *_pool = nullptr);
+
+      /// \brief Finish queued jobs and stop the worker.
+      public: void Stop();
+
+      /// \brief Queue a job.
+      /// \param[in] _job Job to run after every previously submitted job.
+      /// \param[in] _block Wait for a slot when full, else reject the job.
+      /// \return False if the job was rejected.
+      public: bool Submit(const Job &_job, const bool _block);
+
+      /// \brief Wait until every submitted job finished.
+      public: void Flush();
+
+      /// \brief Get the pipeline depth.
+      /// \return Maximum number of frames in flight.
+      public: unsigned int Depth() const;
+
+      /// \brief Worker thread main loop.
+      private: void Run();
+
+      /// \brief Pool task, runs the front job and posts the next one.
+      private: void RunNext();
+
+      /// \brief Remove the job at head, with mutex held.
+      private: void PopFront();
+
+      /// \brief Maximum number of jobs queued or running.
+      private: unsigned int depth = 0;
+
+      /// \brief Ring of depth jobs queued or running; the one at head
+      /// runs.
+      private: std::vector<Job> jobs;
+
+      /// \brief Index of the oldest job in jobs.
+      private: size_t head = 0;
+
+      /// \brief Number of jobs queued or running.
+      private: size_t count = 0;
+
+      /// \brief Protects jobs, head, count and stop.
+      private: std::mutex mutex;
+
+      /// \brief Signals queue changes.
+      private: std::condition_variable condition;
+
+      /// \brief True when the worker should exit once idle.
+      private: bool stop = false;
+
+      /// \brief Worker thread.
+      private: std::thread thread;
+
+      /// \brief Pool jobs run on, or null.
+      private: NpsBeamWorkerPool *pool = nullptr;
+
+      /// \brief True while a pool task of this pipeline is queued or
+      /// running.
+      private: bool posted = false;
+    };
+  }
+}
+#endif
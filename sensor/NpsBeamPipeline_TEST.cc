@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamPipeline.hh"
+#include "NpsBeamScanKernel.hh"
+#include "NpsBeamScanProcessor.hh"
+#include "NpsBeamSyntheticScene.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief A frame as it was published.
+  struct Published
+  {
+    /// \brief Frame sequence.
+    uint64_t sequence;
+
+    /// \brief Index of the update the frame was read back in.
+    unsigned int update;
+
+    /// \brief Measurement time, seconds part.
+    int32_t sec;
+
+    /// \brief Measurement time, nanoseconds part.
+    int32_t nsec;
+
+    /// \brief True if every range matched the scene at the stamp.
+    bool matches;
+  };
+
+  /// \brief Sensor stand-in: renders the synthetic scene in the update
+  /// and processes and publishes on the pipeline, as NpsBeamSensor does.
+  class PipelineSensor
+  {
+    /// \brief Constructor
+    public: PipelineSensor()
+    {
+      this->scene.Configure(10.0, 1.0, 8.0, 2.0);
+    }
+
+    /// \brief Render, read back and submit one frame.
+    /// \param[in] _update Update index, which also sets the time.
+    /// \param[in] _block Wait for a pipeline slot when full.
+    /// \return False if the frame was dropped.
+    public: bool Update(const unsigned int _update, const bool _block)
+    {
+      // 100 Hz simulation time
+      const int32_t sec = static_cast<int32_t>(_update / 100);
+      const int32_t nsec = static_cast<int32_t>((_update % 100) * 10000000);
+      const double time = sec + nsec * 1e-9;
+
+      this->raw.resize(kWidth * kHeight * 3);
+      this->scene.Render(kWidth, kHeight, -kAngle, kAngle, -kVertical,
+          kVertical, 0.0, time, this->raw.data());
+
+      NpsBeamFrame *frame = this->store.BeginWrite();
+      frame->Resize(kWidth, kHeight);
+      frame->sec = sec;
+      frame->nsec = nsec;
+      frame->angleMin = -kAngle;
+      frame->angleMax = kAngle;
+      frame->verticalAngleMin = -kVertical;
+      frame->verticalAngleMax = kVertical;
+      frame->rangeMin = 0.5;
+      frame->rangeMax = 30.0;
+      DeinterleaveBeamFrame(this->raw.data(), kWidth * kHeight, 3,
+          frame->ranges.data(), frame->intensities.data());
+
+      const bool submitted = this->pipeline.Submit([this, frame, _update]()
+          {
+            this->Process(frame, _update);
+          }, _block);
+      if (!submitted)
+        this->store.AbortWrite(frame);
+      return submitted;
+    }
+
+    /// \brief Pipeline job.
+    private: void Process(NpsBeamFrame *_frame, const unsigned int _update)
+    {
+      this->store.AssignSequence(_frame);
+
+      // Staggered latencies: a long job followed by short ones would be
+      // overtaken if jobs ran out of order
+      std::this_thread::sleep_for(
+          std::chrono::microseconds((_update * 7 % 5) * 400));
+
+      this->processor.Process(*_frame, _frame->ranges.size());
+
+      // Data must still belong to the stamp it was read back with
+      const double time = _frame->sec + _frame->nsec * 1e-9;
+      const double step = 2 * kAngle / (kWidth - 1);
+      const double vStep = 2 * kVertical / (kHeight - 1);
+      bool matches = true;
+      for (unsigned int v = 0; v < kHeight; ++v)
+      {
+        for (unsigned int h = 0; h < kWidth; ++h)
+        {
+          const double expected = this->scene.Range(-kAngle + h * step,
+              -kVertical + v * vStep, time);
+          if (std::fabs(_frame->ranges[v * kWidth + h] - expected) > 1e-4)
+            matches = false;
+        }
+      }
+
+      this->store.EndWrite(_frame);
+
+      const NpsBeamFramePtr latest = this->store.Latest();
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->published.push_back({latest->sequence, _update, latest->sec,
+          latest->nsec, matches && latest.get() == _frame});
+    }
+
+    /// \brief Rays per row.
+    public: static const unsigned int kWidth = 64;
+
+    /// \brief Rows.
+    public: static const unsigned int kHeight = 4;
+
+    /// \brief Half the horizontal field of view.
+    public: static constexpr double kAngle = 1.0;
+
+    /// \brief Half the vertical field of view.
+    public: static constexpr double kVertical = 0.2;
+
+    /// \brief Scene being rendered.
+    public: NpsBeamSyntheticScene scene;
+
+    /// \brief Interleaved render output.
+    public: std::vector<float> raw;
+
+    /// \brief Frame store.
+    public: NpsBeamFrameStore store;
+
+    /// \brief Masking, run on the pipeline.
+    public: NpsBeamScanProcessor processor;
+
+    /// \brief Pipeline under test.
+    public: NpsBeamPipeline pipeline;
+
+    /// \brief Protects published.
+    public: std::mutex mutex;
+
+    /// \brief Publication log.
+    public: std::vector<Published> published;
+  };
+
+  constexpr double PipelineSensor::kAngle;
+  constexpr double PipelineSensor::kVertical;
+
+  /// \brief Run updates and check the publication log.
+  /// \param[in] _depth Pipeline depth.
+  /// \param[in] _pool Pool to run on, or null.
+  /// \param[in] _block Wait for a slot when the pipeline is full.
+  void RunPipeline(const unsigned int _depth, NpsBeamWorkerPool *_pool,
+      const bool _block)
+  {
+    PipelineSensor sensor;
+    sensor.pipeline.Start(_depth, _pool);
+
+    const unsigned int updates = 60;
+    std::vector<unsigned int> submitted;
+    for (unsigned int i = 0; i < updates; ++i)
+    {
+      if (sensor.Update(i, _block))
+        submitted.push_back(i);
+    }
+    sensor.pipeline.Flush();
+    sensor.pipeline.Stop();
+
+    if (_block)
+    {
+      EXPECT_EQ(updates, submitted.size());
+    }
+    ASSERT_EQ(submitted.size(), sensor.published.size());
+
+    for (size_t i = 0; i < sensor.published.size(); ++i)
+    {
+      const Published &frame = sensor.published[i];
+      EXPECT_EQ(i + 1, frame.sequence);
+      EXPECT_EQ(submitted[i], frame.update);
+      EXPECT_TRUE(frame.matches) << "frame " << i;
+      EXPECT_EQ(static_cast<int32_t>(frame.update / 100), frame.sec);
+      EXPECT_EQ(static_cast<int32_t>((frame.update % 100) * 10000000),
+          frame.nsec);
+      if (i > 0)
+      {
+        const Published &previous = sensor.published[i - 1];
+        EXPECT_TRUE(frame.sec > previous.sec ||
+            (frame.sec == previous.sec && frame.nsec > previous.nsec));
+      }
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamPipeline, Synchronous)
+{
+  RunPipeline(0, nullptr, true);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamPipeline, Thread)
+{
+  RunPipeline(1, nullptr, true);
+  RunPipeline(3, nullptr, true);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamPipeline, Pool)
+{
+  NpsBeamWorkerPool pool(3);
+  RunPipeline(1, &pool, true);
+  RunPipeline(3, &pool, true);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamPipeline, DropWhenFull)
+{
+  NpsBeamWorkerPool pool(2);
+  RunPipeline(2, nullptr, false);
+  RunPipeline(2, &pool, false);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
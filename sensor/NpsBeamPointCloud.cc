@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#include "NpsBeamPointCloud.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Row major rotation and translation of a frame pose.
+  struct Transform
+  {
+    float rot[9];
+    float pos[3];
+  };
+
+  /// \brief Get the transform of a frame, or the identity.
+  /// \param[in] _frame Frame with pose x, y, z, qw, qx, qy, qz.
+  /// \param[in] _world False for the identity.
+  Transform FrameTransform(const NpsBeamFrame &_frame, const bool _world)
+  {
+    Transform t = {{1, 0, 0, 0, 1, 0, 0, 0, 1}, {0, 0, 0}};
+    if (!_world)
+      return t;
+
+    const double *p = _frame.pose;
+    const double w = p[3];
+    const double x = p[4];
+    const double y = p[5];
+    const double z = p[6];
+    const double rot[9] = {
+      1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w),
+      2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w),
+      2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y)};
+    for (int i = 0; i < 9; ++i)
+      t.rot[i] = static_cast<float>(rot[i]);
+    for (int i = 0; i < 3; ++i)
+      t.pos[i] = static_cast<float>(p[i]);
+    return t;
+  }
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  /// \brief Transform four cells and append the finite ones.
+  ///
+  /// The transpose to x, y, z, intensity points and the compaction work
+  /// on four points at a time, so AVX2 builds use this path as well.
+  /// \return Number of points appended.
+  inline size_t BuildFour(const __m128 _range, const __m128 _intensity,
+      const __m128 _dx, const __m128 _dy, const __m128 _dz,
+      const Transform &_t, float *_out)
+  {
+    const __m128 sx = _mm_mul_ps(_range, _dx);
+    const __m128 sy = _mm_mul_ps(_range, _dy);
+    const __m128 sz = _mm_mul_ps(_range, _dz);
+
+    __m128 x = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(_t.rot[0]), sx),
+            _mm_mul_ps(_mm_set1_ps(_t.rot[1]), sy)),
+          _mm_mul_ps(_mm_set1_ps(_t.rot[2]), sz)), _mm_set1_ps(_t.pos[0]));
+    __m128 y = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(_t.rot[3]), sx),
+            _mm_mul_ps(_mm_set1_ps(_t.rot[4]), sy)),
+          _mm_mul_ps(_mm_set1_ps(_t.rot[5]), sz)), _mm_set1_ps(_t.pos[1]));
+    __m128 z = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_set1_ps(_t.rot[6]), sx),
+            _mm_mul_ps(_mm_set1_ps(_t.rot[7]), sy)),
+          _mm_mul_ps(_mm_set1_ps(_t.rot[8]), sz)), _mm_set1_ps(_t.pos[2]));
+    __m128 i = _intensity;
+
+    // r - r is 0 for finite ranges and NaN for infinities and NaN
+    const __m128 diff = _mm_sub_ps(_range, _range);
+    const int valid =
+      _mm_movemask_ps(_mm_cmpeq_ps(diff, _mm_setzero_ps()));
+
+    // Store every point and only advance past the valid ones
+    _MM_TRANSPOSE4_PS(x, y, z, i);
+    size_t n = 0;
+    _mm_storeu_ps(_out, x);
+    n += valid & 1;
+    _mm_storeu_ps(_out + n * 4, y);
+    n += (valid >> 1) & 1;
+    _mm_storeu_ps(_out + n * 4, z);
+    n += (valid >> 2) & 1;
+    _mm_storeu_ps(_out + n * 4, i);
+    n += (valid >> 3) & 1;
+    return n;
+  }
+#endif
+}
+
+//////////////////////////////////////////////////
+void NpsBeamPointCloud::Configure(const std::vector<double> &_angles,
+    const std::vector<double> &_verticalAngles)
+{
+  const size_t count = _angles.size() * _verticalAngles.size();
+  this->dirX.resize(count);
+  this->dirY.resize(count);
+  this->dirZ.resize(count);
+
+  size_t cell = 0;
+  for (const double pitch : _verticalAngles)
+  {
+    for (const double yaw : _angles)
+    {
+      this->dirX[cell] = static_cast<float>(std::cos(pitch) * std::cos(yaw));
+      this->dirY[cell] = static_cast<float>(std::cos(pitch) * std::sin(yaw));
+      this->dirZ[cell] = static_cast<float>(std::sin(pitch));
+      ++cell;
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamPointCloud::Count() const
+{
+  return this->dirX.size();
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamPointCloud::Build(const NpsBeamFrame &_frame, const bool _world,
+    float *_out) const
+{
+  const Transform t = FrameTransform(_frame, _world);
+  const size_t count = std::min(this->dirX.size(), _frame.ranges.size());
+  const float *ranges = _frame.ranges.data();
+  const float *intensities = _frame.intensities.data();
+  const float *dx = this->dirX.data();
+  const float *dy = this->dirY.data();
+  const float *dz = this->dirZ.data();
+
+  size_t points = 0;
+  size_t c = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  // BuildFour stores four points, so stop while that stays in bounds
+  for (; c + 4 <= count; c += 4)
+  {
+    points += BuildFour(_mm_loadu_ps(ranges + c),
+        _mm_loadu_ps(intensities + c), _mm_loadu_ps(dx + c),
+        _mm_loadu_ps(dy + c), _mm_loadu_ps(dz + c), t,
+        _out + points * PointStride);
+  }
+#endif
+
+  for (; c < count; ++c)
+  {
+    const float r = ranges[c];
+    if (!std::isfinite(r))
+      continue;
+
+    const float sx = r * dx[c];
+    const float sy = r * dy[c];
+    const float sz = r * dz[c];
+    float *point = _out + points * PointStride;
+    point[0] = t.rot[0] * sx + t.rot[1] * sy + t.rot[2] * sz + t.pos[0];
+    point[1] = t.rot[3] * sx + t.rot[4] * sy + t.rot[5] * sz + t.pos[1];
+    point[2] = t.rot[6] * sx + t.rot[7] * sy + t.rot[8] * sz + t.pos[2];
+    point[3] = intensities[c];
+    ++points;
+  }
+
+  return points;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_POINT_CLOUD_HH
+#define NPS_BEAM_POINT_CLOUD_HH
+
+#include <cstddef>
+#include <vector>
+
+#include "NpsBeamFrameStore.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Turns processed beam frames into 3D points.
+    ///
+    /// Configure stores the unit direction of every cell once per scan
+    /// geometry, as separate x, y and z arrays, so a frame costs a scale
+    /// by the range and one rigid transform per point and no
+    /// trigonometry. Cells whose range is not finite, i.e. masked below
+    /// the minimum or beyond the maximum range, are compacted away in the
+    /// same pass.
+    class NpsBeamPointCloud
+    {
+      /// \brief Floats per output point: x, y, z and intensity.
+      public: static const size_t PointStride = 4;
+
+      /// \brief Compute the cell directions.
+      /// \param[in] _angles Horizontal angle of each column.
+      /// \param[in] _verticalAngles Vertical angle of each row.
+      public: void Configure(const std::vector<double> &_angles,
+                  const std::vector<double> &_verticalAngles);
+
+      /// \brief Number of cells, i.e. the largest number of points.
+      /// \return Cell count.
+      public: size_t Count() const;
+
+      /// \brief Compute the points of a frame.
+      /// \param[in] _frame Processed frame with Count() cells.
+      /// \param[in] _world Transform the points by the frame pose into
+      /// the world frame, else keep them in the sensor frame.
+      /// \param[out] _out Room for Count() points of PointStride floats.
+      /// \return Number of points written.
+      public: size_t Build(const NpsBeamFrame &_frame, const bool _world,
+                  float *_out) const;
+
+      /// \brief X component of each cell direction.
+      private: std::vector<float> dirX;
+
+      /// \brief Y component of each cell direction.
+      private: std::vector<float> dirY;
+
+      /// \brief Z component of each cell direction.
+      private: std::vector<float> dirZ;
+    };
+  }
+}
+#endif
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "NpsBeamPointCloud.hh"
+#include "NpsBeamResampler.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Rotate a vector by a unit quaternion.
+  /// \param[in] _q Quaternion w, x, y, z.
+  /// \param[in] _v Vector, rotated in place.
+  void Rotate(const double _q[4], double _v[3])
+  {
+    const double w = _q[0];
+    const double x = _q[1];
+    const double y = _q[2];
+    const double z = _q[3];
+
+    // v + 2w (q x v) + 2 q x (q x v)
+    const double c[3] = {y * _v[2] - z * _v[1], z * _v[0] - x * _v[2],
+      x * _v[1] - y * _v[0]};
+    const double cc[3] = {y * c[2] - z * c[1], z * c[0] - x * c[2],
+      x * c[1] - y * c[0]};
+    for (int i = 0; i < 3; ++i)
+      _v[i] += 2 * w * c[i] + 2 * cc[i];
+  }
+
+  /// \brief Make a frame with a range and intensity per cell.
+  NpsBeamFrame MakeFrame(const unsigned int _width,
+      const unsigned int _height)
+  {
+    NpsBeamFrame frame;
+    frame.Resize(_width, _height);
+    for (size_t i = 0; i < frame.ranges.size(); ++i)
+    {
+      frame.ranges[i] = 1.0f + 0.25f * static_cast<float>(i % 13);
+      frame.intensities[i] = static_cast<float>(i);
+    }
+    return frame;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamPointCloud, SensorFrameDirections)
+{
+  const std::vector<double> angles = {-M_PI / 2, 0.0, M_PI / 2};
+  const std::vector<double> verticalAngles = {0.0, M_PI / 4};
+
+  NpsBeamPointCloud cloud;
+  cloud.Configure(angles, verticalAngles);
+  ASSERT_EQ(6u, cloud.Count());
+
+  NpsBeamFrame frame = MakeFrame(3, 2);
+  std::fill(frame.ranges.begin(), frame.ranges.end(), 2.0f);
+
+  std::vector<float> points(cloud.Count() * NpsBeamPointCloud::PointStride);
+  ASSERT_EQ(6u, cloud.Build(frame, false, points.data()));
+
+  // Row major cells, columns along the horizontal angles
+  const float h = static_cast<float>(std::sqrt(2.0));
+  const float expected[6][4] = {
+    {0, -2, 0, 0}, {2, 0, 0, 1}, {0, 2, 0, 2},
+    {0, -h, h, 3}, {h, 0, h, 4}, {0, h, h, 5}};
+  for (int p = 0; p < 6; ++p)
+  {
+    for (int k = 0; k < 4; ++k)
+    {
+      EXPECT_NEAR(expected[p][k],
+          points[p * NpsBeamPointCloud::PointStride + k], 1e-5)
+        << "point " << p << " field " << k;
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamPointCloud, NonFiniteCompacted)
+{
+  // Eleven cells cover the four wide path and the scalar tail
+  const unsigned int width = 11;
+  NpsBeamPointCloud cloud;
+  cloud.Configure(NpsBeamResampler::UniformAngles(-1.0, 1.0, width),
+      std::vector<double>(1, 0.0));
+
+  NpsBeamFrame frame = MakeFrame(width, 1);
+  const float inf = std::numeric_limits<float>::infinity();
+  frame.ranges[1] = NAN;
+  frame.ranges[2] = inf;
+  frame.ranges[3] = -inf;
+  frame.ranges[8] = inf;
+  frame.ranges[10] = NAN;
+
+  std::vector<float> points(cloud.Count() * NpsBeamPointCloud::PointStride,
+      -1.0f);
+  const size_t count = cloud.Build(frame, false, points.data());
+
+  // The intensity field holds the cell index of each point, in order
+  const std::vector<float> kept = {0, 4, 5, 6, 7, 9};
+  ASSERT_EQ(kept.size(), count);
+  for (size_t p = 0; p < count; ++p)
+  {
+    const float *point = &points[p * NpsBeamPointCloud::PointStride];
+    EXPECT_FLOAT_EQ(kept[p], point[3]);
+
+    const size_t c = static_cast<size_t>(kept[p]);
+    EXPECT_NEAR(frame.ranges[c], std::sqrt(point[0] * point[0] +
+          point[1] * point[1] + point[2] * point[2]), 1e-5);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamPointCloud, WorldTransform)
+{
+  const unsigned int width = 37;
+  const unsigned int height = 5;
+  const std::vector<double> angles =
+    NpsBeamResampler::UniformAngles(-1.2, 1.2, width);
+  const std::vector<double> verticalAngles =
+    NpsBeamResampler::UniformAngles(-0.3, 0.3, height);
+
+  NpsBeamPointCloud cloud;
+  cloud.Configure(angles, verticalAngles);
+
+  NpsBeamFrame frame = MakeFrame(width, height);
+
+  // Translated, yawed by 90 degrees and pitched by 30 degrees
+  const double yaw = M_PI / 4;
+  const double pitch = M_PI / 12;
+  const double q[4] = {std::cos(yaw) * std::cos(pitch),
+    -std::sin(yaw) * std::sin(pitch), std::cos(yaw) * std::sin(pitch),
+    std::sin(yaw) * std::cos(pitch)};
+  const double pos[3] = {1.0, -2.0, 3.5};
+  for (int i = 0; i < 3; ++i)
+    frame.pose[i] = pos[i];
+  for (int i = 0; i < 4; ++i)
+    frame.pose[3 + i] = q[i];
+
+  std::vector<float> sensorPoints(
+      cloud.Count() * NpsBeamPointCloud::PointStride);
+  std::vector<float> worldPoints(sensorPoints.size());
+  ASSERT_EQ(cloud.Count(), cloud.Build(frame, false, sensorPoints.data()));
+  ASSERT_EQ(cloud.Count(), cloud.Build(frame, true, worldPoints.data()));
+
+  for (unsigned int v = 0; v < height; ++v)
+  {
+    for (unsigned int h = 0; h < width; ++h)
+    {
+      const size_t c = v * width + h;
+      const double r = frame.ranges[c];
+      double point[3] = {
+        r * std::cos(verticalAngles[v]) * std::cos(angles[h]),
+        r * std::cos(verticalAngles[v]) * std::sin(angles[h]),
+        r * std::sin(verticalAngles[v])};
+
+      const float *sensor = &sensorPoints[c * NpsBeamPointCloud::PointStride];
+      for (int k = 0; k < 3; ++k)
+        EXPECT_NEAR(point[k], sensor[k], 1e-5) << "cell " << c;
+
+      Rotate(q, point);
+      const float *world = &worldPoints[c * NpsBeamPointCloud::PointStride];
+      for (int k = 0; k < 3; ++k)
+        EXPECT_NEAR(point[k] + pos[k], world[k], 1e-4) << "cell " << c;
+      EXPECT_FLOAT_EQ(frame.intensities[c], world[3]);
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamPointCloud, SmallerFrame)
+{
+  // A frame with fewer cells than the table only yields its own cells
+  NpsBeamPointCloud cloud;
+  cloud.Configure(NpsBeamResampler::UniformAngles(-1.0, 1.0, 8),
+      std::vector<double>(2, 0.0));
+  ASSERT_EQ(16u, cloud.Count());
+
+  const NpsBeamFrame frame = MakeFrame(8, 1);
+  std::vector<float> points(cloud.Count() * NpsBeamPointCloud::PointStride);
+  EXPECT_EQ(8u, cloud.Build(frame, true, points.data()));
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
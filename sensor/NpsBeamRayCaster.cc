@@ -0,0 +1,728 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#include "NpsBeamRayCaster.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Number of centroid bins per axis when splitting a node.
+  const unsigned int kBins = 12;
+
+  /// \brief Nodes with at most this many triangles are never split.
+  const uint32_t kMinLeafSize = 2;
+
+  /// \brief Deepest traversal stack.
+  const size_t kMaxDepth = 64;
+
+  /// \brief Packets per parallel chunk.
+  const size_t kPacketGrain = 64;
+
+#if defined(__SSE2__)
+  /// \brief Four packet lanes.
+  struct Float4
+  {
+    __m128 v;
+  };
+
+  /// \brief Per lane comparison result.
+  struct Mask4
+  {
+    __m128 v;
+  };
+
+  inline Float4 Set1(const float _a) { return {_mm_set1_ps(_a)}; }
+  inline Float4 operator+(const Float4 _a, const Float4 _b)
+  { return {_mm_add_ps(_a.v, _b.v)}; }
+  inline Float4 operator-(const Float4 _a, const Float4 _b)
+  { return {_mm_sub_ps(_a.v, _b.v)}; }
+  inline Float4 operator*(const Float4 _a, const Float4 _b)
+  { return {_mm_mul_ps(_a.v, _b.v)}; }
+  inline Float4 operator/(const Float4 _a, const Float4 _b)
+  { return {_mm_div_ps(_a.v, _b.v)}; }
+  inline Float4 Min(const Float4 _a, const Float4 _b)
+  { return {_mm_min_ps(_a.v, _b.v)}; }
+  inline Float4 Max(const Float4 _a, const Float4 _b)
+  { return {_mm_max_ps(_a.v, _b.v)}; }
+  inline Mask4 operator<(const Float4 _a, const Float4 _b)
+  { return {_mm_cmplt_ps(_a.v, _b.v)}; }
+  inline Mask4 operator<=(const Float4 _a, const Float4 _b)
+  { return {_mm_cmple_ps(_a.v, _b.v)}; }
+  inline Mask4 operator&(const Mask4 _a, const Mask4 _b)
+  { return {_mm_and_ps(_a.v, _b.v)}; }
+  inline int Bits(const Mask4 _m) { return _mm_movemask_ps(_m.v); }
+  inline Float4 Select(const Mask4 _m, const Float4 _a, const Float4 _b)
+  { return {_mm_or_ps(_mm_and_ps(_m.v, _a.v), _mm_andnot_ps(_m.v, _b.v))}; }
+  inline void Store(float *_out, const Float4 _a) { _mm_storeu_ps(_out, _a.v); }
+#else
+  /// \brief Four packet lanes.
+  struct Float4
+  {
+    float v[4];
+  };
+
+  /// \brief Per lane comparison result.
+  struct Mask4
+  {
+    bool v[4];
+  };
+
+  inline Float4 Set1(const float _a) { return {{_a, _a, _a, _a}}; }
+  #define NPS_BEAM_LANES(expr) \
+    Float4 r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r;
+  #define NPS_BEAM_MASK(expr) \
+    Mask4 r; for (int i = 0; i < 4; ++i) r.v[i] = (expr); return r;
+  inline Float4 operator+(const Float4 _a, const Float4 _b)
+  { NPS_BEAM_LANES(_a.v[i] + _b.v[i]) }
+  inline Float4 operator-(const Float4 _a, const Float4 _b)
+  { NPS_BEAM_LANES(_a.v[i] - _b.v[i]) }
+  inline Float4 operator*(const Float4 _a, const Float4 _b)
+  { NPS_BEAM_LANES(_a.v[i] * _b.v[i]) }
+  inline Float4 operator/(const Float4 _a, const Float4 _b)
+  { NPS_BEAM_LANES(_a.v[i] / _b.v[i]) }
+  inline Float4 Min(const Float4 _a, const Float4 _b)
+  { NPS_BEAM_LANES(_a.v[i] < _b.v[i] ? _a.v[i] : _b.v[i]) }
+  inline Float4 Max(const Float4 _a, const Float4 _b)
+  { NPS_BEAM_LANES(_a.v[i] > _b.v[i] ? _a.v[i] : _b.v[i]) }
+  inline Mask4 operator<(const Float4 _a, const Float4 _b)
+  { NPS_BEAM_MASK(_a.v[i] < _b.v[i]) }
+  inline Mask4 operator<=(const Float4 _a, const Float4 _b)
+  { NPS_BEAM_MASK(_a.v[i] <= _b.v[i]) }
+  inline Mask4 operator&(const Mask4 _a, const Mask4 _b)
+  { NPS_BEAM_MASK(_a.v[i] && _b.v[i]) }
+  inline Float4 Select(const Mask4 _m, const Float4 _a, const Float4 _b)
+  { NPS_BEAM_LANES(_m.v[i] ? _a.v[i] : _b.v[i]) }
+  #undef NPS_BEAM_LANES
+  #undef NPS_BEAM_MASK
+  inline int Bits(const Mask4 _m)
+  { return _m.v[0] | _m.v[1] << 1 | _m.v[2] << 2 | _m.v[3] << 3; }
+  inline void Store(float *_out, const Float4 _a)
+  { std::memcpy(_out, _a.v, sizeof(_a.v)); }
+#endif
+
+  /// \brief Half the surface area of a box.
+  inline float HalfArea(const float _min[3], const float _max[3])
+  {
+    const float x = _max[0] - _min[0];
+    const float y = _max[1] - _min[1];
+    const float z = _max[2] - _min[2];
+    return x * y + y * z + z * x;
+  }
+
+  /// \brief Grow a box to contain a point.
+  inline void Grow(float _min[3], float _max[3], const float _p[3])
+  {
+    for (int k = 0; k < 3; ++k)
+    {
+      _min[k] = std::min(_min[k], _p[k]);
+      _max[k] = std::max(_max[k], _p[k]);
+    }
+  }
+
+  /// \brief Reset a box to empty.
+  inline void Empty(float _min[3], float _max[3])
+  {
+    for (int k = 0; k < 3; ++k)
+    {
+      _min[k] = std::numeric_limits<float>::max();
+      _max[k] = -std::numeric_limits<float>::max();
+    }
+  }
+
+  /// \brief Apply a row major 3x4 transform to a point.
+  inline void TransformPoint(const float _t[12], const float _p[3],
+      float _out[3])
+  {
+    for (int k = 0; k < 3; ++k)
+    {
+      _out[k] = _t[4 * k] * _p[0] + _t[4 * k + 1] * _p[1] +
+        _t[4 * k + 2] * _p[2] + _t[4 * k + 3];
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamRayCaster::AddMesh(const std::vector<float> &_vertices,
+    const std::vector<uint32_t> &_indices, const float _retro)
+{
+  Mesh mesh;
+  mesh.local.reserve(_indices.size() * 3);
+  for (uint32_t index : _indices)
+  {
+    mesh.local.insert(mesh.local.end(), &_vertices[index * 3],
+        &_vertices[index * 3] + 3);
+  }
+
+  const float identity[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+  std::copy(identity, identity + 12, mesh.transform);
+  mesh.retro = _retro;
+  mesh.first = static_cast<uint32_t>(this->triangles.size());
+  mesh.moved = true;
+
+  const size_t count = _indices.size() / 3;
+  this->triangles.resize(this->triangles.size() + count);
+  this->retros.resize(this->retros.size() + count, _retro);
+
+  this->meshes.push_back(std::move(mesh));
+  return static_cast<unsigned int>(this->meshes.size() - 1);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::SetTransform(const unsigned int _mesh,
+    const float _transform[12])
+{
+  Mesh &mesh = this->meshes[_mesh];
+  if (!std::equal(_transform, _transform + 12, mesh.transform))
+  {
+    std::copy(_transform, _transform + 12, mesh.transform);
+    mesh.moved = true;
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::Clear()
+{
+  this->meshes.clear();
+  this->triangles.clear();
+  this->retros.clear();
+  this->order.clear();
+  this->nodes.clear();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::TransformMesh(const Mesh &_mesh)
+{
+  const size_t count = _mesh.local.size() / 9;
+  for (size_t i = 0; i < count; ++i)
+  {
+    float p0[3], p1[3], p2[3];
+    TransformPoint(_mesh.transform, &_mesh.local[i * 9], p0);
+    TransformPoint(_mesh.transform, &_mesh.local[i * 9 + 3], p1);
+    TransformPoint(_mesh.transform, &_mesh.local[i * 9 + 6], p2);
+
+    Triangle &tri = this->triangles[_mesh.first + i];
+    for (int k = 0; k < 3; ++k)
+    {
+      tri.v0[k] = p0[k];
+      tri.e1[k] = p1[k] - p0[k];
+      tri.e2[k] = p2[k] - p0[k];
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::LeafBounds(Node &_node) const
+{
+  Empty(_node.min, _node.max);
+  for (uint32_t i = _node.first; i < _node.first + _node.count; ++i)
+  {
+    const Triangle &tri = this->triangles[this->order[i]];
+    float p[3];
+    Grow(_node.min, _node.max, tri.v0);
+    for (int k = 0; k < 3; ++k)
+      p[k] = tri.v0[k] + tri.e1[k];
+    Grow(_node.min, _node.max, p);
+    for (int k = 0; k < 3; ++k)
+      p[k] = tri.v0[k] + tri.e2[k];
+    Grow(_node.min, _node.max, p);
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::Build()
+{
+  for (Mesh &mesh : this->meshes)
+  {
+    this->TransformMesh(mesh);
+    mesh.moved = false;
+  }
+
+  const uint32_t count = static_cast<uint32_t>(this->triangles.size());
+  this->order.resize(count);
+  std::iota(this->order.begin(), this->order.end(), 0u);
+  this->nodes.clear();
+  if (count == 0)
+    return;
+
+  std::vector<float> centroids(count * 3);
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    const Triangle &tri = this->triangles[i];
+    for (int k = 0; k < 3; ++k)
+    {
+      centroids[i * 3 + k] =
+        tri.v0[k] + (tri.e1[k] + tri.e2[k]) / 3.0f;
+    }
+  }
+
+  this->nodes.reserve(2 * count);
+  Node root;
+  root.first = 0;
+  root.count = count;
+  this->LeafBounds(root);
+  this->nodes.push_back(root);
+  this->Subdivide(0, centroids);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::Subdivide(const uint32_t _node,
+    const std::vector<float> &_centroids)
+{
+  std::vector<uint32_t> pending(1, _node);
+  while (!pending.empty())
+  {
+    const uint32_t index = pending.back();
+    pending.pop_back();
+
+    const uint32_t first = this->nodes[index].first;
+    const uint32_t count = this->nodes[index].count;
+    if (count <= kMinLeafSize)
+      continue;
+
+    float cmin[3], cmax[3];
+    Empty(cmin, cmax);
+    for (uint32_t i = first; i < first + count; ++i)
+      Grow(cmin, cmax, &_centroids[this->order[i] * 3]);
+
+    // Evaluate the binned surface area heuristic on every axis
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    unsigned int bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      const float extent = cmax[axis] - cmin[axis];
+      if (extent <= 0)
+        continue;
+      const float scale = kBins / extent;
+
+      float binMin[kBins][3], binMax[kBins][3];
+      uint32_t binCount[kBins] = {0};
+      for (unsigned int b = 0; b < kBins; ++b)
+        Empty(binMin[b], binMax[b]);
+
+      for (uint32_t i = first; i < first + count; ++i)
+      {
+        const uint32_t tri = this->order[i];
+        const unsigned int b = std::min(kBins - 1, static_cast<unsigned int>(
+              (_centroids[tri * 3 + axis] - cmin[axis]) * scale));
+        ++binCount[b];
+        const Triangle &t = this->triangles[tri];
+        float p[3];
+        Grow(binMin[b], binMax[b], t.v0);
+        for (int k = 0; k < 3; ++k)
+          p[k] = t.v0[k] + t.e1[k];
+        Grow(binMin[b], binMax[b], p);
+        for (int k = 0; k < 3; ++k)
+          p[k] = t.v0[k] + t.e2[k];
+        Grow(binMin[b], binMax[b], p);
+      }
+
+      // Sweep from the right, then from the left to price each plane
+      float rightArea[kBins];
+      uint32_t rightCount[kBins];
+      float boxMin[3], boxMax[3];
+      Empty(boxMin, boxMax);
+      uint32_t sum = 0;
+      for (unsigned int b = kBins - 1; b > 0; --b)
+      {
+        if (binCount[b])
+        {
+          Grow(boxMin, boxMax, binMin[b]);
+          Grow(boxMin, boxMax, binMax[b]);
+        }
+        sum += binCount[b];
+        rightArea[b] = sum ? HalfArea(boxMin, boxMax) : 0.0f;
+        rightCount[b] = sum;
+      }
+
+      Empty(boxMin, boxMax);
+      sum = 0;
+      for (unsigned int b = 0; b + 1 < kBins; ++b)
+      {
+        if (binCount[b])
+        {
+          Grow(boxMin, boxMax, binMin[b]);
+          Grow(boxMin, boxMax, binMax[b]);
+        }
+        sum += binCount[b];
+        if (!sum || !rightCount[b + 1])
+          continue;
+        const float cost = sum * HalfArea(boxMin, boxMax) +
+          rightCount[b + 1] * rightArea[b + 1];
+        if (cost < bestCost)
+        {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = b + 1;
+        }
+      }
+    }
+
+    Node &node = this->nodes[index];
+    if (bestAxis < 0 || bestCost >= count * HalfArea(node.min, node.max))
+      continue;
+
+    const float splitMin = cmin[bestAxis];
+    const float splitScale = kBins / (cmax[bestAxis] - cmin[bestAxis]);
+    uint32_t *mid = std::partition(&this->order[first],
+        &this->order[first] + count,
+        [&](const uint32_t _tri)
+        {
+          return std::min(kBins - 1, static_cast<unsigned int>(
+                (_centroids[_tri * 3 + bestAxis] - splitMin) * splitScale)) <
+            bestSplit;
+        });
+    const uint32_t leftCount =
+      static_cast<uint32_t>(mid - &this->order[first]);
+    if (leftCount == 0 || leftCount == count)
+      continue;
+
+    const uint32_t left = static_cast<uint32_t>(this->nodes.size());
+    Node child;
+    child.first = first;
+    child.count = leftCount;
+    this->LeafBounds(child);
+    this->nodes.push_back(child);
+    child.first = first + leftCount;
+    child.count = count - leftCount;
+    this->LeafBounds(child);
+    this->nodes.push_back(child);
+
+    this->nodes[index].first = left;
+    this->nodes[index].count = 0;
+    pending.push_back(left);
+    pending.push_back(left + 1);
+  }
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRayCaster::Refit()
+{
+  bool moved = false;
+  for (Mesh &mesh : this->meshes)
+  {
+    if (mesh.moved)
+    {
+      this->TransformMesh(mesh);
+      mesh.moved = false;
+      moved = true;
+    }
+  }
+  if (!moved)
+    return false;
+
+  // Children always come after their parent
+  for (size_t i = this->nodes.size(); i-- > 0;)
+  {
+    Node &node = this->nodes[i];
+    if (node.count)
+    {
+      this->LeafBounds(node);
+      continue;
+    }
+
+    const Node &left = this->nodes[node.first];
+    const Node &right = this->nodes[node.first + 1];
+    for (int k = 0; k < 3; ++k)
+    {
+      node.min[k] = std::min(left.min[k], right.min[k]);
+      node.max[k] = std::max(left.max[k], right.max[k]);
+    }
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::Cast(const float _origin[3],
+    const float _rotation[9], const float *_directions, const size_t _count,
+    const float _rangeMin, const float _rangeMax, float *_out,
+    const size_t _stride, NpsBeamWorkerPool *_pool) const
+{
+  const size_t packets = (_count + 3) / 4;
+  if (_pool)
+  {
+    _pool->ParallelFor(packets, kPacketGrain,
+        [&](const size_t _begin, const size_t _end)
+        {
+          this->CastPackets(_origin, _rotation, _directions, _count,
+              _rangeMin, _rangeMax, _out, _stride, _begin, _end);
+        });
+  }
+  else
+  {
+    this->CastPackets(_origin, _rotation, _directions, _count, _rangeMin,
+        _rangeMax, _out, _stride, 0, packets);
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::CastPackets(const float _origin[3],
+    const float _rotation[9], const float *_directions, const size_t _count,
+    const float _rangeMin, const float _rangeMax, float *_out,
+    const size_t _stride, const size_t _begin, const size_t _end) const
+{
+  const Float4 ox = Set1(_origin[0]);
+  const Float4 oy = Set1(_origin[1]);
+  const Float4 oz = Set1(_origin[2]);
+  const Float4 one = Set1(1.0f);
+  const Float4 zero = Set1(0.0f);
+  const Float4 tmin = Set1(_rangeMin);
+  const Node *nodes = this->nodes.data();
+
+  for (size_t packet = _begin; packet < _end; ++packet)
+  {
+    // Rotate the four directions into the world, repeating the last ray
+    // to fill a partial packet
+    float dir[3][4];
+    for (int lane = 0; lane < 4; ++lane)
+    {
+      const float *d =
+        &_directions[std::min(packet * 4 + lane, _count - 1) * 3];
+      for (int k = 0; k < 3; ++k)
+      {
+        dir[k][lane] = _rotation[k * 3] * d[0] + _rotation[k * 3 + 1] * d[1] +
+          _rotation[k * 3 + 2] * d[2];
+      }
+    }
+
+    Float4 dx, dy, dz;
+    std::memcpy(&dx, dir[0], sizeof(dx));
+    std::memcpy(&dy, dir[1], sizeof(dy));
+    std::memcpy(&dz, dir[2], sizeof(dz));
+    const Float4 ix = one / dx;
+    const Float4 iy = one / dy;
+    const Float4 iz = one / dz;
+
+    Float4 best = Set1(_rangeMax);
+    Float4 retro = zero;
+
+    uint32_t stack[kMaxDepth];
+    size_t depth = 0;
+    if (!this->nodes.empty())
+      stack[depth++] = 0;
+
+    while (depth)
+    {
+      const Node &node = nodes[stack[--depth]];
+
+      const Float4 t1x = (Set1(node.min[0]) - ox) * ix;
+      const Float4 t2x = (Set1(node.max[0]) - ox) * ix;
+      const Float4 t1y = (Set1(node.min[1]) - oy) * iy;
+      const Float4 t2y = (Set1(node.max[1]) - oy) * iy;
+      const Float4 t1z = (Set1(node.min[2]) - oz) * iz;
+      const Float4 t2z = (Set1(node.max[2]) - oz) * iz;
+      const Float4 tnear = Max(Max(Min(t1x, t2x), Min(t1y, t2y)),
+          Max(Min(t1z, t2z), tmin));
+      const Float4 tfar = Min(Min(Max(t1x, t2x), Max(t1y, t2y)),
+          Min(Max(t1z, t2z), best));
+      if (!Bits(tnear <= tfar))
+        continue;
+
+      if (!node.count)
+      {
+        // Visit the child nearer along the first ray first
+        const Node &left = nodes[node.first];
+        const Node &right = nodes[node.first + 1];
+        int axis = 0;
+        float extent = -1;
+        for (int k = 0; k < 3; ++k)
+        {
+          const float e = std::fabs(left.min[k] + left.max[k] -
+              right.min[k] - right.max[k]);
+          if (e > extent)
+          {
+            extent = e;
+            axis = k;
+          }
+        }
+        const bool leftFirst = (left.min[axis] + left.max[axis] <
+            right.min[axis] + right.max[axis]) == (dir[axis][0] >= 0);
+        if (depth + 2 > kMaxDepth)
+          continue;
+        stack[depth++] = leftFirst ? node.first + 1 : node.first;
+        stack[depth++] = leftFirst ? node.first : node.first + 1;
+        continue;
+      }
+
+      for (uint32_t i = node.first; i < node.first + node.count; ++i)
+      {
+        const uint32_t index = this->order[i];
+        const Triangle &tri = this->triangles[index];
+
+        // Moller-Trumbore; terms that only depend on the shared origin
+        // and the triangle are computed once for the packet
+        const float tv[3] = {_origin[0] - tri.v0[0], _origin[1] - tri.v0[1],
+          _origin[2] - tri.v0[2]};
+        const float q[3] = {tv[1] * tri.e1[2] - tv[2] * tri.e1[1],
+          tv[2] * tri.e1[0] - tv[0] * tri.e1[2],
+          tv[0] * tri.e1[1] - tv[1] * tri.e1[0]};
+        const float tnum =
+          tri.e2[0] * q[0] + tri.e2[1] * q[1] + tri.e2[2] * q[2];
+
+        const Float4 px = dy * Set1(tri.e2[2]) - dz * Set1(tri.e2[1]);
+        const Float4 py = dz * Set1(tri.e2[0]) - dx * Set1(tri.e2[2]);
+        const Float4 pz = dx * Set1(tri.e2[1]) - dy * Set1(tri.e2[0]);
+        const Float4 det = Set1(tri.e1[0]) * px + Set1(tri.e1[1]) * py +
+          Set1(tri.e1[2]) * pz;
+        const Float4 inv = one / det;
+        const Float4 u = (Set1(tv[0]) * px + Set1(tv[1]) * py +
+            Set1(tv[2]) * pz) * inv;
+        const Float4 v = (dx * Set1(q[0]) + dy * Set1(q[1]) +
+            dz * Set1(q[2])) * inv;
+        const Float4 t = Set1(tnum) * inv;
+
+        const Mask4 hit = (zero <= u) & (zero <= v) & (u + v <= one) &
+          (tmin <= t) & (t < best);
+        if (Bits(hit))
+        {
+          best = Select(hit, t, best);
+          retro = Select(hit, Set1(this->retros[index]), retro);
+        }
+      }
+    }
+
+    float ranges[4], retros[4];
+    Store(ranges, best);
+    Store(retros, retro);
+    for (size_t lane = 0; lane < 4 && packet * 4 + lane < _count; ++lane)
+    {
+      float *cell = _out + (packet * 4 + lane) * _stride;
+      cell[0] = ranges[lane] < _rangeMax ?
+        ranges[lane] : std::numeric_limits<float>::infinity();
+      cell[1] = retros[lane];
+      std::fill(cell + 2, cell + _stride, 0.0f);
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamRayCaster::TriangleCount() const
+{
+  return this->triangles.size();
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamRayCaster::NodeCount() const
+{
+  return this->nodes.size();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::MakeBox(const float _x, const float _y,
+    const float _z, std::vector<float> &_vertices,
+    std::vector<uint32_t> &_indices)
+{
+  const uint32_t base = static_cast<uint32_t>(_vertices.size() / 3);
+  for (int i = 0; i < 8; ++i)
+  {
+    _vertices.push_back((i & 1 ? 0.5f : -0.5f) * _x);
+    _vertices.push_back((i & 2 ? 0.5f : -0.5f) * _y);
+    _vertices.push_back((i & 4 ? 0.5f : -0.5f) * _z);
+  }
+
+  static const uint32_t faces[36] = {
+    0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,
+    0, 1, 4, 1, 5, 4,  2, 6, 3, 3, 6, 7,
+    0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5};
+  for (uint32_t index : faces)
+    _indices.push_back(base + index);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::MakeSphere(const float _radius,
+    const unsigned int _segments, std::vector<float> &_vertices,
+    std::vector<uint32_t> &_indices)
+{
+  const uint32_t base = static_cast<uint32_t>(_vertices.size() / 3);
+  const unsigned int segments = std::max(3u, _segments);
+  const unsigned int rings = std::max(2u, segments / 2);
+
+  for (unsigned int r = 0; r <= rings; ++r)
+  {
+    const float polar = static_cast<float>(M_PI) * r / rings;
+    for (unsigned int s = 0; s < segments; ++s)
+    {
+      const float azimuth = 2.0f * static_cast<float>(M_PI) * s / segments;
+      _vertices.push_back(_radius * std::sin(polar) * std::cos(azimuth));
+      _vertices.push_back(_radius * std::sin(polar) * std::sin(azimuth));
+      _vertices.push_back(_radius * std::cos(polar));
+    }
+  }
+
+  for (unsigned int r = 0; r < rings; ++r)
+  {
+    for (unsigned int s = 0; s < segments; ++s)
+    {
+      const uint32_t a = base + r * segments + s;
+      const uint32_t b = base + r * segments + (s + 1) % segments;
+      const uint32_t c = a + segments;
+      const uint32_t d = b + segments;
+      if (r > 0)
+        _indices.insert(_indices.end(), {a, c, b});
+      if (r + 1 < rings)
+        _indices.insert(_indices.end(), {b, c, d});
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRayCaster::MakeCylinder(const float _radius,
+    const float _length, const unsigned int _segments,
+    std::vector<float> &_vertices, std::vector<uint32_t> &_indices)
+{
+  const uint32_t base = static_cast<uint32_t>(_vertices.size() / 3);
+  const unsigned int segments = std::max(3u, _segments);
+
+  // Two rim rings followed by the two cap centers
+  for (int end = 0; end < 2; ++end)
+  {
+    for (unsigned int s = 0; s < segments; ++s)
+    {
+      const float azimuth = 2.0f * static_cast<float>(M_PI) * s / segments;
+      _vertices.push_back(_radius * std::cos(azimuth));
+      _vertices.push_back(_radius * std::sin(azimuth));
+      _vertices.push_back((end ? 0.5f : -0.5f) * _length);
+    }
+  }
+  _vertices.insert(_vertices.end(), {0, 0, -0.5f * _length});
+  _vertices.insert(_vertices.end(), {0, 0, 0.5f * _length});
+
+  const uint32_t bottom = base + 2 * segments;
+  const uint32_t top = bottom + 1;
+  for (unsigned int s = 0; s < segments; ++s)
+  {
+    const uint32_t a = base + s;
+    const uint32_t b = base + (s + 1) % segments;
+    const uint32_t c = a + segments;
+    const uint32_t d = b + segments;
+    _indices.insert(_indices.end(), {a, b, c, b, d, c});
+    _indices.insert(_indices.end(), {bottom, b, a});
+    _indices.insert(_indices.end(), {top, c, d});
+  }
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_RAY_CASTER_HH
+#define NPS_BEAM_RAY_CASTER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamWorkerPool;
+
+    /// \brief CPU ray caster over a bounding volume hierarchy of triangle
+    /// meshes.
+    ///
+    /// Meshes are added once in their local frame and placed with a
+    /// transform. Build creates the hierarchy with a binned surface area
+    /// heuristic; when meshes move, SetTransform followed by Refit updates
+    /// the triangles and node bounds without rebuilding the topology.
+    ///
+    /// Cast traces a fan of rays sharing one origin, four rays per SIMD
+    /// packet, and writes the interleaved (range, retro, 0) layout that
+    /// GpuLaser delivers, so the output can go through the same
+    /// post-render path.
+    class NpsBeamRayCaster
+    {
+      /// \brief Add a triangle mesh.
+      /// \param[in] _vertices Vertex positions as x, y, z triples in the
+      /// mesh frame.
+      /// \param[in] _indices Three vertex indices per triangle.
+      /// \param[in] _retro Laser retro value reported for hits.
+      /// \return Mesh id for SetTransform.
+      public: unsigned int AddMesh(const std::vector<float> &_vertices,
+                  const std::vector<uint32_t> &_indices, const float _retro);
+
+      /// \brief Place a mesh in the world.
+      /// \param[in] _mesh Mesh id returned by AddMesh.
+      /// \param[in] _transform Row major 3x4 transform from the mesh frame
+      /// to the world frame.
+      public: void SetTransform(const unsigned int _mesh,
+                  const float _transform[12]);
+
+      /// \brief Remove every mesh.
+      public: void Clear();
+
+      /// \brief Build the hierarchy over the current mesh placements.
+      public: void Build();
+
+      /// \brief Update triangles and bounds of meshes moved since the last
+      /// Build or Refit.
+      /// \return False if nothing moved.
+      public: bool Refit();
+
+      /// \brief Trace a fan of rays from a common origin.
+      /// \param[in] _origin Ray origin in the world frame.
+      /// \param[in] _rotation Row major 3x3 rotation applied to
+      /// _directions.
+      /// \param[in] _directions Unit ray directions as x, y, z triples in
+      /// the sensor frame.
+      /// \param[in] _count Number of rays.
+      /// \param[in] _rangeMin Hits closer than this are ignored, like the
+      /// near clip plane of the laser camera.
+      /// \param[in] _rangeMax Farthest range traced.
+      /// \param[out] _out _count cells of _stride floats: range (+inf on
+      /// a miss), retro, then zeros.
+      /// \param[in] _stride Floats per output cell, at least 2.
+      /// \param[in] _pool Pool to spread packets over, or null to run on
+      /// the calling thread.
+      public: void Cast(const float _origin[3], const float _rotation[9],
+                  const float *_directions, const size_t _count,
+                  const float _rangeMin, const float _rangeMax, float *_out,
+                  const size_t _stride, NpsBeamWorkerPool *_pool) const;
+
+      /// \brief Number of triangles.
+      /// \return Triangle count.
+      public: size_t TriangleCount() const;
+
+      /// \brief Number of hierarchy nodes.
+      /// \return Node count.
+      public: size_t NodeCount() const;
+
+      /// \brief Append a box centered on the origin to a mesh.
+      /// \param[in] _x Size along x.
+      /// \param[in] _y Size along y.
+      /// \param[in] _z Size along z.
+      /// \param[in,out] _vertices Vertex positions.
+      /// \param[in,out] _indices Triangle indices.
+      public: static void MakeBox(const float _x, const float _y,
+                  const float _z, std::vector<float> &_vertices,
+                  std::vector<uint32_t> &_indices);
+
+      /// \brief Append a sphere centered on the origin to a mesh.
+      /// \param[in] _radius Sphere radius.
+      /// \param[in] _segments Segments around the z axis; half as many
+      /// rings are used.
+      /// \param[in,out] _vertices Vertex positions.
+      /// \param[in,out] _indices Triangle indices.
+      public: static void MakeSphere(const float _radius,
+                  const unsigned int _segments, std::vector<float> &_vertices,
+                  std::vector<uint32_t> &_indices);
+
+      /// \brief Append a closed cylinder along z, centered on the origin,
+      /// to a mesh.
+      /// \param[in] _radius Cylinder radius.
+      /// \param[in] _length Cylinder length.
+      /// \param[in] _segments Segments around the z axis.
+      /// \param[in,out] _vertices Vertex positions.
+      /// \param[in,out] _indices Triangle indices.
+      public: static void MakeCylinder(const float _radius,
+                  const float _length, const unsigned int _segments,
+                  std::vector<float> &_vertices,
+                  std::vector<uint32_t> &_indices);
+
+      /// \brief Mesh instance.
+      private: struct Mesh
+      {
+        /// \brief Triangle corners in the mesh frame, 9 floats each.
+        std::vector<float> local;
+
+        /// \brief Row major 3x4 mesh to world transform.
+        float transform[12];
+
+        /// \brief Retro value of hits.
+        float retro;
+
+        /// \brief Index of the first triangle in triangles.
+        uint32_t first;
+
+        /// \brief True if the transform changed since the last refit.
+        bool moved;
+      };
+
+      /// \brief World space triangle, stored as a corner and two edges.
+      private: struct Triangle
+      {
+        /// \brief First corner.
+        float v0[3];
+
+        /// \brief Second corner minus the first.
+        float e1[3];
+
+        /// \brief Third corner minus the first.
+        float e2[3];
+      };
+
+      /// \brief Hierarchy node. Leaves have a non zero count of triangles
+      /// starting at first in order; inner nodes have children first and
+      /// first + 1.
+      private: struct Node
+      {
+        /// \brief Bounds minimum.
+        float min[3];
+
+        /// \brief First triangle or left child.
+        uint32_t first;
+
+        /// \brief Bounds maximum.
+        float max[3];
+
+        /// \brief Number of triangles, 0 for inner nodes.
+        uint32_t count;
+      };
+
+      /// \brief Transform the triangles of a mesh into the world.
+      private: void TransformMesh(const Mesh &_mesh);
+
+      /// \brief Split a node with the binned surface area heuristic.
+      private: void Subdivide(const uint32_t _node,
+                   const std::vector<float> &_centroids);
+
+      /// \brief Recompute the bounds of a leaf from its triangles.
+      private: void LeafBounds(Node &_node) const;
+
+      /// \brief Trace a range of four ray packets.
+      private: void CastPackets(const float _origin[3],
+                   const float _rotation[9], const float *_directions,
+                   const size_t _count, const float _rangeMin,
+                   const float _rangeMax, float *_out, const size_t _stride,
+                   const size_t _begin, const size_t _end) const;
+
+      /// \brief Mesh instances.
+      private: std::vector<Mesh> meshes;
+
+      /// \brief World space triangles of all meshes.
+      private: std::vector<Triangle> triangles;
+
+      /// \brief Retro value of each triangle.
+      private: std::vector<float> retros;
+
+      /// \brief Triangle indices in leaf order.
+      private: std::vector<uint32_t> order;
+
+      /// \brief Hierarchy nodes, the root first and children after their
+      /// parents.
+      private: std::vector<Node> nodes;
+    };
+  }
+}
+#endif
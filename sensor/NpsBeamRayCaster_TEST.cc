@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "NpsBeamRayCaster.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  const float kIdentity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+
+  /// \brief Unit directions fanning over the full sphere.
+  std::vector<float> SphereFan(const unsigned int _width,
+      const unsigned int _height)
+  {
+    std::vector<float> directions(static_cast<size_t>(_width) * _height * 3);
+    for (unsigned int v = 0; v < _height; ++v)
+    {
+      const double pitch = -1.4 + 2.8 * v / std::max(1u, _height - 1);
+      for (unsigned int h = 0; h < _width; ++h)
+      {
+        const double yaw = -M_PI + 2 * M_PI * h / _width;
+        float *dir = &directions[(static_cast<size_t>(v) * _width + h) * 3];
+        dir[0] = std::cos(pitch) * std::cos(yaw);
+        dir[1] = std::cos(pitch) * std::sin(yaw);
+        dir[2] = std::sin(pitch);
+      }
+    }
+    return directions;
+  }
+
+  /// \brief Cast a single ray and return its range.
+  float CastOne(const NpsBeamRayCaster &_caster, const float _origin[3],
+      const float _direction[3], const float _rangeMin = 0.1f,
+      const float _rangeMax = 100.0f, const float *_rotation = kIdentity)
+  {
+    float out[3];
+    _caster.Cast(_origin, _rotation, _direction, 1, _rangeMin, _rangeMax,
+        out, 3, nullptr);
+    return out[0];
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamRayCaster, ClosedRoomIsExact)
+{
+  const float halfRoom = 10.0f;
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  NpsBeamRayCaster::MakeBox(2 * halfRoom, 2 * halfRoom, 2 * halfRoom,
+      vertices, indices);
+  NpsBeamRayCaster caster;
+  caster.AddMesh(vertices, indices, 1.0f);
+  caster.Build();
+  EXPECT_EQ(12u, caster.TriangleCount());
+
+  // A width that is not a multiple of the packet size
+  const unsigned int width = 181;
+  const unsigned int height = 16;
+  const size_t count = static_cast<size_t>(width) * height;
+  const std::vector<float> directions = SphereFan(width, height);
+  const float origin[3] = {0.1f, -0.2f, 0.05f};
+
+  NpsBeamWorkerPool pool(3);
+  for (NpsBeamWorkerPool *castPool :
+      {&pool, static_cast<NpsBeamWorkerPool *>(nullptr)})
+  {
+    std::vector<float> out(count * 3, -1.0f);
+    caster.Cast(origin, kIdentity, directions.data(), count, 0.1f, 100.0f,
+        out.data(), 3, castPool);
+
+    double maxError = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      double expected = HUGE_VAL;
+      for (int k = 0; k < 3; ++k)
+      {
+        const double d = directions[i * 3 + k];
+        if (d != 0)
+        {
+          expected = std::min(expected,
+              ((d > 0 ? halfRoom : -halfRoom) - origin[k]) / d);
+        }
+      }
+      maxError = std::max(maxError, std::fabs(out[i * 3] - expected));
+      EXPECT_FLOAT_EQ(1.0f, out[i * 3 + 1]);
+      EXPECT_FLOAT_EQ(0.0f, out[i * 3 + 2]);
+    }
+    EXPECT_LT(maxError, 1e-4);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamRayCaster, RangeLimits)
+{
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  NpsBeamRayCaster::MakeBox(20, 20, 20, vertices, indices);
+  NpsBeamRayCaster caster;
+  caster.AddMesh(vertices, indices, 1.0f);
+  caster.Build();
+
+  const float origin[3] = {0, 0, 0};
+  const float forward[3] = {1, 0, 0};
+  const float inf = std::numeric_limits<float>::infinity();
+  EXPECT_NEAR(10.0f, CastOne(caster, origin, forward), 1e-5);
+
+  // Walls beyond the maximum range or before the minimum range are missed
+  EXPECT_EQ(inf, CastOne(caster, origin, forward, 0.1f, 5.0f));
+  EXPECT_EQ(inf, CastOne(caster, origin, forward, 15.0f, 100.0f));
+
+  // Nothing to hit at all
+  NpsBeamRayCaster empty;
+  empty.Build();
+  EXPECT_EQ(inf, CastOne(empty, origin, forward));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamRayCaster, SphereAndRefit)
+{
+  const float radius = 1.0f;
+  const unsigned int segments = 24;
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  NpsBeamRayCaster::MakeSphere(radius, segments, vertices, indices);
+
+  NpsBeamRayCaster caster;
+  const unsigned int mesh = caster.AddMesh(vertices, indices, 2.0f);
+  const float transform[12] = {1, 0, 0, 5, 0, 1, 0, 0, 0, 0, 1, 0};
+  caster.SetTransform(mesh, transform);
+  caster.Build();
+
+  // The tessellated surface lies between the inscribed and the true sphere
+  const double sag = radius * (1 - std::cos(M_PI / segments));
+  const float origin[3] = {0, 0, 0};
+  const float forward[3] = {1, 0, 0};
+  const float backward[3] = {-1, 0, 0};
+  float out[3];
+  caster.Cast(origin, kIdentity, forward, 1, 0.1f, 100.0f, out, 3,
+      nullptr);
+  EXPECT_GE(out[0], 4.0f - 1e-5);
+  EXPECT_LE(out[0], 4.0f + sag * 2 + 1e-5);
+  EXPECT_FLOAT_EQ(2.0f, out[1]);
+  EXPECT_EQ(std::numeric_limits<float>::infinity(),
+      CastOne(caster, origin, backward));
+
+  // The rotation turns the backward ray onto the sphere
+  const float turn[9] = {-1, 0, 0, 0, -1, 0, 0, 0, 1};
+  EXPECT_NEAR(out[0], CastOne(caster, origin, backward, 0.1f, 100.0f, turn),
+      1e-5);
+
+  // Move the sphere behind the sensor
+  const float moved[12] = {1, 0, 0, -8, 0, 1, 0, 0, 0, 0, 1, 0};
+  caster.SetTransform(mesh, moved);
+  EXPECT_TRUE(caster.Refit());
+  EXPECT_FALSE(caster.Refit());
+  EXPECT_EQ(std::numeric_limits<float>::infinity(),
+      CastOne(caster, origin, forward));
+  EXPECT_NEAR(out[0] + 3.0f, CastOne(caster, origin, backward), 1e-4);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
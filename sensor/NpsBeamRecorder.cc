@@ -0,0 +1,667 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include "NpsBeamRecorder.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Identifies a beam recording.
+  const char kMagic[8] = {'N', 'P', 'S', 'B', 'R', 'E', 'C', '1'};
+
+  /// \brief Identifies a chunk of a beam recording.
+  const char kChunkMagic[8] = {'N', 'P', 'S', 'B', 'C', 'H', 'K', '1'};
+
+  /// \brief Identifies a frame record.
+  const uint32_t kRecordMagic = 0x4652424e;
+
+  /// \brief File format version, bumped on incompatible changes.
+  const uint32_t kVersion = 1;
+
+  /// \brief File header, at the start of the first page.
+  struct FileHeader
+  {
+    /// \brief kMagic.
+    char magic[8];
+
+    /// \brief kVersion.
+    uint32_t version;
+
+    /// \brief File offset of the first chunk.
+    uint32_t dataOffset;
+
+    /// \brief File offset of the index, 0 until the file is closed.
+    uint64_t indexOffset;
+
+    /// \brief Number of index entries.
+    uint64_t indexCount;
+  };
+
+  /// \brief Chunk header, followed by frame records.
+  struct ChunkHeader
+  {
+    /// \brief kChunkMagic.
+    char magic[8];
+
+    /// \brief Chunk size in bytes, including this header.
+    uint64_t size;
+
+    /// \brief Bytes of the chunk holding complete records, including
+    /// this header; updated after every record.
+    uint64_t used;
+
+    /// \brief Unused.
+    uint64_t reserved;
+  };
+
+  /// \brief Record header, followed by the ranges and then the
+  /// intensities of the frame.
+  struct RecordHeader
+  {
+    /// \brief kRecordMagic.
+    uint32_t magic;
+
+    /// \brief Number of horizontal cells.
+    uint32_t width;
+
+    /// \brief Number of vertical cells.
+    uint32_t height;
+
+    /// \brief Measurement time, seconds part.
+    int32_t sec;
+
+    /// \brief Measurement time, nanoseconds part.
+    int32_t nsec;
+
+    /// \brief Unused.
+    uint32_t reserved;
+
+    /// \brief Frame sequence.
+    uint64_t sequence;
+
+    /// \brief Record size in bytes, including this header.
+    uint64_t size;
+
+    /// \brief Sensor world pose as x, y, z, qw, qx, qy, qz.
+    double pose[7];
+
+    /// \brief Horizontal angle min, max and step, vertical angle min,
+    /// max and step, and range min and max.
+    double geometry[8];
+  };
+
+  /// \brief Round up to a multiple.
+  /// \param[in] _value Value to round.
+  /// \param[in] _multiple Multiple to round to.
+  /// \return Rounded value.
+  uint64_t RoundUp(const uint64_t _value, const uint64_t _multiple)
+  {
+    return (_value + _multiple - 1) / _multiple * _multiple;
+  }
+
+  /// \brief Size of the record of a frame.
+  /// \param[in] _cells Number of cells.
+  /// \return Record size in bytes.
+  size_t RecordSize(const size_t _cells)
+  {
+    return RoundUp(sizeof(RecordHeader) + 2 * _cells * sizeof(float), 8);
+  }
+
+  /// \brief Stamp of a frame in nanoseconds.
+  /// \param[in] _sec Seconds part.
+  /// \param[in] _nsec Nanoseconds part.
+  /// \return Nanoseconds.
+  int64_t StampNs(const int32_t _sec, const int32_t _nsec)
+  {
+    return static_cast<int64_t>(_sec) * 1000000000 + _nsec;
+  }
+
+  /// \brief Order index entries by stamp.
+  bool EarlierStamp(const NpsBeamRecordEntry &_a,
+      const NpsBeamRecordEntry &_b)
+  {
+    return _a.stamp < _b.stamp;
+  }
+
+  /// \brief Write a whole buffer at an offset.
+  /// \param[in] _fd File descriptor.
+  /// \param[in] _data Buffer.
+  /// \param[in] _size Buffer size.
+  /// \param[in] _offset File offset.
+  /// \return False on error.
+  bool WriteAll(const int _fd, const void *_data, size_t _size,
+      uint64_t _offset)
+  {
+    const char *data = static_cast<const char *>(_data);
+    while (_size > 0)
+    {
+      const ssize_t n = pwrite(_fd, data, _size, _offset);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data += n;
+      _size -= n;
+      _offset += n;
+    }
+    return true;
+  }
+}
+
+//////////////////////////////////////////////////
+NpsBeamRecorder::NpsBeamRecorder()
+: failed(false),
+  written(0),
+  dropped(0)
+{
+}
+
+//////////////////////////////////////////////////
+NpsBeamRecorder::~NpsBeamRecorder()
+{
+  this->Close();
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecorder::Open(const std::string &_path, const size_t _chunkSize,
+    const unsigned int _slots)
+{
+  this->Close();
+
+  const int file = open(_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+      0644);
+  if (file < 0)
+    return false;
+
+  this->pageSize = std::max<long>(sysconf(_SC_PAGESIZE), 4096);
+
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.dataOffset = this->pageSize;
+  if (!WriteAll(file, &header, sizeof(header), 0) ||
+      ftruncate(file, this->pageSize) != 0)
+  {
+    close(file);
+    return false;
+  }
+
+  this->fd = file;
+  this->chunkSize = RoundUp(std::max(_chunkSize, this->pageSize),
+      this->pageSize);
+  this->fileEnd = this->pageSize;
+  this->index.clear();
+  this->slots.assign(std::max(1u, _slots), NpsBeamFrame());
+  this->head = 0;
+  this->queued = 0;
+  this->stop = false;
+  this->failed = false;
+  this->written = 0;
+  this->dropped = 0;
+  this->thread = std::thread(&NpsBeamRecorder::Run, this);
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRecorder::Close()
+{
+  if (!this->thread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->condition.notify_all();
+  this->thread.join();
+
+  // Cut the last chunk down to the records it holds
+  if (this->chunk)
+  {
+    ChunkHeader *header = reinterpret_cast<ChunkHeader *>(this->chunk);
+    header->size = this->chunkUsed;
+    this->fileEnd = this->chunkOffset + this->chunkUsed;
+  }
+  this->UnmapChunk();
+
+  std::stable_sort(this->index.begin(), this->index.end(), EarlierStamp);
+  const uint64_t indexOffset = RoundUp(this->fileEnd, 8);
+  const size_t indexBytes = this->index.size() * sizeof(NpsBeamRecordEntry);
+  if (WriteAll(this->fd, this->index.data(), indexBytes, indexOffset) &&
+      ftruncate(this->fd, indexOffset + indexBytes) == 0)
+  {
+    // Written last, so a file cut short has no index and is recovered
+    const uint64_t location[2] = {indexOffset, this->index.size()};
+    WriteAll(this->fd, location, sizeof(location),
+        offsetof(FileHeader, indexOffset));
+  }
+
+  close(this->fd);
+  this->fd = -1;
+  this->slots.clear();
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecorder::IsOpen() const
+{
+  return this->fd >= 0;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecorder::Write(const NpsBeamFrame &_frame)
+{
+  if (this->fd < 0)
+    return false;
+
+  size_t slot;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->failed || this->queued == this->slots.size())
+    {
+      ++this->dropped;
+      return false;
+    }
+    slot = (this->head + this->queued) % this->slots.size();
+  }
+
+  // The slot is not queued yet, so the writer thread leaves it alone
+  // while the frame is copied without the lock
+  this->slots[slot] = _frame;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    ++this->queued;
+  }
+  this->condition.notify_one();
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecorder::Failed() const
+{
+  return this->failed;
+}
+
+//////////////////////////////////////////////////
+uint64_t NpsBeamRecorder::Written() const
+{
+  return this->written;
+}
+
+//////////////////////////////////////////////////
+uint64_t NpsBeamRecorder::Dropped() const
+{
+  return this->dropped;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRecorder::Run()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (true)
+  {
+    this->condition.wait(lock,
+        [this]() { return this->stop || this->queued > 0; });
+
+    if (this->queued == 0)
+      return;
+
+    // Keep the frame queued while it is written so Write skips its slot
+    const NpsBeamFrame &frame = this->slots[this->head];
+    lock.unlock();
+    const bool appended = !this->failed && this->Append(frame);
+    lock.lock();
+
+    if (appended)
+    {
+      ++this->written;
+    }
+    else
+    {
+      this->failed = true;
+      ++this->dropped;
+    }
+    this->head = (this->head + 1) % this->slots.size();
+    --this->queued;
+  }
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecorder::Append(const NpsBeamFrame &_frame)
+{
+  // Frames whose arrays do not match their size are skipped
+  const size_t cells = static_cast<size_t>(_frame.width) * _frame.height;
+  if (_frame.ranges.size() < cells || _frame.intensities.size() < cells)
+    return true;
+
+  const size_t bytes = RecordSize(cells);
+  if ((!this->chunk || this->chunkUsed + bytes > this->chunkBytes) &&
+      !this->NewChunk(bytes))
+  {
+    return false;
+  }
+
+  RecordHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = kRecordMagic;
+  header.width = _frame.width;
+  header.height = _frame.height;
+  header.sec = _frame.sec;
+  header.nsec = _frame.nsec;
+  header.sequence = _frame.sequence;
+  header.size = bytes;
+  std::copy(_frame.pose, _frame.pose + 7, header.pose);
+  const double geometry[8] = {_frame.angleMin, _frame.angleMax,
+    _frame.angleStep, _frame.verticalAngleMin, _frame.verticalAngleMax,
+    _frame.verticalAngleStep, _frame.rangeMin, _frame.rangeMax};
+  std::copy(geometry, geometry + 8, header.geometry);
+
+  char *out = this->chunk + this->chunkUsed;
+  std::memcpy(out, &header, sizeof(header));
+  std::memcpy(out + sizeof(header), _frame.ranges.data(),
+      cells * sizeof(float));
+  std::memcpy(out + sizeof(header) + cells * sizeof(float),
+      _frame.intensities.data(), cells * sizeof(float));
+
+  NpsBeamRecordEntry entry;
+  entry.stamp = StampNs(_frame.sec, _frame.nsec);
+  entry.offset = this->chunkOffset + this->chunkUsed;
+  this->index.push_back(entry);
+
+  // Count the record in the chunk only once it is complete
+  this->chunkUsed += bytes;
+  reinterpret_cast<ChunkHeader *>(this->chunk)->used = this->chunkUsed;
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecorder::NewChunk(const size_t _minSize)
+{
+  this->UnmapChunk();
+
+  const size_t size = RoundUp(
+      std::max(this->chunkSize, _minSize + sizeof(ChunkHeader)),
+      this->pageSize);
+
+  // Reserve the blocks up front, so a full disk fails here rather than
+  // with a bus error on a mapped page
+  int error = posix_fallocate(this->fd, this->fileEnd, size);
+  if (error == EOPNOTSUPP || error == EINVAL)
+    error = ftruncate(this->fd, this->fileEnd + size) == 0 ? 0 : errno;
+  if (error != 0)
+    return false;
+
+  void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      this->fd, this->fileEnd);
+  if (memory == MAP_FAILED)
+    return false;
+
+  this->chunk = static_cast<char *>(memory);
+  this->chunkBytes = size;
+  this->chunkOffset = this->fileEnd;
+  this->chunkUsed = sizeof(ChunkHeader);
+  this->fileEnd += size;
+
+  ChunkHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kChunkMagic, sizeof(kChunkMagic));
+  header.size = size;
+  header.used = this->chunkUsed;
+  std::memcpy(this->chunk, &header, sizeof(header));
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRecorder::UnmapChunk()
+{
+  if (!this->chunk)
+    return;
+
+  munmap(this->chunk, this->chunkBytes);
+  this->chunk = nullptr;
+  this->chunkBytes = 0;
+}
+
+//////////////////////////////////////////////////
+NpsBeamRecordReader::NpsBeamRecordReader()
+{
+}
+
+//////////////////////////////////////////////////
+NpsBeamRecordReader::~NpsBeamRecordReader()
+{
+  this->Close();
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecordReader::Open(const std::string &_path)
+{
+  this->Close();
+
+  const int file = open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(file, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < sizeof(FileHeader))
+  {
+    close(file);
+    return false;
+  }
+
+  void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+  close(file);
+  if (memory == MAP_FAILED)
+    return false;
+
+  this->memory = static_cast<const char *>(memory);
+  this->size = info.st_size;
+
+  const FileHeader *header =
+    reinterpret_cast<const FileHeader *>(this->memory);
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion)
+  {
+    this->Close();
+    return false;
+  }
+
+  const uint64_t indexBytes =
+    header->indexCount * sizeof(NpsBeamRecordEntry);
+  if (header->indexOffset != 0 && header->indexOffset % 8 == 0 &&
+      header->indexOffset + indexBytes <= this->size)
+  {
+    this->entries = reinterpret_cast<const NpsBeamRecordEntry *>(
+        this->memory + header->indexOffset);
+    this->count = header->indexCount;
+    return true;
+  }
+
+  // Not closed: walk the chunks for complete records
+  uint64_t offset = header->dataOffset;
+  while (offset + sizeof(ChunkHeader) <= this->size)
+  {
+    const ChunkHeader *chunk =
+      reinterpret_cast<const ChunkHeader *>(this->memory + offset);
+    if (std::memcmp(chunk->magic, kChunkMagic, sizeof(kChunkMagic)) != 0 ||
+        chunk->size < sizeof(ChunkHeader))
+    {
+      break;
+    }
+
+    const uint64_t end = std::min<uint64_t>(offset +
+        std::min(chunk->used, chunk->size), this->size);
+    uint64_t position = offset + sizeof(ChunkHeader);
+    while (position + sizeof(RecordHeader) <= end)
+    {
+      const RecordHeader *record =
+        reinterpret_cast<const RecordHeader *>(this->memory + position);
+      if (record->magic != kRecordMagic || record->size == 0 ||
+          position + record->size > end)
+      {
+        break;
+      }
+
+      NpsBeamRecordEntry entry;
+      entry.stamp = StampNs(record->sec, record->nsec);
+      entry.offset = position;
+      this->rebuilt.push_back(entry);
+      position += record->size;
+    }
+    offset += chunk->size;
+  }
+
+  std::stable_sort(this->rebuilt.begin(), this->rebuilt.end(),
+      EarlierStamp);
+  this->entries = this->rebuilt.data();
+  this->count = this->rebuilt.size();
+  this->recovered = true;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamRecordReader::Close()
+{
+  if (this->memory)
+    munmap(const_cast<char *>(this->memory), this->size);
+  this->memory = nullptr;
+  this->size = 0;
+  this->entries = nullptr;
+  this->count = 0;
+  this->rebuilt.clear();
+  this->recovered = false;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamRecordReader::Count() const
+{
+  return this->count;
+}
+
+//////////////////////////////////////////////////
+int64_t NpsBeamRecordReader::Stamp(const size_t _index) const
+{
+  return _index < this->count ? this->entries[_index].stamp : 0;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamRecordReader::Seek(const int64_t _stamp) const
+{
+  NpsBeamRecordEntry key;
+  key.stamp = _stamp;
+  return std::lower_bound(this->entries, this->entries + this->count, key,
+      EarlierStamp) - this->entries;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecordReader::ReadHeader(const size_t _index,
+    NpsBeamFrame &_frame) const
+{
+  const char *data = this->Record(_index);
+  if (!data)
+    return false;
+
+  const RecordHeader *record = reinterpret_cast<const RecordHeader *>(data);
+  _frame.width = record->width;
+  _frame.height = record->height;
+  _frame.sequence = record->sequence;
+  _frame.sec = record->sec;
+  _frame.nsec = record->nsec;
+  std::copy(record->pose, record->pose + 7, _frame.pose);
+  _frame.angleMin = record->geometry[0];
+  _frame.angleMax = record->geometry[1];
+  _frame.angleStep = record->geometry[2];
+  _frame.verticalAngleMin = record->geometry[3];
+  _frame.verticalAngleMax = record->geometry[4];
+  _frame.verticalAngleStep = record->geometry[5];
+  _frame.rangeMin = record->geometry[6];
+  _frame.rangeMax = record->geometry[7];
+  return true;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamRecordReader::ReadData(const size_t _index, float *_ranges,
+    float *_intensities, const size_t _count) const
+{
+  const char *data = this->Record(_index);
+  if (!data)
+    return 0;
+
+  const RecordHeader *record = reinterpret_cast<const RecordHeader *>(data);
+  const size_t cells = static_cast<size_t>(record->width) * record->height;
+  const size_t count = std::min(_count, cells);
+  const char *ranges = data + sizeof(RecordHeader);
+  std::memcpy(_ranges, ranges, count * sizeof(float));
+  std::memcpy(_intensities, ranges + cells * sizeof(float),
+      count * sizeof(float));
+  return count;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecordReader::Read(const size_t _index,
+    NpsBeamFrame &_frame) const
+{
+  if (!this->ReadHeader(_index, _frame))
+    return false;
+
+  _frame.Resize(_frame.width, _frame.height);
+  this->ReadData(_index, _frame.ranges.data(), _frame.intensities.data(),
+      _frame.ranges.size());
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamRecordReader::Recovered() const
+{
+  return this->recovered;
+}
+
+//////////////////////////////////////////////////
+const char *NpsBeamRecordReader::Record(const size_t _index) const
+{
+  if (_index >= this->count)
+    return nullptr;
+
+  const uint64_t offset = this->entries[_index].offset;
+  if (offset + sizeof(RecordHeader) > this->size)
+    return nullptr;
+
+  const RecordHeader *record =
+    reinterpret_cast<const RecordHeader *>(this->memory + offset);
+  const uint64_t cells = static_cast<uint64_t>(record->width) *
+    record->height;
+  if (record->magic != kRecordMagic ||
+      offset + sizeof(RecordHeader) + 2 * cells * sizeof(float) > this->size)
+  {
+    return nullptr;
+  }
+
+  return this->memory + offset;
+}
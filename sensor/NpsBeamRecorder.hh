@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_RECORDER_HH
+#define NPS_BEAM_RECORDER_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "NpsBeamFrameStore.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Entry of a recording's index.
+    class NpsBeamRecordEntry
+    {
+      /// \brief Measurement time in nanoseconds.
+      public: int64_t stamp = 0;
+
+      /// \brief File offset of the frame record.
+      public: uint64_t offset = 0;
+    };
+
+    /// \brief Appends beam frames to a chunked, memory mapped log file.
+    ///
+    /// The file holds a header page followed by chunks of at least the
+    /// configured size, each mapped while it is filled, and records of
+    /// one frame each: the frame header, stamp, world pose and scan
+    /// geometry followed by the raw ranges and intensities. Close
+    /// appends an index of every record sorted by stamp, so a reader
+    /// seeks to any time with a binary search; a file that was never
+    /// closed is still readable, the reader then rebuilds the index
+    /// from the chunks.
+    ///
+    /// Write only copies the frame into one of a few preallocated slots;
+    /// a thread of the recorder appends it to the file. When every slot
+    /// is taken Write drops the frame instead of waiting, so the caller
+    /// is never held up by the disk.
+    ///
+    /// The file format and NpsBeamRecordReader only depend on
+    /// NpsBeamFrame and POSIX, so offline tools link the small NpsBeamShm
+    /// library without Gazebo.
+    class NpsBeamRecorder
+    {
+      /// \brief Constructor
+      public: NpsBeamRecorder();
+
+      /// \brief Destructor, closes the file.
+      public: ~NpsBeamRecorder();
+
+      /// \brief Create a recording, replacing an existing file.
+      /// \param[in] _path File to write.
+      /// \param[in] _chunkSize Bytes to map and grow the file by at once.
+      /// \param[in] _slots Frames that may wait for the writer thread.
+      /// \return False if the file could not be created.
+      public: bool Open(const std::string &_path, const size_t _chunkSize,
+                  const unsigned int _slots);
+
+      /// \brief Write the frames still queued, append the index and close
+      /// the file.
+      public: void Close();
+
+      /// \brief Check whether a recording is open.
+      /// \return True between a successful Open and Close.
+      public: bool IsOpen() const;
+
+      /// \brief Queue a frame for writing. Called from one thread at a
+      /// time.
+      /// \param[in] _frame Frame to record.
+      /// \return False if the frame was dropped because every slot was
+      /// taken or writing failed.
+      public: bool Write(const NpsBeamFrame &_frame);
+
+      /// \brief Check whether the file could not be extended or mapped,
+      /// after which every frame is dropped.
+      /// \return True once writing failed.
+      public: bool Failed() const;
+
+      /// \brief Number of frames written to the file.
+      /// \return Frame count.
+      public: uint64_t Written() const;
+
+      /// \brief Number of frames dropped by Write.
+      /// \return Frame count.
+      public: uint64_t Dropped() const;
+
+      /// \brief Writer thread main loop.
+      private: void Run();
+
+      /// \brief Append a frame to the file, on the writer thread.
+      /// \param[in] _frame Frame to append.
+      /// \return False if the file could not be extended or mapped.
+      private: bool Append(const NpsBeamFrame &_frame);
+
+      /// \brief Unmap the current chunk and map a new one at the end of
+      /// the file.
+      /// \param[in] _minSize Bytes the chunk must hold at least.
+      /// \return False if the file could not be extended or mapped.
+      private: bool NewChunk(const size_t _minSize);
+
+      /// \brief Unmap the current chunk.
+      private: void UnmapChunk();
+
+      /// \brief File descriptor, -1 if closed.
+      private: int fd = -1;
+
+      /// \brief Bytes to grow the file by at once.
+      private: size_t chunkSize = 0;
+
+      /// \brief Page size chunks are aligned to.
+      private: size_t pageSize = 0;
+
+      /// \brief Mapped chunk being filled, null if none.
+      private: char *chunk = nullptr;
+
+      /// \brief Size of the mapped chunk.
+      private: size_t chunkBytes = 0;
+
+      /// \brief File offset of the mapped chunk.
+      private: uint64_t chunkOffset = 0;
+
+      /// \brief Bytes of the mapped chunk in use.
+      private: size_t chunkUsed = 0;
+
+      /// \brief File size.
+      private: uint64_t fileEnd = 0;
+
+      /// \brief One entry per record written, in write order.
+      private: std::vector<NpsBeamRecordEntry> index;
+
+      /// \brief Ring of frames waiting for the writer thread.
+      private: std::vector<NpsBeamFrame> slots;
+
+      /// \brief Index of the oldest queued frame in slots.
+      private: size_t head = 0;
+
+      /// \brief Number of queued frames; the one at head is being
+      /// written.
+      private: size_t queued = 0;
+
+      /// \brief Protects slots, head, queued and stop.
+      private: std::mutex mutex;
+
+      /// \brief Signals queued frames and shutdown.
+      private: std::condition_variable condition;
+
+      /// \brief True when the writer should exit once idle.
+      private: bool stop = false;
+
+      /// \brief Writer thread.
+      private: std::thread thread;
+
+      /// \brief True once writing failed.
+      private: std::atomic<bool> failed;
+
+      /// \brief Frames written.
+      private: std::atomic<uint64_t> written;
+
+      /// \brief Frames dropped.
+      private: std::atomic<uint64_t> dropped;
+    };
+
+    /// \brief Reads a recording of NpsBeamRecorder.
+    ///
+    /// Maps the whole file read only and copies frames straight out of
+    /// the mapping.
+    class NpsBeamRecordReader
+    {
+      /// \brief Constructor
+      public: NpsBeamRecordReader();
+
+      /// \brief Destructor, unmaps the file.
+      public: ~NpsBeamRecordReader();
+
+      /// \brief Map a recording.
+      /// \param[in] _path File to read.
+      /// \return False if the file does not exist or is not a beam
+      /// recording.
+      public: bool Open(const std::string &_path);
+
+      /// \brief Unmap the file.
+      public: void Close();
+
+      /// \brief Number of frames in the recording.
+      /// \return Frame count.
+      public: size_t Count() const;
+
+      /// \brief Get the stamp of a frame.
+      /// \param[in] _index Frame index in stamp order, below Count().
+      /// \return Measurement time in nanoseconds.
+      public: int64_t Stamp(const size_t _index) const;
+
+      /// \brief Find the first frame at or after a time.
+      /// \param[in] _stamp Time in nanoseconds.
+      /// \return Frame index, Count() if every frame is older.
+      public: size_t Seek(const int64_t _stamp) const;
+
+      /// \brief Copy the header of a frame, without its data.
+      /// \param[in] _index Frame index, below Count().
+      /// \param[out] _frame Frame whose size, stamp, pose and geometry
+      /// are set; its arrays are left as they are.
+      /// \return False if the index is out of range.
+      public: bool ReadHeader(const size_t _index,
+                  NpsBeamFrame &_frame) const;
+
+      /// \brief Copy the data of a frame into caller buffers.
+      /// \param[in] _index Frame index, below Count().
+      /// \param[out] _ranges Output ranges.
+      /// \param[out] _intensities Output intensities.
+      /// \param[in] _count Maximum number of cells to copy.
+      /// \return Number of cells copied.
+      public: size_t ReadData(const size_t _index, float *_ranges,
+                  float *_intensities, const size_t _count) const;
+
+      /// \brief Copy a whole frame.
+      /// \param[in] _index Frame index, below Count().
+      /// \param[out] _frame Frame to fill.
+      /// \return False if the index is out of range.
+      public: bool Read(const size_t _index, NpsBeamFrame &_frame) const;
+
+      /// \brief Check whether the index was rebuilt because the file was
+      /// not closed.
+      /// \return True if the recording was not closed.
+      public: bool Recovered() const;
+
+      /// \brief Get the record of a frame.
+      /// \param[in] _index Frame index.
+      /// \return Start of the record, null if out of range.
+      private: const char *Record(const size_t _index) const;
+
+      /// \brief Mapped file, null if closed.
+      private: const char *memory = nullptr;
+
+      /// \brief Size of the mapping in bytes.
+      private: size_t size = 0;
+
+      /// \brief Index in stamp order, in the file or in rebuilt.
+      private: const NpsBeamRecordEntry *entries = nullptr;
+
+      /// \brief Number of index entries.
+      private: size_t count = 0;
+
+      /// \brief Index rebuilt from the chunks of an unclosed file.
+      private: std::vector<NpsBeamRecordEntry> rebuilt;
+
+      /// \brief True if the index was rebuilt.
+      private: bool recovered = false;
+    };
+  }
+}
+#endif
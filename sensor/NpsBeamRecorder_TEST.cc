@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamRecorder.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+/////////////////////////////////////////////////
+TEST(NpsBeamRecorder, RecordsPublishedSequence)
+{
+  const std::string path = "/tmp/NpsBeamRecorder_TEST_" +
+    std::to_string(getpid()) + ".log";
+
+  NpsBeamFrameStore store;
+  NpsBeamRecorder recorder;
+  ASSERT_TRUE(recorder.Open(path, 1 << 20, 8));
+
+  // Frames are recorded before they are published, as in the sensor
+  const unsigned int frames = 5;
+  std::vector<uint64_t> published;
+  for (unsigned int i = 0; i < frames; ++i)
+  {
+    NpsBeamFrame *frame = store.BeginWrite();
+    frame->Resize(16, 2);
+    for (size_t j = 0; j < frame->ranges.size(); ++j)
+    {
+      frame->ranges[j] = static_cast<float>(i + j);
+      frame->intensities[j] = 1.0f;
+    }
+    frame->sec = static_cast<int32_t>(i);
+    store.AssignSequence(frame);
+    EXPECT_TRUE(recorder.Write(*frame));
+    store.EndWrite(frame);
+    published.push_back(store.Latest()->sequence);
+  }
+  recorder.Close();
+  EXPECT_EQ(frames, recorder.Written());
+
+  NpsBeamRecordReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  ASSERT_EQ(frames, reader.Count());
+  for (unsigned int i = 0; i < frames; ++i)
+  {
+    NpsBeamFrame frame;
+    ASSERT_TRUE(reader.Read(i, frame));
+    EXPECT_EQ(published[i], frame.sequence);
+    EXPECT_NE(0u, frame.sequence);
+    EXPECT_EQ(static_cast<int32_t>(i), frame.sec);
+    EXPECT_FLOAT_EQ(static_cast<float>(i + 1), frame.ranges[1]);
+  }
+  reader.Close();
+  std::remove(path.c_str());
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
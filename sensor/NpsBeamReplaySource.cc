@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+
+#include "gazebo/common/Console.hh"
+#include "gazebo/physics/World.hh"
+
+#include "NpsBeamReplaySource.hh"
+#include "NpsBeamSensor.hh"
+#include "NpsBeamSensorPrivate.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+bool NpsBeamReplaySource::Init(NpsBeamSensor &_sensor,
+    const NpsBeamSourceContext &_context)
+{
+  this->sensor = &_sensor;
+  this->world = _context.world;
+
+  sdf::ElementPtr elem = NpsBeamElement(_context.config, "replay");
+  const std::string file = NpsBeamParam<std::string>(elem, "file", "");
+  this->rate = std::max(0.0, NpsBeamParam<double>(elem, "rate", 1.0));
+  this->loop = NpsBeamParam<bool>(elem, "loop", true);
+
+  if (!this->reader.Open(file) || this->reader.Count() == 0 ||
+      !this->reader.ReadHeader(0, this->frame))
+  {
+    gzerr << "Unable to read beam recording[" << file << "]\n";
+    return false;
+  }
+
+  if (this->reader.Recovered())
+  {
+    gzwarn << "Beam recording[" << file << "] was not closed, recovered "
+           << this->reader.Count() << " frames\n";
+  }
+
+  if (this->frame.width != _sensor.RayCount() ||
+      this->frame.height != _sensor.VerticalRayCount())
+  {
+    gzerr << "Beam recording[" << file << "] has " << this->frame.width
+          << "x" << this->frame.height << " cells but the sensor reads "
+          << _sensor.RayCount() << "x" << _sensor.VerticalRayCount()
+          << " rays\n";
+    return false;
+  }
+
+  // Publish the recorded scan angles
+  _sensor.SetAngleMin(this->frame.angleMin);
+  _sensor.SetAngleMax(this->frame.angleMax);
+  if (this->frame.height > 1)
+  {
+    _sensor.SetVerticalAngleMin(this->frame.verticalAngleMin);
+    _sensor.SetVerticalAngleMax(this->frame.verticalAngleMax);
+  }
+
+  this->started = false;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamReplaySource::Fini()
+{
+  this->reader.Close();
+}
+
+//////////////////////////////////////////////////
+common::Time NpsBeamReplaySource::Render(const NpsBeamGeometry &/*_geom*/,
+    const ignition::math::Pose3d &/*_pose*/)
+{
+  this->current = this->FrameAt(this->world->SimTime());
+  this->reader.ReadHeader(this->current, this->frame);
+  this->frameTime = common::Time(this->frame.sec, this->frame.nsec);
+
+  if (this->newLaserFrame.ConnectionCount() > 0)
+  {
+    const size_t cells =
+      static_cast<size_t>(this->frame.width) * this->frame.height;
+    this->frame.Resize(this->frame.width, this->frame.height);
+    this->reader.ReadData(this->current, this->frame.ranges.data(),
+        this->frame.intensities.data(), cells);
+
+    this->data.resize(cells * 3);
+    for (size_t i = 0; i < cells; ++i)
+    {
+      this->data[i * 3] = this->frame.ranges[i];
+      this->data[i * 3 + 1] = this->frame.intensities[i];
+      this->data[i * 3 + 2] = 0.0f;
+    }
+    this->newLaserFrame(this->data.data(), this->frame.width,
+        this->frame.height, 3, "PF_FLOAT32_RGB");
+  }
+
+  return this->frameTime;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamReplaySource::Read(float *_ranges, float *_intensities,
+    const size_t _count)
+{
+  // Straight from the mapped file into the sensor's frame
+  return this->reader.ReadData(this->current, _ranges, _intensities,
+      _count);
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamReplaySource::FramePose(ignition::math::Pose3d &_pose) const
+{
+  _pose.Set(this->frame.pose[0], this->frame.pose[1], this->frame.pose[2],
+      this->frame.pose[3], this->frame.pose[4], this->frame.pose[5],
+      this->frame.pose[6]);
+  return true;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamReplaySource::FrameAt(const common::Time &_simTime)
+{
+  const size_t count = this->reader.Count();
+  if (!this->started)
+  {
+    this->started = true;
+    this->simStart = _simTime;
+    return 0;
+  }
+
+  if (this->rate <= 0)
+  {
+    if (this->current + 1 < count)
+      return this->current + 1;
+    return this->loop ? 0 : this->current;
+  }
+
+  const int64_t first = this->reader.Stamp(0);
+  const int64_t span = this->reader.Stamp(count - 1) - first;
+  int64_t elapsed = static_cast<int64_t>(
+      (_simTime - this->simStart).Double() * 1e9 * this->rate);
+  if (this->loop && span > 0)
+    elapsed %= span + 1;
+
+  // The last frame at or before the playback time
+  const size_t after = this->reader.Seek(first + elapsed + 1);
+  return after > 0 ? after - 1 : 0;
+}
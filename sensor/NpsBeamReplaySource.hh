@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_REPLAY_SOURCE_HH
+#define NPS_BEAM_REPLAY_SOURCE_HH
+
+#include <vector>
+
+#include "NpsBeamFrameSource.hh"
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamRecorder.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Frame source playing back a recording of NpsBeamRecorder.
+    ///
+    /// Recorded frames are raw, so they run through the sensor's whole
+    /// processing and publishing path again. With a positive rate the
+    /// source maps simulation time since the first frame onto recording
+    /// time scaled by the rate, and seeks the frame due at that time
+    /// through the recording's index; with a rate of 0 every update plays
+    /// the next frame, as fast as the sensor updates. Frames keep their
+    /// recorded stamp and world pose.
+    ///
+    /// The sensor must read as many rays as the recording has cells, so
+    /// a recording of a resampled sensor plays back on a sensor with that
+    /// many samples and a resolution of 1.
+    class NpsBeamReplaySource : public NpsBeamFrameSource
+    {
+      // Documentation inherited
+      public: virtual bool Init(NpsBeamSensor &_sensor,
+                  const NpsBeamSourceContext &_context);
+
+      // Documentation inherited
+      public: virtual void Fini();
+
+      // Documentation inherited
+      public: virtual common::Time Render(const NpsBeamGeometry &_geom,
+                  const ignition::math::Pose3d &_pose);
+
+      // Documentation inherited
+      public: virtual size_t Read(float *_ranges, float *_intensities,
+                  const size_t _count);
+
+      // Documentation inherited
+      public: virtual bool FramePose(ignition::math::Pose3d &_pose) const;
+
+      /// \brief Pick the frame to play at a simulation time.
+      /// \param[in] _simTime Current simulation time.
+      /// \return Frame index.
+      private: size_t FrameAt(const common::Time &_simTime);
+
+      /// \brief World providing the simulation time.
+      private: physics::WorldPtr world;
+
+      /// \brief Recording being played.
+      private: NpsBeamRecordReader reader;
+
+      /// \brief Recording seconds played per simulation second, 0 to play
+      /// one frame per update.
+      private: double rate = 1.0;
+
+      /// \brief Start over after the last frame instead of holding it.
+      private: bool loop = true;
+
+      /// \brief True once the first frame was played.
+      private: bool started = false;
+
+      /// \brief Simulation time of the first frame played.
+      private: common::Time simStart;
+
+      /// \brief Index of the frame being played.
+      private: size_t current = 0;
+
+      /// \brief Header of the frame being played.
+      private: NpsBeamFrame frame;
+
+      /// \brief Interleaved frame data for new laser frame subscribers.
+      private: std::vector<float> data;
+    };
+  }
+}
+#endif
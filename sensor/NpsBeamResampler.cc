@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#include "NpsBeamResampler.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Output cells per pool chunk.
+  const size_t kCellGrain = 8192;
+
+  /// \brief Map an angle onto a source axis.
+  /// \param[in] _angle Angle to map.
+  /// \param[in] _min Angle of the first sample.
+  /// \param[in] _max Angle of the last sample.
+  /// \param[in] _count Number of samples.
+  /// \param[out] _index Lower sample index.
+  /// \param[out] _weight Weight of the upper sample.
+  void MapAngle(const double _angle, const double _min, const double _max,
+      const unsigned int _count, int32_t &_index, float &_weight)
+  {
+    if (_count < 2 || _max <= _min)
+    {
+      _index = 0;
+      _weight = 0.0f;
+      return;
+    }
+
+    const double u = std::min(std::max(
+          (_angle - _min) / (_max - _min) * (_count - 1), 0.0),
+        static_cast<double>(_count - 1));
+    _index = std::min(static_cast<int32_t>(u),
+        static_cast<int32_t>(_count) - 2);
+    _weight = static_cast<float>(u - _index);
+  }
+
+  /// \brief Check whether a mapped angle lands exactly on a sample.
+  /// \param[in] _index Lower sample index from MapAngle.
+  /// \param[in] _weight Upper sample weight from MapAngle.
+  /// \param[in] _expected Sample expected.
+  /// \return True if the angle maps to sample _expected.
+  bool OnSample(const int32_t _index, const float _weight,
+      const unsigned int _expected)
+  {
+    const double position = _index + static_cast<double>(_weight);
+    return std::fabs(position - _expected) < 1e-4;
+  }
+
+  /// \brief Scalar version of the per-cell gather and blend.
+  inline void ResampleCell(const float *_ranges, const float *_intensities,
+      const int32_t _base, const int32_t _stepX, const int32_t _stepY,
+      const float _wx, const float _wy, const float _edge, float &_range,
+      float &_intensity)
+  {
+    const float a = _ranges[_base];
+    const float b = _ranges[_base + _stepX];
+    const float c = _ranges[_base + _stepY];
+    const float d = _ranges[_base + _stepX + _stepY];
+
+    const float top = a + (b - a) * _wx;
+    const float bottom = c + (d - c) * _wx;
+    const float range = top + (bottom - top) * _wy;
+    const float spread = std::max(std::max(a, b), std::max(c, d)) -
+      std::min(std::min(a, b), std::min(c, d));
+
+    if (!(spread <= _edge) || std::isnan(range))
+    {
+      const int32_t nearest = _base + (_wx >= 0.5f ? _stepX : 0) +
+        (_wy >= 0.5f ? _stepY : 0);
+      _range = _ranges[nearest];
+      _intensity = _intensities[nearest];
+      return;
+    }
+
+    const float ia = _intensities[_base];
+    const float ib = _intensities[_base + _stepX];
+    const float ic = _intensities[_base + _stepY];
+    const float id = _intensities[_base + _stepX + _stepY];
+    const float itop = ia + (ib - ia) * _wx;
+    const float ibottom = ic + (id - ic) * _wx;
+    _range = range;
+    _intensity = itop + (ibottom - itop) * _wy;
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamResampler::Configure(const unsigned int _width,
+    const unsigned int _height, const double _angleMin,
+    const double _angleMax, const double _verticalAngleMin,
+    const double _verticalAngleMax, const std::vector<double> &_angles,
+    const std::vector<double> &_verticalAngles, const float _edgeThreshold)
+{
+  this->sourceWidth = std::max(1u, _width);
+  this->sourceHeight = std::max(1u, _height);
+  this->width = _angles.size();
+  this->height = _verticalAngles.size();
+  this->edgeThreshold = _edgeThreshold;
+  this->stepX = this->sourceWidth > 1 ? 1 : 0;
+  this->stepY = this->sourceHeight > 1 ?
+    static_cast<int32_t>(this->sourceWidth) : 0;
+
+  std::vector<int32_t> columns(this->width);
+  std::vector<float> columnWeights(this->width);
+  this->identity = this->width == this->sourceWidth &&
+    this->height == this->sourceHeight;
+  for (unsigned int i = 0; i < this->width; ++i)
+  {
+    MapAngle(_angles[i], _angleMin, _angleMax, this->sourceWidth,
+        columns[i], columnWeights[i]);
+    this->identity = this->identity &&
+      OnSample(columns[i], columnWeights[i], i);
+  }
+
+  const size_t count = this->OutputCount();
+  this->bases.resize(count);
+  this->weightsX.resize(count);
+  this->weightsY.resize(count);
+
+  for (unsigned int j = 0; j < this->height; ++j)
+  {
+    int32_t row;
+    float rowWeight;
+    MapAngle(_verticalAngles[j], _verticalAngleMin, _verticalAngleMax,
+        this->sourceHeight, row, rowWeight);
+    this->identity = this->identity && OnSample(row, rowWeight, j);
+
+    for (unsigned int i = 0; i < this->width; ++i)
+    {
+      const size_t cell = static_cast<size_t>(j) * this->width + i;
+      this->bases[cell] = row * static_cast<int32_t>(this->sourceWidth) +
+        columns[i];
+      this->weightsX[cell] = columnWeights[i];
+      this->weightsY[cell] = rowWeight;
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamResampler::Apply(const float *_ranges, const float *_intensities,
+    float *_outRanges, float *_outIntensities, NpsBeamWorkerPool *_pool) const
+{
+  const size_t count = this->OutputCount();
+  if (this->identity)
+  {
+    std::copy(_ranges, _ranges + count, _outRanges);
+    std::copy(_intensities, _intensities + count, _outIntensities);
+    return;
+  }
+
+  if (_pool)
+  {
+    _pool->ParallelFor(count, kCellGrain,
+        [&](const size_t _begin, const size_t _end)
+        {
+          this->ApplyRows(_ranges, _intensities, _outRanges,
+              _outIntensities, _begin, _end);
+        });
+  }
+  else
+  {
+    this->ApplyRows(_ranges, _intensities, _outRanges, _outIntensities, 0,
+        count);
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamResampler::ApplyRows(const float *_ranges,
+    const float *_intensities, float *_outRanges, float *_outIntensities,
+    const size_t _begin, const size_t _end) const
+{
+  size_t i = _begin;
+
+#if defined(__AVX2__)
+  const __m256 vEdge = _mm256_set1_ps(this->edgeThreshold);
+  const __m256 vHalf = _mm256_set1_ps(0.5f);
+  const __m256i vStepX = _mm256_set1_epi32(this->stepX);
+  const __m256i vStepY = _mm256_set1_epi32(this->stepY);
+
+  for (; i + 8 <= _end; i += 8)
+  {
+    const __m256i ia = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(&this->bases[i]));
+    const __m256i ib = _mm256_add_epi32(ia, vStepX);
+    const __m256i ic = _mm256_add_epi32(ia, vStepY);
+    const __m256i id = _mm256_add_epi32(ib, vStepY);
+    const __m256 wx = _mm256_loadu_ps(&this->weightsX[i]);
+    const __m256 wy = _mm256_loadu_ps(&this->weightsY[i]);
+
+    const __m256 a = _mm256_i32gather_ps(_ranges, ia, 4);
+    const __m256 b = _mm256_i32gather_ps(_ranges, ib, 4);
+    const __m256 c = _mm256_i32gather_ps(_ranges, ic, 4);
+    const __m256 d = _mm256_i32gather_ps(_ranges, id, 4);
+    const __m256 top = _mm256_add_ps(a,
+        _mm256_mul_ps(_mm256_sub_ps(b, a), wx));
+    const __m256 bottom = _mm256_add_ps(c,
+        _mm256_mul_ps(_mm256_sub_ps(d, c), wx));
+    const __m256 range = _mm256_add_ps(top,
+        _mm256_mul_ps(_mm256_sub_ps(bottom, top), wy));
+
+    const __m256 ja = _mm256_i32gather_ps(_intensities, ia, 4);
+    const __m256 jb = _mm256_i32gather_ps(_intensities, ib, 4);
+    const __m256 jc = _mm256_i32gather_ps(_intensities, ic, 4);
+    const __m256 jd = _mm256_i32gather_ps(_intensities, id, 4);
+    const __m256 itop = _mm256_add_ps(ja,
+        _mm256_mul_ps(_mm256_sub_ps(jb, ja), wx));
+    const __m256 ibottom = _mm256_add_ps(jc,
+        _mm256_mul_ps(_mm256_sub_ps(jd, jc), wx));
+    const __m256 intensity = _mm256_add_ps(itop,
+        _mm256_mul_ps(_mm256_sub_ps(ibottom, itop), wy));
+
+    // NaN texels make the blend NaN, which the second test catches
+    const __m256 spread = _mm256_sub_ps(
+        _mm256_max_ps(_mm256_max_ps(a, b), _mm256_max_ps(c, d)),
+        _mm256_min_ps(_mm256_min_ps(a, b), _mm256_min_ps(c, d)));
+    const __m256 edge = _mm256_or_ps(
+        _mm256_cmp_ps(spread, vEdge, _CMP_NLE_UQ),
+        _mm256_cmp_ps(range, range, _CMP_UNORD_Q));
+
+    if (_mm256_movemask_ps(edge) == 0)
+    {
+      _mm256_storeu_ps(_outRanges + i, range);
+      _mm256_storeu_ps(_outIntensities + i, intensity);
+      continue;
+    }
+
+    const __m256i nearX = _mm256_and_si256(vStepX, _mm256_castps_si256(
+          _mm256_cmp_ps(wx, vHalf, _CMP_GE_OQ)));
+    const __m256i nearY = _mm256_and_si256(vStepY, _mm256_castps_si256(
+          _mm256_cmp_ps(wy, vHalf, _CMP_GE_OQ)));
+    const __m256i nearest =
+      _mm256_add_epi32(ia, _mm256_add_epi32(nearX, nearY));
+    _mm256_storeu_ps(_outRanges + i, _mm256_blendv_ps(range,
+          _mm256_i32gather_ps(_ranges, nearest, 4), edge));
+    _mm256_storeu_ps(_outIntensities + i, _mm256_blendv_ps(intensity,
+          _mm256_i32gather_ps(_intensities, nearest, 4), edge));
+  }
+#elif defined(__SSE2__)
+  const __m128 vEdge = _mm_set1_ps(this->edgeThreshold);
+
+  for (; i + 4 <= _end; i += 4)
+  {
+    const int32_t *base = &this->bases[i];
+    const __m128 wx = _mm_loadu_ps(&this->weightsX[i]);
+    const __m128 wy = _mm_loadu_ps(&this->weightsY[i]);
+
+    // No gather instruction, so assemble the texels lane by lane
+    const int32_t sx = this->stepX;
+    const int32_t sy = this->stepY;
+    const __m128 a = _mm_setr_ps(_ranges[base[0]], _ranges[base[1]],
+        _ranges[base[2]], _ranges[base[3]]);
+    const __m128 b = _mm_setr_ps(_ranges[base[0] + sx],
+        _ranges[base[1] + sx], _ranges[base[2] + sx], _ranges[base[3] + sx]);
+    const __m128 c = _mm_setr_ps(_ranges[base[0] + sy],
+        _ranges[base[1] + sy], _ranges[base[2] + sy], _ranges[base[3] + sy]);
+    const __m128 d = _mm_setr_ps(_ranges[base[0] + sx + sy],
+        _ranges[base[1] + sx + sy], _ranges[base[2] + sx + sy],
+        _ranges[base[3] + sx + sy]);
+
+    const __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), wx));
+    const __m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), wx));
+    const __m128 range = _mm_add_ps(top,
+        _mm_mul_ps(_mm_sub_ps(bottom, top), wy));
+
+    const __m128 spread = _mm_sub_ps(
+        _mm_max_ps(_mm_max_ps(a, b), _mm_max_ps(c, d)),
+        _mm_min_ps(_mm_min_ps(a, b), _mm_min_ps(c, d)));
+    const __m128 edge = _mm_or_ps(_mm_cmpnle_ps(spread, vEdge),
+        _mm_cmpunord_ps(range, range));
+
+    if (_mm_movemask_ps(edge) != 0)
+    {
+      for (size_t k = i; k < i + 4; ++k)
+      {
+        ResampleCell(_ranges, _intensities, this->bases[k], sx, sy,
+            this->weightsX[k], this->weightsY[k], this->edgeThreshold,
+            _outRanges[k], _outIntensities[k]);
+      }
+      continue;
+    }
+
+    const __m128 ja = _mm_setr_ps(_intensities[base[0]],
+        _intensities[base[1]], _intensities[base[2]], _intensities[base[3]]);
+    const __m128 jb = _mm_setr_ps(_intensities[base[0] + sx],
+        _intensities[base[1] + sx], _intensities[base[2] + sx],
+        _intensities[base[3] + sx]);
+    const __m128 jc = _mm_setr_ps(_intensities[base[0] + sy],
+        _intensities[base[1] + sy], _intensities[base[2] + sy],
+        _intensities[base[3] + sy]);
+    const __m128 jd = _mm_setr_ps(_intensities[base[0] + sx + sy],
+        _intensities[base[1] + sx + sy], _intensities[base[2] + sx + sy],
+        _intensities[base[3] + sx + sy]);
+    const __m128 itop = _mm_add_ps(ja, _mm_mul_ps(_mm_sub_ps(jb, ja), wx));
+    const __m128 ibottom = _mm_add_ps(jc,
+        _mm_mul_ps(_mm_sub_ps(jd, jc), wx));
+
+    _mm_storeu_ps(_outRanges + i, range);
+    _mm_storeu_ps(_outIntensities + i, _mm_add_ps(itop,
+          _mm_mul_ps(_mm_sub_ps(ibottom, itop), wy)));
+  }
+#endif
+
+  for (; i < _end; ++i)
+  {
+    ResampleCell(_ranges, _intensities, this->bases[i], this->stepX,
+        this->stepY, this->weightsX[i], this->weightsY[i],
+        this->edgeThreshold, _outRanges[i], _outIntensities[i]);
+  }
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamResampler::IsIdentity() const
+{
+  return this->identity;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamResampler::SourceCount() const
+{
+  return static_cast<size_t>(this->sourceWidth) * this->sourceHeight;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamResampler::OutputCount() const
+{
+  return static_cast<size_t>(this->width) * this->height;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamResampler::Width() const
+{
+  return this->width;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamResampler::Height() const
+{
+  return this->height;
+}
+
+//////////////////////////////////////////////////
+std::vector<double> NpsBeamResampler::UniformAngles(const double _min,
+    const double _max, const unsigned int _count)
+{
+  std::vector<double> angles(_count);
+  if (_count == 1)
+    angles[0] = 0.5 * (_min + _max);
+  for (unsigned int i = 0; _count > 1 && i < _count; ++i)
+    angles[i] = _min + (_max - _min) * i / (_count - 1);
+  return angles;
+}
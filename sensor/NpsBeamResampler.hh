@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_RESAMPLER_HH
+#define NPS_BEAM_RESAMPLER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamWorkerPool;
+
+    /// \brief Resamples a uniform grid of ray samples onto the beam
+    /// angles of the published scan through a precomputed gather table.
+    ///
+    /// The source is the row major grid a frame source produces: width
+    /// rays evenly spaced over [angleMin, angleMax], height rows evenly
+    /// spaced over the vertical limits. Each output cell has its own beam
+    /// angles, so the spacing may be non-uniform. Configure builds, once
+    /// per geometry, a table holding for every output cell the index of
+    /// its top left source texel and the horizontal and vertical
+    /// interpolation weights; Apply then costs four gathers and three
+    /// blends per cell.
+    ///
+    /// Interpolating across an object edge would create a range between
+    /// the two surfaces that does not exist. When the four texels of a
+    /// cell spread over more than the edge threshold, or one of them is
+    /// not finite, the cell takes the nearest texel instead.
+    class NpsBeamResampler
+    {
+      /// \brief Build the gather table.
+      /// \param[in] _width Source rays per row.
+      /// \param[in] _height Source rows.
+      /// \param[in] _angleMin Horizontal angle of the first source column.
+      /// \param[in] _angleMax Horizontal angle of the last source column.
+      /// \param[in] _verticalAngleMin Vertical angle of the first source
+      /// row.
+      /// \param[in] _verticalAngleMax Vertical angle of the last source
+      /// row.
+      /// \param[in] _angles Horizontal angle of each output column.
+      /// \param[in] _verticalAngles Vertical angle of each output row.
+      /// \param[in] _edgeThreshold Largest range spread, in meters, that
+      /// is still interpolated.
+      public: void Configure(const unsigned int _width,
+                  const unsigned int _height, const double _angleMin,
+                  const double _angleMax, const double _verticalAngleMin,
+                  const double _verticalAngleMax,
+                  const std::vector<double> &_angles,
+                  const std::vector<double> &_verticalAngles,
+                  const float _edgeThreshold);
+
+      /// \brief Resample one frame.
+      /// \param[in] _ranges SourceCount() source ranges.
+      /// \param[in] _intensities SourceCount() source intensities.
+      /// \param[out] _outRanges OutputCount() resampled ranges.
+      /// \param[out] _outIntensities OutputCount() resampled intensities.
+      /// \param[in] _pool Pool to spread rows over, or null to run on the
+      /// calling thread.
+      public: void Apply(const float *_ranges, const float *_intensities,
+                  float *_outRanges, float *_outIntensities,
+                  NpsBeamWorkerPool *_pool) const;
+
+      /// \brief Check whether every output cell sits exactly on a source
+      /// texel of the same index, in which case Apply is a copy and may
+      /// be skipped.
+      /// \return True if the output grid is the source grid.
+      public: bool IsIdentity() const;
+
+      /// \brief Number of source cells.
+      /// \return Source width times height.
+      public: size_t SourceCount() const;
+
+      /// \brief Number of output cells.
+      /// \return Output width times height.
+      public: size_t OutputCount() const;
+
+      /// \brief Number of output columns.
+      /// \return Output width.
+      public: unsigned int Width() const;
+
+      /// \brief Number of output rows.
+      /// \return Output height.
+      public: unsigned int Height() const;
+
+      /// \brief Evenly spaced beam angles.
+      /// \param[in] _min First angle.
+      /// \param[in] _max Last angle.
+      /// \param[in] _count Number of angles; a single angle lies halfway.
+      /// \return The angles.
+      public: static std::vector<double> UniformAngles(const double _min,
+                  const double _max, const unsigned int _count);
+
+      /// \brief Resample the output rows [_begin, _end).
+      private: void ApplyRows(const float *_ranges, const float *_intensities,
+                   float *_outRanges, float *_outIntensities,
+                   const size_t _begin, const size_t _end) const;
+
+      /// \brief Index of the top left texel of each output cell.
+      private: std::vector<int32_t> bases;
+
+      /// \brief Horizontal weight of the right texels of each output cell.
+      private: std::vector<float> weightsX;
+
+      /// \brief Vertical weight of the bottom texels of each output cell.
+      private: std::vector<float> weightsY;
+
+      /// \brief Index offset of the right texels, 0 for one source column.
+      private: int32_t stepX = 0;
+
+      /// \brief Index offset of the bottom texels, 0 for one source row.
+      private: int32_t stepY = 0;
+
+      /// \brief Largest texel spread that is interpolated.
+      private: float edgeThreshold = 0;
+
+      /// \brief Source width.
+      private: unsigned int sourceWidth = 0;
+
+      /// \brief Source height.
+      private: unsigned int sourceHeight = 0;
+
+      /// \brief Output width.
+      private: unsigned int width = 0;
+
+      /// \brief Output height.
+      private: unsigned int height = 0;
+
+      /// \brief True if the output grid is the source grid.
+      private: bool identity = false;
+    };
+  }
+}
+#endif
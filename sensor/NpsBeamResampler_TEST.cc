@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "NpsBeamResampler.hh"
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  const double kAngleMin = -1.2;
+  const double kAngleMax = 1.2;
+  const double kVerticalMin = -0.3;
+  const double kVerticalMax = 0.3;
+
+  /// \brief Smooth range field the source grid samples.
+  double Field(const double _yaw, const double _pitch)
+  {
+    return 5.0 + 2.0 * std::sin(3.0 * _yaw) + std::cos(4.0 * _pitch);
+  }
+
+  /// \brief Source grid sampling Field.
+  struct Grid
+  {
+    /// \brief Rays per row.
+    public: unsigned int width;
+
+    /// \brief Rows.
+    public: unsigned int height;
+
+    /// \brief Row major ranges.
+    public: std::vector<float> ranges;
+
+    /// \brief Row major intensities, one per ray index.
+    public: std::vector<float> intensities;
+  };
+
+  /// \brief Sample Field on a uniform _width by _height grid.
+  Grid MakeGrid(const unsigned int _width, const unsigned int _height)
+  {
+    Grid grid;
+    grid.width = _width;
+    grid.height = _height;
+    const std::vector<double> angles =
+      NpsBeamResampler::UniformAngles(kAngleMin, kAngleMax, _width);
+    const std::vector<double> verticalAngles =
+      NpsBeamResampler::UniformAngles(kVerticalMin, kVerticalMax, _height);
+    for (unsigned int v = 0; v < _height; ++v)
+    {
+      for (unsigned int h = 0; h < _width; ++h)
+      {
+        grid.ranges.push_back(Field(angles[h], verticalAngles[v]));
+        grid.intensities.push_back(0.5f);
+      }
+    }
+    return grid;
+  }
+
+  /// \brief Resample _grid onto the given beam angles and return the
+  /// largest deviation from Field.
+  double MaxError(const Grid &_grid, const std::vector<double> &_angles,
+      const std::vector<double> &_verticalAngles)
+  {
+    NpsBeamResampler resampler;
+    resampler.Configure(_grid.width, _grid.height, kAngleMin, kAngleMax,
+        kVerticalMin, kVerticalMax, _angles, _verticalAngles, 0.5f);
+    EXPECT_FALSE(resampler.IsIdentity());
+    EXPECT_EQ(_grid.ranges.size(), resampler.SourceCount());
+    EXPECT_EQ(_angles.size() * _verticalAngles.size(),
+        resampler.OutputCount());
+
+    std::vector<float> ranges(resampler.OutputCount());
+    std::vector<float> intensities(resampler.OutputCount());
+    resampler.Apply(_grid.ranges.data(), _grid.intensities.data(),
+        ranges.data(), intensities.data(), nullptr);
+
+    double maxError = 0;
+    for (size_t v = 0; v < _verticalAngles.size(); ++v)
+    {
+      for (size_t h = 0; h < _angles.size(); ++h)
+      {
+        const size_t cell = v * _angles.size() + h;
+        maxError = std::max(maxError, std::fabs(ranges[cell] -
+              Field(_angles[h], _verticalAngles[v])));
+        EXPECT_FLOAT_EQ(0.5f, intensities[cell]);
+      }
+    }
+    return maxError;
+  }
+
+  /// \brief Resample a single row of texels at fractional positions.
+  /// \param[in] _texels Source ranges; intensities are the texel index.
+  /// \param[in] _positions Output positions in texel units.
+  /// \param[out] _intensities Resampled intensities.
+  /// \return Resampled ranges.
+  std::vector<float> ResampleRow(const std::vector<float> &_texels,
+      const std::vector<double> &_positions, std::vector<float> &_intensities)
+  {
+    const unsigned int count = _texels.size();
+    std::vector<double> angles;
+    for (const double position : _positions)
+      angles.push_back(position / (count - 1));
+
+    std::vector<float> sourceIntensities;
+    for (unsigned int i = 0; i < count; ++i)
+      sourceIntensities.push_back(i);
+
+    NpsBeamResampler resampler;
+    resampler.Configure(count, 1, 0.0, 1.0, 0.0, 0.0, angles,
+        std::vector<double>(1, 0.0), 0.5f);
+
+    std::vector<float> ranges(resampler.OutputCount());
+    _intensities.resize(resampler.OutputCount());
+    resampler.Apply(_texels.data(), sourceIntensities.data(), ranges.data(),
+        _intensities.data(), nullptr);
+    return ranges;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamResampler, UniformAngles)
+{
+  const std::vector<double> one = NpsBeamResampler::UniformAngles(-1, 3, 1);
+  ASSERT_EQ(1u, one.size());
+  EXPECT_DOUBLE_EQ(1.0, one[0]);
+
+  const std::vector<double> five = NpsBeamResampler::UniformAngles(-1, 1, 5);
+  ASSERT_EQ(5u, five.size());
+  EXPECT_DOUBLE_EQ(-1.0, five.front());
+  EXPECT_DOUBLE_EQ(0.5, five[3]);
+  EXPECT_DOUBLE_EQ(1.0, five.back());
+
+  EXPECT_TRUE(NpsBeamResampler::UniformAngles(0, 1, 0).empty());
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamResampler, IdentityCopies)
+{
+  const Grid grid = MakeGrid(37, 5);
+  NpsBeamResampler resampler;
+  resampler.Configure(grid.width, grid.height, kAngleMin, kAngleMax,
+      kVerticalMin, kVerticalMax,
+      NpsBeamResampler::UniformAngles(kAngleMin, kAngleMax, grid.width),
+      NpsBeamResampler::UniformAngles(kVerticalMin, kVerticalMax,
+        grid.height), 0.5f);
+  EXPECT_TRUE(resampler.IsIdentity());
+  EXPECT_EQ(grid.width, resampler.Width());
+  EXPECT_EQ(grid.height, resampler.Height());
+
+  std::vector<float> ranges(resampler.OutputCount());
+  std::vector<float> intensities(resampler.OutputCount());
+  resampler.Apply(grid.ranges.data(), grid.intensities.data(),
+      ranges.data(), intensities.data(), nullptr);
+  EXPECT_EQ(grid.ranges, ranges);
+  EXPECT_EQ(grid.intensities, intensities);
+
+  // One beam off its ray is no longer a copy
+  std::vector<double> shifted =
+    NpsBeamResampler::UniformAngles(kAngleMin, kAngleMax, grid.width);
+  shifted[10] += 0.01;
+  resampler.Configure(grid.width, grid.height, kAngleMin, kAngleMax,
+      kVerticalMin, kVerticalMax, shifted,
+      NpsBeamResampler::UniformAngles(kVerticalMin, kVerticalMax,
+        grid.height), 0.5f);
+  EXPECT_FALSE(resampler.IsIdentity());
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamResampler, SmoothFieldAccuracy)
+{
+  // Odd sizes leave vector tails in every row
+  const Grid grid = MakeGrid(257, 33);
+
+  // Bilinear error on Field is bounded by h^2 / 8 times the largest
+  // second derivative along each axis: 18 across, 16 up
+  const double dx = (kAngleMax - kAngleMin) / (grid.width - 1);
+  const double dy = (kVerticalMax - kVerticalMin) / (grid.height - 1);
+  const double bound = (18 * dx * dx + 16 * dy * dy) / 8 + 1e-5;
+
+  // Half resolution
+  EXPECT_LT(MaxError(grid,
+        NpsBeamResampler::UniformAngles(kAngleMin, kAngleMax, 128),
+        NpsBeamResampler::UniformAngles(kVerticalMin, kVerticalMax, 16)),
+      bound);
+
+  // Double resolution
+  EXPECT_LT(MaxError(grid,
+        NpsBeamResampler::UniformAngles(kAngleMin, kAngleMax, 515),
+        NpsBeamResampler::UniformAngles(kVerticalMin, kVerticalMax, 67)),
+      bound);
+
+  // Denser towards the center, like a focused array
+  std::vector<double> focused =
+    NpsBeamResampler::UniformAngles(kAngleMin, kAngleMax, 301);
+  for (double &angle : focused)
+    angle = kAngleMax * std::sin(angle / kAngleMax * M_PI / 2);
+  EXPECT_LT(MaxError(grid, focused,
+        NpsBeamResampler::UniformAngles(kVerticalMin, kVerticalMax, 33)),
+      bound);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamResampler, EdgeTakesNearest)
+{
+  // A wall at 2 m in front of one at 8 m, and a gentle slope that stays
+  // under the threshold
+  const std::vector<float> texels = {2, 2, 2, 8, 8, 8, 8.2f, 8.4f, 8.6f};
+  const std::vector<double> positions = {1.5, 2.25, 2.5, 2.75, 3.5, 6.5};
+  std::vector<float> intensities;
+  const std::vector<float> ranges = ResampleRow(texels, positions,
+      intensities);
+  ASSERT_EQ(positions.size(), ranges.size());
+
+  EXPECT_FLOAT_EQ(2.0f, ranges[0]);
+  EXPECT_FLOAT_EQ(1.5f, intensities[0]);
+
+  // Across the step each beam snaps to one surface, with its intensity
+  EXPECT_EQ(2.0f, ranges[1]);
+  EXPECT_EQ(2.0f, intensities[1]);
+  EXPECT_EQ(8.0f, ranges[2]);
+  EXPECT_EQ(3.0f, intensities[2]);
+  EXPECT_EQ(8.0f, ranges[3]);
+  EXPECT_EQ(3.0f, intensities[3]);
+
+  EXPECT_FLOAT_EQ(8.0f, ranges[4]);
+  EXPECT_FLOAT_EQ(8.3f, ranges[5]);
+  EXPECT_FLOAT_EQ(6.5f, intensities[5]);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamResampler, NonFiniteTakesNearest)
+{
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const std::vector<float> texels = {1, nan, 1, 1, inf, 1, 1};
+  const std::vector<double> positions = {0.25, 0.75, 2.5, 3.25, 3.75};
+  std::vector<float> intensities;
+  const std::vector<float> ranges = ResampleRow(texels, positions,
+      intensities);
+  ASSERT_EQ(positions.size(), ranges.size());
+
+  // A missing return only spreads to the beams nearest to it
+  EXPECT_EQ(1.0f, ranges[0]);
+  EXPECT_EQ(0.0f, intensities[0]);
+  EXPECT_TRUE(std::isnan(ranges[1]));
+  EXPECT_FLOAT_EQ(1.0f, ranges[2]);
+  EXPECT_EQ(1.0f, ranges[3]);
+  EXPECT_EQ(3.0f, intensities[3]);
+  EXPECT_EQ(inf, ranges[4]);
+  EXPECT_EQ(4.0f, intensities[4]);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamResampler, PoolMatchesCallingThread)
+{
+  Grid grid = MakeGrid(256, 64);
+  // A few edges so both the blend and the nearest paths run
+  for (size_t i = 0; i < grid.ranges.size(); i += 97)
+    grid.ranges[i] += 10.0f;
+
+  NpsBeamResampler resampler;
+  resampler.Configure(grid.width, grid.height, kAngleMin, kAngleMax,
+      kVerticalMin, kVerticalMax,
+      NpsBeamResampler::UniformAngles(kAngleMin, kAngleMax, 509),
+      NpsBeamResampler::UniformAngles(kVerticalMin, kVerticalMax, 131),
+      0.5f);
+
+  std::vector<float> ranges(resampler.OutputCount());
+  std::vector<float> intensities(resampler.OutputCount());
+  resampler.Apply(grid.ranges.data(), grid.intensities.data(),
+      ranges.data(), intensities.data(), nullptr);
+
+  std::vector<float> poolRanges(resampler.OutputCount());
+  std::vector<float> poolIntensities(resampler.OutputCount());
+  resampler.Apply(grid.ranges.data(), grid.intensities.data(),
+      poolRanges.data(), poolIntensities.data(),
+      &NpsBeamWorkerPool::Instance());
+
+  EXPECT_EQ(ranges, poolRanges);
+  EXPECT_EQ(intensities, poolIntensities);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
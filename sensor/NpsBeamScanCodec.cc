@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "NpsBeamScanCodec.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Compact scan magic, "NPSC".
+  const uint8_t kMagic[4] = {'N', 'P', 'S', 'C'};
+
+  /// \brief Compact scan format version.
+  const uint8_t kVersion = 1;
+
+  /// \brief Flag set when the ranges are delta coded.
+  const uint8_t kFlagDelta = 1;
+
+  /// \brief Flag set when the scan has intensities.
+  const uint8_t kFlagIntensities = 2;
+
+  /// \brief Range code of ranges below the minimum.
+  const uint16_t kCodeBelow = 0;
+
+  /// \brief Largest range code of a valid range.
+  const uint16_t kCodeMax = 0xFFFD;
+
+  /// \brief Range code of cells without data.
+  const uint16_t kCodeNaN = 0xFFFE;
+
+  /// \brief Range code of ranges beyond the maximum.
+  const uint16_t kCodeAbove = 0xFFFF;
+
+  /// \brief Largest encoded size of one delta coded range.
+  const size_t kMaxVarintSize = 3;
+
+  /// \brief Write an unsigned integer in little endian order.
+  template <typename T>
+  inline uint8_t *PutUint(uint8_t *_out, const T _value)
+  {
+    for (size_t i = 0; i < sizeof(T); ++i)
+      _out[i] = static_cast<uint8_t>(_value >> (8 * i));
+    return _out + sizeof(T);
+  }
+
+  /// \brief Read an unsigned integer in little endian order.
+  template <typename T>
+  inline const uint8_t *GetUint(const uint8_t *_in, T &_value)
+  {
+    _value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+      _value |= static_cast<T>(_in[i]) << (8 * i);
+    return _in + sizeof(T);
+  }
+
+  /// \brief Write a double in little endian order.
+  inline uint8_t *PutDouble(uint8_t *_out, const double _value)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &_value, sizeof(bits));
+    return PutUint(_out, bits);
+  }
+
+  /// \brief Read a double in little endian order.
+  inline const uint8_t *GetDouble(const uint8_t *_in, double &_value)
+  {
+    uint64_t bits;
+    _in = GetUint(_in, bits);
+    std::memcpy(&_value, &bits, sizeof(bits));
+    return _in;
+  }
+
+  /// \brief Quantize one processed range.
+  inline uint16_t RangeCode(const float _range, const float _rangeMin,
+      const float _scale)
+  {
+    if (std::isnan(_range))
+      return kCodeNaN;
+    else if (_range == std::numeric_limits<float>::infinity())
+      return kCodeAbove;
+    else if (_range == -std::numeric_limits<float>::infinity())
+      return kCodeBelow;
+
+    const float steps = std::max((_range - _rangeMin) * _scale, 0.0f);
+    return static_cast<uint16_t>(
+        std::min(steps + 1.5f, static_cast<float>(kCodeMax)));
+  }
+
+  /// \brief Restore one range from its code.
+  inline float RangeValue(const uint16_t _code, const float _rangeMin,
+      const float _step)
+  {
+    switch (_code)
+    {
+      case kCodeBelow:
+        return -std::numeric_limits<float>::infinity();
+      case kCodeNaN:
+        return std::numeric_limits<float>::quiet_NaN();
+      case kCodeAbove:
+        return std::numeric_limits<float>::infinity();
+      default:
+        return _rangeMin + (_code - 1) * _step;
+    }
+  }
+}
+
+const size_t NpsBeamScanCodec::HeaderSize = 168;
+
+//////////////////////////////////////////////////
+void NpsBeamScanCodec::Configure(const double _rangeResolution,
+    const double _intensityMax, const bool _delta, const bool _intensities)
+{
+  this->rangeResolution = _rangeResolution;
+  this->intensityMax = _intensityMax;
+  this->delta = _delta;
+  this->intensities = _intensities;
+}
+
+//////////////////////////////////////////////////
+double NpsBeamScanCodec::RangeStep(const NpsBeamFrame &_frame) const
+{
+  const double span = std::max(_frame.rangeMax - _frame.rangeMin, 0.0);
+  return std::max(this->rangeResolution, span / (kCodeMax - 1));
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScanCodec::Encode(const NpsBeamFrame &_frame,
+    std::string &_out) const
+{
+  const size_t count = static_cast<size_t>(_frame.width) * _frame.height;
+  const double step = this->RangeStep(_frame);
+
+  double intensityScale = 1.0;
+  if (this->intensities)
+  {
+    double maxIntensity = this->intensityMax;
+    if (maxIntensity <= 0)
+    {
+      float frameMax = 0;
+      for (size_t i = 0; i < count; ++i)
+      {
+        if (std::isfinite(_frame.intensities[i]))
+          frameMax = std::max(frameMax, _frame.intensities[i]);
+      }
+      maxIntensity = frameMax;
+    }
+    if (maxIntensity > 0)
+      intensityScale = maxIntensity / 255.0;
+  }
+
+  // Size for the worst case, then trim to what was written
+  _out.resize(HeaderSize + (this->intensities ? count : 0) +
+      count * (this->delta ? kMaxVarintSize : sizeof(uint16_t)));
+  uint8_t *const begin = reinterpret_cast<uint8_t *>(&_out[0]);
+  uint8_t *out = begin;
+
+  std::memcpy(out, kMagic, sizeof(kMagic));
+  out += sizeof(kMagic);
+  *out++ = kVersion;
+  *out++ = (this->delta ? kFlagDelta : 0) |
+    (this->intensities ? kFlagIntensities : 0);
+  out = PutUint<uint16_t>(out, 0);
+  out = PutUint<uint32_t>(out, _frame.width);
+  out = PutUint<uint32_t>(out, _frame.height);
+  out = PutUint<uint64_t>(out, _frame.sequence);
+  out = PutUint<uint32_t>(out, static_cast<uint32_t>(_frame.sec));
+  out = PutUint<uint32_t>(out, static_cast<uint32_t>(_frame.nsec));
+  for (double value : _frame.pose)
+    out = PutDouble(out, value);
+  out = PutDouble(out, _frame.angleMin);
+  out = PutDouble(out, _frame.angleMax);
+  out = PutDouble(out, _frame.angleStep);
+  out = PutDouble(out, _frame.verticalAngleMin);
+  out = PutDouble(out, _frame.verticalAngleMax);
+  out = PutDouble(out, _frame.verticalAngleStep);
+  out = PutDouble(out, _frame.rangeMin);
+  out = PutDouble(out, _frame.rangeMax);
+  out = PutDouble(out, step);
+  out = PutDouble(out, intensityScale);
+
+  // Intensities have a fixed size, so they go first and the variable
+  // size range stream needs no length field
+  if (this->intensities)
+  {
+    const float scale = static_cast<float>(1.0 / intensityScale);
+    for (size_t i = 0; i < count; ++i)
+    {
+      const float value = _frame.intensities[i] * scale;
+      out[i] = value >= 0.0f ?
+        static_cast<uint8_t>(std::min(value + 0.5f, 255.0f)) : 0;
+    }
+    out += count;
+  }
+
+  const float rangeMin = static_cast<float>(_frame.rangeMin);
+  const float rangeScale = static_cast<float>(1.0 / step);
+  if (this->delta)
+  {
+    int32_t previous = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      const int32_t code = RangeCode(_frame.ranges[i], rangeMin, rangeScale);
+      const int32_t diff = code - previous;
+      previous = code;
+
+      uint32_t zigzag = (static_cast<uint32_t>(diff) << 1) ^
+        static_cast<uint32_t>(diff >> 31);
+      while (zigzag >= 0x80)
+      {
+        *out++ = static_cast<uint8_t>(zigzag | 0x80);
+        zigzag >>= 7;
+      }
+      *out++ = static_cast<uint8_t>(zigzag);
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      out = PutUint<uint16_t>(out,
+          RangeCode(_frame.ranges[i], rangeMin, rangeScale));
+    }
+  }
+
+  _out.resize(out - begin);
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamScanCodec::Decode(const void *_data, const size_t _size,
+    NpsBeamFrame &_frame)
+{
+  const uint8_t *in = static_cast<const uint8_t *>(_data);
+  const uint8_t *const end = in + _size;
+
+  if (_size < HeaderSize || std::memcmp(in, kMagic, sizeof(kMagic)) != 0 ||
+      in[4] != kVersion)
+  {
+    return false;
+  }
+  const uint8_t flags = in[5];
+  in += 8;
+
+  uint32_t width, height, sec, nsec;
+  in = GetUint(in, width);
+  in = GetUint(in, height);
+  in = GetUint(in, _frame.sequence);
+  in = GetUint(in, sec);
+  in = GetUint(in, nsec);
+  for (double &value : _frame.pose)
+    in = GetDouble(in, value);
+  in = GetDouble(in, _frame.angleMin);
+  in = GetDouble(in, _frame.angleMax);
+  in = GetDouble(in, _frame.angleStep);
+  in = GetDouble(in, _frame.verticalAngleMin);
+  in = GetDouble(in, _frame.verticalAngleMax);
+  in = GetDouble(in, _frame.verticalAngleStep);
+  in = GetDouble(in, _frame.rangeMin);
+  in = GetDouble(in, _frame.rangeMax);
+  double step, intensityScale;
+  in = GetDouble(in, step);
+  in = GetDouble(in, intensityScale);
+  _frame.sec = static_cast<int32_t>(sec);
+  _frame.nsec = static_cast<int32_t>(nsec);
+
+  const size_t count = static_cast<size_t>(width) * height;
+  const bool hasIntensities = (flags & kFlagIntensities) != 0;
+  const bool isDelta = (flags & kFlagDelta) != 0;
+  const size_t remaining = end - in;
+  if ((hasIntensities && remaining < count) ||
+      (!isDelta && remaining < count * (hasIntensities ? 3 : 2)))
+  {
+    return false;
+  }
+
+  _frame.Resize(width, height);
+
+  if (hasIntensities)
+  {
+    const float scale = static_cast<float>(intensityScale);
+    for (size_t i = 0; i < count; ++i)
+      _frame.intensities[i] = in[i] * scale;
+    in += count;
+  }
+  else
+  {
+    std::fill(_frame.intensities.begin(), _frame.intensities.end(), 0.0f);
+  }
+
+  const float rangeMin = static_cast<float>(_frame.rangeMin);
+  const float rangeStep = static_cast<float>(step);
+  if (isDelta)
+  {
+    int32_t previous = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      uint32_t zigzag = 0;
+      for (unsigned int shift = 0; ; shift += 7)
+      {
+        if (in == end || shift > 14)
+          return false;
+        const uint8_t byte = *in++;
+        zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+          break;
+      }
+
+      previous += static_cast<int32_t>(zigzag >> 1) ^
+        -static_cast<int32_t>(zigzag & 1);
+      if (previous < 0 || previous > kCodeAbove)
+        return false;
+      _frame.ranges[i] = RangeValue(static_cast<uint16_t>(previous),
+          rangeMin, rangeStep);
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      uint16_t code;
+      in = GetUint(in, code);
+      _frame.ranges[i] = RangeValue(code, rangeMin, rangeStep);
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_SCAN_CODEC_HH
+#define NPS_BEAM_SCAN_CODEC_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "NpsBeamFrameStore.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Compact, quantized encoding of processed beam frames.
+    ///
+    /// A compact scan is a little endian header carrying the frame
+    /// metadata, followed by the ranges as uint16 steps of a fixed
+    /// resolution above the minimum range and the intensities as uint8
+    /// steps of a per-scan scale. Code 0 marks ranges below the minimum
+    /// (-inf), 0xFFFF ranges beyond the maximum (+inf) and 0xFFFE cells
+    /// without data (NaN), so REP 117 masking survives the round trip.
+    ///
+    /// With delta coding the range codes are stored as zigzag varints of
+    /// the difference to the previous cell, which typically takes one
+    /// byte per cell on smooth surfaces.
+    class NpsBeamScanCodec
+    {
+      /// \brief Set the encoding parameters.
+      /// \param[in] _rangeResolution Range quantization step. It is
+      /// enlarged when needed so that the whole range fits in 16 bits.
+      /// \param[in] _intensityMax Intensity mapped to 255, or 0 to scale
+      /// every scan to its own maximum intensity.
+      /// \param[in] _delta Delta and varint code the ranges.
+      /// \param[in] _intensities Include intensities.
+      public: void Configure(const double _rangeResolution,
+                  const double _intensityMax, const bool _delta,
+                  const bool _intensities);
+
+      /// \brief Encode a processed frame.
+      /// \param[in] _frame Frame to encode.
+      /// \param[out] _out Encoded scan. Its capacity is reused, so a
+      /// string kept across frames settles without reallocating.
+      public: void Encode(const NpsBeamFrame &_frame,
+                  std::string &_out) const;
+
+      /// \brief Decode a compact scan into a frame.
+      ///
+      /// The frame sequence, stamp, pose and geometry are restored from
+      /// the header. Intensities are zero when the scan has none.
+      /// \param[in] _data Encoded scan.
+      /// \param[in] _size Size of _data in bytes.
+      /// \param[out] _frame Decoded frame.
+      /// \return False if _data is not a valid compact scan.
+      public: static bool Decode(const void *_data, const size_t _size,
+                  NpsBeamFrame &_frame);
+
+      /// \brief Range step used to encode a frame.
+      /// \param[in] _frame Frame to encode.
+      /// \return Effective range resolution.
+      public: double RangeStep(const NpsBeamFrame &_frame) const;
+
+      /// \brief Size of the encoded header in bytes.
+      public: static const size_t HeaderSize;
+
+      /// \brief Requested range quantization step.
+      private: double rangeResolution = 0.001;
+
+      /// \brief Intensity mapped to 255, 0 for per-scan scaling.
+      private: double intensityMax = 0;
+
+      /// \brief True to delta and varint code the ranges.
+      private: bool delta = true;
+
+      /// \brief True to include intensities.
+      private: bool intensities = true;
+    };
+  }
+}
+#endif
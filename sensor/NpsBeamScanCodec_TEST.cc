@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamScanCodec.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Fill a frame with ranges inside the limits, a few masked
+  /// cells and varying intensities.
+  void FillFrame(NpsBeamFrame &_frame, const unsigned int _width,
+      const unsigned int _height)
+  {
+    _frame.Resize(_width, _height);
+    _frame.sec = 12;
+    _frame.nsec = 345678;
+    _frame.angleMin = -1.5;
+    _frame.angleMax = 1.5;
+    _frame.angleStep = 3.0 / (_width - 1);
+    _frame.verticalAngleMin = -0.2;
+    _frame.verticalAngleMax = 0.2;
+    _frame.verticalAngleStep = 0.4 / (_height - 1);
+    _frame.rangeMin = 0.5;
+    _frame.rangeMax = 80.0;
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> range(
+        static_cast<float>(_frame.rangeMin),
+        static_cast<float>(_frame.rangeMax));
+    std::uniform_real_distribution<float> intensity(0.0f, 3.0f);
+    for (size_t i = 0; i < _frame.ranges.size(); ++i)
+    {
+      _frame.ranges[i] = range(random);
+      _frame.intensities[i] = intensity(random);
+    }
+
+    const float inf = std::numeric_limits<float>::infinity();
+    _frame.ranges[0] = -inf;
+    _frame.ranges[1] = inf;
+    _frame.ranges[2] = std::numeric_limits<float>::quiet_NaN();
+    _frame.ranges[3] = static_cast<float>(_frame.rangeMin);
+    _frame.ranges[4] = static_cast<float>(_frame.rangeMax);
+  }
+
+  /// \brief Encode and decode a frame, checking the lossy error bounds.
+  void RoundTrip(const NpsBeamScanCodec &_codec, const NpsBeamFrame &_frame,
+      const bool _intensities)
+  {
+    std::string encoded;
+    _codec.Encode(_frame, encoded);
+
+    NpsBeamFrame decoded;
+    ASSERT_TRUE(NpsBeamScanCodec::Decode(encoded.data(), encoded.size(),
+        decoded));
+    ASSERT_EQ(_frame.width, decoded.width);
+    ASSERT_EQ(_frame.height, decoded.height);
+    EXPECT_EQ(_frame.sequence, decoded.sequence);
+    EXPECT_EQ(_frame.sec, decoded.sec);
+    EXPECT_EQ(_frame.nsec, decoded.nsec);
+    EXPECT_DOUBLE_EQ(_frame.angleStep, decoded.angleStep);
+    EXPECT_DOUBLE_EQ(_frame.rangeMin, decoded.rangeMin);
+    EXPECT_DOUBLE_EQ(_frame.rangeMax, decoded.rangeMax);
+
+    // Quantization rounds to the nearest step; allow float rounding on
+    // top of half a step
+    const double rangeBound = _codec.RangeStep(_frame) * 0.5 + 1e-4;
+    float maxIntensity = 0;
+    for (float value : _frame.intensities)
+      maxIntensity = std::max(maxIntensity, value);
+    const double intensityBound = maxIntensity / 255.0 * 0.5 + 1e-5;
+
+    for (size_t i = 0; i < _frame.ranges.size(); ++i)
+    {
+      const float expected = _frame.ranges[i];
+      const float actual = decoded.ranges[i];
+      if (std::isnan(expected))
+        EXPECT_TRUE(std::isnan(actual)) << i;
+      else if (std::isinf(expected))
+        EXPECT_EQ(expected, actual) << i;
+      else
+        EXPECT_NEAR(expected, actual, rangeBound) << i;
+
+      if (_intensities)
+      {
+        EXPECT_NEAR(_frame.intensities[i], decoded.intensities[i],
+            intensityBound) << i;
+      }
+      else
+      {
+        EXPECT_FLOAT_EQ(0.0f, decoded.intensities[i]) << i;
+      }
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScanCodec, RoundTripFixed)
+{
+  NpsBeamFrame frame;
+  FillFrame(frame, 181, 16);
+  frame.sequence = 42;
+
+  NpsBeamScanCodec codec;
+  codec.Configure(0.002, 0, false, true);
+  RoundTrip(codec, frame, true);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScanCodec, RoundTripDelta)
+{
+  NpsBeamFrame frame;
+  FillFrame(frame, 181, 16);
+  frame.sequence = 43;
+
+  NpsBeamScanCodec codec;
+  codec.Configure(0.002, 0, true, false);
+  RoundTrip(codec, frame, false);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScanCodec, ResolutionEnlargedToFit)
+{
+  NpsBeamFrame frame;
+  FillFrame(frame, 64, 4);
+
+  // 80 m at 1 mm does not fit in 16 bits, the step has to grow
+  NpsBeamScanCodec codec;
+  codec.Configure(0.001, 0, true, true);
+  EXPECT_GT(codec.RangeStep(frame), 0.001);
+  RoundTrip(codec, frame, true);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScanCodec, RejectsTruncated)
+{
+  NpsBeamFrame frame;
+  FillFrame(frame, 64, 4);
+
+  NpsBeamScanCodec codec;
+  codec.Configure(0.01, 0, false, true);
+  std::string encoded;
+  codec.Encode(frame, encoded);
+
+  NpsBeamFrame decoded;
+  EXPECT_FALSE(NpsBeamScanCodec::Decode(encoded.data(),
+      NpsBeamScanCodec::HeaderSize - 1, decoded));
+  EXPECT_FALSE(NpsBeamScanCodec::Decode(encoded.data(),
+      encoded.size() - 1, decoded));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScanCodec, EncodesPublishedSequence)
+{
+  // A frame encoded before EndWrite must carry the sequence readers get
+  NpsBeamFrameStore store;
+  NpsBeamScanCodec codec;
+  codec.Configure(0.01, 0, true, true);
+
+  for (int i = 0; i < 5; ++i)
+  {
+    NpsBeamFrame *frame = store.BeginWrite();
+    FillFrame(*frame, 32, 2);
+    const uint64_t sequence = store.AssignSequence(frame);
+    EXPECT_EQ(sequence, store.AssignSequence(frame));
+
+    std::string encoded;
+    codec.Encode(*frame, encoded);
+    store.EndWrite(frame);
+
+    NpsBeamFrame decoded;
+    ASSERT_TRUE(NpsBeamScanCodec::Decode(encoded.data(), encoded.size(),
+        decoded));
+    const NpsBeamFramePtr latest = store.Latest();
+    ASSERT_TRUE(latest != nullptr);
+    EXPECT_EQ(sequence, latest->sequence);
+    EXPECT_EQ(latest->sequence, decoded.sequence);
+    EXPECT_EQ(static_cast<uint64_t>(i + 1), decoded.sequence);
+  }
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#include "NpsBeamScanKernel.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Scalar version of the per-cell range processing.
+  inline float ProcessRange(const float _in, const float _noise,
+      const float _rangeMin, const float _rangeMax)
+  {
+    if (_in >= _rangeMax)
+      return std::numeric_limits<float>::infinity();
+    else if (_in <= _rangeMin)
+      return -std::numeric_limits<float>::infinity();
+    else if (std::isnan(_in))
+      return _rangeMax;
+
+    return std::min(std::max(_in + _noise, _rangeMin), _rangeMax);
+  }
+}
+
+//////////////////////////////////////////////////
+void sensors::DeinterleaveBeamFrame(const float *_frame, const size_t _count,
+    const size_t _stride, float *_ranges, float *_intensities)
+{
+  if (_intensities)
+  {
+    for (size_t i = 0; i < _count; ++i)
+    {
+      _ranges[i] = _frame[i * _stride];
+      _intensities[i] = _frame[i * _stride + 1];
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < _count; ++i)
+      _ranges[i] = _frame[i * _stride];
+  }
+}
+
+//////////////////////////////////////////////////
+void sensors::ProcessBeamRanges(const float *_in, const float *_noise,
+    float *_out, const size_t _count, const float _rangeMin,
+    const float _rangeMax)
+{
+#if defined(__AVX2__)
+  ProcessBeamRangesAvx2(_in, _noise, _out, _count, _rangeMin, _rangeMax);
+#elif defined(__SSE2__)
+  ProcessBeamRangesSse2(_in, _noise, _out, _count, _rangeMin, _rangeMax);
+#else
+  ProcessBeamRangesScalar(_in, _noise, _out, _count, _rangeMin, _rangeMax);
+#endif
+}
+
+//////////////////////////////////////////////////
+void sensors::ProcessBeamRangesScalar(const float *_in, const float *_noise,
+    float *_out, const size_t _count, const float _rangeMin,
+    const float _rangeMax)
+{
+  for (size_t i = 0; i < _count; ++i)
+  {
+    _out[i] = ProcessRange(_in[i], _noise ? _noise[i] : 0.0f,
+        _rangeMin, _rangeMax);
+  }
+}
+
+#if defined(__SSE2__)
+//////////////////////////////////////////////////
+void sensors::ProcessBeamRangesSse2(const float *_in, const float *_noise,
+    float *_out, const size_t _count, const float _rangeMin,
+    const float _rangeMax)
+{
+  const __m128 vMin = _mm_set1_ps(_rangeMin);
+  const __m128 vMax = _mm_set1_ps(_rangeMax);
+  const __m128 vPosInf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  const __m128 vNegInf = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+
+  size_t i = 0;
+  for (; i + 4 <= _count; i += 4)
+  {
+    const __m128 x = _mm_loadu_ps(_in + i);
+    __m128 v = _noise ? _mm_add_ps(x, _mm_loadu_ps(_noise + i)) : x;
+    v = _mm_min_ps(_mm_max_ps(v, vMin), vMax);
+
+    __m128 mask = _mm_cmpunord_ps(x, x);
+    v = _mm_or_ps(_mm_and_ps(mask, vMax), _mm_andnot_ps(mask, v));
+    mask = _mm_cmple_ps(x, vMin);
+    v = _mm_or_ps(_mm_and_ps(mask, vNegInf), _mm_andnot_ps(mask, v));
+    mask = _mm_cmpge_ps(x, vMax);
+    v = _mm_or_ps(_mm_and_ps(mask, vPosInf), _mm_andnot_ps(mask, v));
+    _mm_storeu_ps(_out + i, v);
+  }
+
+  ProcessBeamRangesScalar(_in + i, _noise ? _noise + i : nullptr, _out + i,
+      _count - i, _rangeMin, _rangeMax);
+}
+#endif
+
+#if defined(__AVX2__)
+//////////////////////////////////////////////////
+void sensors::ProcessBeamRangesAvx2(const float *_in, const float *_noise,
+    float *_out, const size_t _count, const float _rangeMin,
+    const float _rangeMax)
+{
+  const __m256 vMin = _mm256_set1_ps(_rangeMin);
+  const __m256 vMax = _mm256_set1_ps(_rangeMax);
+  const __m256 vPosInf =
+    _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 vNegInf =
+    _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+
+  size_t i = 0;
+  for (; i + 8 <= _count; i += 8)
+  {
+    const __m256 x = _mm256_loadu_ps(_in + i);
+    __m256 v = _noise ? _mm256_add_ps(x, _mm256_loadu_ps(_noise + i)) : x;
+    v = _mm256_min_ps(_mm256_max_ps(v, vMin), vMax);
+
+    // Later blends take precedence, so apply them in reverse priority.
+    v = _mm256_blendv_ps(v, vMax, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+    v = _mm256_blendv_ps(v, vNegInf, _mm256_cmp_ps(x, vMin, _CMP_LE_OQ));
+    v = _mm256_blendv_ps(v, vPosInf, _mm256_cmp_ps(x, vMax, _CMP_GE_OQ));
+    _mm256_storeu_ps(_out + i, v);
+  }
+
+  ProcessBeamRangesScalar(_in + i, _noise ? _noise + i : nullptr, _out + i,
+      _count - i, _rangeMin, _rangeMax);
+}
+#endif
+
+//////////////////////////////////////////////////
+const char *sensors::BeamScanKernelIsa()
+{
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSE2__)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_SCAN_KERNEL_HH
+#define NPS_BEAM_SCAN_KERNEL_HH
+
+#include <cstddef>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Split an interleaved laser frame into contiguous range and
+    /// intensity arrays.
+    ///
+    /// The frame layout is the one delivered by GpuLaser through
+    /// ConnectNewLaserFrame: _count cells of _stride floats each, with the
+    /// range at offset 0 and the intensity at offset 1.
+    /// \param[in] _frame Interleaved frame data.
+    /// \param[in] _count Number of cells in the frame.
+    /// \param[in] _stride Number of floats per cell (at least 2).
+    /// \param[out] _ranges Output array of _count ranges.
+    /// \param[out] _intensities Output array of _count intensities, may be
+    /// null if intensities are not needed.
+    void DeinterleaveBeamFrame(const float *_frame, const size_t _count,
+        const size_t _stride, float *_ranges, float *_intensities);
+
+    /// \brief Apply REP 117 range masking to a contiguous range array.
+    ///
+    /// For each cell: ranges at or beyond _rangeMax become +inf, ranges at
+    /// or below _rangeMin become -inf, and in-range values have the
+    /// optional additive _noise applied before being clamped to
+    /// [_rangeMin, _rangeMax]. NaN inputs are replaced with _rangeMax.
+    /// _in and _out may alias. Runs the widest kernel the build enables.
+    /// \param[in] _in Raw ranges.
+    /// \param[in] _noise Per-cell additive noise, or null for no noise.
+    /// \param[out] _out Processed ranges.
+    /// \param[in] _count Number of cells.
+    /// \param[in] _rangeMin Minimum valid range.
+    /// \param[in] _rangeMax Maximum valid range.
+    void ProcessBeamRanges(const float *_in, const float *_noise,
+        float *_out, const size_t _count, const float _rangeMin,
+        const float _rangeMax);
+
+    /// \brief Scalar ProcessBeamRanges, the reference for the vector
+    /// kernels.
+    void ProcessBeamRangesScalar(const float *_in, const float *_noise,
+        float *_out, const size_t _count, const float _rangeMin,
+        const float _rangeMax);
+
+#if defined(__SSE2__)
+    /// \brief SSE2 ProcessBeamRanges, four cells at a time.
+    void ProcessBeamRangesSse2(const float *_in, const float *_noise,
+        float *_out, const size_t _count, const float _rangeMin,
+        const float _rangeMax);
+#endif
+
+#if defined(__AVX2__)
+    /// \brief AVX2 ProcessBeamRanges, eight cells at a time.
+    void ProcessBeamRangesAvx2(const float *_in, const float *_noise,
+        float *_out, const size_t _count, const float _rangeMin,
+        const float _rangeMax);
+#endif
+
+    /// \brief Name of the instruction set the scan kernels were built
+    /// for, e.g. "avx2", "sse2" or "scalar".
+    /// \return Kernel instruction set name.
+    const char *BeamScanKernelIsa();
+  }
+}
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "NpsBeamScanKernel.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Signature shared by the kernels.
+  typedef void (*Kernel)(const float *, const float *, float *,
+      const size_t, const float, const float);
+
+  const float kInf = std::numeric_limits<float>::infinity();
+  const float kNaN = std::numeric_limits<float>::quiet_NaN();
+  const float kRangeMin = 0.5f;
+  const float kRangeMax = 20.0f;
+
+  /// \brief The per-ray masking UpdateImpl did before the scan kernels,
+  /// in double precision.
+  float Baseline(const float _in, const float *_noise)
+  {
+    double range = _in;
+    if (range >= kRangeMax)
+    {
+      range = std::numeric_limits<double>::infinity();
+    }
+    else if (range <= kRangeMin)
+    {
+      range = -std::numeric_limits<double>::infinity();
+    }
+    else if (_noise)
+    {
+      // As ignition::math::clamp, which lets NaN through
+      range = range + *_noise;
+      range = std::max(std::min(range, static_cast<double>(kRangeMax)),
+          static_cast<double>(kRangeMin));
+    }
+    return static_cast<float>(std::isnan(range) ? kRangeMax : range);
+  }
+
+  /// \brief Inputs hitting every branch: NaN, infinities, both limits,
+  /// values just inside and outside them and ordinary ranges.
+  std::vector<float> Inputs(const size_t _count)
+  {
+    const float special[] = {kNaN, kInf, -kInf, kRangeMin, kRangeMax,
+      0.0f, -1.0f, 0.4999f, 0.5001f, 19.999f, 20.001f, 1e30f, -kNaN,
+      std::nextafter(kRangeMin, 0.0f), std::nextafter(kRangeMax, kInf)};
+    const size_t specials = sizeof(special) / sizeof(special[0]);
+
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> ranges(-1.0f, 25.0f);
+    std::vector<float> in(_count);
+    for (size_t i = 0; i < _count; ++i)
+      in[i] = (i * 7) % 3 == 0 ? special[i % specials] : ranges(random);
+    return in;
+  }
+
+  /// \brief Noise that pushes some cells past the limits.
+  std::vector<float> Noise(const size_t _count)
+  {
+    std::mt19937 random(13);
+    std::normal_distribution<float> noise(0.0f, 0.5f);
+    std::vector<float> out(_count);
+    for (float &value : out)
+      value = noise(random);
+    return out;
+  }
+
+  /// \brief Compare a kernel with the baseline on every length up to
+  /// a few vector widths past a block, so every tail length is hit.
+  void CheckKernel(const Kernel _kernel)
+  {
+    for (size_t count = 0; count <= 67; ++count)
+    {
+      const std::vector<float> in = Inputs(count);
+      const std::vector<float> noise = Noise(count);
+
+      for (const bool withNoise : {false, true})
+      {
+        const float *noisePtr = withNoise ? noise.data() : nullptr;
+        std::vector<float> out(count + 1, 123.0f);
+        _kernel(in.data(), noisePtr, out.data(), count, kRangeMin,
+            kRangeMax);
+
+        // In place must give the same result
+        std::vector<float> inPlace = in;
+        _kernel(inPlace.data(), noisePtr, inPlace.data(), count, kRangeMin,
+            kRangeMax);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+          const float expected =
+            Baseline(in[i], withNoise ? &noise[i] : nullptr);
+          ASSERT_FALSE(std::isnan(out[i]));
+          if (std::isinf(expected))
+            EXPECT_EQ(expected, out[i]) << count << " " << i;
+          else
+            EXPECT_FLOAT_EQ(expected, out[i]) << count << " " << i;
+          EXPECT_EQ(out[i], inPlace[i]) << count << " " << i;
+        }
+
+        // Nothing is written past the end
+        EXPECT_EQ(123.0f, out[count]);
+      }
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScanKernel, Scalar)
+{
+  CheckKernel(ProcessBeamRangesScalar);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScanKernel, Default)
+{
+  CheckKernel(ProcessBeamRanges);
+}
+
+#if defined(__SSE2__)
+/////////////////////////////////////////////////
+TEST(NpsBeamScanKernel, Sse2)
+{
+  CheckKernel(ProcessBeamRangesSse2);
+}
+#endif
+
+#if defined(__AVX2__)
+/////////////////////////////////////////////////
+TEST(NpsBeamScanKernel, Avx2)
+{
+  if (!__builtin_cpu_supports("avx2"))
+  {
+    std::cout << "AVX2 not supported by this CPU, skipping" << std::endl;
+    return;
+  }
+  CheckKernel(ProcessBeamRangesAvx2);
+}
+#endif
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScanKernel, Deinterleave)
+{
+  const std::vector<float> frame = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<float> ranges(3);
+  std::vector<float> intensities(3);
+  DeinterleaveBeamFrame(frame.data(), 3, 3, ranges.data(),
+      intensities.data());
+  EXPECT_EQ(std::vector<float>({1, 4, 7}), ranges);
+  EXPECT_EQ(std::vector<float>({2, 5, 8}), intensities);
+
+  std::fill(ranges.begin(), ranges.end(), 0.0f);
+  DeinterleaveBeamFrame(frame.data(), 3, 3, ranges.data(), nullptr);
+  EXPECT_EQ(std::vector<float>({1, 4, 7}), ranges);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
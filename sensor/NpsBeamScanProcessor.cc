@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+
+#include <ignition/math/Helpers.hh>
+#include <ignition/math/Pose3.hh>
+
+#include "NpsBeamScanKernel.hh"
+#include "NpsBeamScanProcessor.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+/// \brief Resize a repeated message field without per-element calls.
+///
+/// Capacity grows with 25% headroom and is never released, so switching
+/// between resolutions at runtime settles without reallocating.
+/// \param[in] _field Field to resize.
+/// \param[in] _size New number of elements.
+/// \return Pointer to the field's contiguous storage.
+static double *ResizeRepeated(google::protobuf::RepeatedField<double> *_field,
+    const int _size)
+{
+  if (_size > _field->Capacity())
+    _field->Reserve(_size + _size / 4);
+  _field->Resize(_size, ignition::math::NAN_D);
+  return _field->mutable_data();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScanProcessor::SetNoise(const NpsBeamNoiseEngine &_engine)
+{
+  this->engine = _engine;
+  this->bulkNoise = true;
+  this->hasNoise = true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScanProcessor::SetNoise(const NoiseFunction &_function)
+{
+  this->noiseFunction = _function;
+  this->bulkNoise = false;
+  this->hasNoise = static_cast<bool>(_function);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScanProcessor::ClearNoise()
+{
+  this->noiseFunction = NoiseFunction();
+  this->bulkNoise = false;
+  this->hasNoise = false;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamScanProcessor::HasBulkNoise() const
+{
+  return this->hasNoise && this->bulkNoise;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScanProcessor::SetPool(NpsBeamWorkerPool *_pool)
+{
+  this->pool = _pool;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScanProcessor::Process(NpsBeamFrame &_frame, const size_t _count,
+    const NoiseFunction *_noise)
+{
+  float *ranges = _frame.ranges.data();
+  const float rangeMin = _frame.rangeMin;
+  const float rangeMax = _frame.rangeMax;
+
+  // Draw noise only for in-range cells, the kernel masks the rest
+  float *noise = nullptr;
+  if (this->hasNoise || _noise)
+  {
+    if (this->noiseBuffer.size() < _count)
+      this->noiseBuffer.resize(_count);
+    noise = this->noiseBuffer.data();
+
+    const NoiseFunction &function = _noise ? *_noise : this->noiseFunction;
+    if (this->bulkNoise && !_noise)
+    {
+      this->engine.Fill(ranges, noise, _count, this->noiseFrame++,
+          this->pool);
+    }
+    else
+    {
+      for (size_t i = 0; i < _count; ++i)
+      {
+        const double range = ranges[i];
+        if (range > _frame.rangeMin && range < _frame.rangeMax)
+          noise[i] = function(range) - range;
+        else
+          noise[i] = 0.0f;
+      }
+    }
+  }
+
+  // Mask ranges outside of min/max to +/- inf, as per REP 117
+  ProcessBeamRanges(ranges, noise, ranges, _count, rangeMin, rangeMax);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScanProcessor::FillScan(const NpsBeamFrame &_frame,
+    msgs::LaserScan *_scan)
+{
+  msgs::Set(_scan->mutable_world_pose(), ignition::math::Pose3d(
+        _frame.pose[0], _frame.pose[1], _frame.pose[2],
+        _frame.pose[3], _frame.pose[4], _frame.pose[5], _frame.pose[6]));
+  _scan->set_angle_min(_frame.angleMin);
+  _scan->set_angle_max(_frame.angleMax);
+  _scan->set_angle_step(_frame.angleStep);
+  _scan->set_count(_frame.width);
+
+  _scan->set_vertical_angle_min(_frame.verticalAngleMin);
+  _scan->set_vertical_angle_max(_frame.verticalAngleMax);
+  _scan->set_vertical_angle_step(_frame.verticalAngleStep);
+  _scan->set_vertical_count(_frame.height);
+
+  _scan->set_range_min(_frame.rangeMin);
+  _scan->set_range_max(_frame.rangeMax);
+
+  // Bulk copy the processed frame into the message storage
+  const int numRays = static_cast<int>(_frame.ranges.size());
+  std::copy(_frame.ranges.begin(), _frame.ranges.end(),
+      ResizeRepeated(_scan->mutable_ranges(), numRays));
+  std::copy(_frame.intensities.begin(), _frame.intensities.end(),
+      ResizeRepeated(_scan->mutable_intensities(), numRays));
+}
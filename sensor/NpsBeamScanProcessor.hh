@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_SCAN_PROCESSOR_HH
+#define NPS_BEAM_SCAN_PROCESSOR_HH
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "gazebo/msgs/msgs.hh"
+
+#include "NpsBeamFrameStore.hh"
+#include "NpsBeamNoise.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    class NpsBeamWorkerPool;
+
+    /// \brief Render independent post-processing of beam frames.
+    ///
+    /// Takes a frame whose raw ranges and intensities were gathered from
+    /// the laser camera, applies noise and REP 117 masking in place, and
+    /// fills a LaserScan message from it. NpsBeamSensor runs every frame
+    /// through this class, and the benchmark harness drives it directly
+    /// with recorded or synthetic frames.
+    class NpsBeamScanProcessor
+    {
+      /// \brief Per-ray noise function, returns the noisy range.
+      public: typedef std::function<double(double)> NoiseFunction;
+
+      /// \brief Use bulk Gaussian noise.
+      /// \param[in] _engine Configured noise engine.
+      public: void SetNoise(const NpsBeamNoiseEngine &_engine);
+
+      /// \brief Use a per-ray noise function.
+      /// \param[in] _function Noise function, called for in-range rays.
+      public: void SetNoise(const NoiseFunction &_function);
+
+      /// \brief Disable noise.
+      public: void ClearNoise();
+
+      /// \brief Check whether bulk Gaussian noise is in use.
+      /// \return True if SetNoise was last called with an engine.
+      public: bool HasBulkNoise() const;
+
+      /// \brief Set the pool used to parallelize noise generation.
+      /// \param[in] _pool Worker pool, or null to stay on the caller.
+      public: void SetPool(NpsBeamWorkerPool *_pool);
+
+      /// \brief Apply noise and range masking to a frame in place.
+      /// \param[in,out] _frame Frame with raw ranges and header filled.
+      /// \param[in] _count Number of valid cells at the start of the
+      /// frame; the remaining cells are left untouched.
+      /// \param[in] _noise Per-ray noise function to apply to this frame
+      /// instead of the configured noise, or null.
+      public: void Process(NpsBeamFrame &_frame, const size_t _count,
+                  const NoiseFunction *_noise = nullptr);
+
+      /// \brief Fill a LaserScan from a processed frame.
+      ///
+      /// The repeated fields are resized in place with headroom and
+      /// filled with bulk copies, so a reused message settles without
+      /// reallocating.
+      /// \param[in] _frame Processed frame.
+      /// \param[out] _scan Message to fill.
+      public: static void FillScan(const NpsBeamFrame &_frame,
+                                   msgs::LaserScan *_scan);
+
+      /// \brief Additive noise of the current frame.
+      private: std::vector<float> noiseBuffer;
+
+      /// \brief Bulk noise generator.
+      private: NpsBeamNoiseEngine engine;
+
+      /// \brief Per-ray noise function.
+      private: NoiseFunction noiseFunction;
+
+      /// \brief True to use engine, false to use noiseFunction.
+      private: bool bulkNoise = false;
+
+      /// \brief True if any noise is applied.
+      private: bool hasNoise = false;
+
+      /// \brief Frame counter selecting the noise stream.
+      private: uint64_t noiseFrame = 0;
+
+      /// \brief Pool for noise generation.
+      private: NpsBeamWorkerPool *pool = nullptr;
+    };
+  }
+}
+#endif
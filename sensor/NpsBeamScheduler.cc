@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+
+#include "gazebo/common/Events.hh"
+
+#include "NpsBeamScheduler.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+NpsBeamScheduler &NpsBeamScheduler::Instance()
+{
+  static NpsBeamScheduler scheduler;
+  return scheduler;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamScheduler::Add(const double _rate,
+    const RenderFunction &_render, const ReadbackFunction &_readback)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  ClientPtr client(new Client);
+  client->id = this->nextId++;
+  client->render = _render;
+  client->readback = _readback;
+  this->groups[_rate].push_back(client);
+
+  if (!this->connection)
+  {
+    this->connection = event::Events::ConnectRender(
+        std::bind(&NpsBeamScheduler::Tick, this));
+  }
+
+  return client->id;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScheduler::SetRate(const unsigned int _id, const double _rate)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  for (auto iter = this->groups.begin(); iter != this->groups.end(); ++iter)
+  {
+    std::vector<ClientPtr> &clients = iter->second;
+    auto client = std::find_if(clients.begin(), clients.end(),
+        [_id](const ClientPtr &_client) { return _client->id == _id; });
+    if (client == clients.end())
+      continue;
+
+    if (iter->first == _rate)
+      return;
+
+    const ClientPtr moved = *client;
+    clients.erase(client);
+    if (clients.empty())
+      this->groups.erase(iter);
+    this->groups[_rate].push_back(moved);
+    return;
+  }
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScheduler::Remove(const unsigned int _id)
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  for (auto iter = this->groups.begin(); iter != this->groups.end(); ++iter)
+  {
+    std::vector<ClientPtr> &clients = iter->second;
+    auto client = std::find_if(clients.begin(), clients.end(),
+        [_id](const ClientPtr &_client) { return _client->id == _id; });
+    if (client == clients.end())
+      continue;
+
+    (*client)->removed = true;
+    clients.erase(client);
+    if (clients.empty())
+      this->groups.erase(iter);
+    break;
+  }
+
+  if (this->groups.empty())
+    this->connection.reset();
+
+  // A callback of the tick may still be running on another thread
+  if (this->tickThread != std::this_thread::get_id())
+    this->tickDone.wait(lock, [this]() { return !this->ticking; });
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamScheduler::Count() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  size_t count = 0;
+  for (const auto &group : this->groups)
+    count += group.second.size();
+  return count;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamScheduler::GroupCount() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  return this->groups.size();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamScheduler::Tick()
+{
+  // Take the sensors of this tick and release the lock for the renders
+  // and readbacks, so registering or re-rating a sensor does not wait
+  // for a whole tick
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->tick.clear();
+    for (const auto &group : this->groups)
+    {
+      this->tick.insert(this->tick.end(), group.second.begin(),
+          group.second.end());
+    }
+    this->ticking = true;
+    this->tickThread = std::this_thread::get_id();
+  }
+
+  this->rendered.clear();
+  for (const ClientPtr &client : this->tick)
+  {
+    if (!client->removed && client->render())
+      this->rendered.push_back(client.get());
+  }
+
+  for (Client *client : this->rendered)
+  {
+    if (!client->removed)
+      client->readback();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->tick.clear();
+    this->ticking = false;
+  }
+  this->tickDone.notify_all();
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_SCHEDULER_HH
+#define NPS_BEAM_SCHEDULER_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gazebo/common/Event.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Process wide render scheduler of the beam sensors.
+    ///
+    /// Instead of one render event connection per sensor, every sensor
+    /// that renders on the render event registers here and a single
+    /// connection drives them all. Sensors are grouped by update rate,
+    /// and each tick offers a render to every sensor, group by group, so
+    /// sensors of one rate, which fall due together, render back to back.
+    /// A sensor that is not due declines the render. Only then are the
+    /// rendered sensors read back; the GPU works through all the queued
+    /// scenes while the readbacks wait on the first of them, instead of
+    /// stalling once per sensor.
+    ///
+    /// The callbacks run without the scheduler's lock, so a sensor may
+    /// change its rate with SetRate from its own render callback.
+    class NpsBeamScheduler
+    {
+      /// \brief Render callback, returns true if the sensor was due and a
+      /// frame was rendered.
+      public: typedef std::function<bool()> RenderFunction;
+
+      /// \brief Readback callback, called after every render of the tick
+      /// for each sensor whose render returned true.
+      public: typedef std::function<void()> ReadbackFunction;
+
+      /// \brief Get the scheduler shared by all beam sensors.
+      /// \return Shared scheduler.
+      public: static NpsBeamScheduler &Instance();
+
+      /// \brief Register a sensor.
+      /// \param[in] _rate Update rate of the sensor in Hz, 0 if unlimited.
+      /// \param[in] _render Render callback.
+      /// \param[in] _readback Readback callback.
+      /// \return Id for SetRate and Remove.
+      public: unsigned int Add(const double _rate,
+                  const RenderFunction &_render,
+                  const ReadbackFunction &_readback);
+
+      /// \brief Move a sensor to the group of a new update rate. Takes
+      /// effect from the next tick.
+      /// \param[in] _id Id returned by Add.
+      /// \param[in] _rate Update rate in Hz, 0 if unlimited.
+      public: void SetRate(const unsigned int _id, const double _rate);
+
+      /// \brief Unregister a sensor. Waits for a tick in progress, unless
+      /// called from one of its callbacks; either way the sensor's
+      /// callbacks are not called again once this returns.
+      /// \param[in] _id Id returned by Add.
+      public: void Remove(const unsigned int _id);
+
+      /// \brief Number of registered sensors.
+      /// \return Sensor count.
+      public: size_t Count() const;
+
+      /// \brief Number of update rate groups.
+      /// \return Group count.
+      public: size_t GroupCount() const;
+
+      /// \brief Run one tick: offer every sensor a render, then read back
+      /// those that rendered. Called on every render event, and directly
+      /// by benchmarks.
+      public: void Tick();
+
+      /// \brief Registered sensor.
+      private: struct Client
+      {
+        /// \brief Id returned by Add.
+        unsigned int id;
+
+        /// \brief Render callback.
+        RenderFunction render;
+
+        /// \brief Readback callback.
+        ReadbackFunction readback;
+
+        /// \brief Set by Remove, so a tick in progress skips the sensor.
+        std::atomic<bool> removed{false};
+      };
+
+      /// \brief Shared pointer to a registered sensor.
+      private: typedef std::shared_ptr<Client> ClientPtr;
+
+      /// \brief Sensors grouped by update rate, each group in the order
+      /// the sensors were added.
+      private: std::map<double, std::vector<ClientPtr>> groups;
+
+      /// \brief Sensors of the current tick, group by group. Only used
+      /// by the ticking thread.
+      private: std::vector<ClientPtr> tick;
+
+      /// \brief Sensors rendered in the current tick. Only used by the
+      /// ticking thread.
+      private: std::vector<Client *> rendered;
+
+      /// \brief Id of the next sensor.
+      private: unsigned int nextId = 1;
+
+      /// \brief True while a tick runs its callbacks.
+      private: bool ticking = false;
+
+      /// \brief Thread running the current or last tick.
+      private: std::thread::id tickThread;
+
+      /// \brief Signalled when a tick finishes.
+      private: std::condition_variable tickDone;
+
+      /// \brief Render event connection, held while sensors are
+      /// registered.
+      private: event::ConnectionPtr connection;
+
+      /// \brief Protects every member except those only used by the
+      /// ticking thread; not held while callbacks run.
+      private: mutable std::mutex mutex;
+    };
+  }
+}
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "NpsBeamScheduler.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScheduler, RendersBeforeReadbacks)
+{
+  NpsBeamScheduler scheduler;
+  std::vector<std::string> calls;
+
+  // Both 20 Hz sensors render before the 30 Hz one added between them,
+  // and the sensor that declines is not read back
+  auto add = [&](const double _rate, const std::string &_name,
+      const bool _due)
+  {
+    return scheduler.Add(_rate,
+        [&calls, _name, _due]()
+        {
+          calls.push_back("render " + _name);
+          return _due;
+        },
+        [&calls, _name]() { calls.push_back("readback " + _name); });
+  };
+  add(20, "a", true);
+  add(30, "b", false);
+  add(20, "c", true);
+  EXPECT_EQ(3u, scheduler.Count());
+  EXPECT_EQ(2u, scheduler.GroupCount());
+
+  scheduler.Tick();
+  const std::vector<std::string> expected = {"render a", "render c",
+    "render b", "readback a", "readback c"};
+  EXPECT_EQ(expected, calls);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScheduler, SetRateMovesGroup)
+{
+  NpsBeamScheduler scheduler;
+  std::vector<unsigned int> order;
+  std::vector<unsigned int> ids;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    ids.push_back(scheduler.Add(10 * (i + 1),
+        [&order, i]() { order.push_back(i); return false; }, []() {}));
+  }
+  EXPECT_EQ(3u, scheduler.GroupCount());
+
+  // Moving the 10 Hz sensor to 30 Hz empties its group and puts it
+  // after the sensor already at 30 Hz
+  scheduler.SetRate(ids[0], 30);
+  EXPECT_EQ(2u, scheduler.GroupCount());
+  EXPECT_EQ(3u, scheduler.Count());
+  scheduler.Tick();
+  EXPECT_EQ(std::vector<unsigned int>({1, 2, 0}), order);
+
+  // The same rate keeps the group
+  scheduler.SetRate(ids[1], 20);
+  EXPECT_EQ(2u, scheduler.GroupCount());
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamScheduler, CallbacksRunWithoutLock)
+{
+  NpsBeamScheduler scheduler;
+  unsigned int idA = 0;
+  unsigned int idB = 0;
+  unsigned int renderedB = 0;
+  unsigned int readbackB = 0;
+
+  // A renders first, re-rates itself and removes B, as a sensor may from
+  // its own callbacks; B is skipped for the rest of the tick
+  idA = scheduler.Add(10,
+      [&]()
+      {
+        scheduler.SetRate(idA, 5);
+        scheduler.Remove(idB);
+        return scheduler.Count() == 1;
+      }, []() {});
+  idB = scheduler.Add(10, [&]() { ++renderedB; return true; },
+      [&]() { ++readbackB; });
+
+  scheduler.Tick();
+  EXPECT_EQ(0u, renderedB);
+  EXPECT_EQ(0u, readbackB);
+  EXPECT_EQ(1u, scheduler.Count());
+  EXPECT_EQ(1u, scheduler.GroupCount());
+  scheduler.Remove(idA);
+  EXPECT_EQ(0u, scheduler.Count());
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
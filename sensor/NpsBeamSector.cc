@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cmath>
+
+#include "NpsBeamSector.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+NpsBeamGeometryPtr NpsBeamSector::Select(const NpsBeamGeometryPtr &_full,
+    const double _center, const double _width,
+    const std::vector<double> &_beamAngles,
+    std::atomic<unsigned int> &_versions)
+{
+  if (_width <= 0 || _width >= _full->angleMax - _full->angleMin ||
+      _full->rayCount < 3)
+  {
+    return _full;
+  }
+
+  // Snap outward to the ray grid; the tolerance keeps exact ray angles
+  // from picking up a neighbour through rounding
+  const double step = (_full->angleMax - _full->angleMin) /
+    (_full->rayCount - 1);
+  const double tolerance = 1e-6;
+  int first = static_cast<int>(std::floor(
+        (_center - _width * 0.5 - _full->angleMin) / step + tolerance));
+  int last = static_cast<int>(std::ceil(
+        (_center + _width * 0.5 - _full->angleMin) / step - tolerance));
+  first = std::min(std::max(first, 0), _full->rayCount - 2);
+  last = std::min(std::max(last, first + 1), _full->rayCount - 1);
+
+  const double angleMin = _full->angleMin + first * step;
+  const double angleMax = _full->angleMin + last * step;
+
+  // Range cells follow the rays, or the configured beam angles inside
+  // the sector when they describe the whole fan
+  const double ratio =
+    static_cast<double>(_full->rangeCount) / _full->rayCount;
+  int rangeOffset = static_cast<int>(std::round(first * ratio));
+  int rangeCount = std::max(1, static_cast<int>(
+        std::round((last - first + 1) * ratio)));
+  if (_full->rangeCount == _full->rayCount)
+  {
+    rangeOffset = first;
+    rangeCount = last - first + 1;
+  }
+  else if (_beamAngles.size() == static_cast<size_t>(_full->rangeCount))
+  {
+    const int begin = static_cast<int>(std::lower_bound(_beamAngles.begin(),
+          _beamAngles.end(), angleMin - tolerance) - _beamAngles.begin());
+    const int end = static_cast<int>(std::upper_bound(_beamAngles.begin(),
+          _beamAngles.end(), angleMax + tolerance) - _beamAngles.begin());
+    if (end > begin)
+    {
+      rangeOffset = begin;
+      rangeCount = end - begin;
+    }
+  }
+
+  if (this->geometry && this->baseVersion == _full->version &&
+      this->geometry->sectorRayOffset == first &&
+      this->geometry->rayCount == last - first + 1 &&
+      this->geometry->sectorRangeOffset == rangeOffset &&
+      this->geometry->rangeCount == rangeCount)
+  {
+    return this->geometry;
+  }
+
+  std::shared_ptr<NpsBeamGeometry> geom(new NpsBeamGeometry(*_full));
+  geom->version = ++_versions;
+  geom->angleMin = angleMin;
+  geom->angleMax = angleMax;
+  geom->rayCount = last - first + 1;
+  geom->rangeCount = rangeCount;
+  geom->sectorRayOffset = first;
+  geom->sectorRangeOffset = rangeOffset;
+  geom->angleResolution = rangeCount > 1 ?
+    (angleMax - angleMin) / (rangeCount - 1) : 0.0;
+
+  this->geometry = geom;
+  this->baseVersion = _full->version;
+  return this->geometry;
+}
+
+//////////////////////////////////////////////////
+double NpsBeamSector::SweepCenter(const NpsBeamGeometry &_geom,
+    const double _center, const double _width, const double _rate,
+    const double _elapsed)
+{
+  const double low = _geom.angleMin + _width * 0.5;
+  const double span = _geom.angleMax - _width * 0.5 - low;
+  if (span <= 0)
+    return low + span * 0.5;
+
+  const double start = std::min(std::max(_center - low, 0.0), span);
+  double phase = std::fmod(start + _rate * _elapsed, 2.0 * span);
+  if (phase < 0)
+    phase += 2.0 * span;
+  return low + (phase <= span ? phase : 2.0 * span - phase);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_SECTOR_HH
+#define NPS_BEAM_SECTOR_HH
+
+#include <atomic>
+#include <vector>
+
+#include "NpsBeamGeometry.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Narrows the whole fan geometry to an active sector.
+    ///
+    /// Select snaps a requested sector outward to whole ray columns of
+    /// the fan, keeping at least two, and picks the range columns that
+    /// follow them. The snapshot of the last sector is reused while it
+    /// covers the same columns of the same fan, so tables keyed on the
+    /// geometry version are only rebuilt when a scanning head moves onto
+    /// new rays.
+    class NpsBeamSector
+    {
+      /// \brief Get the geometry of a sector.
+      /// \param[in] _full Whole fan geometry.
+      /// \param[in] _center Sector center in radians.
+      /// \param[in] _width Sector width in radians, 0 for the whole fan.
+      /// \param[in] _beamAngles Angle of each range column of the whole
+      /// fan, or empty if the range columns follow the rays evenly.
+      /// \param[in,out] _versions Source of geometry snapshot versions,
+      /// incremented for every new sector snapshot.
+      /// \return The sector geometry, or _full if the sector covers the
+      /// whole fan or the fan has fewer than three rays.
+      public: NpsBeamGeometryPtr Select(const NpsBeamGeometryPtr &_full,
+                  const double _center, const double _width,
+                  const std::vector<double> &_beamAngles,
+                  std::atomic<unsigned int> &_versions);
+
+      /// \brief Get the center of a scanning sector at a time.
+      ///
+      /// The center sweeps back and forth between the positions that
+      /// keep the sector inside the fan, starting at the requested
+      /// center.
+      /// \param[in] _geom Whole fan geometry.
+      /// \param[in] _center Requested center in radians.
+      /// \param[in] _width Sector width in radians.
+      /// \param[in] _rate Sweep rate in radians per second.
+      /// \param[in] _elapsed Seconds since the sweep started.
+      /// \return Sector center in radians.
+      public: static double SweepCenter(const NpsBeamGeometry &_geom,
+                  const double _center, const double _width,
+                  const double _rate, const double _elapsed);
+
+      /// \brief Snapshot of the last sector.
+      private: NpsBeamGeometryPtr geometry;
+
+      /// \brief Version of the whole fan geometry the snapshot was
+      /// derived from.
+      private: unsigned int baseVersion = 0;
+    };
+  }
+}
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "NpsBeamSector.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Whole fan from -1 to 1 radian with a ray every 0.1 radian.
+  /// \param[in] _rangeCount Horizontal range count.
+  /// \param[in] _version Geometry version.
+  NpsBeamGeometryPtr Fan(const int _rangeCount, const unsigned int _version)
+  {
+    std::shared_ptr<NpsBeamGeometry> geom(new NpsBeamGeometry);
+    geom->angleMin = -1.0;
+    geom->angleMax = 1.0;
+    geom->rayCount = 21;
+    geom->rangeCount = _rangeCount;
+    geom->fullRayCount = geom->rayCount;
+    geom->fullRangeCount = geom->rangeCount;
+    geom->angleResolution = 2.0 / (_rangeCount - 1);
+    geom->rangeMin = 0.5;
+    geom->rangeMax = 20;
+    geom->version = _version;
+    return geom;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamSector, RayColumns)
+{
+  const NpsBeamGeometryPtr full = Fan(21, 1);
+  const std::vector<double> noAngles;
+  std::atomic<unsigned int> versions(1);
+
+  // Snaps outward to the rays around -0.1 to 0.2
+  NpsBeamSector sector;
+  NpsBeamGeometryPtr geom = sector.Select(full, 0.05, 0.3, noAngles,
+      versions);
+  ASSERT_NE(full, geom);
+  EXPECT_EQ(9, geom->sectorRayOffset);
+  EXPECT_EQ(4, geom->rayCount);
+  EXPECT_EQ(9, geom->sectorRangeOffset);
+  EXPECT_EQ(4, geom->rangeCount);
+  EXPECT_NEAR(-0.1, geom->angleMin, 1e-12);
+  EXPECT_NEAR(0.2, geom->angleMax, 1e-12);
+  EXPECT_NEAR(0.1, geom->angleResolution, 1e-12);
+  EXPECT_EQ(21, geom->fullRayCount);
+  EXPECT_DOUBLE_EQ(full->rangeMax, geom->rangeMax);
+
+  // Edges on exact ray angles do not pick up a neighbour
+  geom = sector.Select(full, 0.0, 0.2, noAngles, versions);
+  EXPECT_EQ(9, geom->sectorRayOffset);
+  EXPECT_EQ(3, geom->rayCount);
+
+  // A sector narrower than a ray keeps the two rays around it
+  geom = sector.Select(full, 0.05, 0.02, noAngles, versions);
+  EXPECT_EQ(10, geom->sectorRayOffset);
+  EXPECT_EQ(2, geom->rayCount);
+
+  // Sectors past the edge are clamped to the fan
+  geom = sector.Select(full, -0.95, 0.3, noAngles, versions);
+  EXPECT_EQ(0, geom->sectorRayOffset);
+  EXPECT_EQ(3, geom->rayCount);
+  EXPECT_NEAR(-1.0, geom->angleMin, 1e-12);
+  geom = sector.Select(full, 1.5, 0.3, noAngles, versions);
+  EXPECT_EQ(19, geom->sectorRayOffset);
+  EXPECT_EQ(2, geom->rayCount);
+  EXPECT_NEAR(1.0, geom->angleMax, 1e-12);
+
+  // No sector, or one covering the whole fan, keeps the fan
+  EXPECT_EQ(full, sector.Select(full, 0.0, 0.0, noAngles, versions));
+  EXPECT_EQ(full, sector.Select(full, 0.0, 2.0, noAngles, versions));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamSector, RangeColumns)
+{
+  const std::vector<double> noAngles;
+  std::atomic<unsigned int> versions(1);
+
+  // Range columns spread evenly over the rays follow them in proportion
+  NpsBeamSector even;
+  NpsBeamGeometryPtr geom = even.Select(Fan(11, 1), 0.05, 0.3, noAngles,
+      versions);
+  EXPECT_EQ(9, geom->sectorRayOffset);
+  EXPECT_EQ(4, geom->rayCount);
+  EXPECT_EQ(5, geom->sectorRangeOffset);
+  EXPECT_EQ(2, geom->rangeCount);
+  EXPECT_NEAR(0.3, geom->angleResolution, 1e-12);
+
+  // Configured beam angles select the beams inside the sector rays
+  const std::vector<double> beamAngles = {-1.0, -0.8, -0.5, -0.3, -0.1,
+    0.0, 0.05, 0.2, 0.5, 0.8, 1.0};
+  NpsBeamSector uneven;
+  geom = uneven.Select(Fan(11, 1), 0.05, 0.3, beamAngles, versions);
+  EXPECT_EQ(4, geom->sectorRangeOffset);
+  EXPECT_EQ(4, geom->rangeCount);
+
+  // A sector between two beams falls back to the proportional columns
+  geom = uneven.Select(Fan(11, 1), 0.65, 0.02, beamAngles, versions);
+  EXPECT_EQ(16, geom->sectorRayOffset);
+  EXPECT_EQ(2, geom->rayCount);
+  EXPECT_EQ(8, geom->sectorRangeOffset);
+  EXPECT_EQ(1, geom->rangeCount);
+  EXPECT_DOUBLE_EQ(0.0, geom->angleResolution);
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamSector, Versions)
+{
+  const NpsBeamGeometryPtr full = Fan(21, 1);
+  const std::vector<double> noAngles;
+  std::atomic<unsigned int> versions(1);
+
+  NpsBeamSector sector;
+  const NpsBeamGeometryPtr first = sector.Select(full, 0.05, 0.3, noAngles,
+      versions);
+  EXPECT_EQ(2u, first->version);
+  EXPECT_EQ(2u, versions);
+
+  // Moving within the same rays reuses the snapshot
+  EXPECT_EQ(first, sector.Select(full, 0.055, 0.27, noAngles, versions));
+  EXPECT_EQ(first, sector.Select(full, 0.06, 0.28, noAngles, versions));
+  EXPECT_EQ(2u, versions);
+
+  // Moving onto new rays makes a new version
+  const NpsBeamGeometryPtr moved = sector.Select(full, 0.15, 0.3,
+      noAngles, versions);
+  EXPECT_NE(first, moved);
+  EXPECT_EQ(3u, moved->version);
+  EXPECT_EQ(10, moved->sectorRayOffset);
+
+  // Only the last sector is kept, so returning makes another version
+  const NpsBeamGeometryPtr back = sector.Select(full, 0.05, 0.3, noAngles,
+      versions);
+  EXPECT_EQ(4u, back->version);
+  EXPECT_EQ(first->sectorRayOffset, back->sectorRayOffset);
+
+  // A new whole fan geometry invalidates the snapshot of the same rays
+  const NpsBeamGeometryPtr changed = sector.Select(Fan(21, 9), 0.05, 0.3,
+      noAngles, versions);
+  EXPECT_NE(back, changed);
+  EXPECT_EQ(5u, changed->version);
+  EXPECT_EQ(changed, sector.Select(Fan(21, 9), 0.05, 0.3, noAngles,
+        versions));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamSector, SweepCenter)
+{
+  const NpsBeamGeometryPtr full = Fan(21, 1);
+
+  // A 0.4 radian sector moves between centers -0.8 and 0.8
+  EXPECT_NEAR(0.0, NpsBeamSector::SweepCenter(*full, 0.0, 0.4, 0.4, 0.0),
+      1e-12);
+  EXPECT_NEAR(0.4, NpsBeamSector::SweepCenter(*full, 0.0, 0.4, 0.4, 1.0),
+      1e-12);
+  EXPECT_NEAR(0.8, NpsBeamSector::SweepCenter(*full, 0.0, 0.4, 0.4, 2.0),
+      1e-12);
+  EXPECT_NEAR(0.4, NpsBeamSector::SweepCenter(*full, 0.0, 0.4, 0.4, 3.0),
+      1e-12);
+  EXPECT_NEAR(-0.4, NpsBeamSector::SweepCenter(*full, 0.0, 0.4, -0.4, 3.0),
+      1e-12);
+
+  // A full period returns to the start, which is clamped into the fan
+  EXPECT_NEAR(-0.8, NpsBeamSector::SweepCenter(*full, -2.0, 0.4, 0.4, 8.0),
+      1e-12);
+
+  for (int i = 0; i < 200; ++i)
+  {
+    const double center =
+      NpsBeamSector::SweepCenter(*full, 0.3, 0.4, 0.7, i * 0.1);
+    EXPECT_LE(std::abs(center), 0.8 + 1e-12);
+  }
+
+  // A sector wider than the fan stays in the middle
+  EXPECT_NEAR(0.0, NpsBeamSector::SweepCenter(*full, 0.5, 2.4, 0.4, 1.0),
+      1e-12);
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
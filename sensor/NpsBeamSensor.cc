@@ -20,8 +20,12 @@
   #include <Winsock2.h>
 #endif
 
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
+#include <cmath>
 #include <functional>
+#include <mutex>
+#include <sstream>
 #include <ignition/math.hh>
 #include <ignition/math/Helpers.hh>
 #include "gazebo/physics/World.hh"
@@ -41,6 +45,11 @@
 #include "gazebo/sensors/Noise.hh"
 #include "gazebo/sensors/SensorFactory.hh"
 
+#include "NpsBeamFrameSource.hh"
+#include "NpsBeamNoise.hh"
+#include "NpsBeamScanProcessor.hh"
+#include "NpsBeamScheduler.hh"
+#include "NpsBeamWorkerPool.hh"
 #include "NpsBeamSensorPrivate.hh"
 #include "NpsBeamSensor.hh"
 
@@ -49,16 +58,322 @@ using namespace sensors;
 
 GZ_REGISTER_STATIC_SENSOR("nps_beam", NpsBeamSensor)
 
+namespace
+{
+  /// \brief Publishes sensor outputs on a Gazebo topic.
+  class TransportPublisher : public NpsBeamPublisher
+  {
+    /// \brief Constructor.
+    /// \param[in] _pub Advertised topic publisher.
+    public: explicit TransportPublisher(transport::PublisherPtr _pub)
+            : pub(_pub)
+            {
+            }
+
+    // Documentation inherited
+    public: virtual bool HasConnections() const
+            {
+              return this->pub->HasConnections();
+            }
+
+    // Documentation inherited
+    public: virtual void Publish(const google::protobuf::Message &_msg)
+            {
+              this->pub->Publish(_msg);
+            }
+
+    /// \brief Topic publisher.
+    private: transport::PublisherPtr pub;
+  };
+
+  /// \brief Advertise a sensor output topic.
+  /// \param[in] _node Node to advertise on.
+  /// \param[in] _topic Topic name.
+  /// \param[in] _queueLimit Outgoing message queue limit.
+  /// \return Publisher of the topic.
+  template<typename M>
+  NpsBeamPublisherPtr Advertise(transport::NodePtr _node,
+      const std::string &_topic, const unsigned int _queueLimit)
+  {
+    return NpsBeamPublisherPtr(new TransportPublisher(
+          _node->Advertise<M>(_topic, _queueLimit)));
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Compare two geometry snapshots, ignoring their versions.
+/// \param[in] _a First geometry.
+/// \param[in] _b Second geometry.
+/// \return True if every scan parameter is equal.
+static bool SameGeometry(const NpsBeamGeometry &_a,
+    const NpsBeamGeometry &_b)
+{
+  return _a.angleMin == _b.angleMin && _a.angleMax == _b.angleMax &&
+    _a.verticalAngleMin == _b.verticalAngleMin &&
+    _a.verticalAngleMax == _b.verticalAngleMax &&
+    _a.rangeMin == _b.rangeMin && _a.rangeMax == _b.rangeMax &&
+    _a.rangeResolution == _b.rangeResolution &&
+    _a.rayCount == _b.rayCount && _a.rangeCount == _b.rangeCount &&
+    _a.verticalRayCount == _b.verticalRayCount &&
+    _a.verticalRangeCount == _b.verticalRangeCount;
+}
+
+//////////////////////////////////////////////////
+/// \brief Rebuild the geometry snapshot from the scan SDF elements.
+/// \param[in] _data Sensor private data holding the SDF elements.
+static void UpdateGeometry(NpsBeamSensorPrivate &_data)
+{
+  std::shared_ptr<NpsBeamGeometry> geom(new NpsBeamGeometry);
+
+  const NpsBeamGeometryPtr previous = _data.Geometry();
+  geom->version = ++_data.geometryVersions;
+
+  geom->angleMin = _data.horzElem->Get<double>("min_angle");
+  geom->angleMax = _data.horzElem->Get<double>("max_angle");
+  geom->rayCount = _data.horzElem->Get<unsigned int>("samples");
+  geom->rangeCount =
+    geom->rayCount * _data.horzElem->Get<double>("resolution");
+
+  geom->rangeMin = _data.rangeElem->Get<double>("min");
+  geom->rangeMax = _data.rangeElem->Get<double>("max");
+  geom->rangeResolution = _data.rangeElem->Get<double>("resolution");
+
+  if (_data.scanElem->HasElement("vertical"))
+  {
+    geom->verticalAngleMin = _data.vertElem->Get<double>("min_angle");
+    geom->verticalAngleMax = _data.vertElem->Get<double>("max_angle");
+    geom->verticalRayCount = _data.vertElem->Get<unsigned int>("samples");
+    geom->verticalRangeCount = std::max(1, static_cast<int>(
+          geom->verticalRayCount * _data.vertElem->Get<double>("resolution")));
+  }
+
+  geom->fullRayCount = geom->rayCount;
+  geom->fullRangeCount = geom->rangeCount;
+
+  geom->angleResolution = (geom->angleMax - geom->angleMin) /
+    (geom->rangeCount - 1);
+  geom->verticalAngleResolution =
+    (geom->verticalAngleMax - geom->verticalAngleMin) /
+    (geom->verticalRangeCount - 1);
+
+  // Setters that leave the geometry as it was keep the snapshot, so
+  // tables built for its version stay valid
+  if (previous && SameGeometry(*previous, *geom))
+    return;
+
+  std::atomic_store(&_data.geometry, NpsBeamGeometryPtr(geom));
+}
+
+//////////////////////////////////////////////////
+/// \brief Get the geometry of the active sector at a time.
+///
+/// Applies the scanning head to the requested sector and narrows the
+/// whole fan to it through NpsBeamSector.
+/// \param[in] _data Sensor private data.
+/// \param[in] _simTime Current simulation time.
+/// \return The sector geometry, or the whole fan without a sector or
+/// if the source cannot narrow the fan.
+static NpsBeamGeometryPtr ActiveGeometry(NpsBeamSensorPrivate &_data,
+    const common::Time &_simTime)
+{
+  const NpsBeamGeometryPtr full = _data.Geometry();
+
+  double center;
+  double width;
+  {
+    std::lock_guard<std::mutex> lock(_data.sectorMutex);
+    width = _data.sectorWidth;
+    center = _data.sectorCenter;
+    if (width <= 0 || width >= full->angleMax - full->angleMin ||
+        full->rayCount < 3 || !_data.source->SupportsSector())
+    {
+      return full;
+    }
+
+    if (!ignition::math::equal(_data.sectorRate, 0.0))
+    {
+      if (_data.sectorRestart)
+      {
+        _data.sectorStart = _simTime;
+        _data.sectorRestart = false;
+      }
+      center = NpsBeamSector::SweepCenter(*full, center, width,
+          _data.sectorRate, (_simTime - _data.sectorStart).Double());
+    }
+  }
+
+  return _data.sector.Select(full, center, width, _data.beamAngles,
+      _data.geometryVersions);
+}
+
+//////////////////////////////////////////////////
+/// \brief Fill the header of a frame.
+/// \param[out] _frame Frame to fill, resized to the geometry.
+/// \param[in] _geom Geometry the frame is produced with.
+/// \param[in] _stamp Measurement time.
+/// \param[in] _pose Sensor world pose.
+static void FillFrameHeader(NpsBeamFrame &_frame, const NpsBeamGeometry &_geom,
+    const common::Time &_stamp, const ignition::math::Pose3d &_pose)
+{
+  _frame.Resize(_geom.rangeCount, _geom.verticalRangeCount);
+  _frame.sec = _stamp.sec;
+  _frame.nsec = _stamp.nsec;
+  _frame.pose[0] = _pose.Pos().X();
+  _frame.pose[1] = _pose.Pos().Y();
+  _frame.pose[2] = _pose.Pos().Z();
+  _frame.pose[3] = _pose.Rot().W();
+  _frame.pose[4] = _pose.Rot().X();
+  _frame.pose[5] = _pose.Rot().Y();
+  _frame.pose[6] = _pose.Rot().Z();
+  _frame.angleMin = _geom.angleMin;
+  _frame.angleMax = _geom.angleMax;
+  _frame.angleStep = _geom.angleResolution;
+  _frame.verticalAngleMin = _geom.verticalAngleMin;
+  _frame.verticalAngleMax = _geom.verticalAngleMax;
+  _frame.verticalAngleStep = _geom.verticalAngleResolution;
+  _frame.rangeMin = _geom.rangeMin;
+  _frame.rangeMax = _geom.rangeMax;
+}
+
+//////////////////////////////////////////////////
+/// \brief Parse a whitespace separated list of angles.
+/// \param[in] _elem Parent element, may be null.
+/// \param[in] _name Child element holding the list.
+/// \return The angles, empty if the child is missing.
+static std::vector<double> ParseAngles(sdf::ElementPtr _elem,
+    const std::string &_name)
+{
+  std::vector<double> angles;
+  std::istringstream stream(
+      NpsBeamParam<std::string>(_elem, _name, std::string()));
+  double angle;
+  while (stream >> angle)
+    angles.push_back(angle);
+  return angles;
+}
+
+//////////////////////////////////////////////////
+/// \brief Build the gather table from source rays to published range
+/// cells for a geometry.
+/// \param[in] _data Sensor private data.
+/// \param[in] _geom Geometry to configure for.
+static void ConfigureResampler(NpsBeamSensorPrivate &_data,
+    const NpsBeamGeometry &_geom)
+{
+  std::vector<double> angles;
+  std::vector<double> verticalAngles;
+  if (!_data.BeamAngles(_geom, angles, verticalAngles))
+  {
+    gzwarn << "NpsBeamSensor: beam angle lists do not match the "
+           << _geom.rangeCount << "x" << _geom.verticalRangeCount
+           << " ranges, using uniform angles.\n";
+  }
+
+  _data.resampler.Configure(_geom.rayCount, _geom.verticalRayCount,
+      _geom.angleMin, _geom.angleMax, _geom.verticalAngleMin,
+      _geom.verticalAngleMax, angles, verticalAngles,
+      _data.resampleEdgeThreshold);
+  _data.resamplerVersion = _geom.version;
+  _data.resamplerReady = true;
+}
+
+//////////////////////////////////////////////////
+/// \brief Build the footprint tables of the multi-echo output for a
+/// geometry.
+/// \param[in] _data Sensor private data.
+/// \param[in] _geom Geometry to configure for.
+static void ConfigureMultiEcho(NpsBeamSensorPrivate &_data,
+    const NpsBeamGeometry &_geom)
+{
+  std::vector<double> angles;
+  std::vector<double> verticalAngles;
+  _data.BeamAngles(_geom, angles, verticalAngles);
+
+  _data.multiEcho.Configure(_geom.rayCount, _geom.verticalRayCount,
+      _geom.angleMin, _geom.angleMax, _geom.verticalAngleMin,
+      _geom.verticalAngleMax, angles, verticalAngles, _data.echoes,
+      _data.echoGap);
+  _data.multiEchoVersion = _geom.version;
+  _data.multiEchoReady = true;
+}
+
+//////////////////////////////////////////////////
+/// \brief Fill the echoes of a frame from its raw rays, or from the
+/// cached frame when the rays were not read again.
+/// \param[in] _data Sensor private data.
+/// \param[in,out] _frame Frame with its echo arrays sized.
+/// \param[in] _geom Geometry the frame was produced with.
+/// \param[in] _rays Raw ray ranges, or null to reuse the cached echoes.
+/// \param[in] _rayIntensities Raw ray intensities.
+static void FindEchoes(NpsBeamSensorPrivate &_data, NpsBeamFrame &_frame,
+    const NpsBeamGeometry &_geom, const float *_rays,
+    const float *_rayIntensities)
+{
+  if (!_rays)
+  {
+    const size_t slots = std::min(_frame.echoRanges.size(),
+        _data.cachedEchoRanges.size());
+    const size_t cells = std::min(_frame.echoCounts.size(),
+        _data.cachedEchoCounts.size());
+    std::copy(_data.cachedEchoRanges.begin(),
+        _data.cachedEchoRanges.begin() + slots, _frame.echoRanges.begin());
+    std::copy(_data.cachedEchoIntensities.begin(),
+        _data.cachedEchoIntensities.begin() + slots,
+        _frame.echoIntensities.begin());
+    std::copy(_data.cachedEchoCounts.begin(),
+        _data.cachedEchoCounts.begin() + cells, _frame.echoCounts.begin());
+    return;
+  }
+
+  if (!_data.multiEchoReady || _data.multiEchoVersion != _geom.version)
+    ConfigureMultiEcho(_data, _geom);
+
+  _data.multiEcho.Apply(_rays, _rayIntensities,
+      static_cast<float>(_geom.rangeMin), static_cast<float>(_geom.rangeMax),
+      _frame.echoRanges.data(), _frame.echoIntensities.data(),
+      _frame.echoCounts.data(), &NpsBeamWorkerPool::Instance());
+
+  if (_data.incremental)
+  {
+    _data.cachedEchoRanges = _frame.echoRanges;
+    _data.cachedEchoIntensities = _frame.echoIntensities;
+    _data.cachedEchoCounts = _frame.echoCounts;
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Check whether the last raw frame can stand in for a new one,
+/// and count the outcome.
+/// \param[in] _data Sensor private data.
+/// \param[in] _world World the sensor is in.
+/// \param[in] _geom Current scan geometry.
+/// \param[in] _pose Sensor world pose.
+/// \return True if the frame is to be reused instead of rendered.
+static bool ReuseFrame(NpsBeamSensorPrivate &_data,
+    const physics::WorldPtr &_world, const NpsBeamGeometry &_geom,
+    const ignition::math::Pose3d &_pose)
+{
+  if (!_data.incremental)
+    return false;
+
+  // Always update the tracker, so its reference is the frame rendered next
+  const bool hit = _data.changeTracker.Unchanged(_world, _data.parentEntity,
+      _pose, _geom.rangeMax, _geom.version) && _data.cacheReady;
+
+  _data.diagnostics.Count(hit ? NpsBeamDiagnostics::INCREMENTAL_HITS :
+      NpsBeamDiagnostics::INCREMENTAL_MISSES);
+  return hit;
+}
+
 //////////////////////////////////////////////////
 NpsBeamSensor::NpsBeamSensor()
 : Sensor(sensors::IMAGE),
   dataPtr(new NpsBeamSensorPrivate)
 {
   this->dataPtr->rendered = false;
+  this->dataPtr->reuse = false;
+  this->dataPtr->geometryVersions = 0;
   this->active = false;
-  this->connections.push_back(
-      event::Events::ConnectRender(
-        std::bind(&NpsBeamSensor::Render, this)));
 }
 
 //////////////////////////////////////////////////
@@ -77,6 +392,76 @@ std::string NpsBeamSensor::Topic() const
   return topicName;
 }
 
+//////////////////////////////////////////////////
+std::string NpsBeamSensor::BeamImageTopic() const
+{
+  std::string topicName = "~/";
+  topicName += this->ParentName() + "/" + this->Name() + "/beam_image";
+  boost::replace_all(topicName, "::", "/");
+
+  return topicName;
+}
+
+//////////////////////////////////////////////////
+std::string NpsBeamSensor::FanImageTopic() const
+{
+  std::string topicName = "~/";
+  topicName += this->ParentName() + "/" + this->Name() + "/fan_image";
+  boost::replace_all(topicName, "::", "/");
+
+  return topicName;
+}
+
+//////////////////////////////////////////////////
+std::string NpsBeamSensor::CompactTopic() const
+{
+  std::string topicName = "~/";
+  topicName += this->ParentName() + "/" + this->Name() + "/scan_compact";
+  boost::replace_all(topicName, "::", "/");
+
+  return topicName;
+}
+
+//////////////////////////////////////////////////
+std::string NpsBeamSensor::EchoTopic() const
+{
+  std::string topicName = "~/";
+  topicName += this->ParentName() + "/" + this->Name() + "/echoes";
+  boost::replace_all(topicName, "::", "/");
+
+  return topicName;
+}
+
+//////////////////////////////////////////////////
+std::string NpsBeamSensor::PointCloudTopic() const
+{
+  std::string topicName = "~/";
+  topicName += this->ParentName() + "/" + this->Name() + "/point_cloud";
+  boost::replace_all(topicName, "::", "/");
+
+  return topicName;
+}
+
+//////////////////////////////////////////////////
+std::string NpsBeamSensor::DiagnosticsTopic() const
+{
+  std::string topicName = "~/";
+  topicName += this->ParentName() + "/" + this->Name() + "/diagnostics";
+  boost::replace_all(topicName, "::", "/");
+
+  return topicName;
+}
+
+//////////////////////////////////////////////////
+std::string NpsBeamSensor::SectorTopic() const
+{
+  std::string topicName = "~/";
+  topicName += this->ParentName() + "/" + this->Name() + "/sector";
+  boost::replace_all(topicName, "::", "/");
+
+  return topicName;
+}
+
 //////////////////////////////////////////////////
 void NpsBeamSensor::Load(const std::string &_worldName, sdf::ElementPtr _sdf)
 {
@@ -89,7 +474,7 @@ void NpsBeamSensor::Load(const std::string &_worldName)
   Sensor::Load(_worldName);
 
   this->dataPtr->scanPub =
-    this->node->Advertise<msgs::LaserScanStamped>(this->Topic(), 50);
+    Advertise<msgs::LaserScanStamped>(this->node, this->Topic(), 50);
 
   sdf::ElementPtr rayElem = this->sdf->GetElement("ray");
   this->dataPtr->scanElem = rayElem->GetElement("scan");
@@ -99,221 +484,269 @@ void NpsBeamSensor::Load(const std::string &_worldName)
   if (this->dataPtr->scanElem->HasElement("vertical"))
     this->dataPtr->vertElem = this->dataPtr->scanElem->GetElement("vertical");
 
-  this->dataPtr->horzRayCount = this->RayCount();
-  this->dataPtr->vertRayCount = this->VerticalRayCount();
+  UpdateGeometry(*this->dataPtr);
 
-  if (this->dataPtr->horzRayCount == 0 || this->dataPtr->vertRayCount == 0)
+  this->dataPtr->configElem = NpsBeamConfigElement(this->sdf);
+
+  sdf::ElementPtr beamImageElem =
+    NpsBeamElement(this->dataPtr->configElem, "beam_image");
+  if (beamImageElem)
   {
-    gzthrow("NpsBeamSensor: Image has 0 size!");
+    this->dataPtr->beamImageBeams =
+      NpsBeamParam<unsigned int>(beamImageElem, "beams", 0);
+    this->dataPtr->beamImageBins =
+      NpsBeamParam<unsigned int>(beamImageElem, "bins", 1000);
+    this->dataPtr->beamImageBeamwidth =
+      NpsBeamParam<double>(beamImageElem, "vertical_beamwidth", 0.0);
+    this->dataPtr->beamImageUseIntensity =
+      NpsBeamParam<bool>(beamImageElem, "use_intensity", true);
+
+    this->dataPtr->beamImagePub = Advertise<msgs::ImageStamped>(
+        this->node, this->BeamImageTopic(), 50);
   }
 
-  this->dataPtr->horzRangeCount = this->RangeCount();
-  this->dataPtr->vertRangeCount = this->VerticalRangeCount();
-
-  // Handle noise model settings.
-  if (rayElem->HasElement("noise"))
+  sdf::ElementPtr compactElem =
+    NpsBeamElement(this->dataPtr->configElem, "compact");
+  if (compactElem)
   {
-    this->noises[GPU_RAY_NOISE] =
-        NoiseFactory::NewNoiseModel(rayElem->GetElement("noise"),
-        this->Type());
+    this->dataPtr->compactResolution =
+      NpsBeamParam<double>(compactElem, "resolution", 0.0);
+    this->dataPtr->compactIntensityMax =
+      NpsBeamParam<double>(compactElem, "intensity_max", 0.0);
+    this->dataPtr->compactDelta =
+      NpsBeamParam<bool>(compactElem, "delta", true);
+    this->dataPtr->compactIntensities =
+      NpsBeamParam<bool>(compactElem, "intensities", true);
+
+    this->dataPtr->compactPub = Advertise<msgs::Packet>(
+        this->node, this->CompactTopic(), 50);
   }
 
-  this->dataPtr->parentEntity =
-    this->world->EntityByName(this->ParentName());
+  sdf::ElementPtr multiEchoElem =
+    NpsBeamElement(this->dataPtr->configElem, "multi_echo");
+  if (multiEchoElem)
+  {
+    this->dataPtr->echoes = std::min(std::max(1u,
+          NpsBeamParam<unsigned int>(multiEchoElem, "echoes", 3)),
+        NpsBeamMultiEcho::MaxEchoes);
+    this->dataPtr->echoGap =
+      NpsBeamParam<double>(multiEchoElem, "gap", 0.5);
 
-  GZ_ASSERT(this->dataPtr->parentEntity != nullptr,
-      "Unable to get the parent entity.");
-}
+    this->dataPtr->echoPub = Advertise<msgs::Packet>(
+        this->node, this->EchoTopic(), 50);
 
-//////////////////////////////////////////////////
-void NpsBeamSensor::Init()
-{
-  if (rendering::RenderEngine::Instance()->GetRenderPathType() ==
-      rendering::RenderEngine::NONE)
-  {
-    gzerr << "Unable to create NpsBeamSensor. Rendering is disabled.\n";
-    return;
+    // Set once; setting a long string from a literal allocates a copy
+    this->dataPtr->echoMsg.set_type("nps_beam_echoes");
   }
 
-  std::string worldName = this->world->Name();
-
-  if (!worldName.empty())
+  sdf::ElementPtr fanImageElem =
+    NpsBeamElement(this->dataPtr->configElem, "fan_image");
+  if (fanImageElem)
   {
-    this->scene = rendering::get_scene(worldName);
+    this->dataPtr->fanImageWidth = std::max(1u,
+        NpsBeamParam<unsigned int>(fanImageElem, "width", 1024));
+    this->dataPtr->fanImageHeight = std::max(1u,
+        NpsBeamParam<unsigned int>(fanImageElem, "height", 1024));
 
-    if (!this->scene)
-      this->scene = rendering::create_scene(worldName, false, true);
+    this->dataPtr->fanImagePub = Advertise<msgs::ImageStamped>(
+        this->node, this->FanImageTopic(), 50);
+  }
 
-    this->dataPtr->laserCam = this->scene->CreateGpuLaser(
-        this->sdf->Get<std::string>("name"), false);
+  sdf::ElementPtr pointCloudElem =
+    NpsBeamElement(this->dataPtr->configElem, "point_cloud");
+  if (pointCloudElem)
+  {
+    this->dataPtr->pointCloudWorld =
+      NpsBeamParam<bool>(pointCloudElem, "world_frame", true);
 
-    if (!this->dataPtr->laserCam)
-    {
-      gzerr << "Unable to create gpu laser sensor\n";
-      return;
-    }
-    this->dataPtr->laserCam->SetCaptureData(true);
+    this->dataPtr->pointCloudPub = Advertise<msgs::PointCloudPacked>(
+        this->node, this->PointCloudTopic(), 50);
+  }
+
+  sdf::ElementPtr shmElem =
+    NpsBeamElement(this->dataPtr->configElem, "shm");
+  if (shmElem)
+  {
+    std::string shmName = "/nps_beam_" + this->ScopedName();
+    boost::replace_all(shmName, "::", "_");
+    this->dataPtr->shmName =
+      NpsBeamParam<std::string>(shmElem, "name", shmName);
+    if (this->dataPtr->shmName.empty() || this->dataPtr->shmName[0] != '/')
+      this->dataPtr->shmName = "/" + this->dataPtr->shmName;
+    this->dataPtr->shmSlots =
+      NpsBeamParam<unsigned int>(shmElem, "slots", 8);
+  }
 
-    // initialize GpuLaser from sdf
-    if (this->dataPtr->vertRayCount == 1)
+  sdf::ElementPtr recordElem =
+    NpsBeamElement(this->dataPtr->configElem, "record");
+  if (recordElem)
+  {
+    std::string recordPath = this->ScopedName() + ".beamrec";
+    boost::replace_all(recordPath, "::", "_");
+    recordPath = NpsBeamParam<std::string>(recordElem, "file", recordPath);
+    if (!this->dataPtr->recorder.Open(recordPath,
+          NpsBeamParam<unsigned int>(recordElem, "chunk_mb", 64) << 20,
+          NpsBeamParam<unsigned int>(recordElem, "slots", 4)))
     {
-      this->dataPtr->vertRangeCount = 1;
-      this->dataPtr->laserCam->SetIsHorizontal(true);
+      gzerr << "Unable to create beam recording[" << recordPath << "]\n";
     }
-    else
-      this->dataPtr->laserCam->SetIsHorizontal(false);
-
-    this->dataPtr->rangeCountRatio =
-      this->dataPtr->horzRangeCount / this->dataPtr->vertRangeCount;
-
-    this->dataPtr->laserCam->SetNearClip(this->RangeMin());
-    this->dataPtr->laserCam->SetFarClip(this->RangeMax());
-
-    this->dataPtr->laserCam->SetHorzFOV(
-        (this->AngleMax() - this->AngleMin()).Radian());
-    this->dataPtr->laserCam->SetVertFOV(
-        (this->VerticalAngleMax() - this->VerticalAngleMin()).Radian());
-
-    this->dataPtr->laserCam->SetHorzHalfAngle(
-      (this->AngleMax() + this->AngleMin()).Radian() / 2.0);
-
-    this->dataPtr->laserCam->SetVertHalfAngle((this->VerticalAngleMax()
-            + this->VerticalAngleMin()).Radian() / 2.0);
+  }
 
-    if (this->HorzFOV() > 2 * M_PI)
-      this->dataPtr->laserCam->SetHorzFOV(2*M_PI);
+  sdf::ElementPtr pipelineElem =
+    NpsBeamElement(this->dataPtr->configElem, "pipeline");
+  this->dataPtr->pipelineDropWhenFull =
+    NpsBeamParam<bool>(pipelineElem, "drop_when_full", false);
+  this->dataPtr->pipeline.Start(
+      NpsBeamParam<unsigned int>(pipelineElem, "depth", 0),
+      NpsBeamParam<bool>(pipelineElem, "shared_pool", false) ?
+      &NpsBeamWorkerPool::Instance() : nullptr);
+  this->dataPtr->pendingFrames.assign(this->dataPtr->pipeline.Depth() + 1,
+      NpsBeamPendingFrame());
+  this->dataPtr->nextPending = 0;
+
+  sdf::ElementPtr resampleElem =
+    NpsBeamElement(this->dataPtr->configElem, "resample");
+  this->dataPtr->beamAngles = ParseAngles(resampleElem, "horizontal_angles");
+  this->dataPtr->verticalBeamAngles =
+    ParseAngles(resampleElem, "vertical_angles");
+  this->dataPtr->resampleEdgeThreshold =
+    NpsBeamParam<double>(resampleElem, "edge_threshold", 0.5);
+
+  sdf::ElementPtr incrementalElem =
+    NpsBeamElement(this->dataPtr->configElem, "incremental");
+  this->dataPtr->incremental =
+    NpsBeamParam<bool>(incrementalElem, "enabled", false);
+  this->dataPtr->changeTracker.Configure(
+      NpsBeamParam<double>(incrementalElem, "position_tolerance", 0.001),
+      NpsBeamParam<double>(incrementalElem, "angle_tolerance", 0.001));
+
+  sdf::ElementPtr sectorElem =
+    NpsBeamElement(this->dataPtr->configElem, "sector");
+  this->SetSector(NpsBeamParam<double>(sectorElem, "center", 0.0),
+      NpsBeamParam<double>(sectorElem, "width", 0.0),
+      NpsBeamParam<double>(sectorElem, "scan_rate", 0.0));
+  this->dataPtr->sectorSub = this->node->Subscribe(this->SectorTopic(),
+      &NpsBeamSensor::OnSectorRequest, this);
+
+  // Diagnostics are opt-in: without a rate nothing is timed or counted
+  this->dataPtr->diagnosticsRate = NpsBeamParam<double>(
+      NpsBeamElement(this->dataPtr->configElem, "diagnostics"), "rate", 0.0);
+  this->dataPtr->diagnostics.SetEnabled(this->dataPtr->diagnosticsRate > 0);
+  if (this->dataPtr->diagnosticsRate > 0)
+  {
+    this->dataPtr->diagnosticsPub = Advertise<msgs::Param_V>(
+        this->node, this->DiagnosticsTopic(), 10);
+  }
 
-    this->dataPtr->laserCam->SetCameraCount(1);
+  this->dataPtr->vertRayCount = this->VerticalRayCount();
 
-    if (this->HorzFOV() > 2.8)
-    {
-      if (this->HorzFOV() > 5.6)
-        this->dataPtr->laserCam->SetCameraCount(3);
-      else
-        this->dataPtr->laserCam->SetCameraCount(2);
-    }
+  if (this->RayCount() == 0 || this->dataPtr->vertRayCount == 0)
+  {
+    gzthrow("NpsBeamSensor: Image has 0 size!");
+  }
 
-    this->dataPtr->laserCam->SetHorzFOV(this->HorzFOV() / this->CameraCount());
-    this->dataPtr->horzRayCount /= this->CameraCount();
+  this->dataPtr->horzRangeCount = this->RangeCount();
+  this->dataPtr->vertRangeCount = this->VerticalRangeCount();
+  if (this->dataPtr->vertRayCount == 1)
+    this->dataPtr->vertRangeCount = 1;
+  this->dataPtr->rangeCountRatio =
+    static_cast<double>(this->dataPtr->horzRangeCount) /
+    this->dataPtr->vertRangeCount;
 
-    if (this->VertFOV() > M_PI / 2)
-    {
-      gzwarn << "Vertical FOV for block GPU laser is capped at 90 degrees.\n";
-      this->dataPtr->laserCam->SetVertFOV(M_PI / 2);
-      this->SetVerticalAngleMin(this->dataPtr->laserCam->VertHalfAngle() -
-                                (this->VertFOV() / 2));
-      this->SetVerticalAngleMax(this->dataPtr->laserCam->VertHalfAngle() +
-                                (this->VertFOV() / 2));
-    }
+  this->dataPtr->sourceName = NpsBeamParam<std::string>(
+      this->dataPtr->configElem, "source", "auto");
 
-    if ((this->dataPtr->horzRayCount * this->dataPtr->vertRayCount) <
-        (this->dataPtr->horzRangeCount * this->dataPtr->vertRangeCount))
-    {
-      this->dataPtr->horzRayCount =
-        std::max(this->dataPtr->horzRayCount, this->dataPtr->horzRangeCount);
-      this->dataPtr->vertRayCount =
-        std::max(this->dataPtr->vertRayCount, this->dataPtr->vertRangeCount);
-    }
+  // Handle noise model settings.
+  if (rayElem->HasElement("noise"))
+  {
+    sdf::ElementPtr noiseElem = rayElem->GetElement("noise");
+    this->noises[GPU_RAY_NOISE] =
+        NoiseFactory::NewNoiseModel(noiseElem, this->Type());
 
-    if (this->dataPtr->laserCam->IsHorizontal())
+    // Gaussian noise is drawn in bulk, custom noise stays per ray
+    const std::string noiseType = noiseElem->Get<std::string>("type");
+    if (noiseType == "gaussian" || noiseType == "gaussian_quantized")
     {
-      if (this->dataPtr->vertRayCount > 1)
-      {
-        this->dataPtr->laserCam->SetCosHorzFOV(
-          2 * atan(tan(this->HorzFOV()/2) / cos(this->VertFOV()/2)));
-        this->dataPtr->laserCam->SetCosVertFOV(this->VertFOV());
-        this->dataPtr->laserCam->SetRayCountRatio(
-          tan(this->CosHorzFOV()/2.0) / tan(this->VertFOV()/2.0));
-
-        if ((this->dataPtr->horzRayCount / this->RayCountRatio()) >
-            this->dataPtr->vertRayCount)
-        {
-          this->dataPtr->vertRayCount =
-            this->dataPtr->horzRayCount / this->RayCountRatio();
-        }
-        else
-        {
-          this->dataPtr->horzRayCount =
-            this->dataPtr->vertRayCount * this->RayCountRatio();
-        }
-      }
-      else
-      {
-        this->dataPtr->laserCam->SetCosHorzFOV(this->HorzFOV());
-        this->dataPtr->laserCam->SetCosVertFOV(this->VertFOV());
-      }
+      NpsBeamNoiseEngine engine;
+      engine.Configure(
+          NpsBeamParam<double>(noiseElem, "mean", 0.0),
+          NpsBeamParam<double>(noiseElem, "stddev", 0.0),
+          NpsBeamParam<double>(noiseElem, "bias_mean", 0.0),
+          NpsBeamParam<double>(noiseElem, "bias_stddev", 0.0),
+          noiseType == "gaussian_quantized" ?
+            NpsBeamParam<double>(noiseElem, "precision", 0.0) : 0.0,
+          NpsBeamParam<unsigned int>(this->dataPtr->configElem,
+            "noise_seed", ignition::math::Rand::Seed()),
+          NpsBeamNoiseSalt(this->ScopedName()));
+      this->dataPtr->processor.SetNoise(engine);
+      this->dataPtr->bulkNoise = true;
+
+      // Kept for a custom noise callback set on the model later
+      NoisePtr noise = this->noises[GPU_RAY_NOISE];
+      this->dataPtr->customNoiseFunction =
+          [noise](double _range) { return noise->Apply(_range); };
     }
     else
     {
-      if (this->dataPtr->horzRayCount > 1)
-      {
-        this->dataPtr->laserCam->SetCosHorzFOV(this->HorzFOV());
-        this->dataPtr->laserCam->SetCosVertFOV(
-          2 * atan(tan(this->VertFOV()/2) / cos(this->HorzFOV()/2)));
-        this->dataPtr->laserCam->SetRayCountRatio(
-          tan(this->HorzFOV()/2.0) / tan(this->CosVertFOV()/2.0));
-
-        if ((this->dataPtr->horzRayCount / this->RayCountRatio()) >
-            this->dataPtr->vertRayCount)
-        {
-          this->dataPtr->vertRayCount =
-            this->dataPtr->horzRayCount / this->RayCountRatio();
-        }
-        else
-        {
-          this->dataPtr->horzRayCount = this->dataPtr->vertRayCount *
-            this->RayCountRatio();
-        }
-      }
-      else
-      {
-        this->dataPtr->laserCam->SetCosHorzFOV(this->HorzFOV());
-        this->dataPtr->laserCam->SetCosVertFOV(this->VertFOV());
-      }
+      NoisePtr noise = this->noises[GPU_RAY_NOISE];
+      this->dataPtr->processor.SetNoise(
+          [noise](double _range) { return noise->Apply(_range); });
     }
+  }
+  this->dataPtr->processor.SetPool(&NpsBeamWorkerPool::Instance());
 
-    // Initialize camera sdf for GpuLaser
-    this->dataPtr->cameraElem.reset(new sdf::Element);
-    sdf::initFile("camera.sdf", this->dataPtr->cameraElem);
-
-    this->dataPtr->cameraElem->GetElement("horizontal_fov")->Set(
-        this->CosHorzFOV());
+  this->dataPtr->parentEntity =
+    this->world->EntityByName(this->ParentName());
 
-    sdf::ElementPtr ptr = this->dataPtr->cameraElem->GetElement("image");
-    ptr->GetElement("width")->Set(this->dataPtr->horzRayCount);
-    ptr->GetElement("height")->Set(this->dataPtr->vertRayCount);
-    ptr->GetElement("format")->Set("R8G8B8");
+  GZ_ASSERT(this->dataPtr->parentEntity != nullptr,
+      "Unable to get the parent entity.");
+}
 
-    ptr = this->dataPtr->cameraElem->GetElement("clip");
-    ptr->GetElement("near")->Set(this->dataPtr->laserCam->NearClip());
-    ptr->GetElement("far")->Set(this->dataPtr->laserCam->FarClip());
+//////////////////////////////////////////////////
+void NpsBeamSensor::Init()
+{
+  std::string sourceName = this->dataPtr->sourceName;
+  if (sourceName == "auto")
+  {
+    sourceName = rendering::RenderEngine::Instance()->GetRenderPathType() ==
+      rendering::RenderEngine::NONE ? "cpu" : "gpu";
+  }
+  else if (sourceName == "gpu" &&
+      rendering::RenderEngine::Instance()->GetRenderPathType() ==
+      rendering::RenderEngine::NONE)
+  {
+    gzerr << "Unable to create NpsBeamSensor. Rendering is disabled.\n";
+    return;
+  }
 
-    // Load camera sdf for GpuLaser
-    this->dataPtr->laserCam->Load(this->dataPtr->cameraElem);
+  this->dataPtr->source = NpsBeamFrameSource::Create(sourceName);
+  if (!this->dataPtr->source)
+  {
+    gzerr << "Unknown NpsBeamSensor source [" << sourceName << "]\n";
+    return;
+  }
 
+  NpsBeamSourceContext context;
+  context.world = this->world;
+  context.parent = this->dataPtr->parentEntity;
+  context.config = this->dataPtr->configElem;
+  if (!this->dataPtr->source->Init(*this, context))
+  {
+    this->dataPtr->source.reset();
+    return;
+  }
 
-    // initialize GpuLaser
-    this->dataPtr->laserCam->Init();
-    this->dataPtr->laserCam->SetRangeCount(
-        this->dataPtr->horzRangeCount, this->dataPtr->vertRangeCount);
-    this->dataPtr->laserCam->SetClipDist(this->RangeMin(), this->RangeMax());
-    this->dataPtr->laserCam->CreateLaserTexture(
-        this->ScopedName() + "_RttTex_Laser");
-    this->dataPtr->laserCam->CreateRenderTexture(
-        this->ScopedName() + "_RttTex_Image");
-    this->dataPtr->laserCam->SetWorldPose(this->pose);
-    this->dataPtr->laserCam->AttachToVisual(this->ParentId(), true, 0, 0);
+  this->dataPtr->laserMsg.mutable_scan()->set_frame(this->ParentName());
+  this->dataPtr->cacheReady = false;
+  this->dataPtr->changeTracker.Reset();
 
-    this->dataPtr->laserMsg.mutable_scan()->set_frame(this->ParentName());
+  if (this->dataPtr->source->RendersOnRenderEvent())
+  {
+    this->dataPtr->scheduledRate = this->UpdateRate();
+    this->dataPtr->schedulerId = NpsBeamScheduler::Instance().Add(
+        this->dataPtr->scheduledRate, std::bind(&NpsBeamSensor::Render, this),
+        std::bind(&NpsBeamSensor::ReadBack, this));
   }
-  else
-    gzerr << "No world name\n";
-
-  // Disable clouds and moon on server side until fixed and also to improve
-  // performance
-  this->scene->SetSkyXMode(rendering::Scene::GZ_SKYX_ALL &
-      ~rendering::Scene::GZ_SKYX_CLOUDS &
-      ~rendering::Scene::GZ_SKYX_MOON);
 
   Sensor::Init();
 }
@@ -321,11 +754,19 @@ void NpsBeamSensor::Init()
 //////////////////////////////////////////////////
 void NpsBeamSensor::Fini()
 {
-  if (this->scene)
-    this->scene->RemoveCamera(this->dataPtr->laserCam->Name());
-  this->scene.reset();
+  if (this->dataPtr->schedulerId)
+    NpsBeamScheduler::Instance().Remove(this->dataPtr->schedulerId);
+  this->dataPtr->schedulerId = 0;
+
+  this->dataPtr->pipeline.Stop();
 
-  this->dataPtr->laserCam.reset();
+  if (this->dataPtr->source)
+    this->dataPtr->source->Fini();
+  this->dataPtr->source.reset();
+
+  this->dataPtr->sectorSub.reset();
+  this->dataPtr->shmWriter.Close();
+  this->dataPtr->recorder.Close();
 
   Sensor::Fini();
 }
@@ -335,49 +776,75 @@ event::ConnectionPtr NpsBeamSensor::ConnectNewLaserFrame(
   std::function<void(const float *, unsigned int, unsigned int, unsigned int,
   const std::string &)> _subscriber)
 {
-  return this->dataPtr->laserCam->ConnectNewLaserFrame(_subscriber);
+  if (!this->dataPtr->source)
+    return event::ConnectionPtr();
+  return this->dataPtr->source->ConnectNewLaserFrame(_subscriber);
+}
+
+//////////////////////////////////////////////////
+common::Time NpsBeamSensor::FrameTime() const
+{
+  if (!this->dataPtr->source)
+    return common::Time();
+  return this->dataPtr->source->FrameTime();
 }
 
 //////////////////////////////////////////////////
 unsigned int NpsBeamSensor::CameraCount() const
 {
-  return this->dataPtr->laserCam->CameraCount();
+  if (!this->dataPtr->source)
+    return 1;
+  return this->dataPtr->source->CameraCount();
 }
 
 //////////////////////////////////////////////////
 bool NpsBeamSensor::IsHorizontal() const
 {
-  return this->dataPtr->laserCam->IsHorizontal();
+  if (!this->dataPtr->source)
+    return true;
+  return this->dataPtr->source->IsHorizontal();
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::HorzFOV() const
 {
-  return this->dataPtr->laserCam->HorzFOV();
+  if (!this->dataPtr->source)
+    return this->AngleMax().Radian() - this->AngleMin().Radian();
+  return this->dataPtr->source->HorzFOV();
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::CosHorzFOV() const
 {
-  return this->dataPtr->laserCam->CosHorzFOV();
+  if (!this->dataPtr->source)
+    return this->HorzFOV();
+  return this->dataPtr->source->CosHorzFOV();
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::VertFOV() const
 {
-  return this->dataPtr->laserCam->VertFOV();
+  if (!this->dataPtr->source)
+    return this->VerticalAngleMax().Radian() -
+      this->VerticalAngleMin().Radian();
+  return this->dataPtr->source->VertFOV();
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::CosVertFOV() const
 {
-  return this->dataPtr->laserCam->CosVertFOV();
+  if (!this->dataPtr->source)
+    return this->VertFOV();
+  return this->dataPtr->source->CosVertFOV();
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::RayCountRatio() const
 {
-  return this->dataPtr->laserCam->RayCountRatio();
+  if (!this->dataPtr->source)
+    return static_cast<double>(this->RayCount()) /
+      this->VerticalRayCount();
+  return this->dataPtr->source->RayCountRatio();
 }
 
 //////////////////////////////////////////////////
@@ -389,160 +856,186 @@ double NpsBeamSensor::RangeCountRatio() const
 //////////////////////////////////////////////////
 ignition::math::Angle NpsBeamSensor::AngleMin() const
 {
-  return this->dataPtr->horzElem->Get<double>("min_angle");
+  return this->dataPtr->Geometry()->angleMin;
 }
 
 //////////////////////////////////////////////////
 void NpsBeamSensor::SetAngleMin(double _angle)
 {
   this->dataPtr->horzElem->GetElement("min_angle")->Set(_angle);
+  UpdateGeometry(*this->dataPtr);
 }
 
 //////////////////////////////////////////////////
 ignition::math::Angle NpsBeamSensor::AngleMax() const
 {
-  return this->dataPtr->horzElem->Get<double>("max_angle");
+  return this->dataPtr->Geometry()->angleMax;
 }
 
 //////////////////////////////////////////////////
 void NpsBeamSensor::SetAngleMax(double _angle)
 {
   this->dataPtr->horzElem->GetElement("max_angle")->Set(_angle);
+  UpdateGeometry(*this->dataPtr);
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::RangeMin() const
 {
-  return this->dataPtr->rangeElem->Get<double>("min");
+  return this->dataPtr->Geometry()->rangeMin;
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::RangeMax() const
 {
-  return this->dataPtr->rangeElem->Get<double>("max");
+  return this->dataPtr->Geometry()->rangeMax;
 }
 
 /////////////////////////////////////////////////
 double NpsBeamSensor::AngleResolution() const
 {
-  return (this->AngleMax() - this->AngleMin()).Radian() /
-    (this->RangeCount()-1);
+  return this->dataPtr->Geometry()->angleResolution;
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::RangeResolution() const
 {
-  return this->dataPtr->rangeElem->Get<double>("resolution");
+  return this->dataPtr->Geometry()->rangeResolution;
 }
 
 //////////////////////////////////////////////////
 int NpsBeamSensor::RayCount() const
 {
-  return this->dataPtr->horzElem->Get<unsigned int>("samples");
+  return this->dataPtr->Geometry()->rayCount;
 }
 
 //////////////////////////////////////////////////
 int NpsBeamSensor::RangeCount() const
 {
-  return this->RayCount() * this->dataPtr->horzElem->Get<double>("resolution");
+  return this->dataPtr->Geometry()->rangeCount;
 }
 
 //////////////////////////////////////////////////
 int NpsBeamSensor::VerticalRayCount() const
 {
-  if (this->dataPtr->scanElem->HasElement("vertical"))
-    return this->dataPtr->vertElem->Get<unsigned int>("samples");
-  else
-    return 1;
+  return this->dataPtr->Geometry()->verticalRayCount;
 }
 
 //////////////////////////////////////////////////
 int NpsBeamSensor::VerticalRangeCount() const
 {
-  if (this->dataPtr->scanElem->HasElement("vertical"))
-  {
-    int rows =  (this->VerticalRayCount() *
-          this->dataPtr->vertElem->Get<double>("resolution"));
-    if (rows > 1)
-      return rows;
-    else
-      return 1;
-  }
-  else
-    return 1;
+  return this->dataPtr->Geometry()->verticalRangeCount;
 }
 
 //////////////////////////////////////////////////
 ignition::math::Angle NpsBeamSensor::VerticalAngleMin() const
 {
-  if (this->dataPtr->scanElem->HasElement("vertical"))
-    return this->dataPtr->vertElem->Get<double>("min_angle");
-  else
-    return ignition::math::Angle(0);
+  return this->dataPtr->Geometry()->verticalAngleMin;
 }
 
 //////////////////////////////////////////////////
 void NpsBeamSensor::SetVerticalAngleMin(const double _angle)
 {
   if (this->dataPtr->scanElem->HasElement("vertical"))
+  {
     this->dataPtr->vertElem->GetElement("min_angle")->Set(_angle);
+    UpdateGeometry(*this->dataPtr);
+  }
 }
 
 //////////////////////////////////////////////////
 ignition::math::Angle NpsBeamSensor::VerticalAngleMax() const
 {
-  if (this->dataPtr->scanElem->HasElement("vertical"))
-    return this->dataPtr->vertElem->Get<double>("max_angle");
-  else
-    return ignition::math::Angle(0);
+  return this->dataPtr->Geometry()->verticalAngleMax;
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::VerticalAngleResolution() const
 {
-  return (this->VerticalAngleMax() - this->VerticalAngleMin()).Radian() /
-    (this->VerticalRangeCount()-1);
+  return this->dataPtr->Geometry()->verticalAngleResolution;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamSensor::SetSector(const double _center, const double _width,
+    const double _scanRate)
+{
+  std::lock_guard<std::mutex> lock(this->dataPtr->sectorMutex);
+  this->dataPtr->sectorCenter = _center;
+  this->dataPtr->sectorWidth = _width;
+  this->dataPtr->sectorRate = _scanRate;
+  this->dataPtr->sectorRestart = true;
 }
 
 //////////////////////////////////////////////////
 void NpsBeamSensor::SetVerticalAngleMax(const double _angle)
 {
   if (this->dataPtr->scanElem->HasElement("vertical"))
+  {
     this->dataPtr->vertElem->GetElement("max_angle")->Set(_angle);
+    UpdateGeometry(*this->dataPtr);
+  }
+}
+
+//////////////////////////////////////////////////
+NpsBeamFramePtr NpsBeamSensor::LatestScan() const
+{
+  return this->dataPtr->frameStore.Latest();
 }
 
 //////////////////////////////////////////////////
 void NpsBeamSensor::Ranges(std::vector<double> &_ranges) const
 {
-  std::lock_guard<std::mutex> lock(this->dataPtr->mutex);
+  const NpsBeamFramePtr frame = this->LatestScan();
+  if (!frame)
+  {
+    _ranges.clear();
+    return;
+  }
+
+  _ranges.assign(frame->ranges.begin(), frame->ranges.end());
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamSensor::Ranges(double *_ranges, const size_t _count) const
+{
+  const NpsBeamFramePtr frame = this->LatestScan();
+  if (!frame)
+    return 0;
 
-  _ranges.resize(this->dataPtr->laserMsg.scan().ranges_size());
-  memcpy(&_ranges[0], this->dataPtr->laserMsg.scan().ranges().data(),
-         sizeof(_ranges[0]) * this->dataPtr->laserMsg.scan().ranges_size());
+  const size_t count = std::min(_count, frame->ranges.size());
+  std::copy(frame->ranges.begin(), frame->ranges.begin() + count, _ranges);
+  return count;
 }
 
 //////////////////////////////////////////////////
 double NpsBeamSensor::Range(const int _index) const
 {
-  std::lock_guard<std::mutex> lock(this->dataPtr->mutex);
-  if (this->dataPtr->laserMsg.scan().ranges_size() == 0)
+  const NpsBeamFramePtr frame = this->LatestScan();
+  if (!frame || frame->ranges.empty())
   {
     gzwarn << "ranges not constructed yet (zero sized)\n";
     return 0.0;
   }
-  if (_index < 0 || _index > this->dataPtr->laserMsg.scan().ranges_size())
+  if (_index < 0 || _index >= static_cast<int>(frame->ranges.size()))
   {
     gzerr << "Invalid range index[" << _index << "]\n";
     return 0.0;
   }
 
-  return this->dataPtr->laserMsg.scan().ranges(_index);
+  return frame->ranges[_index];
 }
 
 //////////////////////////////////////////////////
-double NpsBeamSensor::Retro(const int /*_index*/) const
+double NpsBeamSensor::Retro(const int _index) const
 {
-  return 0.0;
+  const NpsBeamFramePtr frame = this->LatestScan();
+  if (!frame || _index < 0 ||
+      _index >= static_cast<int>(frame->intensities.size()))
+  {
+    return 0.0;
+  }
+
+  return frame->intensities[_index];
 }
 
 //////////////////////////////////////////////////
@@ -552,94 +1045,245 @@ int NpsBeamSensor::Fiducial(const unsigned int /*_index*/) const
 }
 
 //////////////////////////////////////////////////
-void NpsBeamSensor::Render()
+bool NpsBeamSensor::Render()
 {
-  if (!this->dataPtr->laserCam || !this->IsActive() || !this->NeedsUpdate())
-    return;
+  // Wait for the previous frame to be consumed before rendering over it
+  if (!this->dataPtr->source ||
+      !this->dataPtr->source->RendersOnRenderEvent() || !this->IsActive() ||
+      this->dataPtr->rendered)
+  {
+    return false;
+  }
 
-  this->lastMeasurementTime = this->scene->SimTime();
+  // SetUpdateRate does not notify the sensor, so follow rate changes here
+  const double rate = this->UpdateRate();
+  if (rate != this->dataPtr->scheduledRate)
+  {
+    NpsBeamScheduler::Instance().SetRate(this->dataPtr->schedulerId, rate);
+    this->dataPtr->scheduledRate = rate;
+  }
 
-  this->dataPtr->laserCam->Render();
-  this->dataPtr->rendered = true;
-}
+  if (!this->NeedsUpdate())
+  {
+    this->dataPtr->diagnostics.Count(NpsBeamDiagnostics::SKIPPED_NO_UPDATE);
+    return false;
+  }
 
-//////////////////////////////////////////////////
-bool NpsBeamSensor::UpdateImpl(const bool /*_force*/)
-{
-  if (!this->dataPtr->rendered)
+  // UpdateImpl reads the frame with the geometry it was rendered with
+  const NpsBeamGeometryPtr geom =
+    ActiveGeometry(*this->dataPtr, this->world->SimTime());
+  this->dataPtr->frameGeometry = geom;
+  if (ReuseFrame(*this->dataPtr, this->world, *geom,
+        this->pose + this->dataPtr->parentEntity->WorldPose()))
+  {
+    // Nothing to read back; UpdateImpl restamps the cached frame
+    this->lastMeasurementTime = this->world->SimTime();
+    this->dataPtr->reuse = true;
+    this->dataPtr->rendered = true;
     return false;
+  }
 
-  this->dataPtr->laserCam->PostRender();
+  const NpsBeamDiagnostics::Clock::time_point start =
+    NpsBeamDiagnostics::Clock::now();
+  this->lastMeasurementTime = this->dataPtr->source->Render(
+      *geom, ignition::math::Pose3d::Zero);
+  this->dataPtr->diagnostics.Record(NpsBeamDiagnostics::RENDER, start,
+      NpsBeamDiagnostics::Clock::now());
+  this->dataPtr->diagnostics.Count(NpsBeamDiagnostics::CULLED,
+      this->dataPtr->source->CulledCount());
 
-  std::lock_guard<std::mutex> lock(this->dataPtr->mutex);
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamSensor::ReadBack()
+{
+  const NpsBeamDiagnostics::Clock::time_point start =
+    NpsBeamDiagnostics::Clock::now();
+  this->dataPtr->source->PostRender();
+  this->dataPtr->diagnostics.Record(NpsBeamDiagnostics::POST_RENDER, start,
+      NpsBeamDiagnostics::Clock::now());
 
-  msgs::Set(this->dataPtr->laserMsg.mutable_time(),
-      this->lastMeasurementTime);
+  this->dataPtr->rendered = true;
+}
 
-  msgs::LaserScan *scan = this->dataPtr->laserMsg.mutable_scan();
+//////////////////////////////////////////////////
+void NpsBeamSensor::OnSectorRequest(ConstVector3dPtr &_msg)
+{
+  this->SetSector(_msg->x(), _msg->y(), _msg->z());
+}
 
-  // Store the latest laser scans into laserMsg
-  msgs::Set(scan->mutable_world_pose(),
-      this->pose + this->dataPtr->parentEntity->WorldPose());
-  scan->set_angle_min(this->AngleMin().Radian());
-  scan->set_angle_max(this->AngleMax().Radian());
-  scan->set_angle_step(this->AngleResolution());
-  scan->set_count(this->RayCount());
+//////////////////////////////////////////////////
+bool NpsBeamSensor::UpdateImpl(const bool /*_force*/)
+{
+  if (!this->dataPtr->source)
+    return false;
 
-  scan->set_vertical_angle_min(this->VerticalAngleMin().Radian());
-  scan->set_vertical_angle_max(this->VerticalAngleMax().Radian());
-  scan->set_vertical_angle_step(this->VerticalAngleResolution());
-  scan->set_vertical_count(this->VerticalRayCount());
+  NpsBeamDiagnostics &diagnostics = this->dataPtr->diagnostics;
+  const NpsBeamDiagnostics::Clock::time_point start =
+    NpsBeamDiagnostics::Clock::now();
 
-  scan->set_range_min(this->RangeMin());
-  scan->set_range_max(this->RangeMax());
+  const ignition::math::Pose3d worldPose =
+    this->pose + this->dataPtr->parentEntity->WorldPose();
 
-  const int numRays = this->RayCount() * this->VerticalRayCount();
-  if (scan->ranges_size() != numRays)
+  // Use one geometry snapshot for the whole frame
+  NpsBeamGeometryPtr geom;
+  NpsBeamFrameSource &source = *this->dataPtr->source;
+  if (!source.RendersOnRenderEvent())
   {
-    // gzdbg << "Size mismatch; allocating memory\n";
-    scan->clear_ranges();
-    scan->clear_intensities();
-    for (int i = 0; i < numRays; ++i)
+    geom = ActiveGeometry(*this->dataPtr, this->world->SimTime());
+    if (ReuseFrame(*this->dataPtr, this->world, *geom, worldPose))
     {
-      scan->add_ranges(ignition::math::NAN_F);
-      scan->add_intensities(ignition::math::NAN_F);
+      this->lastMeasurementTime = this->world->SimTime();
+      this->dataPtr->reuse = true;
+    }
+    else
+    {
+      this->lastMeasurementTime = source.Render(*geom, worldPose);
+      diagnostics.Record(NpsBeamDiagnostics::RENDER, start,
+          NpsBeamDiagnostics::Clock::now());
     }
   }
-
-  auto dataIter = this->dataPtr->laserCam->LaserDataBegin();
-  auto dataEnd = this->dataPtr->laserCam->LaserDataEnd();
-  for (int i = 0; dataIter != dataEnd; ++dataIter, ++i)
+  else if (!this->dataPtr->rendered)
   {
-    const rendering::GpuLaserData data = *dataIter;
-    double range = data.range;
-    double intensity = data.intensity;
-
-    // Mask ranges outside of min/max to +/- inf, as per REP 117
-    if (range >= this->RangeMax())
+    diagnostics.Count(NpsBeamDiagnostics::SKIPPED_NOT_RENDERED);
+    this->dataPtr->PublishDiagnostics(start);
+    return false;
+  }
+  else
+  {
+    geom = this->dataPtr->frameGeometry;
+  }
+  const int numCells = geom->rangeCount * geom->verticalRangeCount;
+
+  // The frame is private to the pipeline until EndWrite. Render does not
+  // start a new frame before this one is consumed, so
+  // lastMeasurementTime is still the time this frame was rendered.
+  ignition::math::Pose3d framePose = worldPose;
+  source.FramePose(framePose);
+  NpsBeamFrame *frame = this->dataPtr->frameStore.BeginWrite();
+  FillFrameHeader(*frame, *geom, this->lastMeasurementTime, framePose);
+  frame->ResizeEchoes(this->dataPtr->echoes);
+
+  // Gather the laser data straight into the frame for the scan kernel
+  float *ranges = frame->ranges.data();
+  float *intensities = frame->intensities.data();
+
+  // Raw rays of a newly read frame, for the echoes
+  const float *rays = nullptr;
+  const float *rayIntensities = nullptr;
+
+  int count;
+  if (this->dataPtr->reuse)
+  {
+    // Same raw data as the last frame; noise is drawn again in Process
+    count = std::min(numCells,
+        static_cast<int>(this->dataPtr->cachedRanges.size()));
+    std::copy(this->dataPtr->cachedRanges.begin(),
+        this->dataPtr->cachedRanges.begin() + count, ranges);
+    std::copy(this->dataPtr->cachedIntensities.begin(),
+        this->dataPtr->cachedIntensities.begin() + count, intensities);
+    this->dataPtr->reuse = false;
+  }
+  else
+  {
+    if (!this->dataPtr->resamplerReady ||
+        this->dataPtr->resamplerVersion != geom->version)
     {
-      range = ignition::math::INF_D;
+      ConfigureResampler(*this->dataPtr, *geom);
     }
-    else if (range <= this->RangeMin())
+    const NpsBeamResampler &resampler = this->dataPtr->resampler;
+
+    if (resampler.IsIdentity())
     {
-      range = -ignition::math::INF_D;
+      count = static_cast<int>(source.Read(ranges, intensities, numCells));
+      rays = ranges;
+      rayIntensities = intensities;
     }
-    else if (this->noises.find(GPU_RAY_NOISE) != this->noises.end())
+    else
     {
-      range = this->noises[GPU_RAY_NOISE]->Apply(range);
-      range = ignition::math::clamp(range, this->RangeMin(), this->RangeMax());
+      // Read the rays aside and gather them onto the range cells
+      const size_t numRays = resampler.SourceCount();
+      std::vector<float> &rayRanges = this->dataPtr->rayRanges;
+      std::vector<float> &rayIntensityData = this->dataPtr->rayIntensities;
+      rayRanges.resize(numRays);
+      rayIntensityData.resize(numRays);
+
+      const size_t read = source.Read(rayRanges.data(),
+          rayIntensityData.data(), numRays);
+      std::fill(rayRanges.begin() + read, rayRanges.end(),
+          ignition::math::NAN_F);
+      std::fill(rayIntensityData.begin() + read, rayIntensityData.end(),
+          ignition::math::NAN_F);
+
+      resampler.Apply(rayRanges.data(), rayIntensityData.data(), ranges,
+          intensities, &NpsBeamWorkerPool::Instance());
+      count = numCells;
+      rays = rayRanges.data();
+      rayIntensities = rayIntensityData.data();
     }
 
-    range = ignition::math::isnan(range) ? this->RangeMax() : range;
-    scan->set_ranges(i, range);
-    scan->set_intensities(i, intensity);
+    if (this->dataPtr->incremental)
+    {
+      this->dataPtr->cachedRanges.assign(ranges, ranges + count);
+      this->dataPtr->cachedIntensities.assign(intensities,
+          intensities + count);
+      this->dataPtr->cacheReady = true;
+    }
   }
+  std::fill(ranges + count, ranges + numCells, ignition::math::NAN_F);
+  std::fill(intensities + count, intensities + numCells,
+      ignition::math::NAN_F);
 
-  if (this->dataPtr->scanPub && this->dataPtr->scanPub->HasConnections())
-    this->dataPtr->scanPub->Publish(this->dataPtr->laserMsg);
+  if (this->dataPtr->echoes > 0)
+    FindEchoes(*this->dataPtr, *frame, *geom, rays, rayIntensities);
 
+  // The source is free to render the next frame
   this->dataPtr->rendered = false;
 
+  // A custom noise callback set after Load replaces the bulk noise. The
+  // switch is decided here, so the pipeline never reconfigures the
+  // processor while it runs a frame
+  if (this->dataPtr->bulkNoise &&
+      this->noises[GPU_RAY_NOISE]->GetNoiseType() != Noise::GAUSSIAN)
+  {
+    this->dataPtr->bulkNoise = false;
+  }
+
+  // Capture only pointers, so queueing the job does not allocate
+  NpsBeamSensorPrivate *data = this->dataPtr.get();
+  NpsBeamPendingFrame *pending = &data->pendingFrames[data->nextPending];
+  pending->frame = frame;
+  pending->geom = geom;
+  pending->count = count;
+  pending->customNoise = !this->dataPtr->bulkNoise &&
+    this->dataPtr->customNoiseFunction;
+
+  const bool queued = this->dataPtr->pipeline.Submit(
+      [data, pending]()
+      {
+        data->ProcessFrame(pending->frame, *pending->geom, pending->count,
+            pending->customNoise);
+        pending->geom.reset();
+      }, !this->dataPtr->pipelineDropWhenFull);
+
+  if (queued)
+  {
+    data->nextPending = (data->nextPending + 1) % data->pendingFrames.size();
+  }
+  else
+  {
+    pending->geom.reset();
+    this->dataPtr->frameStore.AbortWrite(frame);
+    diagnostics.Count(NpsBeamDiagnostics::DROPPED_PIPELINE_FULL);
+  }
+
+  const NpsBeamDiagnostics::Clock::time_point end =
+    NpsBeamDiagnostics::Clock::now();
+  diagnostics.Record(NpsBeamDiagnostics::UPDATE, start, end);
+
+  this->dataPtr->PublishDiagnostics(end);
+
   return true;
 }
 
@@ -647,11 +1291,23 @@ bool NpsBeamSensor::UpdateImpl(const bool /*_force*/)
 bool NpsBeamSensor::IsActive() const
 {
   return Sensor::IsActive() ||
-    (this->dataPtr->scanPub && this->dataPtr->scanPub->HasConnections());
+    (this->dataPtr->scanPub && this->dataPtr->scanPub->HasConnections()) ||
+    (this->dataPtr->beamImagePub &&
+     this->dataPtr->beamImagePub->HasConnections()) ||
+    (this->dataPtr->fanImagePub &&
+     this->dataPtr->fanImagePub->HasConnections()) ||
+    (this->dataPtr->compactPub &&
+     this->dataPtr->compactPub->HasConnections()) ||
+    (this->dataPtr->echoPub && this->dataPtr->echoPub->HasConnections()) ||
+    (this->dataPtr->pointCloudPub &&
+     this->dataPtr->pointCloudPub->HasConnections()) ||
+    !this->dataPtr->shmName.empty();
 }
 
 //////////////////////////////////////////////////
 rendering::GpuLaserPtr NpsBeamSensor::LaserCamera() const
 {
-  return this->dataPtr->laserCam;
+  if (!this->dataPtr->source)
+    return rendering::GpuLaserPtr();
+  return this->dataPtr->source->LaserCamera();
 }
@@ -24,11 +24,14 @@
 #include <ignition/math/Angle.hh>
 #include <ignition/math/Pose3.hh>
 
+#include "gazebo/msgs/MessageTypes.hh"
 #include "gazebo/rendering/RenderTypes.hh"
 #include "gazebo/sensors/Sensor.hh"
 #include "gazebo/transport/TransportTypes.hh"
 #include "gazebo/util/system.hh"
 
+#include "NpsBeamFrameStore.hh"
+
 namespace gazebo
 {
   /// \ingroup gazebo_sensors
@@ -77,8 +80,66 @@ namespace gazebo
       // Documentation inherited
       public: virtual std::string Topic() const;
 
+      /// \brief Get the topic of the beam intensity image.
+      ///
+      /// Only advertised when the sensor has an <nps:beam><beam_image>
+      /// element. Each row of the image is one beam's intensity profile
+      /// over range bins, as R_FLOAT32 pixels.
+      /// \return Beam image topic name.
+      public: std::string BeamImageTopic() const;
+
+      /// \brief Get the topic of the fan images.
+      ///
+      /// Only advertised when the sensor has an <nps:beam><fan_image>
+      /// element. Each image is the beam image remapped onto a top down
+      /// Cartesian view of the sonar fan, as R_FLOAT32 pixels.
+      /// \return Fan image topic name.
+      public: std::string FanImageTopic() const;
+
+      /// \brief Get the topic of the compact scans.
+      ///
+      /// Only advertised when the sensor has an <nps:beam><compact>
+      /// element. Each msgs::Packet of type "nps_beam_compact_scan" holds
+      /// one scan in its serialized_data, which NpsBeamScanCodec::Decode
+      /// turns back into a frame.
+      /// \return Compact scan topic name.
+      public: std::string CompactTopic() const;
+
+      /// \brief Get the topic of the multi-echo packets.
+      ///
+      /// Only advertised when the sensor has an <nps:beam><multi_echo>
+      /// element. Each msgs::Packet of type "nps_beam_echoes" holds the
+      /// echoes of one scan in its serialized_data, which
+      /// NpsBeamMultiEcho::Decode turns back into a frame.
+      /// \return Multi-echo topic name.
+      public: std::string EchoTopic() const;
+
+      /// \brief Get the topic of the point clouds.
+      ///
+      /// Only advertised when the sensor has an <nps:beam><point_cloud>
+      /// element. Each msgs::PointCloudPacked holds the finite returns of
+      /// one scan as float32 x, y, z and intensity fields.
+      /// \return Point cloud topic name.
+      public: std::string PointCloudTopic() const;
+
+      /// \brief Get the topic of the diagnostics summaries.
+      ///
+      /// Summaries hold per-stage timing histograms and frame counters
+      /// as msgs::Param_V, published at <nps:beam><diagnostics><rate>
+      /// when a rate is set.
+      /// \return Diagnostics topic name.
+      public: std::string DiagnosticsTopic() const;
+
+      /// \brief Get the topic of the active sector requests.
+      ///
+      /// Each msgs::Vector3d sets the sector as in SetSector, with x the
+      /// center, y the width and z the scan rate.
+      /// \return Sector request topic name.
+      public: std::string SectorTopic() const;
+
       /// \brief Returns a pointer to the internally kept rendering::GpuLaser
-      /// \return Pointer to GpuLaser
+      /// \return Pointer to GpuLaser, null unless the sensor uses the gpu
+      /// frame source
       public: rendering::GpuLaserPtr LaserCamera() const;
 
       /// \brief Get the minimum angle
@@ -154,13 +215,25 @@ namespace gazebo
       /// \return Resolution of the angle
       public: double VerticalAngleResolution() const;
 
+      /// \brief Narrow the horizontal fan to an active sector.
+      ///
+      /// Only the rays of the sector are produced and published; frames
+      /// carry the sector angles. The sector snaps outward to whole rays
+      /// of the fan. With a scan rate the sector sweeps back and forth
+      /// across the fan like a mechanically scanned head, starting at
+      /// _center. Sources that cannot narrow the fan keep producing it
+      /// whole.
+      /// \param[in] _center Sector center in radians.
+      /// \param[in] _width Sector width in radians, 0 for the whole fan.
+      /// \param[in] _scanRate Sweep rate in radians per second of
+      /// simulation time, 0 for a fixed sector.
+      public: void SetSector(const double _center, const double _width,
+                  const double _scanRate = 0);
+
       /// \brief Get detected range for a ray.
-      ///         Warning: If you are accessing all the ray data in a loop
-      ///         it's possible that the Ray will update in the middle of
-      ///         your access loop. This means some data will come from one
-      ///         scan, and some from another scan. You can solve this
-      ///         problem by using SetActive(false) <your accessor loop>
-      ///         SetActive(true).
+      ///         Each call reads the latest scan, so a loop over all
+      ///         rays may mix data from several scans. Use LatestScan()
+      ///         to access one whole scan.
       /// \param[in] _index Index of specific ray
       /// \return Returns RangeMax for no detection.
       public: double Range(const int _index) const;
@@ -169,24 +242,34 @@ namespace gazebo
       /// \param[out] _range A vector that will contain all the range data
       public: void Ranges(std::vector<double> &_ranges) const;
 
+      /// \brief Copy the ranges of the latest scan into a caller buffer,
+      /// without allocating.
+      /// \param[out] _ranges Buffer of at least _count values.
+      /// \param[in] _count Size of _ranges.
+      /// \return Number of ranges written, the smaller of _count and the
+      /// scan size; 0 before the first scan.
+      public: size_t Ranges(double *_ranges, const size_t _count) const;
+
+      /// \brief Get the latest complete scan.
+      ///
+      /// The returned frame is immutable and stays valid for as long as
+      /// the caller holds it, without blocking the sensor update. It is
+      /// safe to call from any thread.
+      /// \return Latest scan, or null before the first update.
+      public: NpsBeamFramePtr LatestScan() const;
+
       /// \brief Get detected retro (intensity) value for a ray.
-      ///         Warning: If you are accessing all the ray data in a loop
-      ///         it's possible that the Ray will update in the middle of
-      ///         your access loop. This means some data will come from one
-      ///         scan, and some from another scan. You can solve this
-      ///         problem by using SetActive(false) <your accessor loop>
-      ///         SetActive(true).
+      ///         Each call reads the latest scan, so a loop over all
+      ///         rays may mix data from several scans. Use LatestScan()
+      ///         to access one whole scan.
       /// \param[in] _index Index of specific ray
       /// \return Intensity value of ray
       public: double Retro(const int _index) const;
 
       /// \brief Get detected fiducial value for a ray.
-      ///         Warning: If you are accessing all the ray data in a loop
-      ///         it's possible that the Ray will update in the middle of
-      ///         your access loop. This means some data will come from one
-      ///         scan, and some from another scan. You can solve this
-      ///         problem by using SetActive(false) <your accessor loop>
-      ///         SetActive(true).
+      ///         Each call reads the latest scan, so a loop over all
+      ///         rays may mix data from several scans. Use LatestScan()
+      ///         to access one whole scan.
       /// \param[in] _index Index of specific ray
       /// \return Fiducial value of ray
       public: int Fiducial(const unsigned int _index) const;
@@ -245,11 +328,29 @@ namespace gazebo
         std::function<void(const float *, unsigned int, unsigned int,
         unsigned int, const std::string &)> _subscriber);
 
+      /// \brief Get the simulation time of the frame announced by the
+      /// new laser frame event, which is also the time of the scan
+      /// published for it. Valid inside ConnectNewLaserFrame callbacks,
+      /// where the world time may already have moved on, e.g. for a
+      /// replayed frame or a GPU readback.
+      /// \return Frame time, zero without a frame source.
+      public: common::Time FrameTime() const;
+
       // Documentation inherited
       public: virtual bool IsActive() const;
 
-      /// brief Render the camera.
-      private: void Render();
+      /// \brief Render the source, called by the scheduler on the render
+      /// event.
+      /// \return True if a frame was rendered.
+      private: bool Render();
+
+      /// \brief Read back the frame rendered in this tick, called by the
+      /// scheduler once every due sensor rendered.
+      private: void ReadBack();
+
+      /// \brief Callback for active sector requests.
+      /// \param[in] _msg Sector center, width and scan rate.
+      private: void OnSectorRequest(ConstVector3dPtr &_msg);
 
       /// \internal
       /// \brief Private data pointer.
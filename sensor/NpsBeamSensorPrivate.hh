@@ -17,23 +17,69 @@
 #ifndef NPS_BEAM_SENSOR_PRIVATE_HH
 #define NPS_BEAM_SENSOR_PRIVATE_HH
 
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 #include <sdf/sdf.hh>
 
 #include "gazebo/rendering/RenderTypes.hh"
 #include "gazebo/transport/TransportTypes.hh"
 #include "gazebo/physics/PhysicsTypes.hh"
 #include "gazebo/msgs/msgs.hh"
+#include "gazebo/sensors/SensorTypes.hh"
+
+#include "NpsBeamChangeTracker.hh"
+#include "NpsBeamConfig.hh"
+#include "NpsBeamFrameSource.hh"
+#include "NpsBeamGeometry.hh"
+#include "NpsBeamMultiEcho.hh"
+#include "NpsBeamOutputs.hh"
+#include "NpsBeamPipeline.hh"
+#include "NpsBeamResampler.hh"
+#include "NpsBeamSector.hh"
 
 namespace gazebo
 {
   namespace sensors
   {
+    /// \internal
+    /// \brief Arguments of one frame handed to the pipeline.
+    ///
+    /// Kept in a ring next to the pipeline, so the pipeline job captures
+    /// two pointers and is queued without a heap allocation.
+    class NpsBeamPendingFrame
+    {
+      /// \brief Frame from BeginWrite.
+      public: NpsBeamFrame *frame = nullptr;
+
+      /// \brief Geometry the frame was produced with.
+      public: NpsBeamGeometryPtr geom;
+
+      /// \brief Number of cells read back.
+      public: int count = 0;
+
+      /// \brief True to apply the sensor's customNoiseFunction instead
+      /// of the processor's bulk noise.
+      public: bool customNoise = false;
+    };
+
     /// \internal
     /// \brief NpsBeamSensor private data.
-    class NpsBeamSensorPrivate
+    ///
+    /// Derives the frame processing and the outputs, so the pipeline
+    /// runs the same NpsBeamOutputs::ProcessFrame the tests do.
+    class NpsBeamSensorPrivate : public NpsBeamOutputs
     {
-      /// \brief Scan SDF elementz.
+      /// \brief Get the current geometry snapshot.
+      /// \return Geometry snapshot, safe to keep across setter calls.
+      public: NpsBeamGeometryPtr Geometry() const
+              {
+                return std::atomic_load(&this->geometry);
+              }
+
+      /// \brief Scan SDF elements.
       public: sdf::ElementPtr scanElem;
 
       /// \brief Horizontal SDF element.
@@ -45,11 +91,42 @@ namespace gazebo
       /// \brief Range SDF element.
       public: sdf::ElementPtr rangeElem;
 
-      /// \brief Camera SDF element.
-      public: sdf::ElementPtr cameraElem;
+      /// \brief Optional <nps:beam> configuration element of the sensor.
+      public: sdf::ElementPtr configElem;
+
+      /// \brief Current geometry snapshot, access through Geometry().
+      public: NpsBeamGeometryPtr geometry;
+
+      /// \brief Source of geometry snapshot versions.
+      public: std::atomic<unsigned int> geometryVersions;
+
+      /// \brief Subscriber to active sector requests.
+      public: transport::SubscriberPtr sectorSub;
+
+      /// \brief Protects the requested sector.
+      public: std::mutex sectorMutex;
+
+      /// \brief Requested sector center in radians.
+      public: double sectorCenter = 0;
 
-      /// \brief Horizontal ray count.
-      public: unsigned int horzRayCount;
+      /// \brief Requested sector width in radians, 0 for the whole fan.
+      public: double sectorWidth = 0;
+
+      /// \brief Scanning head rate in radians per second, 0 for a fixed
+      /// sector.
+      public: double sectorRate = 0;
+
+      /// \brief True until the scanning head start time was taken.
+      public: bool sectorRestart = true;
+
+      /// \brief Simulation time the scanning head started at its center.
+      public: common::Time sectorStart;
+
+      /// \brief Narrows the whole fan to the active sector.
+      public: NpsBeamSector sector;
+
+      /// \brief Geometry of the frame rendered on the render event.
+      public: NpsBeamGeometryPtr frameGeometry;
 
       /// \brief Vertical ray count.
       public: unsigned int vertRayCount;
@@ -63,23 +140,102 @@ namespace gazebo
       /// \brief Range count ratio.
       public: double rangeCountRatio;
 
-      /// \brief GPU laser rendering.
-      public: rendering::GpuLaserPtr laserCam;
+      /// \brief Parent entity of gpu ray sensor
+      public: physics::EntityPtr parentEntity;
 
-      /// \brief Mutex to protect getting ranges.
-      public: std::mutex mutex;
+      /// \brief Configured frame source name.
+      public: std::string sourceName;
 
-      /// \brief Laser message to publish data.
-      public: msgs::LaserScanStamped laserMsg;
+      /// \brief Produces raw frames, null until Init succeeded.
+      public: std::unique_ptr<NpsBeamFrameSource> source;
 
-      /// \brief Parent entity of gpu ray sensor
-      public: physics::EntityPtr parentEntity;
+      /// \brief True while the processor's bulk noise stands in for the
+      /// sensor's noise model. Only used on the update thread.
+      public: bool bulkNoise = false;
+
+      /// \brief Echoes kept per beam, 0 without multi-echo output.
+      public: unsigned int echoes = 0;
+
+      /// \brief Largest range gap within one echo, in meters.
+      public: double echoGap = 0.5;
+
+      /// \brief Reduces the rays of each beam to its echoes.
+      public: NpsBeamMultiEcho multiEcho;
+
+      /// \brief Geometry version multiEcho was configured for.
+      public: unsigned int multiEchoVersion = 0;
+
+      /// \brief True once multiEcho was configured.
+      public: bool multiEchoReady = false;
+
+      /// \brief Runs frame processing and publishing.
+      public: NpsBeamPipeline pipeline;
+
+      /// \brief Drop frames instead of waiting when the pipeline is full.
+      public: bool pipelineDropWhenFull = false;
+
+      /// \brief Ring of frame arguments, one more than the pipeline
+      /// depth so a queued or running frame's entry is never reused.
+      public: std::vector<NpsBeamPendingFrame> pendingFrames;
+
+      /// \brief Entry of pendingFrames the next frame uses.
+      public: size_t nextPending = 0;
+
+      /// \brief True if a frame was rendered and read back and not yet
+      /// consumed by UpdateImpl.
+      public: std::atomic<bool> rendered;
+
+      /// \brief Registration with the render scheduler, 0 if none.
+      public: unsigned int schedulerId = 0;
+
+      /// \brief Update rate the scheduler groups the sensor by.
+      public: double scheduledRate = 0;
+
+      /// \brief Reuse the last raw frame while the scene is unchanged.
+      public: bool incremental = false;
+
+      /// \brief Detects scene changes for the incremental mode.
+      public: NpsBeamChangeTracker changeTracker;
+
+      /// \brief Raw ranges of the last frame read from the source.
+      public: std::vector<float> cachedRanges;
+
+      /// \brief Raw intensities of the last frame read from the source.
+      public: std::vector<float> cachedIntensities;
+
+      /// \brief Echo ranges of the last frame read from the source.
+      public: std::vector<float> cachedEchoRanges;
+
+      /// \brief Echo intensities of the last frame read from the source.
+      public: std::vector<float> cachedEchoIntensities;
+
+      /// \brief Echo counts of the last frame read from the source.
+      public: std::vector<uint8_t> cachedEchoCounts;
+
+      /// \brief True once the cached frame holds a frame.
+      public: bool cacheReady = false;
+
+      /// \brief True if the frame to consume is the cached one rather
+      /// than a new one from the source.
+      public: std::atomic<bool> reuse;
+
+      /// \brief Maps source rays onto the published range cells.
+      public: NpsBeamResampler resampler;
+
+      /// \brief Geometry version the resampler was configured for.
+      public: unsigned int resamplerVersion = 0;
+
+      /// \brief True once the resampler was configured.
+      public: bool resamplerReady = false;
+
+      /// \brief Largest range spread the resampler interpolates over.
+      public: double resampleEdgeThreshold = 0.5;
 
-      /// \brief Publisher to publish ray sensor data
-      public: transport::PublisherPtr scanPub;
+      /// \brief Source rays before resampling.
+      public: std::vector<float> rayRanges;
 
-      /// \brief True if the sensor was rendered.
-      public: bool rendered;
+      /// \brief Source intensities before resampling.
+      public: std::vector<float> rayIntensities;
     };
   }
 }
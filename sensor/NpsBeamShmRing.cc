@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#include "NpsBeamShmRing.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Identifies a beam frame ring segment.
+  const char kMagic[8] = {'N', 'P', 'S', 'B', 'S', 'H', 'M', '1'};
+
+  /// \brief Layout version, bumped on incompatible changes.
+  const uint32_t kVersion = 1;
+
+  /// \brief Segment header, at the start of the mapping.
+  struct alignas(64) SegmentHeader
+  {
+    /// \brief kMagic.
+    char magic[8];
+
+    /// \brief kVersion.
+    uint32_t version;
+
+    /// \brief Number of slots.
+    uint32_t slotCount;
+
+    /// \brief Bytes per slot, a multiple of 64.
+    uint64_t slotSize;
+
+    /// \brief Largest number of cells of a frame.
+    uint64_t cells;
+
+    /// \brief Sequence of the newest complete frame, 0 before the first.
+    std::atomic<uint64_t> writeSequence;
+
+    /// \brief Non zero once the writer closed the segment.
+    std::atomic<uint32_t> closed;
+  };
+
+  /// \brief Slot header, followed by the ranges and then the
+  /// intensities of the frame.
+  struct alignas(64) SlotHeader
+  {
+    /// \brief Sequence lock, odd while the writer fills the slot.
+    std::atomic<uint64_t> lock;
+
+    /// \brief Sequence of the frame in the slot.
+    uint64_t sequence;
+
+    /// \brief Measurement time, seconds part.
+    int32_t sec;
+
+    /// \brief Measurement time, nanoseconds part.
+    int32_t nsec;
+
+    /// \brief Number of horizontal cells.
+    uint32_t width;
+
+    /// \brief Number of vertical cells.
+    uint32_t height;
+
+    /// \brief Sensor world pose as x, y, z, qw, qx, qy, qz.
+    double pose[7];
+
+    /// \brief Horizontal and vertical angle min, max and step, then the
+    /// range min and max, in NpsBeamFrame order.
+    double geometry[8];
+  };
+
+  static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+      "shared memory counters must be plain words");
+
+  /// \brief Bytes per slot for a cell count.
+  size_t SlotSize(const size_t _cells)
+  {
+    const size_t bytes = sizeof(SlotHeader) + 2 * _cells * sizeof(float);
+    return (bytes + 63) & ~static_cast<size_t>(63);
+  }
+
+  /// \brief Get a slot of a mapped segment.
+  inline char *Slot(void *_memory, const uint64_t _sequence)
+  {
+    const SegmentHeader *header = static_cast<SegmentHeader *>(_memory);
+    return static_cast<char *>(_memory) + sizeof(SegmentHeader) +
+      ((_sequence - 1) % header->slotCount) * header->slotSize;
+  }
+
+  /// \brief Map an existing segment.
+  /// \param[in] _name Segment name.
+  /// \param[in] _write True to map it writable.
+  /// \param[out] _size Size of the mapping.
+  /// \return Mapping, or null if the segment does not exist or is not a
+  /// beam frame ring.
+  void *MapSegment(const std::string &_name, const bool _write,
+      size_t &_size)
+  {
+    const int fd = shm_open(_name.c_str(), _write ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0)
+      return nullptr;
+
+    struct stat info;
+    void *memory = MAP_FAILED;
+    if (fstat(fd, &info) == 0 &&
+        static_cast<size_t>(info.st_size) >= sizeof(SegmentHeader))
+    {
+      _size = static_cast<size_t>(info.st_size);
+      memory = mmap(nullptr, _size, PROT_READ | (_write ? PROT_WRITE : 0),
+          MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED)
+      return nullptr;
+
+    const SegmentHeader *header = static_cast<SegmentHeader *>(memory);
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+        header->version != kVersion || header->slotCount == 0 ||
+        header->slotSize < SlotSize(header->cells) ||
+        _size < sizeof(SegmentHeader) + header->slotCount * header->slotSize)
+    {
+      munmap(memory, _size);
+      return nullptr;
+    }
+    return memory;
+  }
+}
+
+//////////////////////////////////////////////////
+NpsBeamShmWriter::NpsBeamShmWriter()
+{
+}
+
+//////////////////////////////////////////////////
+NpsBeamShmWriter::~NpsBeamShmWriter()
+{
+  this->Close();
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamShmWriter::Create(const std::string &_name,
+    const unsigned int _slots, const size_t _cells)
+{
+  this->Close();
+
+  // Tell readers still mapping a previous segment of this name to reopen,
+  // then replace it; their mapping stays valid until they do.
+  size_t oldSize = 0;
+  void *old = MapSegment(_name, true, oldSize);
+  if (old)
+  {
+    static_cast<SegmentHeader *>(old)->closed.store(1,
+        std::memory_order_release);
+    munmap(old, oldSize);
+  }
+  shm_unlink(_name.c_str());
+
+  const int fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return false;
+
+  const unsigned int slots = std::max(_slots, 2u);
+  const size_t slotSize = SlotSize(_cells);
+  const size_t size = sizeof(SegmentHeader) + slots * slotSize;
+  void *memory = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+  {
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+        0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    shm_unlink(_name.c_str());
+    return false;
+  }
+
+  // The mapping starts zeroed, so only the header fields and the atomics
+  // need constructing. Readers check the magic last.
+  SegmentHeader *header = new (memory) SegmentHeader;
+  header->version = kVersion;
+  header->slotCount = slots;
+  header->slotSize = slotSize;
+  header->cells = _cells;
+  header->writeSequence.store(0, std::memory_order_relaxed);
+  header->closed.store(0, std::memory_order_relaxed);
+  for (unsigned int i = 0; i < slots; ++i)
+  {
+    SlotHeader *slot = new (Slot(memory, i + 1)) SlotHeader;
+    slot->lock.store(0, std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header->magic, kMagic, sizeof(kMagic));
+
+  this->name = _name;
+  this->memory = memory;
+  this->size = size;
+  this->sequence = 0;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamShmWriter::Close()
+{
+  if (!this->memory)
+    return;
+
+  static_cast<SegmentHeader *>(this->memory)->closed.store(1,
+      std::memory_order_release);
+  munmap(this->memory, this->size);
+  shm_unlink(this->name.c_str());
+  this->memory = nullptr;
+  this->size = 0;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamShmWriter::Write(const NpsBeamFrame &_frame)
+{
+  const size_t cells = static_cast<size_t>(_frame.width) * _frame.height;
+  if (!this->memory || cells > this->Cells() ||
+      _frame.ranges.size() < cells)
+  {
+    return false;
+  }
+
+  SegmentHeader *header = static_cast<SegmentHeader *>(this->memory);
+  const uint64_t next = this->sequence + 1;
+  SlotHeader *slot = reinterpret_cast<SlotHeader *>(Slot(this->memory, next));
+
+  // Odd lock: readers that copy from here on discard what they got.
+  const uint64_t lock = slot->lock.load(std::memory_order_relaxed);
+  slot->lock.store(lock + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->sequence = next;
+  slot->sec = _frame.sec;
+  slot->nsec = _frame.nsec;
+  slot->width = _frame.width;
+  slot->height = _frame.height;
+  std::memcpy(slot->pose, _frame.pose, sizeof(slot->pose));
+  const double geometry[8] = {_frame.angleMin, _frame.angleMax,
+    _frame.angleStep, _frame.verticalAngleMin, _frame.verticalAngleMax,
+    _frame.verticalAngleStep, _frame.rangeMin, _frame.rangeMax};
+  std::memcpy(slot->geometry, geometry, sizeof(geometry));
+
+  float *data = reinterpret_cast<float *>(slot + 1);
+  std::memcpy(data, _frame.ranges.data(), cells * sizeof(float));
+  if (_frame.intensities.size() >= cells)
+  {
+    std::memcpy(data + this->Cells(), _frame.intensities.data(),
+        cells * sizeof(float));
+  }
+  else
+  {
+    std::memset(data + this->Cells(), 0, cells * sizeof(float));
+  }
+
+  slot->lock.store(lock + 2, std::memory_order_release);
+  header->writeSequence.store(next, std::memory_order_release);
+  this->sequence = next;
+  return true;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamShmWriter::Cells() const
+{
+  if (!this->memory)
+    return 0;
+  return static_cast<size_t>(
+      static_cast<const SegmentHeader *>(this->memory)->cells);
+}
+
+//////////////////////////////////////////////////
+const std::string &NpsBeamShmWriter::Name() const
+{
+  return this->name;
+}
+
+//////////////////////////////////////////////////
+NpsBeamShmReader::NpsBeamShmReader()
+{
+}
+
+//////////////////////////////////////////////////
+NpsBeamShmReader::~NpsBeamShmReader()
+{
+  this->Close();
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamShmReader::Open(const std::string &_name)
+{
+  this->Close();
+
+  size_t mapped = 0;
+  void *memory = MapSegment(_name, false, mapped);
+  if (!memory)
+    return false;
+
+  this->memory = memory;
+  this->size = mapped;
+
+  // Start with the newest frame, not with frames written before Open.
+  this->last = this->LatestSequence();
+  this->skipped = 0;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamShmReader::Close()
+{
+  if (!this->memory)
+    return;
+
+  munmap(const_cast<void *>(this->memory), this->size);
+  this->memory = nullptr;
+  this->size = 0;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamShmReader::Stale() const
+{
+  return !this->memory ||
+    static_cast<const SegmentHeader *>(this->memory)->closed.load(
+        std::memory_order_acquire) != 0;
+}
+
+//////////////////////////////////////////////////
+uint64_t NpsBeamShmReader::LatestSequence() const
+{
+  if (!this->memory)
+    return 0;
+  return static_cast<const SegmentHeader *>(this->memory)->
+    writeSequence.load(std::memory_order_acquire);
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamShmReader::ReadLatest(NpsBeamFrame &_frame)
+{
+  // Retries only when the writer lapped the whole ring during the copy.
+  for (;;)
+  {
+    const uint64_t latest = this->LatestSequence();
+    if (latest == 0)
+      return false;
+    if (this->ReadSequence(latest, _frame))
+    {
+      this->last = latest;
+      return true;
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamShmReader::ReadNext(NpsBeamFrame &_frame)
+{
+  if (!this->memory)
+    return false;
+
+  const uint64_t slots =
+    static_cast<const SegmentHeader *>(this->memory)->slotCount;
+  for (;;)
+  {
+    const uint64_t latest = this->LatestSequence();
+    if (latest <= this->last)
+      return false;
+
+    // The slot after the newest one is the next to be overwritten, so
+    // start one past it when the reader fell behind.
+    uint64_t next = this->last + 1;
+    const uint64_t oldest = latest >= slots ? latest - slots + 2 : 1;
+    if (next < oldest)
+    {
+      this->skipped += oldest - next;
+      next = oldest;
+    }
+
+    if (this->ReadSequence(next, _frame))
+    {
+      this->last = next;
+      return true;
+    }
+
+    // The slot was overwritten during the copy, so the writer moved on
+    // and the next pass skips ahead.
+  }
+}
+
+//////////////////////////////////////////////////
+uint64_t NpsBeamShmReader::Skipped() const
+{
+  return this->skipped;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamShmReader::ReadSequence(const uint64_t _sequence,
+    NpsBeamFrame &_frame)
+{
+  const SegmentHeader *header =
+    static_cast<const SegmentHeader *>(this->memory);
+  const SlotHeader *slot = reinterpret_cast<const SlotHeader *>(
+      Slot(const_cast<void *>(this->memory), _sequence));
+
+  const uint64_t lock = slot->lock.load(std::memory_order_acquire);
+  if ((lock & 1) != 0 || slot->sequence != _sequence)
+    return false;
+
+  // Fields may be torn until the lock is checked again, so bound the
+  // copy by the slot size rather than trusting them.
+  const uint32_t width = slot->width;
+  const uint32_t height = slot->height;
+  const size_t cells = static_cast<size_t>(width) * height;
+  if (cells > header->cells)
+    return false;
+
+  _frame.Resize(width, height);
+  _frame.sec = slot->sec;
+  _frame.nsec = slot->nsec;
+  std::memcpy(_frame.pose, slot->pose, sizeof(_frame.pose));
+  double geometry[8];
+  std::memcpy(geometry, slot->geometry, sizeof(geometry));
+  const float *data = reinterpret_cast<const float *>(slot + 1);
+  std::memcpy(_frame.ranges.data(), data, cells * sizeof(float));
+  std::memcpy(_frame.intensities.data(), data + header->cells,
+      cells * sizeof(float));
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot->lock.load(std::memory_order_relaxed) != lock)
+    return false;
+
+  _frame.sequence = _sequence;
+  _frame.angleMin = geometry[0];
+  _frame.angleMax = geometry[1];
+  _frame.angleStep = geometry[2];
+  _frame.verticalAngleMin = geometry[3];
+  _frame.verticalAngleMax = geometry[4];
+  _frame.verticalAngleStep = geometry[5];
+  _frame.rangeMin = geometry[6];
+  _frame.rangeMax = geometry[7];
+  return true;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_SHM_RING_HH
+#define NPS_BEAM_SHM_RING_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "NpsBeamFrameStore.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Producer side of a shared memory ring of beam frames.
+    ///
+    /// The ring lives in a named POSIX shared memory segment holding a
+    /// header and a fixed number of slots, each sized for a maximum
+    /// number of cells. Frame n goes to slot n modulo the slot count.
+    /// Every slot is guarded by a sequence lock: its counter is odd while
+    /// the writer fills the slot, so readers copy without taking locks
+    /// and retry when the counter moved under them. The writer never
+    /// waits for readers; a reader that falls a whole ring behind skips
+    /// to the oldest frame still available.
+    ///
+    /// The segment and its reader, NpsBeamShmReader, only depend on
+    /// NpsBeamFrame and POSIX, so consumers link the small NpsBeamShm
+    /// library without Gazebo.
+    class NpsBeamShmWriter
+    {
+      /// \brief Constructor
+      public: NpsBeamShmWriter();
+
+      /// \brief Destructor, closes and removes the segment.
+      public: ~NpsBeamShmWriter();
+
+      /// \brief Create the segment, replacing one of the same name.
+      /// \param[in] _name Segment name, e.g. "/nps_beam_sonar".
+      /// \param[in] _slots Number of frame slots, at least 2.
+      /// \param[in] _cells Largest number of cells of a frame.
+      /// \return False if the segment could not be created.
+      public: bool Create(const std::string &_name,
+                  const unsigned int _slots, const size_t _cells);
+
+      /// \brief Mark the segment closed for readers and remove it.
+      public: void Close();
+
+      /// \brief Publish a frame. Frames larger than the slots are
+      /// rejected; Create a larger segment for them.
+      /// \param[in] _frame Frame to publish.
+      /// \return False if the frame does not fit or no segment is open.
+      public: bool Write(const NpsBeamFrame &_frame);
+
+      /// \brief Get the largest number of cells of a frame.
+      /// \return Cells per slot, 0 if no segment is open.
+      public: size_t Cells() const;
+
+      /// \brief Get the segment name.
+      /// \return Name passed to Create.
+      public: const std::string &Name() const;
+
+      /// \brief Segment name.
+      private: std::string name;
+
+      /// \brief Mapped segment, null if closed.
+      private: void *memory = nullptr;
+
+      /// \brief Size of the mapping in bytes.
+      private: size_t size = 0;
+
+      /// \brief Sequence of the last frame written.
+      private: uint64_t sequence = 0;
+    };
+
+    /// \brief Consumer side of a shared memory ring of beam frames.
+    ///
+    /// Maps the segment read only, so any number of readers in other
+    /// processes can follow one writer without affecting it.
+    class NpsBeamShmReader
+    {
+      /// \brief Constructor
+      public: NpsBeamShmReader();
+
+      /// \brief Destructor, unmaps the segment.
+      public: ~NpsBeamShmReader();
+
+      /// \brief Map a segment.
+      /// \param[in] _name Segment name used by the writer.
+      /// \return False if the segment does not exist or is not a beam
+      /// frame ring.
+      public: bool Open(const std::string &_name);
+
+      /// \brief Unmap the segment.
+      public: void Close();
+
+      /// \brief Check whether the writer closed the segment, in which
+      /// case the reader should Open it again.
+      /// \return True if the mapped segment is no longer written.
+      public: bool Stale() const;
+
+      /// \brief Get the sequence of the newest complete frame.
+      /// \return Frame sequence, 0 if none was written yet.
+      public: uint64_t LatestSequence() const;
+
+      /// \brief Copy the newest complete frame.
+      /// \param[out] _frame Frame to fill.
+      /// \return False if there is no frame yet.
+      public: bool ReadLatest(NpsBeamFrame &_frame);
+
+      /// \brief Copy the frame after the last one read, or the oldest
+      /// frame still in the ring if the reader fell behind.
+      /// \param[out] _frame Frame to fill.
+      /// \return False if no newer frame was written yet.
+      public: bool ReadNext(NpsBeamFrame &_frame);
+
+      /// \brief Number of frames skipped by ReadNext because the writer
+      /// lapped the reader.
+      /// \return Skipped frame count.
+      public: uint64_t Skipped() const;
+
+      /// \brief Copy a frame out of its slot.
+      /// \param[in] _sequence Frame sequence.
+      /// \param[out] _frame Frame to fill.
+      /// \return False if the slot no longer holds the frame.
+      private: bool ReadSequence(const uint64_t _sequence,
+                   NpsBeamFrame &_frame);
+
+      /// \brief Mapped segment, null if closed.
+      private: const void *memory = nullptr;
+
+      /// \brief Size of the mapping in bytes.
+      private: size_t size = 0;
+
+      /// \brief Sequence of the last frame read.
+      private: uint64_t last = 0;
+
+      /// \brief Frames skipped by ReadNext.
+      private: uint64_t skipped = 0;
+    };
+  }
+}
+#endif
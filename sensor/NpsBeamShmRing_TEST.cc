@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "NpsBeamShmRing.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+namespace
+{
+  /// \brief Segment name unique to this process.
+  std::string SegmentName(const std::string &_test)
+  {
+    return "/NpsBeamShmRing_TEST_" + _test + "_" + std::to_string(getpid());
+  }
+
+  /// \brief Fill a frame whose every cell and time encode a value.
+  void FillFrame(NpsBeamFrame &_frame, const unsigned int _width,
+      const unsigned int _height, const int _value)
+  {
+    _frame.Resize(_width, _height);
+    for (size_t i = 0; i < _frame.ranges.size(); ++i)
+    {
+      _frame.ranges[i] = static_cast<float>(_value);
+      _frame.intensities[i] = static_cast<float>(_value) + 0.5f;
+    }
+    _frame.sec = _value;
+    _frame.nsec = _value * 10;
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamShmRing, WriteRead)
+{
+  const std::string name = SegmentName("WriteRead");
+  NpsBeamShmWriter writer;
+  ASSERT_TRUE(writer.Create(name, 4, 64));
+  EXPECT_EQ(64u, writer.Cells());
+
+  NpsBeamShmReader reader;
+  ASSERT_TRUE(reader.Open(name));
+  EXPECT_FALSE(reader.Stale());
+  EXPECT_EQ(0u, reader.LatestSequence());
+
+  NpsBeamFrame frame;
+  EXPECT_FALSE(reader.ReadNext(frame));
+  EXPECT_FALSE(reader.ReadLatest(frame));
+
+  NpsBeamFrame written;
+  FillFrame(written, 16, 4, 7);
+  for (size_t i = 0; i < written.ranges.size(); ++i)
+    written.ranges[i] = static_cast<float>(i);
+  const double pose[7] = {1, 2, 3, 0, 1, 0, 0};
+  std::copy(pose, pose + 7, written.pose);
+  written.angleMin = -0.5;
+  written.angleMax = 0.5;
+  written.angleStep = 1.0 / 15;
+  written.verticalAngleMin = -0.1;
+  written.verticalAngleMax = 0.1;
+  written.verticalAngleStep = 0.2 / 3;
+  written.rangeMin = 0.2;
+  written.rangeMax = 30;
+  ASSERT_TRUE(writer.Write(written));
+  EXPECT_EQ(1u, reader.LatestSequence());
+
+  ASSERT_TRUE(reader.ReadNext(frame));
+  EXPECT_EQ(1u, frame.sequence);
+  EXPECT_EQ(16u, frame.width);
+  EXPECT_EQ(4u, frame.height);
+  EXPECT_EQ(7, frame.sec);
+  EXPECT_EQ(70, frame.nsec);
+  EXPECT_EQ(written.ranges, frame.ranges);
+  EXPECT_EQ(written.intensities, frame.intensities);
+  for (int i = 0; i < 7; ++i)
+    EXPECT_DOUBLE_EQ(pose[i], frame.pose[i]);
+  EXPECT_DOUBLE_EQ(written.angleMin, frame.angleMin);
+  EXPECT_DOUBLE_EQ(written.angleStep, frame.angleStep);
+  EXPECT_DOUBLE_EQ(written.verticalAngleMax, frame.verticalAngleMax);
+  EXPECT_DOUBLE_EQ(written.verticalAngleStep, frame.verticalAngleStep);
+  EXPECT_DOUBLE_EQ(written.rangeMin, frame.rangeMin);
+  EXPECT_DOUBLE_EQ(written.rangeMax, frame.rangeMax);
+
+  // Nothing newer yet
+  EXPECT_FALSE(reader.ReadNext(frame));
+
+  // Frames larger than the slots are rejected
+  NpsBeamFrame large;
+  FillFrame(large, 65, 1, 8);
+  EXPECT_FALSE(writer.Write(large));
+  EXPECT_EQ(1u, reader.LatestSequence());
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamShmRing, Wrap)
+{
+  const std::string name = SegmentName("Wrap");
+  const unsigned int slots = 4;
+  NpsBeamShmWriter writer;
+  ASSERT_TRUE(writer.Create(name, slots, 32));
+
+  NpsBeamShmReader reader;
+  ASSERT_TRUE(reader.Open(name));
+
+  // Lap the ring more than twice before the reader catches up
+  NpsBeamFrame written;
+  const int frames = 10;
+  for (int i = 1; i <= frames; ++i)
+  {
+    FillFrame(written, 8, 2, i);
+    ASSERT_TRUE(writer.Write(written));
+  }
+
+  // The slot after the newest is the next to be overwritten, so the
+  // oldest frame offered is the newest minus the slot count plus two
+  NpsBeamFrame frame;
+  for (int i = frames - slots + 2; i <= frames; ++i)
+  {
+    ASSERT_TRUE(reader.ReadNext(frame));
+    EXPECT_EQ(static_cast<uint64_t>(i), frame.sequence);
+    EXPECT_EQ(i, frame.sec);
+    EXPECT_FLOAT_EQ(static_cast<float>(i), frame.ranges.back());
+  }
+  EXPECT_FALSE(reader.ReadNext(frame));
+  EXPECT_EQ(static_cast<uint64_t>(frames - slots + 1), reader.Skipped());
+
+  // Every slot was reused, and the latest frame is still intact
+  ASSERT_TRUE(reader.ReadLatest(frame));
+  EXPECT_EQ(static_cast<uint64_t>(frames), frame.sequence);
+
+  // A reader that keeps up skips nothing
+  for (int i = frames + 1; i <= frames + 2 * static_cast<int>(slots); ++i)
+  {
+    FillFrame(written, 8, 2, i);
+    ASSERT_TRUE(writer.Write(written));
+    ASSERT_TRUE(reader.ReadNext(frame));
+    EXPECT_EQ(i, frame.sec);
+  }
+  EXPECT_EQ(static_cast<uint64_t>(frames - slots + 1), reader.Skipped());
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamShmRing, Reopen)
+{
+  const std::string name = SegmentName("Reopen");
+  NpsBeamShmWriter writer;
+  ASSERT_TRUE(writer.Create(name, 2, 16));
+
+  NpsBeamShmReader reader;
+  ASSERT_TRUE(reader.Open(name));
+  EXPECT_FALSE(reader.Stale());
+
+  // Recreating the segment marks the old mapping stale
+  ASSERT_TRUE(writer.Create(name, 2, 32));
+  EXPECT_TRUE(reader.Stale());
+  ASSERT_TRUE(reader.Open(name));
+  EXPECT_FALSE(reader.Stale());
+
+  NpsBeamFrame written;
+  FillFrame(written, 32, 1, 3);
+  ASSERT_TRUE(writer.Write(written));
+  NpsBeamFrame frame;
+  ASSERT_TRUE(reader.ReadNext(frame));
+  EXPECT_EQ(32u, frame.width);
+
+  writer.Close();
+  EXPECT_TRUE(reader.Stale());
+  NpsBeamShmReader late;
+  EXPECT_FALSE(late.Open(name));
+}
+
+/////////////////////////////////////////////////
+TEST(NpsBeamShmRing, ConcurrentReadsAreConsistent)
+{
+  const std::string name = SegmentName("Concurrent");
+  NpsBeamShmWriter writer;
+  ASSERT_TRUE(writer.Create(name, 2, 4096));
+
+  NpsBeamShmReader reader;
+  ASSERT_TRUE(reader.Open(name));
+
+  // With two slots the writer keeps overwriting the slot being read, so
+  // only the sequence lock keeps torn frames from the reader
+  const int frames = 2000;
+  std::atomic<bool> done(false);
+  std::thread producer([&]()
+  {
+    NpsBeamFrame written;
+    for (int i = 1; i <= frames; ++i)
+    {
+      FillFrame(written, 1024, 4, i);
+      writer.Write(written);
+    }
+    done = true;
+  });
+
+  NpsBeamFrame frame;
+  unsigned int reads = 0;
+  unsigned int torn = 0;
+  uint64_t last = 0;
+  while (!done || reader.LatestSequence() > last)
+  {
+    if (!reader.ReadNext(frame))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    ++reads;
+    EXPECT_GT(frame.sequence, last);
+    last = frame.sequence;
+
+    const float value = static_cast<float>(frame.sequence);
+    if (frame.sec != static_cast<int32_t>(frame.sequence))
+      ++torn;
+    for (size_t i = 0; i < frame.ranges.size(); ++i)
+    {
+      if (frame.ranges[i] != value || frame.intensities[i] != value + 0.5f)
+      {
+        ++torn;
+        break;
+      }
+    }
+  }
+  producer.join();
+
+  EXPECT_GT(reads, 0u);
+  EXPECT_EQ(0u, torn);
+  EXPECT_EQ(static_cast<uint64_t>(frames), last);
+  EXPECT_EQ(static_cast<uint64_t>(frames), reads + reader.Skipped());
+}
+
+/////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <cmath>
+
+#include "NpsBeamSyntheticScene.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+void NpsBeamSyntheticScene::Configure(const double _radius,
+    const double _ripple, const double _waves, const double _period)
+{
+  this->radius = _radius;
+  this->ripple = _ripple;
+  this->waves = _waves;
+  this->period = _period;
+}
+
+//////////////////////////////////////////////////
+double NpsBeamSyntheticScene::Range(const double _bearing,
+    const double _verticalAngle, const double _time) const
+{
+  const double phase = this->period > 0 ?
+    2 * M_PI * _time / this->period : 0.0;
+  return (this->radius +
+      this->ripple * std::sin(this->waves * _bearing + phase)) /
+    std::cos(_verticalAngle);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamSyntheticScene::Render(const unsigned int _width,
+    const unsigned int _height, const double _angleMin,
+    const double _angleMax, const double _verticalAngleMin,
+    const double _verticalAngleMax, const double _heading,
+    const double _time, float *_data) const
+{
+  const double hStep = _width > 1 ?
+    (_angleMax - _angleMin) / (_width - 1) : 0.0;
+  const double vStep = _height > 1 ?
+    (_verticalAngleMax - _verticalAngleMin) / (_height - 1) : 0.0;
+  const double phase = this->period > 0 ?
+    2 * M_PI * _time / this->period : 0.0;
+
+  float *cell = _data;
+  for (unsigned int v = 0; v < _height; ++v)
+  {
+    const double slant = 1.0 / std::cos(_verticalAngleMin + v * vStep);
+    for (unsigned int h = 0; h < _width; ++h, cell += 3)
+    {
+      const double bearing = _heading + _angleMin + h * hStep;
+      cell[0] = static_cast<float>(slant * (this->radius +
+            this->ripple * std::sin(this->waves * bearing + phase)));
+      cell[1] = 1.0f;
+      cell[2] = 0.0f;
+    }
+  }
+}
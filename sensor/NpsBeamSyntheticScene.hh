@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_SYNTHETIC_SCENE_HH
+#define NPS_BEAM_SYNTHETIC_SCENE_HH
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Analytic scene of the synthetic frame source.
+    ///
+    /// The sensor sits on the axis of a vertical cylindrical wall whose
+    /// radius ripples with the bearing and drifts over time. The scene
+    /// needs neither a world nor a renderer, so tests can produce the
+    /// same frames as NpsBeamSyntheticSource offline.
+    class NpsBeamSyntheticScene
+    {
+      /// \brief Set the wall shape.
+      /// \param[in] _radius Mean wall radius.
+      /// \param[in] _ripple Ripple amplitude.
+      /// \param[in] _waves Ripples around the full circle.
+      /// \param[in] _period Ripple drift period in seconds, 0 for a still
+      /// wall.
+      public: void Configure(const double _radius, const double _ripple,
+                  const double _waves, const double _period);
+
+      /// \brief Range along one ray.
+      /// \param[in] _bearing World bearing of the ray.
+      /// \param[in] _verticalAngle Elevation of the ray.
+      /// \param[in] _time Simulation time in seconds.
+      /// \return Range to the wall.
+      public: double Range(const double _bearing,
+                  const double _verticalAngle, const double _time) const;
+
+      /// \brief Render a ray grid in the interleaved layout of a laser
+      /// frame: range, intensity 1 and 0 for every ray.
+      /// \param[in] _width Rays per row.
+      /// \param[in] _height Rows.
+      /// \param[in] _angleMin Angle of the first column.
+      /// \param[in] _angleMax Angle of the last column.
+      /// \param[in] _verticalAngleMin Angle of the first row.
+      /// \param[in] _verticalAngleMax Angle of the last row.
+      /// \param[in] _heading Sensor yaw in the world.
+      /// \param[in] _time Simulation time in seconds.
+      /// \param[out] _data Output of _width * _height * 3 floats.
+      public: void Render(const unsigned int _width,
+                  const unsigned int _height, const double _angleMin,
+                  const double _angleMax, const double _verticalAngleMin,
+                  const double _verticalAngleMax, const double _heading,
+                  const double _time, float *_data) const;
+
+      /// \brief Mean wall radius.
+      private: double radius = 0;
+
+      /// \brief Ripple amplitude.
+      private: double ripple = 0;
+
+      /// \brief Ripples around the full circle.
+      private: double waves = 0;
+
+      /// \brief Ripple drift period in seconds.
+      private: double period = 0;
+    };
+  }
+}
+#endif
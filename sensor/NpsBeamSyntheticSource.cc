@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+
+#include "gazebo/physics/World.hh"
+
+#include "NpsBeamScanKernel.hh"
+#include "NpsBeamSensor.hh"
+#include "NpsBeamSensorPrivate.hh"
+#include "NpsBeamSyntheticSource.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+//////////////////////////////////////////////////
+bool NpsBeamSyntheticSource::Init(NpsBeamSensor &_sensor,
+    const NpsBeamSourceContext &_context)
+{
+  this->sensor = &_sensor;
+  this->world = _context.world;
+
+  sdf::ElementPtr elem = NpsBeamElement(_context.config, "synthetic");
+  const double radius = NpsBeamParam<double>(elem, "radius",
+      (_sensor.RangeMin() + _sensor.RangeMax()) / 2.0);
+  this->scene.Configure(radius,
+      NpsBeamParam<double>(elem, "ripple", 0.1 * radius),
+      NpsBeamParam<double>(elem, "waves", 8.0),
+      NpsBeamParam<double>(elem, "period", 10.0));
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamSyntheticSource::SupportsSector() const
+{
+  return true;
+}
+
+//////////////////////////////////////////////////
+common::Time NpsBeamSyntheticSource::Render(const NpsBeamGeometry &_geom,
+    const ignition::math::Pose3d &_pose)
+{
+  const common::Time simTime = this->world->SimTime();
+  this->frameTime = simTime;
+
+  this->width = std::max(1, _geom.rayCount);
+  this->height = std::max(1, _geom.verticalRayCount);
+  this->data.resize(static_cast<size_t>(this->width) * this->height * 3);
+
+  this->scene.Render(this->width, this->height, _geom.angleMin,
+      _geom.angleMax, _geom.verticalAngleMin, _geom.verticalAngleMax,
+      _pose.Rot().Yaw(), simTime.Double(), this->data.data());
+
+  this->newLaserFrame(this->data.data(), this->width, this->height, 3,
+      "PF_FLOAT32_RGB");
+
+  return simTime;
+}
+
+//////////////////////////////////////////////////
+size_t NpsBeamSyntheticSource::Read(float *_ranges, float *_intensities,
+    const size_t _count)
+{
+  const size_t count = std::min(_count,
+      static_cast<size_t>(this->width) * this->height);
+  DeinterleaveBeamFrame(this->data.data(), count, 3, _ranges, _intensities);
+  return count;
+}
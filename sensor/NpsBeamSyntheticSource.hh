@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_SYNTHETIC_SOURCE_HH
+#define NPS_BEAM_SYNTHETIC_SOURCE_HH
+
+#include <vector>
+
+#include "NpsBeamFrameSource.hh"
+#include "NpsBeamSyntheticScene.hh"
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Frame source producing an analytic scene without rendering
+    /// or collision geometry.
+    ///
+    /// Renders NpsBeamSyntheticScene at the world's simulation time.
+    /// Every range is known in closed form, which makes the source useful
+    /// for exercising and timing the whole update path on machines
+    /// without a GPU.
+    class NpsBeamSyntheticSource : public NpsBeamFrameSource
+    {
+      // Documentation inherited
+      public: virtual bool Init(NpsBeamSensor &_sensor,
+                  const NpsBeamSourceContext &_context);
+
+      // Documentation inherited
+      public: virtual bool SupportsSector() const;
+
+      // Documentation inherited
+      public: virtual common::Time Render(const NpsBeamGeometry &_geom,
+                  const ignition::math::Pose3d &_pose);
+
+      // Documentation inherited
+      public: virtual size_t Read(float *_ranges, float *_intensities,
+                  const size_t _count);
+
+      /// \brief World providing the simulation time.
+      private: physics::WorldPtr world;
+
+      /// \brief Analytic scene.
+      private: NpsBeamSyntheticScene scene;
+
+      /// \brief Interleaved frame data.
+      private: std::vector<float> data;
+
+      /// \brief Frame width.
+      private: unsigned int width = 0;
+
+      /// \brief Frame height.
+      private: unsigned int height = 0;
+    };
+  }
+}
+#endif
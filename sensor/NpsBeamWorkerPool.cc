@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "NpsBeamWorkerPool.hh"
+
+using namespace gazebo;
+using namespace sensors;
+
+/// \brief Shared state of one ParallelFor call.
+struct NpsBeamWorkerPool::Job
+{
+  /// \brief Pool the job belongs to.
+  NpsBeamWorkerPool *pool;
+
+  /// \brief Next chunk to run.
+  std::atomic<size_t> next;
+
+  /// \brief Number of chunks not yet finished.
+  std::atomic<size_t> remaining;
+
+  /// \brief Number of tasks and callers still holding the job.
+  std::atomic<size_t> users;
+
+  /// \brief Total number of chunks.
+  size_t chunks;
+
+  /// \brief Indices per chunk.
+  size_t chunkSize;
+
+  /// \brief Loop size.
+  size_t count;
+
+  /// \brief Loop body.
+  RangeCallback callback;
+
+  /// \brief First argument of callback.
+  const void *context;
+
+  /// \brief Protects done.
+  std::mutex mutex;
+
+  /// \brief Signals the caller once every chunk finished.
+  std::condition_variable doneCondition;
+
+  /// \brief Run chunks until none are left.
+  void Work()
+  {
+    size_t chunk;
+    while ((chunk = this->next.fetch_add(1)) < this->chunks)
+    {
+      const size_t begin = chunk * this->chunkSize;
+      this->callback(this->context, begin,
+          std::min(begin + this->chunkSize, this->count));
+      if (this->remaining.fetch_sub(1) == 1)
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->doneCondition.notify_all();
+      }
+    }
+  }
+};
+
+namespace
+{
+  /// \brief Initial task ring size of every worker.
+  const size_t kQueueCapacity = 64;
+
+  /// \brief Loop states made up front per thread that may call
+  /// ParallelFor.
+  const unsigned int kJobsPerThread = 4;
+
+  /// \brief Pool the calling thread is a worker of, if any.
+  thread_local const NpsBeamWorkerPool *currentPool = nullptr;
+
+  /// \brief Worker index of the calling thread in currentPool.
+  thread_local unsigned int currentWorker = 0;
+}
+
+//////////////////////////////////////////////////
+NpsBeamWorkerPool::NpsBeamWorkerPool(const unsigned int _threads)
+: pending(0),
+  nextQueue(0)
+{
+  unsigned int count = _threads;
+  if (count == 0)
+    count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    this->queues.push_back(std::unique_ptr<Queue>(new Queue));
+    this->queues.back()->tasks.resize(kQueueCapacity);
+  }
+
+  // Loops stay in flight while late workers drain their stale tasks, so
+  // start with a few loop states per caller rather than growing later
+  for (unsigned int i = 0; i < kJobsPerThread * (count + 1); ++i)
+  {
+    this->jobs.push_back(std::unique_ptr<Job>(new Job));
+    this->jobs.back()->pool = this;
+    this->freeJobs.push_back(this->jobs.back().get());
+  }
+  for (unsigned int i = 0; i < count; ++i)
+    this->threads.push_back(std::thread(&NpsBeamWorkerPool::Run, this, i));
+}
+
+//////////////////////////////////////////////////
+NpsBeamWorkerPool::~NpsBeamWorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->condition.notify_all();
+
+  for (auto &thread : this->threads)
+    thread.join();
+}
+
+//////////////////////////////////////////////////
+NpsBeamWorkerPool &NpsBeamWorkerPool::Instance()
+{
+  static NpsBeamWorkerPool pool;
+  return pool;
+}
+
+//////////////////////////////////////////////////
+unsigned int NpsBeamWorkerPool::ThreadCount() const
+{
+  return this->threads.size();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamWorkerPool::ParallelFor(const size_t _count, const size_t _grain,
+    const RangeCallback _callback, const void *_context)
+{
+  if (_count == 0)
+    return;
+
+  const size_t grain = std::max<size_t>(_grain, 1);
+  const size_t maxChunks = this->threads.size() + 1;
+  const size_t chunks = std::min(maxChunks, (_count + grain - 1) / grain);
+
+  if (chunks <= 1)
+  {
+    _callback(_context, 0, _count);
+    return;
+  }
+
+  Job *job = this->AcquireJob();
+  job->next = 0;
+  job->remaining = chunks;
+  job->users = chunks;
+  job->chunks = chunks;
+  job->chunkSize = (_count + chunks - 1) / chunks;
+  job->count = _count;
+  job->callback = _callback;
+  job->context = _context;
+
+  // A single pointer capture fits in the std::function itself
+  for (size_t i = 1; i < chunks; ++i)
+  {
+    this->Push([job]()
+        {
+          job->Work();
+          job->pool->ReleaseJob(job);
+        });
+  }
+  this->condition.notify_all();
+
+  job->Work();
+
+  {
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->doneCondition.wait(lock, [job]() { return job->remaining == 0; });
+  }
+
+  // Tasks that found no chunk left may still hold the job
+  this->ReleaseJob(job);
+}
+
+//////////////////////////////////////////////////
+NpsBeamWorkerPool::Job *NpsBeamWorkerPool::AcquireJob()
+{
+  std::lock_guard<std::mutex> lock(this->jobMutex);
+  if (!this->freeJobs.empty())
+  {
+    Job *job = this->freeJobs.back();
+    this->freeJobs.pop_back();
+    return job;
+  }
+
+  this->jobs.push_back(std::unique_ptr<Job>(new Job));
+  this->jobs.back()->pool = this;
+  this->freeJobs.reserve(this->jobs.size());
+  return this->jobs.back().get();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamWorkerPool::ReleaseJob(Job *_job)
+{
+  if (_job->users.fetch_sub(1) != 1)
+    return;
+
+  std::lock_guard<std::mutex> lock(this->jobMutex);
+  this->freeJobs.push_back(_job);
+}
+
+//////////////////////////////////////////////////
+void NpsBeamWorkerPool::Post(const Task &_task)
+{
+  if (this->threads.empty())
+  {
+    _task();
+    return;
+  }
+
+  this->Push(_task);
+  this->condition.notify_one();
+}
+
+//////////////////////////////////////////////////
+void NpsBeamWorkerPool::Push(const Task &_task)
+{
+  // Workers keep their own tasks local; other threads deal round robin
+  const unsigned int index = currentPool == this ? currentWorker :
+    this->nextQueue.fetch_add(1) % this->queues.size();
+
+  // Count first, under the sleep mutex, so pending never drops below the
+  // number of queued tasks and a worker cannot miss the wake up between
+  // checking pending and waiting
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    ++this->pending;
+  }
+
+  std::lock_guard<std::mutex> lock(this->queues[index]->mutex);
+  this->queues[index]->PushBack(_task);
+}
+
+//////////////////////////////////////////////////
+bool NpsBeamWorkerPool::Pop(const unsigned int _worker, Task &_task)
+{
+  {
+    Queue &own = *this->queues[_worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.count > 0)
+    {
+      own.PopBack(_task);
+      --this->pending;
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < this->queues.size(); ++i)
+  {
+    Queue &victim = *this->queues[(_worker + i) % this->queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (victim.count > 0)
+    {
+      victim.PopFront(_task);
+      --this->pending;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamWorkerPool::Queue::PushBack(const Task &_task)
+{
+  if (this->count == this->tasks.size())
+  {
+    // Unroll the ring into a larger one, oldest task first
+    std::vector<Task> grown(std::max<size_t>(kQueueCapacity,
+          2 * this->tasks.size()));
+    for (size_t i = 0; i < this->count; ++i)
+    {
+      grown[i] = std::move(
+          this->tasks[(this->head + i) % this->tasks.size()]);
+    }
+    this->tasks.swap(grown);
+    this->head = 0;
+  }
+
+  this->tasks[(this->head + this->count) % this->tasks.size()] = _task;
+  ++this->count;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamWorkerPool::Queue::PopBack(Task &_task)
+{
+  --this->count;
+  Task &slot = this->tasks[(this->head + this->count) % this->tasks.size()];
+  _task = std::move(slot);
+  slot = nullptr;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamWorkerPool::Queue::PopFront(Task &_task)
+{
+  Task &slot = this->tasks[this->head];
+  _task = std::move(slot);
+  slot = nullptr;
+  this->head = (this->head + 1) % this->tasks.size();
+  --this->count;
+}
+
+//////////////////////////////////////////////////
+void NpsBeamWorkerPool::Run(const unsigned int _worker)
+{
+  currentPool = this;
+  currentWorker = _worker;
+
+  Task task;
+  while (true)
+  {
+    if (this->Pop(_worker, task))
+    {
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->condition.wait(lock,
+        [this]() { return this->stop || this->pending > 0; });
+
+    if (this->stop && this->pending == 0)
+      return;
+  }
+}
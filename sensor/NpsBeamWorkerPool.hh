@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2012 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#ifndef NPS_BEAM_WORKER_POOL_HH
+#define NPS_BEAM_WORKER_POOL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gazebo
+{
+  namespace sensors
+  {
+    /// \brief Small fixed-size work stealing thread pool for per-frame
+    /// data parallel work and the post-processing of many sensors.
+    ///
+    /// Every worker has its own task queue. Tasks posted from a worker go
+    /// to its own queue and run newest first; other tasks are spread over
+    /// the queues in turn. An idle worker steals the oldest task of
+    /// another queue, so one sensor's long frame does not hold up the
+    /// frames queued behind it.
+    ///
+    /// ParallelFor may be called from several sensor threads, and from
+    /// tasks, at once; the calling thread always takes part in its own
+    /// loop, so a loop makes progress even when every worker is busy.
+    ///
+    /// Once warmed up the pool does not touch the heap: loop bodies are
+    /// called through a plain function pointer instead of a
+    /// std::function, loop state is recycled, and task queues are rings
+    /// that only grow.
+    class NpsBeamWorkerPool
+    {
+      /// \brief Loop body, called with a half open index range.
+      public: typedef std::function<void(size_t, size_t)> RangeFunction;
+
+      /// \brief Task run by Post.
+      public: typedef std::function<void()> Task;
+
+      /// \brief Type erased loop body.
+      /// \param[in] _context Loop body object.
+      /// \param[in] _begin First index of the range.
+      /// \param[in] _end One past the last index of the range.
+      public: typedef void (*RangeCallback)(const void *_context,
+                  size_t _begin, size_t _end);
+
+      /// \brief Constructor
+      /// \param[in] _threads Number of worker threads, 0 to use one less
+      /// than the number of hardware threads.
+      public: explicit NpsBeamWorkerPool(const unsigned int _threads = 0);
+
+      /// \brief Destructor, joins the workers.
+      public: ~NpsBeamWorkerPool();
+
+      /// \brief Get the process wide pool shared by all beam sensors.
+      /// \return Shared pool.
+      public: static NpsBeamWorkerPool &Instance();
+
+      /// \brief Run _func over [0, _count) split into chunks of at least
+      /// _grain indices, and wait for all chunks to finish.
+      /// \param[in] _count Number of indices.
+      /// \param[in] _grain Minimum chunk size.
+      /// \param[in] _func Loop body, any callable taking a begin and end
+      /// index, such as a lambda or a RangeFunction.
+      public: template <typename Func>
+              void ParallelFor(const size_t _count, const size_t _grain,
+                               const Func &_func)
+              {
+                this->ParallelFor(_count, _grain,
+                    &NpsBeamWorkerPool::Invoke<Func>, &_func);
+              }
+
+      /// \brief Run _callback over [0, _count) split into chunks of at
+      /// least _grain indices, and wait for all chunks to finish.
+      /// \param[in] _count Number of indices.
+      /// \param[in] _grain Minimum chunk size.
+      /// \param[in] _callback Loop body.
+      /// \param[in] _context First argument of every _callback call.
+      public: void ParallelFor(const size_t _count, const size_t _grain,
+                               const RangeCallback _callback,
+                               const void *_context);
+
+      /// \brief Run a task on a worker without waiting for it. Without
+      /// workers the task runs before Post returns.
+      /// \param[in] _task Task to run.
+      public: void Post(const Task &_task);
+
+      /// \brief Number of worker threads, not counting callers.
+      /// \return Worker count.
+      public: unsigned int ThreadCount() const;
+
+      /// \brief Call a loop body of type Func.
+      /// \param[in] _context Loop body.
+      /// \param[in] _begin First index of the range.
+      /// \param[in] _end One past the last index of the range.
+      private: template <typename Func>
+               static void Invoke(const void *_context, const size_t _begin,
+                                  const size_t _end)
+               {
+                 (*static_cast<const Func *>(_context))(_begin, _end);
+               }
+
+      /// \brief Shared state of one ParallelFor call.
+      private: struct Job;
+
+      /// \brief Task queue of one worker.
+      private: struct Queue
+      {
+        /// \brief Append a task, growing the ring when it is full.
+        /// \param[in] _task Task to append.
+        void PushBack(const Task &_task);
+
+        /// \brief Take the newest task.
+        /// \param[out] _task Task taken.
+        void PopBack(Task &_task);
+
+        /// \brief Take the oldest task.
+        /// \param[out] _task Task taken.
+        void PopFront(Task &_task);
+
+        /// \brief Protects the ring.
+        std::mutex mutex;
+
+        /// \brief Ring of queued tasks; the owner takes from the back,
+        /// thieves from the front.
+        std::vector<Task> tasks;
+
+        /// \brief Index of the oldest task in tasks.
+        size_t head = 0;
+
+        /// \brief Number of queued tasks.
+        size_t count = 0;
+      };
+
+      /// \brief Take a loop state from the free list, or make one.
+      /// \return Loop state owned by jobs.
+      private: Job *AcquireJob();
+
+      /// \brief Drop one user of a loop state, and put it back on the
+      /// free list once the last user is done.
+      /// \param[in] _job Loop state from AcquireJob.
+      private: void ReleaseJob(Job *_job);
+
+      /// \brief Queue a task without waking a worker.
+      /// \param[in] _task Task to queue.
+      private: void Push(const Task &_task);
+
+      /// \brief Take a task, from the worker's own queue first.
+      /// \param[in] _worker Index of the calling worker.
+      /// \param[out] _task Task taken.
+      /// \return False if every queue was empty.
+      private: bool Pop(const unsigned int _worker, Task &_task);
+
+      /// \brief Worker thread main loop.
+      /// \param[in] _worker Index of the worker.
+      private: void Run(const unsigned int _worker);
+
+      /// \brief Every loop state made so far.
+      private: std::vector<std::unique_ptr<Job>> jobs;
+
+      /// \brief Loop states not in use, with room for all of jobs.
+      private: std::vector<Job *> freeJobs;
+
+      /// \brief Protects jobs and freeJobs.
+      private: std::mutex jobMutex;
+
+      /// \brief Worker threads.
+      private: std::vector<std::thread> threads;
+
+      /// \brief One task queue per worker.
+      private: std::vector<std::unique_ptr<Queue>> queues;
+
+      /// \brief Number of queued tasks.
+      private: std::atomic<size_t> pending;
+
+      /// \brief Queue the next task from outside the pool goes to.
+      private: std::atomic<unsigned int> nextQueue;
+
+      /// \brief Protects sleeping and stop.
+      private: std::mutex mutex;
+
+      /// \brief Signals new tasks or shutdown.
+      private: std::condition_variable condition;
+
+      /// \brief True when the workers should exit.
+      private: bool stop = false;
+    };
+  }
+}
+#endif